@@ -37,6 +37,7 @@
 #include <io.h>
 #else
 #include <unistd.h>
+#include <pthread.h>
 #endif
 #include <fcntl.h>
 #include "acvp.h"
@@ -117,6 +118,8 @@ static int app_ecdsa_handler(ACVP_TEST_CASE *test_case);
 #endif
 
 #define JSON_FILENAME_LENGTH 24
+#define OFFLINE_DIR_LENGTH 256
+#define HTTP_STATS_FILE_LENGTH 256
 #define DEFAULT_SERVER "127.0.0.1"
 #define DEFAULT_PORT 443
 #define DEFAULT_CA_CHAIN "certs/acvp-private-root-ca.crt.pem"
@@ -134,6 +137,13 @@ typedef struct app_config {
     int dev;
     int json;
     char json_file[JSON_FILENAME_LENGTH];
+    int offline;
+    char offline_dir[OFFLINE_DIR_LENGTH];
+    int loopback;
+    char loopback_dir[OFFLINE_DIR_LENGTH];
+    int workers;
+    int group_workers;
+    char http_stats_file[HTTP_STATS_FILE_LENGTH];
 
     /*
      * Algorithm Flags
@@ -162,27 +172,109 @@ char *path_segment;
 char *api_context;
 char value[] = "same";
 
-static EVP_CIPHER_CTX *glb_cipher_ctx = NULL; /* need to maintain across calls for MCT */
+/*
+ * With --workers the handlers are called from several threads at once,
+ * each working on its own vector set.  The state kept across calls is
+ * therefore per thread.
+ */
+#ifdef WIN32
+#define APP_THREAD_LOCAL __declspec(thread)
+#else
+#define APP_THREAD_LOCAL __thread
+#endif
+
+static APP_THREAD_LOCAL EVP_CIPHER_CTX *glb_cipher_ctx = NULL; /* need to maintain across calls for MCT */
 
 /* RSA group values */
-int rsa_current_tg = 0;
-BIGNUM *group_n = NULL;
-RSA *group_rsa = NULL;
+APP_THREAD_LOCAL int rsa_current_tg = 0;
+APP_THREAD_LOCAL BIGNUM *group_n = NULL;
+APP_THREAD_LOCAL RSA *group_rsa = NULL;
 
 /* ECDSA group values */
-int ecdsa_current_tg = 0;
-BIGNUM *ecdsa_group_Qx = NULL;
-BIGNUM *ecdsa_group_Qy = NULL;
-EC_KEY *ecdsa_group_key = NULL;
+APP_THREAD_LOCAL int ecdsa_current_tg = 0;
+APP_THREAD_LOCAL BIGNUM *ecdsa_group_Qx = NULL;
+APP_THREAD_LOCAL BIGNUM *ecdsa_group_Qy = NULL;
+APP_THREAD_LOCAL EC_KEY *ecdsa_group_key = NULL;
 
 /* DSA group values */
-DSA *group_dsa = NULL;
-int dsa_current_keygen_tg = 0;
-int dsa_current_siggen_tg = 0;
-BIGNUM *group_p = NULL;
-BIGNUM *group_q = NULL;
-BIGNUM *group_g = NULL;
-BIGNUM *group_pub_key = NULL;
+APP_THREAD_LOCAL DSA *group_dsa = NULL;
+APP_THREAD_LOCAL int dsa_current_keygen_tg = 0;
+APP_THREAD_LOCAL int dsa_current_siggen_tg = 0;
+APP_THREAD_LOCAL BIGNUM *group_p = NULL;
+APP_THREAD_LOCAL BIGNUM *group_q = NULL;
+APP_THREAD_LOCAL BIGNUM *group_g = NULL;
+APP_THREAD_LOCAL BIGNUM *group_pub_key = NULL;
+
+/*
+ * Free the state kept by the calling thread.  The main thread does so
+ * before it returns, the threads libacvp starts when they exit.
+ */
+static void app_thread_state_free(void *unused) {
+    if (glb_cipher_ctx) EVP_CIPHER_CTX_free(glb_cipher_ctx);
+    glb_cipher_ctx = NULL;
+    /* free RSA group vals */
+    if (group_rsa) RSA_free(group_rsa);
+    if (group_n) BN_free(group_n);
+    group_rsa = NULL;
+    group_n = NULL;
+    rsa_current_tg = 0;
+    /* free DSA group vals */
+    if (group_dsa) DSA_free(group_dsa);
+    if (group_p) BN_free(group_p);
+    if (group_q) BN_free(group_q);
+    if (group_g) BN_free(group_g);
+    if (group_pub_key) BN_free(group_pub_key);
+    group_dsa = NULL;
+    group_p = NULL;
+    group_q = NULL;
+    group_g = NULL;
+    group_pub_key = NULL;
+    dsa_current_keygen_tg = 0;
+    dsa_current_siggen_tg = 0;
+    /* free ECDSA group vals */
+    if (ecdsa_group_Qx) BN_free(ecdsa_group_Qx);
+    if (ecdsa_group_Qy) BN_free(ecdsa_group_Qy);
+    if (ecdsa_group_key) EC_KEY_free(ecdsa_group_key);
+    ecdsa_group_Qx = NULL;
+    ecdsa_group_Qy = NULL;
+    ecdsa_group_key = NULL;
+    ecdsa_current_tg = 0;
+}
+
+#ifndef WIN32
+static pthread_key_t app_thread_key;
+static pthread_once_t app_thread_key_once = PTHREAD_ONCE_INIT;
+
+static void app_thread_key_create(void) {
+    pthread_key_create(&app_thread_key, app_thread_state_free);
+}
+#endif
+
+/*
+ * Called before the calling thread keeps state across calls, so that
+ * app_thread_state_free() runs when the thread exits.  The worker
+ * threads libacvp starts would leak the state otherwise.
+ */
+static void app_thread_state_track(void) {
+#ifndef WIN32
+    pthread_once(&app_thread_key_once, app_thread_key_create);
+    if (!pthread_getspecific(app_thread_key)) {
+        pthread_setspecific(app_thread_key, (void *)1);
+    }
+#endif
+}
+
+/*
+ * The cipher context of the calling thread, worker threads get
+ * theirs the first time they need one.
+ */
+static EVP_CIPHER_CTX *app_cipher_ctx(void) {
+    if (glb_cipher_ctx == NULL) {
+        app_thread_state_track();
+        glb_cipher_ctx = EVP_CIPHER_CTX_new();
+    }
+    return glb_cipher_ctx;
+}
 
 #define CHECK_ENABLE_CAP_RV(rv) \
     if (rv != ACVP_SUCCESS) { \
@@ -301,6 +393,25 @@ static void print_usage(int err) {
     printf("If you want to include \"debugRequest\" in your registration, use:\n");
     printf("      --dev\n");
     printf("\n");
+    printf("To process the vector sets saved as *.json files in a directory, without\n");
+    printf("an ACVP server, and write the responses to *.rsp.json files, use:\n");
+    printf("      --offline <dir>\n");
+    printf("\n");
+    printf("To run a whole test session against the vector sets saved as *.json files\n");
+    printf("in a directory, served from within acvp_app instead of by an ACVP server,\n");
+    printf("use:\n");
+    printf("      --loopback <dir>\n");
+    printf("\n");
+    printf("To process several vector sets at once, use:\n");
+    printf("      --workers <count>\n");
+    printf("\n");
+    printf("To process several test groups of a vector set at once, use:\n");
+    printf("      --group_workers <count>\n");
+    printf("\n");
+    printf("To have the timing of each request sent to the ACVP server written\n");
+    printf("to a JSON file at the end of the session, use:\n");
+    printf("      --http_stats <file>\n");
+    printf("\n");
     printf("In addition some options are passed to acvp_app using\n");
     printf("environment variables.  The following variables can be set:\n\n");
     printf("    ACV_SERVER (when not set, defaults to %s)\n", DEFAULT_SERVER);
@@ -514,6 +625,115 @@ static int ingest_cli(APP_CONFIG *cfg, int argc, char **argv) {
             strcpy_s(cfg->json_file, JSON_FILENAME_LENGTH, *argv);
         }
 
+        strcmp_s("--offline", strnlen_s("--offline", OPTION_STR_MAX), *argv, &diff);
+        if (!diff) {
+            cfg->offline = 1;
+            argc--;
+            argv++;
+
+            if (*argv == NULL) {
+                printf(ANSI_COLOR_RED "Command error... [%s]"ANSI_COLOR_RESET
+                       "\nMissing <dir>.\n", "--offline");
+                print_usage(1);
+                return 1;
+            }
+
+            if (strnlen_s(*argv, OFFLINE_DIR_LENGTH + 1) > OFFLINE_DIR_LENGTH) {
+                printf(ANSI_COLOR_RED "Command error... [%s]"ANSI_COLOR_RESET
+                       "\nThe <dir> \"%s\", has a name that is too long."
+                       "\nMax allowed <dir> name length is (%d).\n",
+                       "--offline", *argv, OFFLINE_DIR_LENGTH);
+                print_usage(1);
+                return 1;
+            }
+
+            strcpy_s(cfg->offline_dir, OFFLINE_DIR_LENGTH, *argv);
+            goto next;
+        }
+
+        strcmp_s("--loopback", strnlen_s("--loopback", OPTION_STR_MAX), *argv, &diff);
+        if (!diff) {
+            cfg->loopback = 1;
+            argc--;
+            argv++;
+
+            if (*argv == NULL) {
+                printf(ANSI_COLOR_RED "Command error... [%s]"ANSI_COLOR_RESET
+                       "\nMissing <dir>.\n", "--loopback");
+                print_usage(1);
+                return 1;
+            }
+
+            if (strnlen_s(*argv, OFFLINE_DIR_LENGTH + 1) > OFFLINE_DIR_LENGTH) {
+                printf(ANSI_COLOR_RED "Command error... [%s]"ANSI_COLOR_RESET
+                       "\nThe <dir> \"%s\", has a name that is too long."
+                       "\nMax allowed <dir> name length is (%d).\n",
+                       "--loopback", *argv, OFFLINE_DIR_LENGTH);
+                print_usage(1);
+                return 1;
+            }
+
+            strcpy_s(cfg->loopback_dir, OFFLINE_DIR_LENGTH, *argv);
+            goto next;
+        }
+
+        strcmp_s("--workers", strnlen_s("--workers", OPTION_STR_MAX), *argv, &diff);
+        if (!diff) {
+            argc--;
+            argv++;
+
+            if (*argv == NULL || atoi(*argv) < 1) {
+                printf(ANSI_COLOR_RED "Command error... [%s]"ANSI_COLOR_RESET
+                       "\nMissing or invalid <count>.\n", "--workers");
+                print_usage(1);
+                return 1;
+            }
+
+            cfg->workers = atoi(*argv);
+            goto next;
+        }
+
+        strcmp_s("--group_workers", strnlen_s("--group_workers", OPTION_STR_MAX), *argv, &diff);
+        if (!diff) {
+            argc--;
+            argv++;
+
+            if (*argv == NULL || atoi(*argv) < 1) {
+                printf(ANSI_COLOR_RED "Command error... [%s]"ANSI_COLOR_RESET
+                       "\nMissing or invalid <count>.\n", "--group_workers");
+                print_usage(1);
+                return 1;
+            }
+
+            cfg->group_workers = atoi(*argv);
+            goto next;
+        }
+
+        strcmp_s("--http_stats", strnlen_s("--http_stats", OPTION_STR_MAX), *argv, &diff);
+        if (!diff) {
+            argc--;
+            argv++;
+
+            if (*argv == NULL) {
+                printf(ANSI_COLOR_RED "Command error... [%s]"ANSI_COLOR_RESET
+                       "\nMissing <file>.\n", "--http_stats");
+                print_usage(1);
+                return 1;
+            }
+
+            if (strnlen_s(*argv, HTTP_STATS_FILE_LENGTH + 1) > HTTP_STATS_FILE_LENGTH - 1) {
+                printf(ANSI_COLOR_RED "Command error... [%s]"ANSI_COLOR_RESET
+                       "\nThe <file> \"%s\", has a name that is too long."
+                       "\nMax allowed <file> name length is (%d).\n",
+                       "--http_stats", *argv, HTTP_STATS_FILE_LENGTH - 1);
+                print_usage(1);
+                return 1;
+            }
+
+            strcpy_s(cfg->http_stats_file, HTTP_STATS_FILE_LENGTH, *argv);
+            goto next;
+        }
+
         strcmp_s("--sample", strnlen_s("--sample", OPTION_STR_MAX), *argv, &diff);
         if (!diff) {
             cfg->sample = 1;
@@ -791,6 +1011,64 @@ next:
     return 0;
 }
 
+/*
+ * Enable the algorithm test suites selected on the command line.
+ */
+static int enable_algs(ACVP_CTX *ctx, APP_CONFIG *cfg) {
+    if (cfg->aes) {
+        if (enable_aes(ctx)) return 1;
+    }
+
+    if (cfg->tdes) {
+        if (enable_tdes(ctx)) return 1;
+    }
+
+    if (cfg->hash) {
+        if (enable_hash(ctx)) return 1;
+    }
+
+    if (cfg->cmac) {
+        if (enable_cmac(ctx)) return 1;
+    }
+
+    if (cfg->hmac) {
+        if (enable_hmac(ctx)) return 1;
+    }
+
+#ifdef OPENSSL_KDF_SUPPORT
+    if (cfg->kdf) {
+        if (enable_kdf(ctx)) return 1;
+    }
+#endif
+
+#ifdef ACVP_NO_RUNTIME
+    if (cfg->dsa) {
+        if (enable_dsa(ctx)) return 1;
+    }
+
+    if (cfg->rsa) {
+        if (enable_rsa(ctx)) return 1;
+    }
+
+    if (cfg->ecdsa) {
+        if (enable_ecdsa(ctx)) return 1;
+    }
+
+    if (cfg->drbg) {
+        if (enable_drbg(ctx)) return 1;
+    }
+
+    if (cfg->kas_ecc) {
+        if (enable_kas_ecc(ctx)) return 1;
+    }
+    if (cfg->kas_ffc) {
+        if (enable_kas_ffc(ctx)) return 1;
+    }
+#endif
+
+    return 0;
+}
+
 int main(int argc, char **argv) {
     ACVP_RESULT rv = ACVP_SUCCESS;
     ACVP_CTX *ctx = NULL;
@@ -836,6 +1114,49 @@ int main(int argc, char **argv) {
         }
     }
 
+    if (cfg.workers) {
+        rv = acvp_set_worker_count(ctx, cfg.workers);
+        if (rv != ACVP_SUCCESS) {
+            printf("Failed to set worker count: %s\n", acvp_lookup_error_string(rv));
+            goto end;
+        }
+    }
+
+    if (cfg.group_workers) {
+        rv = acvp_set_group_workers(ctx, cfg.group_workers);
+        if (rv != ACVP_SUCCESS) {
+            printf("Failed to set test group worker count: %s\n", acvp_lookup_error_string(rv));
+            goto end;
+        }
+    }
+
+    if (cfg.http_stats_file[0]) {
+        rv = acvp_set_http_stats_report(ctx, cfg.http_stats_file);
+        if (rv != ACVP_SUCCESS) {
+            printf("Failed to set HTTP stats report: %s\n", acvp_lookup_error_string(rv));
+            goto end;
+        }
+    }
+
+    if (cfg.offline) {
+        /*
+         * Offline there is no server to set up or register with, the
+         * vector sets are read from files and run against the enabled
+         * capabilities.
+         */
+        if (cfg.json) {
+            printf("The --json and --offline options can't be used together\n");
+            goto end;
+        }
+        if (enable_algs(ctx, &cfg)) goto end;
+
+        rv = acvp_process_vector_files(ctx, cfg.offline_dir, NULL);
+        if (rv != ACVP_SUCCESS) {
+            printf("Failed to process vector set files (%d)\n", rv);
+        }
+        goto end;
+    }
+
     /*
      * Next we specify the ACVP server address
      */
@@ -920,14 +1241,26 @@ int main(int argc, char **argv) {
         goto end;
     }
 
-    /*
-     * Specify the callback to be used for 2-FA to perform
-     * TOTP calculation
-     */
-    rv = acvp_set_2fa_callback(ctx, &totp);
-    if (rv != ACVP_SUCCESS) {
-        printf("Failed to set Two-factor authentication callback\n");
-        goto end;
+    if (cfg.loopback) {
+        /*
+         * The test session is served from the vector set files instead
+         * of by the ACVP server, and there is no need to log in.
+         */
+        rv = acvp_set_loopback_transport(ctx, cfg.loopback_dir, NULL);
+        if (rv != ACVP_SUCCESS) {
+            printf("Failed to set up the loopback transport (%d)\n", rv);
+            goto end;
+        }
+    } else {
+        /*
+         * Specify the callback to be used for 2-FA to perform
+         * TOTP calculation
+         */
+        rv = acvp_set_2fa_callback(ctx, &totp);
+        if (rv != ACVP_SUCCESS) {
+            printf("Failed to set Two-factor authentication callback\n");
+            goto end;
+        }
     }
 
     if (cfg.sample) {
@@ -950,56 +1283,7 @@ int main(int argc, char **argv) {
          * We need to register all the crypto module capabilities that will be
          * validated. Each has their own method for readability.
          */
-        if (cfg.aes) {
-            if (enable_aes(ctx)) goto end;
-        }
-
-        if (cfg.tdes) {
-            if (enable_tdes(ctx)) goto end;
-        }
-
-        if (cfg.hash) {
-            if (enable_hash(ctx)) goto end;
-        }
-
-        if (cfg.cmac) {
-            if (enable_cmac(ctx)) goto end;
-        }
-
-        if (cfg.hmac) {
-            if (enable_hmac(ctx)) goto end;
-        }
-
-#ifdef OPENSSL_KDF_SUPPORT
-        if (cfg.kdf) {
-            if (enable_kdf(ctx)) goto end;
-        }
-#endif
-
-#ifdef ACVP_NO_RUNTIME
-        if (cfg.dsa) {
-            if (enable_dsa(ctx)) goto end;
-        }
-
-        if (cfg.rsa) {
-            if (enable_rsa(ctx)) goto end;
-        }
-
-        if (cfg.ecdsa) {
-            if (enable_ecdsa(ctx)) goto end;
-        }
-
-        if (cfg.drbg) {
-            if (enable_drbg(ctx)) goto end;
-        }
-
-        if (cfg.kas_ecc) {
-            if (enable_kas_ecc(ctx)) goto end;
-        }
-        if (cfg.kas_ffc) {
-            if (enable_kas_ffc(ctx)) goto end;
-        }
-#endif
+        if (enable_algs(ctx, &cfg)) goto end;
     }
     /*
      * Now that we have a test session, we register with
@@ -1030,20 +1314,7 @@ int main(int argc, char **argv) {
     }
 
 end:
-    if (glb_cipher_ctx) EVP_CIPHER_CTX_free(glb_cipher_ctx);
-    /* free RSA group vals */
-    if (group_rsa) RSA_free(group_rsa);
-    if (group_n) BN_free(group_n);
-    /* free DSA group vals */
-    if (group_dsa) DSA_free(group_dsa);
-    if (group_p) BN_free(group_p);
-    if (group_q) BN_free(group_q);
-    if (group_g) BN_free(group_g);
-    if (group_pub_key) BN_free(group_pub_key);
-    /* free ECDSA group vals */
-    if (ecdsa_group_Qx) BN_free(ecdsa_group_Qx);
-    if (ecdsa_group_Qy) BN_free(ecdsa_group_Qy);
-    if (ecdsa_group_key) EC_KEY_free(ecdsa_group_key);
+    app_thread_state_free(NULL);
     /* Free all memory associated with libacvp */
     rv = acvp_cleanup(ctx);
 
@@ -2855,7 +3126,11 @@ static int app_des_handler(ACVP_TEST_CASE *test_case) {
     }
 
     /* Begin encrypt code section */
-    cipher_ctx = glb_cipher_ctx;
+    cipher_ctx = app_cipher_ctx();
+    if (!cipher_ctx) {
+        printf("Failed to allocate cipher_ctx\n");
+        return 1;
+    }
 
     switch (tc->cipher) {
     case ACVP_TDES_ECB:
@@ -2994,7 +3269,11 @@ static int app_aes_handler(ACVP_TEST_CASE *test_case) {
     tc = test_case->tc.symmetric;
 
     /* Begin encrypt code section */
-    cipher_ctx = glb_cipher_ctx;
+    cipher_ctx = app_cipher_ctx();
+    if (!cipher_ctx) {
+        printf("Failed to allocate cipher_ctx\n");
+        return rv;
+    }
     if ((tc->test_type != ACVP_SYM_TEST_TYPE_MCT)) {
         EVP_CIPHER_CTX_init(cipher_ctx);
     }
@@ -4024,6 +4303,7 @@ static int app_dsa_handler(ACVP_TEST_CASE *test_case) {
     case ACVP_DSA_MODE_KEYGEN:
         if (dsa_current_keygen_tg != tc->tg_id) {
             dsa_current_keygen_tg = tc->tg_id;
+            app_thread_state_track();
 
             if (group_dsa) FIPS_dsa_free(group_dsa);
             if (group_p) BN_free(group_p);
@@ -4301,6 +4581,7 @@ static int app_dsa_handler(ACVP_TEST_CASE *test_case) {
 
         if (dsa_current_siggen_tg != tc->tg_id) {
             dsa_current_siggen_tg = tc->tg_id;
+            app_thread_state_track();
 
             if (group_dsa) FIPS_dsa_free(group_dsa);
             if (group_p) BN_free(group_p);
@@ -5094,6 +5375,7 @@ static int app_ecdsa_handler(ACVP_TEST_CASE *test_case) {
     case ACVP_ECDSA_SIGGEN:
         if (ecdsa_current_tg != tc->tg_id) {
             ecdsa_current_tg = tc->tg_id;
+            app_thread_state_track();
             if (ecdsa_group_key) EC_KEY_free(ecdsa_group_key);
 
             ecdsa_group_Qx = FIPS_bn_new();
@@ -5329,6 +5611,7 @@ static int app_rsa_sig_handler(ACVP_TEST_CASE *test_case) {
     } else {
         if (rsa_current_tg != tc->tg_id) {
             rsa_current_tg = tc->tg_id;
+            app_thread_state_track();
             if (group_rsa) RSA_free(group_rsa);
             group_rsa = RSA_new();
             if (!FIPS_rsa_x931_generate_key_ex(group_rsa, tc->modulo, bn_e, NULL)) {
@@ -44,8 +44,14 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
 #include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <netdb.h>
 #include <arpa/inet.h>
 #include <openssl/err.h>
@@ -58,9 +64,79 @@
 #include "murl.h"
 #include "murl_lcl.h"
 
-static unsigned int initialized = 0;
 #define DEBUGF(x) do { } while (0)
 
+/*
+ * The SSL_CTXs are shared by the handles of all the threads, so the
+ * cache and the TLS sessions kept in it are guarded by ssl_ctx_lock.
+ */
+static MURL_SSL_CTX *ssl_ctx_cache = NULL;
+static pthread_mutex_t ssl_ctx_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void murl_reset_tls(SessionHandle *ctx);
+
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+/*
+ * OpenSSL 1.0.x must be given locks to be used by several threads.
+ * Later versions take care of it themselves.
+ */
+static pthread_mutex_t *ossl_locks = NULL;
+
+static void murl_ossl_locking_cb(int mode, int n, const char *file, int line)
+{
+    if (mode & CRYPTO_LOCK) {
+        pthread_mutex_lock(&ossl_locks[n]);
+    } else {
+        pthread_mutex_unlock(&ossl_locks[n]);
+    }
+}
+
+static void murl_ossl_threadid_cb(CRYPTO_THREADID *id)
+{
+    CRYPTO_THREADID_set_numeric(id, (unsigned long)pthread_self());
+}
+
+/*
+ * Give OpenSSL its locks, unless the application already did.
+ *
+ * Returns 1 on success, 0 on error
+ */
+static int murl_ossl_init_locks(void)
+{
+    int i;
+
+    if (CRYPTO_get_locking_callback()) {
+        return 1;
+    }
+    ossl_locks = calloc(CRYPTO_num_locks(), sizeof(pthread_mutex_t));
+    if (!ossl_locks) {
+        return 0;
+    }
+    for (i = 0; i < CRYPTO_num_locks(); i++) {
+        pthread_mutex_init(&ossl_locks[i], NULL);
+    }
+    CRYPTO_THREADID_set_callback(murl_ossl_threadid_cb);
+    CRYPTO_set_locking_callback(murl_ossl_locking_cb);
+    return 1;
+}
+
+static void murl_ossl_free_locks(void)
+{
+    int i;
+
+    if (!ossl_locks) {
+        return;
+    }
+    CRYPTO_set_locking_callback(NULL);
+    CRYPTO_THREADID_set_callback(NULL);
+    for (i = 0; i < CRYPTO_num_locks(); i++) {
+        pthread_mutex_destroy(&ossl_locks[i]);
+    }
+    free(ossl_locks);
+    ossl_locks = NULL;
+}
+#endif
+
 /**
  * Global SSL init
  *
@@ -69,6 +145,11 @@ static unsigned int initialized = 0;
  */
 static int Curl_ossl_init(void)
 {
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+    if (!murl_ossl_init_locks())
+        return 0;
+#endif
+
     ENGINE_load_builtin_engines();
 
     /* Lets get nice error messages */
@@ -83,21 +164,26 @@ static int Curl_ossl_init(void)
     return 1;
 }
 
-/**
- * curl_global_init() globally initializes cURL given a bitwise set of the
- * different features of what to initialize.
- */
-static CURLcode curl_global_init()
-{
-    if (initialized++)
-        return CURLE_OK;
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+static CURLcode init_result = CURLE_OK;
 
+static void curl_global_init_once(void)
+{
     if (!Curl_ossl_init()) {
         DEBUGF(fprintf(stderr, "Error: Curl_ssl_init failed\n"));
-        return CURLE_FAILED_INIT;
+        init_result = CURLE_FAILED_INIT;
     }
+}
 
-    return CURLE_OK;
+/**
+ * curl_global_init() globally initializes cURL given a bitwise set of the
+ * different features of what to initialize.  Only the first call does
+ * the work, even when several threads get here at the same time.
+ */
+static CURLcode curl_global_init()
+{
+    pthread_once(&init_once, curl_global_init_once);
+    return init_result;
 }
 
 /*
@@ -110,13 +196,11 @@ CURL *curl_easy_init(void)
     SessionHandle *data;
 
     /* Make sure we inited the global SSL stuff */
-    if (!initialized) {
-        result = curl_global_init();
-        if (result) {
-            /* something in the global init failed, return nothing */
-            DEBUGF(fprintf(stderr, "Error: curl_global_init failed\n"));
-            return NULL;
-        }
+    result = curl_global_init();
+    if (result) {
+        /* something in the global init failed, return nothing */
+        DEBUGF(fprintf(stderr, "Error: curl_global_init failed\n"));
+        return NULL;
     }
 
     /* We use curl_open() with undefined URL so far */
@@ -127,6 +211,7 @@ CURL *curl_easy_init(void)
     }
     data->server_port = 443; /* default to HTTPS port */
     data->ssl_verify_hostname = 1; /* default to verify server hostname */
+    data->sock = -1;
 
     return data;
 }
@@ -137,6 +222,7 @@ static CURLcode setstropt(char **charp, char *s)
        copy of `s'. Return CURLE_OK or CURLE_OUT_OF_MEMORY. */
 
     if (*charp) free(*charp);
+    *charp = NULL;
 
     if (s) {
         s = strdup(s);
@@ -156,6 +242,7 @@ CURLcode Curl_setopt(CURL *ctx, CURLoption option, va_list param)
     CURLcode result = CURLE_OK;
     SessionHandle *data = (SessionHandle*)ctx;
 
+    /* Changing a TLS setting drops the connection and SSL_CTX using the old one */
     switch (option) {
     case CURLOPT_USERAGENT:
         /*
@@ -175,9 +262,28 @@ CURLcode Curl_setopt(CURL *ctx, CURLoption option, va_list param)
          */
         data->headers = va_arg(param, struct curl_slist *);
         break;
+    case CURLOPT_ACCEPT_ENCODING:
+        /*
+         * String to use in the HTTP Accept-Encoding field
+         */
+        result = setstropt(&data->accept_encoding, va_arg(param, char *));
+        break;
     case CURLOPT_POSTFIELDS:
+        /*
+         * As with curl, the data is not copied and must be kept around
+         * until the transfer is done.  It may be binary when the size
+         * is set with CURLOPT_POSTFIELDSIZE_LARGE.
+         */
         data->http_post = 1;
-        result = setstropt(&data->post_fields, va_arg(param, char *));
+        data->post_fields = va_arg(param, char *);
+        break;
+    case CURLOPT_HTTPGET:
+        /*
+         * Go back to GET after a POST on the same handle
+         */
+        if (va_arg(param, long)) {
+            data->http_post = 0;
+        }
         break;
     case CURLOPT_POSTFIELDSIZE_LARGE:
         /*
@@ -191,12 +297,14 @@ CURLcode Curl_setopt(CURL *ctx, CURLoption option, va_list param)
          * Set CA info for SSL connection. Specify file name of the CA certificate
          */
         result = setstropt(&data->ca_file, va_arg(param, char *));
+        murl_reset_tls(data);
         break;
     case CURLOPT_SSL_VERIFYPEER:
         /*
          * Enable peer SSL verifying.
          */
         data->ssl_verify_peer = (0 != va_arg(param, long)) ? 1 : 0;
+        murl_reset_tls(data);
         break;
     case CURLOPT_CERTINFO:
         /*
@@ -209,6 +317,7 @@ CURLcode Curl_setopt(CURL *ctx, CURLoption option, va_list param)
          * String that holds file name of the SSL certificate to use
          */
         result = setstropt(&data->ssl_cert_file, va_arg(param, char *));
+        murl_reset_tls(data);
         break;
     case CURLOPT_SSLCERTTYPE:
         /*
@@ -221,6 +330,7 @@ CURLcode Curl_setopt(CURL *ctx, CURLoption option, va_list param)
          * String that holds file name of the SSL key to use
          */
         result = setstropt(&data->ssl_key_file, va_arg(param, char *));
+        murl_reset_tls(data);
         break;
     case CURLOPT_SSLKEYTYPE:
         /*
@@ -234,11 +344,18 @@ CURLcode Curl_setopt(CURL *ctx, CURLoption option, va_list param)
     case CURLOPT_WRITEFUNCTION:
         data->write_func = va_arg(param, curl_write_callback);
         break;
+    case CURLOPT_PRIVATE:
+        /*
+         * Set private data pointer, returned by CURLINFO_PRIVATE
+         */
+        data->private_data = va_arg(param, void *);
+        break;
     case CURLOPT_SSL_VERIFY_HOSTNAME:
         /*
          * Enable peer hostname verification.
          */
         data->ssl_verify_hostname = (0 != va_arg(param, long)) ? 1 : 0;
+        murl_reset_tls(data);
         break;
 
     default:
@@ -267,92 +384,6 @@ CURLcode curl_easy_setopt(CURL *curl, CURLoption tag, ...)
     return result;
 }
 
-/*
- * This function simply opens a TCP connection using
- * the BIO interface. Returns the file descriptor for
- * the socket.
- */
-static BIO *create_connection(char *server, int port)
-{
-    BIO *b = NULL;
-    char pbuf[64];
-
-    b = BIO_new_connect(server);
-    if (b == NULL) {
-        printf("IP connection failed\n");
-        return NULL;
-    }
-    sprintf(pbuf, "%d", port);
-    BIO_set_conn_port(b, pbuf);
-
-    if (BIO_do_connect(b) <= 0) {
-        printf("TCP connect failed\n");
-        BIO_free_all(b);
-        return NULL;
-    }
-    return b;
-}
-
-/*
- * This function simply opens a TCP connection given an
- * IPv6 address.  The address should be enclosed in square
- * brackets. Example:
- *	[2001:db8:85a3:8d3:1319:8a2e:370:7348]
- */
-#define IPV6_ADDRESS_MAX    41
-static BIO *create_connection_v6(char *address, int port)
-{
-    BIO		    *conn = NULL;
-    struct sockaddr_in6 si6;
-    char	    *host = &address[1];  /* Removes first square bracket */
-    int		    rc;
-    int		    sock;
-
-    /*
-     * Strip off trailing bracket 
-     */
-    host[strnlen(host, IPV6_ADDRESS_MAX)-1] = 0;
-
-    /*
-     * Setup destination address/port 
-     */
-    memset((char *) &si6, 0, sizeof(si6));
-    si6.sin6_flowinfo = 0;
-    si6.sin6_family = AF_INET6;    
-    si6.sin6_port = htons(port);
-    rc = inet_pton(AF_INET6, host, &si6.sin6_addr);
-    if (rc != 1) {
-	fprintf(stderr, "Unable to resolve v6 address: %s\n", host);
-	return(NULL);
-    }
-
-    /*
-     * Create and connect to the socket
-     */
-    if ((sock = socket(AF_INET6, SOCK_STREAM, 0)) < 0 ) {
-	fprintf(stderr, "Unable to create v6 socket for address: %s\n", host);
-	return(NULL);
-    }
-    if (connect(sock, (struct sockaddr *) &si6, sizeof(si6)) < 0 ) {
-	fprintf(stderr, "Unable to connect v6 socket to address: %s  [%s]\n", host, strerror(errno));
-	close(sock);
-	return(NULL);
-    }
-
-    /*
-     * Pass the socket to the BIO interface, which OpenSSL uses
-     * to create the TLS session.
-     */
-    conn = BIO_new_socket(sock, BIO_CLOSE);
-    if (conn == NULL) {
-        fprintf(stderr, "OpenSSL error creating IP socket\n");
-        //ossl_dump_ssl_errors();
-        return(NULL);
-    }        
-
-    return(conn);
-}
-
 /*
  * Parse URL and fill in the relevant members of the connection struct.
  * This code was adapted from Curl.  It now only supports HTTPS with
@@ -634,6 +665,7 @@ static void murl_log_peer_cert(SSL *ssl)
 	    out = BIO_new(BIO_s_mem());
 	    if (!out) {
 		fprintf(stderr, "Unable to allocation OpenSSL BIO\n");
+		X509_free(cert);
 		return;
 	    }
 	    X509_NAME_print(out, subject, 0);
@@ -642,58 +674,147 @@ static void murl_log_peer_cert(SSL *ssl)
 	    //fprintf(stdout, "TLS peer subject name: %s\n", bptr->data); 
 	    BIO_free_all(out);
 	}
+	X509_free(cert);
     }
 }
 
 
-#define TBUF_MAX 1024
-#define READ_CHUNK_SZ 16384
-CURLcode curl_easy_perform(CURL *curl)
+/*
+ * Close the connection to the server, if there is one.  notify is
+ * zero when the connection is known to be broken, in which case the
+ * server isn't told.
+ */
+static void murl_close_connection(SessionHandle *ctx, int notify)
 {
-    BIO *conn;
+    if (ctx->ssl) {
+	if (notify) {
+	    SSL_shutdown(ctx->ssl);
+	}
+	SSL_free(ctx->ssl);
+	ctx->ssl = NULL;
+    }
+    ctx->conn_host[0] = 0;
+    ctx->conn_port = 0;
+}
+
+/*
+ * Check that an idle connection can still be used.  The server may
+ * have closed it since the last response was read.
+ *
+ * Returns 1 if the connection looks alive, 0 otherwise.
+ */
+static int murl_connection_alive(SessionHandle *ctx)
+{
+    struct pollfd pfd;
+    char c;
     int rv;
-    int ssl_err;
-    int read_cnt = 0;
-    char *rbuf = NULL;
-    char tbuf[TBUF_MAX];
-    SSL *ssl = NULL;
-    SSL_CTX *ssl_ctx = NULL;
-    X509_VERIFY_PARAM *vpm = NULL;
-    int cl;
-    SessionHandle *ctx = (SessionHandle*)curl;
-    struct curl_slist *hdrs;
-    unsigned long ossl_err;
-    CURLcode crv;
 
-    if (!ctx) {
-	return CURLE_UNKNOWN_OPTION;
+    /* Data left over from the last response means we lost track */
+    if (SSL_pending(ctx->ssl)) {
+	return 0;
+    }
+    pfd.fd = SSL_get_fd(ctx->ssl);
+    if (pfd.fd < 0) {
+	return 0;
+    }
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    rv = poll(&pfd, 1, 0);
+    if (rv == 0) {
+	/* Nothing received since the last response */
+	return 1;
+    }
+    if (rv < 0) {
+	return 0;
     }
 
     /*
-     * Allocate some space to build the HTTP request
+     * Something is waiting: either the server closed the connection,
+     * or it sent a TLS record on its own, such as a session ticket.
+     * Have OpenSSL process it, which doesn't block since the socket
+     * is non-blocking.  The connection is alive when that leaves it
+     * waiting for more.  A failed request on the connection is
+     * retried in any case.
      */
-    if (ctx->http_post && ctx->post_field_size) {
-        cl = ctx->post_field_size; 
-    } else if (ctx->http_post && ctx->post_fields) {
-        cl = strlen(ctx->post_fields); //FIXME: this is not safe
-    } else {
-        cl = 0;
+    rv = SSL_peek(ctx->ssl, &c, 1);
+    if (rv > 0) {
+	/* Data nobody asked for */
+	return 0;
     }
-    if (cl > MURL_POST_MAX) {
-	fprintf(stderr, "POST data exceeds %d byte limit\n", MURL_POST_MAX);
-	return CURLE_FILESIZE_EXCEEDED;
+    rv = SSL_get_error(ctx->ssl, rv);
+    ERR_clear_error();
+    return (rv == SSL_ERROR_WANT_READ);
+}
+
+static int murl_streq(const char *a, const char *b)
+{
+    if (!a || !b) {
+	return (a == b);
     }
-    rbuf = calloc(1, cl+MURL_HDR_MAX);
-    if (!rbuf) {
-        fprintf(stderr, "calloc failed.\n");
-        return CURLE_OUT_OF_MEMORY;
+    return !strcmp(a, b);
+}
+
+static void murl_ssl_ctx_free(MURL_SSL_CTX *ent)
+{
+    if (ent->ssl_ctx) SSL_CTX_free(ent->ssl_ctx);
+    if (ent->session) SSL_SESSION_free(ent->session);
+    if (ent->ca_file) free(ent->ca_file);
+    if (ent->cert_file) free(ent->cert_file);
+    if (ent->key_file) free(ent->key_file);
+    free(ent);
+}
+
+/*
+ * Copy the name the certificate of the server is checked against
+ * to name, or "" when the handle doesn't check it.
+ */
+static void murl_verified_name(SessionHandle *ctx, char *name)
+{
+    name[0] = 0;
+    if (ctx->ssl_verify_peer && ctx->ssl_verify_hostname) {
+	strncpy(name, ctx->host_name, MURL_HOSTNAME_MAX - 1);
+	name[MURL_HOSTNAME_MAX - 1] = 0;
     }
+}
 
-    /*
-     * Split the URL into it's parts
-     */
-    crv = parseurl(ctx);
-    if (crv != CURLE_OK) goto easy_perform_cleanup;
+/*
+ * OpenSSL calls this when the server hands out a TLS session that can
+ * be resumed.  With TLS 1.3 this happens after the handshake, while
+ * the response is read.  The session replaces the one kept for the
+ * next connection.
+ *
+ * Returns 1 since murl keeps the reference to the session.
+ */
+static int murl_new_session_cb(SSL *ssl, SSL_SESSION *session)
+{
+    SessionHandle *ctx = SSL_get_app_data(ssl);
+    MURL_SSL_CTX *ent;
+
+    if (!ctx || !ctx->ssl_ctx) {
+	return 0;
+    }
+    ent = ctx->ssl_ctx;
+    pthread_mutex_lock(&ssl_ctx_lock);
+    if (ent->session) SSL_SESSION_free(ent->session);
+    ent->session = session;
+    strncpy(ent->session_host, ctx->conn_host, MURL_HOSTNAME_MAX - 1);
+    ent->session_host[MURL_HOSTNAME_MAX - 1] = 0;
+    ent->session_port = ctx->conn_port;
+    murl_verified_name(ctx, ent->session_name);
+    pthread_mutex_unlock(&ssl_ctx_lock);
+    return 1;
+}
+
+/*
+ * Create the SSL_CTX for a set of TLS settings.  This is where
+ * the trust anchors and client certificate are loaded.
+ *
+ * Returns CURLE_OK on success, or the error.
+ */
+static CURLcode murl_ssl_ctx_new(MURL_SSL_CTX *ent)
+{
+    SSL_CTX *ssl_ctx;
+    X509_VERIFY_PARAM *vpm = NULL;
 
     /*
      * Setup OpenSSL API
@@ -702,28 +823,38 @@ CURLcode curl_easy_perform(CURL *curl)
     if (!ssl_ctx) {
         fprintf(stderr, "Failed to create SSL context.\n");
         ERR_print_errors_fp(stderr);
-        crv = CURLE_SSL_CONNECT_ERROR;
-	goto easy_perform_cleanup;
+        return CURLE_SSL_CONNECT_ERROR;
     }
+    ent->ssl_ctx = ssl_ctx;
+    /*
+     * The sockets are non-blocking, SSL_ERROR_WANT_READ and
+     * SSL_ERROR_WANT_WRITE are handled by murl_xfer_perform().
+     */
+    SSL_CTX_clear_mode(ssl_ctx, SSL_MODE_AUTO_RETRY);
+#ifdef SSL_OP_IGNORE_UNEXPECTED_EOF
+    /*
+     * Servers often close idle connections without a close_notify,
+     * which must look like the end of the connection, not an error.
+     */
+    SSL_CTX_set_options(ssl_ctx, SSL_OP_IGNORE_UNEXPECTED_EOF);
+#endif
     /*
-     * This is optional.
-     * Since we'll be using blocking sockets, set the
-     * SSL read/write mode to auto-retry.  This simplifies
-     * the error handling required when reading/writing to
-     * the SSL socket.
+     * Hand the TLS sessions to murl_new_session_cb() so they can
+     * be resumed, OpenSSL doesn't do it by itself for clients.
      */
-    SSL_CTX_set_mode(ssl_ctx, SSL_MODE_AUTO_RETRY);
+    SSL_CTX_set_session_cache_mode(ssl_ctx, SSL_SESS_CACHE_CLIENT |
+                                   SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(ssl_ctx, murl_new_session_cb);
 
 
     /*
      * Enable TLS peer verification if requested and CA certs were provided
      */
-    if (ctx->ssl_verify_peer && ctx->ca_file) {
-        if (!SSL_CTX_load_verify_locations(ssl_ctx, ctx->ca_file, NULL)) {
+    if (ent->ca_file) {
+        if (!SSL_CTX_load_verify_locations(ssl_ctx, ent->ca_file, NULL)) {
             fprintf(stderr, "Failed to set trust anchors.\n");
             ERR_print_errors_fp(stderr);
-            crv = CURLE_SSL_CACERT_BADFILE;
-	    goto easy_perform_cleanup;
+            return CURLE_SSL_CACERT_BADFILE;
         }
         SSL_CTX_set_verify(ssl_ctx, SSL_VERIFY_PEER|SSL_VERIFY_FAIL_IF_NO_PEER_CERT, NULL);
     }
@@ -732,8 +863,7 @@ CURLcode curl_easy_perform(CURL *curl)
     if (vpm == NULL) {
         fprintf(stderr, "Unable to allocate a verify parameter structure.\n");
         ERR_print_errors_fp(stderr);
-        crv = CURLE_SSL_CONNECT_ERROR;
-	goto easy_perform_cleanup;
+        return CURLE_SSL_CONNECT_ERROR;
     }
 #if 0
     /* TODO: Enable CRL checks */
@@ -742,72 +872,579 @@ CURLcode curl_easy_perform(CURL *curl)
 #endif
     X509_VERIFY_PARAM_set_depth(vpm, 7);
     X509_VERIFY_PARAM_set_purpose(vpm, X509_PURPOSE_SSL_SERVER);
-    if (ctx->ssl_verify_hostname) {
-	X509_VERIFY_PARAM_set1_host(vpm, ctx->host_name, strnlen(ctx->host_name, MURL_HOSTNAME_MAX));
-    }
     SSL_CTX_set1_param(ssl_ctx, vpm);
     X509_VERIFY_PARAM_free(vpm);
 
-    if (ctx->ssl_cert_file && ctx->ssl_key_file) {
-        if (SSL_CTX_use_certificate_chain_file(ssl_ctx, ctx->ssl_cert_file) != 1) {
+    if (ent->cert_file && ent->key_file) {
+        if (SSL_CTX_use_certificate_chain_file(ssl_ctx, ent->cert_file) != 1) {
             fprintf(stderr,"Failed to load client certificate\n");
             ERR_print_errors_fp(stderr);
-            crv = CURLE_SSL_CERTPROBLEM;
-	    goto easy_perform_cleanup;
+            return CURLE_SSL_CERTPROBLEM;
         }
-        if (SSL_CTX_use_PrivateKey_file(ssl_ctx, ctx->ssl_key_file, SSL_FILETYPE_PEM) != 1) {
+        if (SSL_CTX_use_PrivateKey_file(ssl_ctx, ent->key_file, SSL_FILETYPE_PEM) != 1) {
             fprintf(stderr, "Failed to load client private key\n");
             ERR_print_errors_fp(stderr);
-            crv = CURLE_SSL_CERTPROBLEM;
-	    goto easy_perform_cleanup;
+            return CURLE_SSL_CERTPROBLEM;
         }
     }
+    return CURLE_OK;
+}
+
+/*
+ * Find the SSL_CTX for the TLS settings of a handle in the cache, or
+ * create it.  The handle holds a reference to it until the handle is
+ * cleaned up or its TLS settings change.
+ *
+ * Returns CURLE_OK on success, or the error.
+ */
+static CURLcode murl_ssl_ctx_get(SessionHandle *ctx)
+{
+    MURL_SSL_CTX *ent;
+    const char *ca_file = ctx->ssl_verify_peer ? ctx->ca_file : NULL;
+    const char *cert_file = NULL, *key_file = NULL;
+    CURLcode crv;
+
+    if (ctx->ssl_ctx) {
+	return CURLE_OK;
+    }
+    if (ctx->ssl_cert_file && ctx->ssl_key_file) {
+	cert_file = ctx->ssl_cert_file;
+	key_file = ctx->ssl_key_file;
+    }
 
     /*
-     * Open TCP connection with server
+     * The lock is held while a missing SSL_CTX is created, so threads
+     * asking for the same one at the same time don't both load it.
      */
-    if (ctx->use_ipv6) {
-	conn = create_connection_v6(ctx->host_name, ctx->server_port);
+    pthread_mutex_lock(&ssl_ctx_lock);
+    for (ent = ssl_ctx_cache; ent; ent = ent->next) {
+	if (ent->verify_peer == ctx->ssl_verify_peer &&
+	    ent->verify_hostname == ctx->ssl_verify_hostname &&
+	    murl_streq(ent->ca_file, ca_file) &&
+	    murl_streq(ent->cert_file, cert_file) &&
+	    murl_streq(ent->key_file, key_file)) {
+	    ent->refs++;
+	    ctx->ssl_ctx = ent;
+	    pthread_mutex_unlock(&ssl_ctx_lock);
+	    return CURLE_OK;
+	}
+    }
+
+    ent = calloc(1, sizeof(MURL_SSL_CTX));
+    if (!ent) {
+	pthread_mutex_unlock(&ssl_ctx_lock);
+	return CURLE_OUT_OF_MEMORY;
+    }
+    ent->verify_peer = ctx->ssl_verify_peer;
+    ent->verify_hostname = ctx->ssl_verify_hostname;
+    if ((ca_file && !(ent->ca_file = strdup(ca_file))) ||
+	(cert_file && !(ent->cert_file = strdup(cert_file))) ||
+	(key_file && !(ent->key_file = strdup(key_file)))) {
+	crv = CURLE_OUT_OF_MEMORY;
     } else {
-	conn = create_connection(ctx->host_name, ctx->server_port);
+	crv = murl_ssl_ctx_new(ent);
     }
-    //FIXME: do we need to free conn, or is this handled by SSL_free?
+    if (crv != CURLE_OK) {
+	pthread_mutex_unlock(&ssl_ctx_lock);
+	murl_ssl_ctx_free(ent);
+	return crv;
+    }
+    ent->refs = 1;
+    ent->next = ssl_ctx_cache;
+    ssl_ctx_cache = ent;
+    ctx->ssl_ctx = ent;
+    pthread_mutex_unlock(&ssl_ctx_lock);
+    return CURLE_OK;
+}
+
+/*
+ * Let go of the SSL_CTX used by a handle.  The last handle using
+ * it frees it.
+ */
+static void murl_ssl_ctx_release(SessionHandle *ctx)
+{
+    MURL_SSL_CTX *ent = ctx->ssl_ctx, **prev;
+
+    if (!ent) {
+	return;
+    }
+    ctx->ssl_ctx = NULL;
+    pthread_mutex_lock(&ssl_ctx_lock);
+    if (--ent->refs > 0) {
+	pthread_mutex_unlock(&ssl_ctx_lock);
+	return;
+    }
+    for (prev = &ssl_ctx_cache; *prev; prev = &(*prev)->next) {
+	if (*prev == ent) {
+	    *prev = ent->next;
+	    break;
+	}
+    }
+    pthread_mutex_unlock(&ssl_ctx_lock);
+    murl_ssl_ctx_free(ent);
+}
+
+/*
+ * Close the connection and let go of the SSL_CTX of a handle, for
+ * when its TLS settings change.
+ */
+static void murl_reset_tls(SessionHandle *ctx)
+{
+    murl_close_connection(ctx, 1);
+    murl_ssl_ctx_release(ctx);
+}
+
+/*
+ * Get the connection for the request of a handle opened to the
+ * server in the URL.
+ *
+ * Returns CURLE_OK on success, or the error.
+ */
+static CURLcode murl_xfer_new_connection(SessionHandle *ctx)
+{
+    CURLcode crv;
+
+    crv = murl_ssl_ctx_get(ctx);
+    if (crv != CURLE_OK) {
+	return crv;
+    }
+
+    /*
+     * Remember who the connection is to
+     */
+    strncpy(ctx->conn_host, ctx->host_name, MURL_HOSTNAME_MAX - 1);
+    ctx->conn_host[MURL_HOSTNAME_MAX - 1] = 0;
+    ctx->conn_port = ctx->server_port;
+
+    ctx->reused = 0;
+    ctx->xfer_state = MURL_XFER_CONNECT;
+    return CURLE_OK;
+}
+
+/*
+ * Start opening a TCP connection to the next address of the server.
+ * The addresses are looked up first if needed.  The lookup blocks,
+ * the connection doesn't.
+ *
+ * Returns CURLE_OK once the connection is open, CURLE_AGAIN while it
+ * is being opened, or the error.
+ */
+static CURLcode murl_tcp_connect(SessionHandle *ctx)
+{
+    struct addrinfo hints, *ai;
+    char host[MURL_HOSTNAME_MAX];
+    char pbuf[16];
+    int rv, len, flags, on = 1;
+
+    if (!ctx->addrs) {
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_socktype = SOCK_STREAM;
+	if (ctx->use_ipv6) {
+	    /*
+	     * Strip off the square brackets around the address
+	     */
+	    len = strnlen(ctx->host_name, MURL_HOSTNAME_MAX);
+	    if (len < 3) {
+		return CURLE_URL_MALFORMAT;
+	    }
+	    snprintf(host, sizeof(host), "%.*s", len - 2, ctx->host_name + 1);
+	    hints.ai_family = AF_INET6;
+	    hints.ai_flags = AI_NUMERICHOST;
+	} else {
+	    strncpy(host, ctx->host_name, MURL_HOSTNAME_MAX - 1);
+	    host[MURL_HOSTNAME_MAX - 1] = 0;
+	    hints.ai_family = AF_UNSPEC;
+	}
+	snprintf(pbuf, sizeof(pbuf), "%d", ctx->server_port);
+	rv = getaddrinfo(host, pbuf, &hints, &ctx->addrs);
+	if (rv) {
+	    fprintf(stderr, "Unable to resolve %s: %s\n", host, gai_strerror(rv));
+	    ctx->addrs = NULL;
+	    return CURLE_COULDNT_RESOLVE_HOST;
+	}
+	ctx->next_addr = ctx->addrs;
+    }
+
+    while (ctx->next_addr) {
+	ai = ctx->next_addr;
+	ctx->next_addr = ai->ai_next;
+	ctx->sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+	if (ctx->sock < 0) {
+	    continue;
+	}
+	flags = fcntl(ctx->sock, F_GETFL, 0);
+	if (flags < 0 || fcntl(ctx->sock, F_SETFL, flags | O_NONBLOCK) < 0) {
+	    close(ctx->sock);
+	    ctx->sock = -1;
+	    continue;
+	}
+	/*
+	 * As with curl, send small writes right away.  Once the
+	 * connection is kept between requests, they would otherwise
+	 * wait for the ACK the server delays.
+	 */
+	setsockopt(ctx->sock, IPPROTO_TCP, TCP_NODELAY, (const char *)&on, sizeof(on));
+	if (!connect(ctx->sock, ai->ai_addr, ai->ai_addrlen)) {
+	    return CURLE_OK;
+	}
+	if (errno == EINPROGRESS) {
+	    ctx->want = POLLOUT;
+	    return CURLE_AGAIN;
+	}
+	close(ctx->sock);
+	ctx->sock = -1;
+    }
+    fprintf(stderr, "TCP connect failed\n");
+    return CURLE_COULDNT_CONNECT;
+}
+
+/*
+ * See whether the TCP connection being opened is open.  If it
+ * failed, the next address of the server is tried.
+ *
+ * Returns CURLE_OK once the connection is open, CURLE_AGAIN while it
+ * is being opened, or the error.
+ */
+static CURLcode murl_tcp_connect_check(SessionHandle *ctx)
+{
+    struct pollfd pfd;
+    int err = 0;
+    socklen_t len = sizeof(err);
+
+    pfd.fd = ctx->sock;
+    pfd.events = POLLOUT;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, 0) <= 0) {
+	ctx->want = POLLOUT;
+	return CURLE_AGAIN;
+    }
+    if (!getsockopt(ctx->sock, SOL_SOCKET, SO_ERROR, &err, &len) && !err) {
+	return CURLE_OK;
+    }
+    close(ctx->sock);
+    ctx->sock = -1;
+    return murl_tcp_connect(ctx);
+}
+
+/*
+ * Set up the TLS connection on top of the TCP connection that was
+ * just opened.  The TLS session from the last connection to the
+ * server is resumed if there is one.
+ *
+ * Returns CURLE_OK on success, or the error.
+ */
+static CURLcode murl_tls_new(SessionHandle *ctx)
+{
+    MURL_SSL_CTX *ent = ctx->ssl_ctx;
+    char name[MURL_HOSTNAME_MAX];
+    BIO *conn;
+    SSL *ssl;
+
+    conn = BIO_new_socket(ctx->sock, BIO_CLOSE);
     if (conn == NULL) {
-        fprintf(stderr, "Unable to open socket with server.\n");
-        crv = CURLE_COULDNT_CONNECT;
-	goto easy_perform_cleanup;
+        fprintf(stderr, "OpenSSL error creating IP socket\n");
+	return CURLE_OUT_OF_MEMORY;
     }
-    ssl = SSL_new(ssl_ctx);
+    /* The socket is closed with the BIO from now on */
+    ctx->sock = -1;
+    ssl = SSL_new(ent->ssl_ctx);
+    if (!ssl) {
+        BIO_free_all(conn);
+        return CURLE_OUT_OF_MEMORY;
+    }
+    SSL_set_app_data(ssl, ctx);
+    /* The socket is non-blocking, let SSL_write() send what it can */
+    SSL_set_mode(ssl, SSL_MODE_ENABLE_PARTIAL_WRITE);
     if (!SSL_set_tlsext_host_name(ssl, ctx->host_name)) {
         fprintf(stderr, "Warning: SNI extension not set.\n");
     }
+    if (ctx->ssl_verify_hostname) {
+	X509_VERIFY_PARAM_set1_host(SSL_get0_param(ssl), ctx->host_name,
+	                            strnlen(ctx->host_name, MURL_HOSTNAME_MAX));
+    }
+    /*
+     * The certificate isn't checked again when the session is resumed,
+     * so it must have been checked against the same name.
+     * SSL_set_session() takes its own reference to the session.
+     */
+    murl_verified_name(ctx, name);
+    pthread_mutex_lock(&ssl_ctx_lock);
+    if (ent->session && ent->session_port == ctx->conn_port &&
+	!strncmp(ent->session_host, ctx->conn_host, MURL_HOSTNAME_MAX) &&
+	!strncmp(ent->session_name, name, MURL_HOSTNAME_MAX)) {
+	SSL_set_session(ssl, ent->session);
+    }
+    pthread_mutex_unlock(&ssl_ctx_lock);
+    /* The BIO is freed by SSL_free() from now on */
     SSL_set_bio(ssl, conn, conn);
-    rv = SSL_connect(ssl);
+    ctx->ssl = ssl;
+    return CURLE_OK;
+}
+
+/*
+ * Work out from the error of an SSL call on the non-blocking socket
+ * whether it just has to wait for the socket.
+ *
+ * Returns 1 if so, with what to wait for in ctx->want, 0 otherwise.
+ */
+static int murl_ssl_wait(SessionHandle *ctx, int ssl_err)
+{
+    switch (ssl_err) {
+    case SSL_ERROR_WANT_READ:
+	ctx->want = POLLIN;
+	return 1;
+    case SSL_ERROR_WANT_WRITE:
+	ctx->want = POLLOUT;
+	return 1;
+    default:
+	return 0;
+    }
+}
+
+static CURLcode murl_xfer_connect(SessionHandle *ctx)
+{
+    CURLcode crv;
+
+    if (ctx->sock < 0) {
+	crv = murl_tcp_connect(ctx);
+    } else {
+	crv = murl_tcp_connect_check(ctx);
+    }
+    if (crv != CURLE_OK) {
+	return crv;
+    }
+    freeaddrinfo(ctx->addrs);
+    ctx->addrs = ctx->next_addr = NULL;
+
+    crv = murl_tls_new(ctx);
+    if (crv != CURLE_OK) {
+	return crv;
+    }
+    ctx->xfer_state = MURL_XFER_HANDSHAKE;
+    return CURLE_OK;
+}
+
+static CURLcode murl_xfer_handshake(SessionHandle *ctx)
+{
+    int rv;
+
+    /*
+     * SSL_get_error() looks at the error queue of the calling thread,
+     * which has to be empty before each TLS operation.
+     */
+    ERR_clear_error();
+    rv = SSL_connect(ctx->ssl);
     if (rv <= 0) {
+	if (murl_ssl_wait(ctx, SSL_get_error(ctx->ssl, rv))) {
+	    return CURLE_AGAIN;
+	}
         fprintf(stderr, "TLS handshake failed.\n");
         ERR_print_errors_fp(stderr);
-        crv = CURLE_SSL_CONNECT_ERROR;
-	goto easy_perform_cleanup;
+        return CURLE_SSL_CONNECT_ERROR;
     }
 
     /*
      * PSB requires we log the X509 distinguished name of the peer
      */
     if (ctx->ssl_verify_peer) {
-	murl_log_peer_cert(ssl);
+	murl_log_peer_cert(ctx->ssl);
+    }
+
+    ctx->xfer_state = MURL_XFER_SEND;
+    return CURLE_OK;
+}
+
+/*
+ * Send the HTTP request headers followed by the POST data.
+ */
+static CURLcode murl_xfer_send(SessionHandle *ctx)
+{
+    int rv;
+    CURLcode crv;
+
+    while (ctx->req_sent < ctx->req_len) {
+	ERR_clear_error();
+	rv = SSL_write(ctx->ssl, ctx->req + ctx->req_sent, ctx->req_len - ctx->req_sent);
+	if (rv <= 0) {
+	    if (murl_ssl_wait(ctx, SSL_get_error(ctx->ssl, rv))) {
+		return CURLE_AGAIN;
+	    }
+	    return CURLE_SEND_ERROR;
+	}
+	ctx->req_sent += rv;
+    }
+
+    crv = murl_http_response_begin(ctx);
+    if (crv != CURLE_OK) {
+	return crv;
+    }
+    ctx->xfer_state = MURL_XFER_RECV;
+    return CURLE_OK;
+}
+
+/*
+ * Read the HTTP response from the server.  Since the connection is
+ * kept open, the response ends where the HTTP framing says it does,
+ * not when the server closes the connection.  The body is passed to
+ * the write callback as it is read.
+ */
+#define READ_CHUNK_SZ 16384
+static CURLcode murl_xfer_recv(SessionHandle *ctx)
+{
+    char rbuf[READ_CHUNK_SZ];
+    int rv;
+    int ssl_err;
+    int done = 0, keep_alive = 0;
+    unsigned long ossl_err;
+    CURLcode crv;
+
+    while (!done) {
+	/*
+	 * Read the next chunk from the server
+	 */
+	ERR_clear_error();
+        rv = SSL_read(ctx->ssl, rbuf, READ_CHUNK_SZ);
+        if (rv <= 0) {
+            ssl_err = SSL_get_error(ctx->ssl, rv);
+	    if (murl_ssl_wait(ctx, ssl_err)) {
+		return CURLE_AGAIN;
+	    }
+            switch (ssl_err) {
+            case SSL_ERROR_NONE:
+            case SSL_ERROR_ZERO_RETURN:
+                break;
+            default:
+                ossl_err = ERR_get_error();
+                if ((rv < 0) || ossl_err) {
+                    fprintf(stderr, "SSL_read failed, rv=%d ssl_err=%d ossl_err=%d.\n",
+                            rv, ssl_err, (int)ossl_err);
+                    ERR_print_errors_fp(stderr);
+                    return CURLE_USE_SSL_FAILED;
+                }
+                break;
+            }
+	    /*
+	     * The server closed the connection
+	     */
+	    if (!ctx->received) {
+		return CURLE_GOT_NOTHING;
+	    }
+	    rv = 0;
+        } else {
+	    ctx->received = 1;
+	}
+
+	crv = murl_http_response_feed(ctx, rbuf, rv, &done);
+	if (crv != CURLE_OK) {
+	    return crv;
+	}
+	if (!rv && !done) {
+	    return CURLE_PARTIAL_FILE;
+	}
+    }
+
+    crv = murl_http_response_finish(ctx, &keep_alive);
+    if (crv != CURLE_OK) {
+	return crv;
+    }
+    if (!keep_alive) {
+	murl_close_connection(ctx, 1);
+    }
+    ctx->xfer_state = MURL_XFER_DONE;
+    return CURLE_OK;
+}
+
+/*
+ * Finish the request of a handle.  The connection is closed when
+ * the request failed, since it's in an unknown state.
+ *
+ * Returns the result of the request.
+ */
+static CURLcode murl_xfer_end(SessionHandle *ctx, CURLcode crv)
+{
+    if (crv != CURLE_OK) {
+	murl_http_response_free(ctx);
+	murl_close_connection(ctx, 0);
+    }
+    if (ctx->sock >= 0) {
+	close(ctx->sock);
+	ctx->sock = -1;
+    }
+    if (ctx->addrs) {
+	freeaddrinfo(ctx->addrs);
+	ctx->addrs = ctx->next_addr = NULL;
+    }
+    if (ctx->req) {
+	free(ctx->req);
+	ctx->req = NULL;
+    }
+    ctx->want = 0;
+    ctx->xfer_state = MURL_XFER_DONE;
+    ctx->xfer_result = crv;
+    return crv;
+}
+
+/*
+ * Get the request set up on a handle going.  The connection kept
+ * from the last request is used if it is to the same server and the
+ * server didn't close it in the meantime.  murl_xfer_perform() then
+ * moves the request along.
+ *
+ * Returns CURLE_OK on success, or the error, in which case the
+ * request is already done.
+ */
+#define TBUF_MAX 1024
+CURLcode murl_xfer_start(SessionHandle *ctx)
+{
+    char tbuf[TBUF_MAX];
+    int cl;
+    struct curl_slist *hdrs;
+    CURLcode crv;
+
+    ctx->reused = 0;
+    ctx->received = 0;
+    ctx->want = 0;
+    ctx->xfer_result = CURLE_OK;
+
+    /*
+     * Allocate some space to build the HTTP request
+     */
+    if (ctx->http_post && ctx->post_field_size > 0) {
+        cl = ctx->post_field_size; 
+    } else if (ctx->http_post && ctx->post_fields) {
+        cl = strlen(ctx->post_fields); //FIXME: this is not safe
+    } else {
+        cl = 0;
+    }
+    if (cl > MURL_POST_MAX) {
+	fprintf(stderr, "POST data exceeds %d byte limit\n", MURL_POST_MAX);
+	return murl_xfer_end(ctx, CURLE_FILESIZE_EXCEEDED);
+    }
+    ctx->req = calloc(1, MURL_HDR_MAX + cl);
+    if (!ctx->req) {
+        fprintf(stderr, "calloc failed.\n");
+        return murl_xfer_end(ctx, CURLE_OUT_OF_MEMORY);
+    }
+
+    /*
+     * Split the URL into it's parts
+     */
+    crv = parseurl(ctx);
+    if (crv != CURLE_OK) {
+	return murl_xfer_end(ctx, crv);
     }
 
     /*
      * Build HTTP request
      */
     memset(tbuf, 0, sizeof(tbuf));
-    snprintf(tbuf, TBUF_MAX, "%s %s HTTP/1.0\r\n"
+    snprintf(tbuf, TBUF_MAX, "%s %s HTTP/1.1\r\n"
             "Host: %s:%d\r\n"
             "User-Agent: %s\r\n",
             (ctx->http_post ? "POST" : "GET"),
             ctx->path_segment, ctx->host_name, ctx->server_port,
             (ctx->user_agent ? ctx->user_agent : "Murl"));
-    strcat(rbuf, tbuf); //FIXME: safe string handling needed
+    strcat(ctx->req, tbuf); //FIXME: safe string handling needed
 
     /*
      * Add any custom headers requested by the user
@@ -817,106 +1454,176 @@ CURLcode curl_easy_perform(CURL *curl)
         while (hdrs) {
             memset(tbuf, 0, sizeof(tbuf));
             snprintf(tbuf, TBUF_MAX, "%s\r\n", hdrs->data);
-            strcat(rbuf, tbuf); //FIXME: safe string handling needed
+            strcat(ctx->req, tbuf); //FIXME: safe string handling needed
             hdrs = hdrs->next;
         }
     }
 
+    /*
+     * Ask for a compressed response if requested by the user
+     */
+    if (ctx->accept_encoding) {
+        memset(tbuf, 0, sizeof(tbuf));
+        snprintf(tbuf, TBUF_MAX, "Accept-Encoding: %s\r\n",
+                 (*ctx->accept_encoding ? ctx->accept_encoding : MURL_ACCEPT_ENCODING));
+        strcat(ctx->req, tbuf); //FIXME: safe string handling needed
+    }
+
     /*
      * Set the Content-length header
      */
     memset(tbuf, 0, sizeof(tbuf));
     snprintf(tbuf, TBUF_MAX, "Content-Length: %d\r\n" "Accept: */*\r\n\r\n", cl);
-    strcat(rbuf, tbuf); //FIXME: safe string handling needed
+    strcat(ctx->req, tbuf); //FIXME: safe string handling needed
 
     /*
-     * Send the HTTP request
+     * The POST data goes out right behind the headers
      */
-    SSL_write(ssl, rbuf, strlen(rbuf));
-    SSL_write(ssl, ctx->post_fields, cl);
-
-    ERR_clear_error();
-    free(rbuf);
-    rbuf = NULL;
+    ctx->req_len = strlen(ctx->req);
+    if (cl) {
+	memcpy(ctx->req + ctx->req_len, ctx->post_fields, cl);
+	ctx->req_len += cl;
+    }
+    ctx->req_sent = 0;
 
     /*
-     * Read the HTTP response
+     * Only reuse the connection from the last request if it is to
+     * the same server and the server didn't close it in the meantime
      */
-    rv = 1;
-    while (rv) {
-	/*
-	 * Allocate some space to receive the response from the server
-	 */
-	rbuf = realloc(rbuf, read_cnt + READ_CHUNK_SZ);
-	if (!rbuf) {
-	    fprintf(stderr, "realloc failed (%s).\n", __FUNCTION__);
-	    crv = CURLE_OUT_OF_MEMORY;
-	    goto easy_perform_cleanup;
+    if (ctx->ssl) {
+	if (ctx->conn_port != ctx->server_port ||
+	    strncmp(ctx->conn_host, ctx->host_name, MURL_HOSTNAME_MAX)) {
+	    murl_close_connection(ctx, 1);
+	} else if (!murl_connection_alive(ctx)) {
+	    murl_close_connection(ctx, 0);
 	}
-	memset(rbuf+read_cnt, 0x0, READ_CHUNK_SZ);
-	
-	/*
-	 * Read the next chunk from the server
-	 */
-        rv = SSL_read(ssl, rbuf+read_cnt, READ_CHUNK_SZ);
-        if (rv <= 0) {
-            ssl_err = SSL_get_error(ssl, rv);
-            switch (ssl_err) {
-            case SSL_ERROR_NONE:
-            case SSL_ERROR_ZERO_RETURN:
-                //fprintf(stderr, "SSL_read finished\n");
-                break;
-            default:
-                ossl_err = ERR_get_error();
-                if ((rv < 0) || ossl_err) {
-                    fprintf(stderr, "SSL_read failed, rv=%d ssl_err=%d ossl_err=%d.\n",
-                            rv, ssl_err, (int)ossl_err);
-                    ERR_print_errors_fp(stderr);
-                    crv = CURLE_USE_SSL_FAILED;
-	            goto easy_perform_cleanup;
-                }
-                break;
-            }
-        }
-        read_cnt += rv;
-	
-	/*
-	 * Make sure we're not receving too much data from the server.
-	 */
-	if (read_cnt > MURL_RCV_MAX) {
-	    crv = CURLE_FILESIZE_EXCEEDED;
-	    goto easy_perform_cleanup;
+    }
+    if (ctx->ssl) {
+	ctx->reused = 1;
+	ctx->xfer_state = MURL_XFER_SEND;
+	return CURLE_OK;
+    }
+    crv = murl_xfer_new_connection(ctx);
+    if (crv != CURLE_OK) {
+	return murl_xfer_end(ctx, crv);
+    }
+    return CURLE_OK;
+}
+
+/*
+ * Move the request of a handle along as far as it can go without
+ * blocking.
+ *
+ * Returns CURLE_AGAIN while the request waits for ctx->want on the
+ * socket from murl_xfer_fd(), otherwise the result of the request.
+ */
+CURLcode murl_xfer_perform(SessionHandle *ctx)
+{
+    MURL_XFER_STATE state;
+    CURLcode crv;
+
+    ctx->want = 0;
+    while (ctx->xfer_state != MURL_XFER_DONE) {
+	state = ctx->xfer_state;
+	switch (state) {
+	case MURL_XFER_CONNECT:
+	    crv = murl_xfer_connect(ctx);
+	    break;
+	case MURL_XFER_HANDSHAKE:
+	    crv = murl_xfer_handshake(ctx);
+	    break;
+	case MURL_XFER_SEND:
+	    crv = murl_xfer_send(ctx);
+	    break;
+	case MURL_XFER_RECV:
+	    crv = murl_xfer_recv(ctx);
+	    break;
+	default:
+	    /* No request was started */
+	    return CURLE_FAILED_INIT;
 	}
+	if (crv == CURLE_AGAIN) {
+	    return crv;
+	}
+	if (crv == CURLE_OK) {
+	    if (ctx->xfer_state == MURL_XFER_DONE) {
+		return murl_xfer_end(ctx, CURLE_OK);
+	    }
+	    continue;
+	}
+
+	if (ctx->reused && !ctx->received &&
+	    (state == MURL_XFER_SEND || state == MURL_XFER_RECV)) {
+	    /*
+	     * The server closed the reused connection before answering,
+	     * try once more on a new one.
+	     */
+	    murl_http_response_free(ctx);
+	    murl_close_connection(ctx, 0);
+	    ctx->req_sent = 0;
+	    crv = murl_xfer_new_connection(ctx);
+	    if (crv == CURLE_OK) {
+		continue;
+	    }
+	}
+	return murl_xfer_end(ctx, crv);
     }
+    return ctx->xfer_result;
+}
 
-    /*
-     * make sure the data is null terminated
-     */
-    rbuf[read_cnt] = 0;
+/*
+ * The socket the request of a handle waits on, or -1 if none.
+ */
+int murl_xfer_fd(SessionHandle *ctx)
+{
+    if (ctx->sock >= 0) {
+	return ctx->sock;
+    }
+    return ctx->ssl ? SSL_get_fd(ctx->ssl) : -1;
+}
 
-    /*
-     * Parse the HTTP response
-     */
-    if (murl_http_parse_response(ctx, rbuf)) {
-        crv = CURLE_HTTP2;
-	goto easy_perform_cleanup;
+/*
+ * Drop the request of a handle if it didn't finish.  The handle is
+ * left ready for the next one.
+ */
+void murl_xfer_abort(SessionHandle *ctx)
+{
+    if (ctx->xfer_state != MURL_XFER_IDLE && ctx->xfer_state != MURL_XFER_DONE) {
+	murl_xfer_end(ctx, CURLE_ABORTED_BY_CALLBACK);
     }
+    ctx->xfer_state = MURL_XFER_IDLE;
+}
 
-    /*
-     * Send the data back to the user
-     */
-    if (ctx->write_func) {
-        (ctx->write_func)(ctx->recv_buf, 1, ctx->recv_ctr, ctx->write_ctx);
+CURLcode curl_easy_perform(CURL *curl)
+{
+    SessionHandle *ctx = (SessionHandle*)curl;
+    struct pollfd pfd;
+    CURLcode crv;
+
+    if (!ctx) {
+	return CURLE_UNKNOWN_OPTION;
+    }
+    /* The requests of a handle in a multi handle are driven by it */
+    if (ctx->multi) {
+	return CURLE_FAILED_INIT;
     }
 
-    crv = CURLE_OK;
-easy_perform_cleanup:
-    if (ssl) {
-	SSL_shutdown(ssl);
-	SSL_free(ssl);
+    crv = murl_xfer_start(ctx);
+    if (crv != CURLE_OK) {
+	return crv;
+    }
+
+    /*
+     * Same as with a multi handle, waiting on the one socket
+     */
+    while ((crv = murl_xfer_perform(ctx)) == CURLE_AGAIN) {
+	pfd.fd = murl_xfer_fd(ctx);
+	pfd.events = ctx->want;
+	pfd.revents = 0;
+	if (poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+	    return murl_xfer_end(ctx, CURLE_RECV_ERROR);
+	}
     }
-    if (ssl_ctx) SSL_CTX_free(ssl_ctx);
-    if (rbuf) free(rbuf);
     return crv;
 }
 
@@ -934,12 +1641,25 @@ static CURLcode getinfo_long(SessionHandle *data, CURLINFO info, long *param_lon
 }
 
 
+static CURLcode getinfo_char(SessionHandle *data, CURLINFO info, char **param_charp)
+{
+    switch (info) {
+    case CURLINFO_PRIVATE:
+        *param_charp = (char *)data->private_data;
+        break;
+    default:
+        return CURLE_BAD_FUNCTION_ARGUMENT;
+    }
+
+    return CURLE_OK;
+}
+
 static CURLcode Curl_getinfo(SessionHandle *data, CURLINFO info, ...)
 {
     va_list arg;
     long *param_longp = NULL;
     //double *param_doublep = NULL;
-    //char **param_charp = NULL;
+    char **param_charp = NULL;
     //struct curl_slist **param_slistp = NULL;
     int type;
     /* default return code is to error out! */
@@ -952,13 +1672,11 @@ static CURLcode Curl_getinfo(SessionHandle *data, CURLINFO info, ...)
 
     type = CURLINFO_TYPEMASK & (int)info;
     switch (type) {
-#if 0
     case CURLINFO_STRING:
         param_charp = va_arg(arg, char **);
         if (param_charp)
             result = getinfo_char(data, info, param_charp);
         break;
-#endif
     case CURLINFO_LONG:
         param_longp = va_arg(arg, long *);
         if (param_longp)
@@ -1109,6 +1827,8 @@ static void Curl_ossl_cleanup(void)
     /* Free thread local error state, destroying hash upon zero refcount */
     ERR_remove_thread_state(NULL);
     ERR_remove_state(0);
+
+    murl_ossl_free_locks();
 #endif
 }
 
@@ -1118,20 +1838,35 @@ void curl_easy_cleanup(CURL *curl)
 
     if (data->user_agent) free(data->user_agent);
     if (data->url) free(data->url);
-    if (data->post_fields) free(data->post_fields);
+    if (data->accept_encoding) free(data->accept_encoding);
     if (data->ca_file) free(data->ca_file);
     if (data->ssl_cert_file) free(data->ssl_cert_file);
     if (data->ssl_cert_type) free(data->ssl_cert_type);
     if (data->ssl_key_file) free(data->ssl_key_file);
     if (data->ssl_key_type) free(data->ssl_key_type);
-    if (data->recv_buf) free(data->recv_buf);
+    if (data->multi) curl_multi_remove_handle(data->multi, data);
+    murl_xfer_abort(data);
+    murl_http_response_free(data);
+    murl_reset_tls(data);
     //if (data->headers) curl_slist_free_all(data->headers);
 
     free(data);
 }
 
+/*
+ * As with Curl, this must only be called once no other thread
+ * uses murl.
+ */
 void curl_global_cleanup(void)
 {
+    MURL_SSL_CTX *ent;
+
+    /* Only left over if some handles weren't cleaned up */
+    while (ssl_ctx_cache) {
+	ent = ssl_ctx_cache;
+	ssl_ctx_cache = ent->next;
+	murl_ssl_ctx_free(ent);
+    }
     Curl_ossl_cleanup();
 }
 
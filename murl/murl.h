@@ -293,6 +293,9 @@ typedef enum {
 
     CINIT(HEADERFUNCTION, FUNCTIONPOINT, 79),
 
+    /* Set the HTTP request method back to GET on a reused handle */
+    CINIT(HTTPGET, LONG, 80),
+
     /* Set if we should verify the Common name from the peer certificate in ssl
      * handshake, set 1 to check existence, 2 to ensure that it matches the
      * provided hostname. */
@@ -307,6 +310,14 @@ typedef enum {
     /* type of the file keeping your private SSL-key ("DER", "PEM", "ENG") */
     CINIT(SSLKEYTYPE, OBJECTPOINT, 88),
 
+    /* Set the Accept-Encoding string. Use this to tell a server you would like
+       the response to be compressed. An empty string asks for every encoding
+       supported, which are then decoded. */
+    CINIT(ACCEPT_ENCODING, OBJECTPOINT, 102),
+
+    /* Set pointer to private data, returned by CURLINFO_PRIVATE */
+    CINIT(PRIVATE, OBJECTPOINT, 103),
+
     /* The _LARGE version of the standard POSTFIELDSIZE option */
     CINIT(POSTFIELDSIZE_LARGE, OFF_T, 120),
 
@@ -419,6 +430,104 @@ typedef size_t (*curl_write_callback)(char *buffer,
                                       size_t nitems,
                                       void *outstream);
 
+/*
+ * The subset of the Curl multi interface provided by murl, used to
+ * run the requests of several handles at once from a single thread.
+ */
+typedef void CURLM;
+
+typedef enum {
+    CURLM_CALL_MULTI_PERFORM = -1, /* please call curl_multi_perform() soon */
+    CURLM_OK,
+    CURLM_BAD_HANDLE,      /* the passed-in handle is not a valid CURLM handle */
+    CURLM_BAD_EASY_HANDLE, /* an easy handle was not good/valid */
+    CURLM_OUT_OF_MEMORY,   /* if you ever get this, you're in deep sh*t */
+    CURLM_INTERNAL_ERROR,  /* this is a libcurl bug */
+    CURLM_BAD_SOCKET,      /* the passed in socket argument did not match */
+    CURLM_UNKNOWN_OPTION,  /* curl_multi_setopt() with unsupported option */
+    CURLM_ADDED_ALREADY,   /* an easy handle already added to a multi handle was
+                              attempted to get added - again */
+    CURLM_LAST
+} CURLMcode;
+
+typedef enum {
+    CURLMSG_NONE, /* first, not used */
+    CURLMSG_DONE, /* This easy handle has completed. 'result' contains
+                     the CURLcode of the transfer */
+    CURLMSG_LAST  /* last, not used */
+} CURLMSG;
+
+struct CURLMsg {
+    CURLMSG msg;       /* what this message means */
+    CURL *easy_handle; /* the handle it concerns */
+    union {
+        void *whatever;    /* message-specific data */
+        CURLcode result;   /* return code for transfer */
+    } data;
+};
+typedef struct CURLMsg CURLMsg;
+
+typedef int curl_socket_t;
+
+/* Based on poll(2) structure and values */
+#define CURL_WAIT_POLLIN    0x0001
+#define CURL_WAIT_POLLPRI   0x0002
+#define CURL_WAIT_POLLOUT   0x0004
+
+struct curl_waitfd {
+    curl_socket_t fd;
+    short events;
+    short revents; /* set by curl_multi_wait() */
+};
+
+#define CURL_SOCKET_BAD -1
+#define CURL_SOCKET_TIMEOUT CURL_SOCKET_BAD
+
+/* What the socket callback is told to wait for */
+#define CURL_POLL_NONE   0
+#define CURL_POLL_IN     1
+#define CURL_POLL_OUT    2
+#define CURL_POLL_INOUT  3
+#define CURL_POLL_REMOVE 4
+
+/* What curl_multi_socket_action() is told the socket is ready for */
+#define CURL_CSELECT_IN   0x01
+#define CURL_CSELECT_OUT  0x02
+#define CURL_CSELECT_ERR  0x04
+
+typedef int (*curl_socket_callback)(CURL *easy,
+                                    curl_socket_t s,
+                                    int what,
+                                    void *userp,
+                                    void *socketp);
+
+typedef int (*curl_multi_timer_callback)(CURLM *multi,
+                                         long timeout_ms,
+                                         void *userp);
+
+typedef enum {
+    /* Called when the sockets to wait on, or what for, change */
+    CURLMOPT_SOCKETFUNCTION = CURLOPTTYPE_FUNCTIONPOINT + 1,
+    CURLMOPT_SOCKETDATA = CURLOPTTYPE_OBJECTPOINT + 2,
+    /* Called when the time to call curl_multi_socket_action() changes */
+    CURLMOPT_TIMERFUNCTION = CURLOPTTYPE_FUNCTIONPOINT + 4,
+    CURLMOPT_TIMERDATA = CURLOPTTYPE_OBJECTPOINT + 5
+} CURLMoption;
+
+CURL_EXTERN CURLM *curl_multi_init(void);
+CURL_EXTERN CURLMcode curl_multi_setopt(CURLM *multi_handle, CURLMoption option, ...);
+CURL_EXTERN CURLMcode curl_multi_add_handle(CURLM *multi_handle, CURL *curl_handle);
+CURL_EXTERN CURLMcode curl_multi_remove_handle(CURLM *multi_handle, CURL *curl_handle);
+CURL_EXTERN CURLMcode curl_multi_perform(CURLM *multi_handle, int *running_handles);
+CURL_EXTERN CURLMcode curl_multi_wait(CURLM *multi_handle, struct curl_waitfd extra_fds[],
+                                      unsigned int extra_nfds, int timeout_ms, int *ret);
+CURL_EXTERN CURLMcode curl_multi_timeout(CURLM *multi_handle, long *milliseconds);
+CURL_EXTERN CURLMcode curl_multi_socket_action(CURLM *multi_handle, curl_socket_t s,
+                                               int ev_bitmask, int *running_handles);
+CURL_EXTERN CURLMsg *curl_multi_info_read(CURLM *multi_handle, int *msgs_in_queue);
+CURL_EXTERN CURLMcode curl_multi_cleanup(CURLM *multi_handle);
+CURL_EXTERN const char *curl_multi_strerror(CURLMcode error);
+
 
 #ifdef  __cplusplus
 }
@@ -51,6 +51,8 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
+#include <zlib.h>
 #include "murl_lcl.h"
 #include "http_parser.h"
 
@@ -61,14 +63,7 @@
 //       use cases.
 #define MAX_HEADERS 64
 #define MAX_ELEMENT_SIZE 64*1024
-#define MAX_BODY_SIZE 64*1024*1024
-
-/*
- * Using this global variable to track when all the HTTP data has been 
- * parsed.  This will need to be addressed if/when thread-safety is
- * desired.
- */
-static int currently_parsing_eof;
+#define INFLATE_CHUNK_SZ 16*1024
 
 typedef struct message {
     const char *name; // for debugging purposes
@@ -80,7 +75,6 @@ typedef struct message {
     char request_url[MAX_ELEMENT_SIZE];
     char fragment[MAX_ELEMENT_SIZE];
     char query_string[MAX_ELEMENT_SIZE];
-    char body[MAX_BODY_SIZE];
     size_t body_size;
     int num_headers;
     enum { NONE=0, FIELD, VALUE } last_header_element;
@@ -96,6 +90,15 @@ typedef struct message {
     int headers_complete_cb_called;
     int message_complete_cb_called;
     int message_complete_on_eof;
+    int currently_parsing_eof; /* set while the end of the data is parsed */
+
+    /* The body is passed to the user of this handle as it arrives */
+    SessionHandle *ctx;
+    CURLcode error;        /* why a callback stopped the parser */
+    int inflating;         /* 1 while decompressing the body */
+    int inflate_raw;       /* 1 once deflate data was found to lack the zlib wrapper */
+    int inflate_done;      /* 1 once the end of the compressed data was reached */
+    z_stream zs;
 } http_msg;
 
 int request_path_cb (http_parser *p, const char *buf, size_t len)
@@ -189,17 +192,98 @@ int header_value_cb (http_parser *p, const char *buf, size_t len)
     return 0;
 }
 
+/*
+ * Pass the next len bytes of the body to the user of the handle.
+ *
+ * Returns 0 on success, -1 if the user didn't take the data.
+ */
+static int murl_http_write_body (http_msg *msg, const char *buf, size_t len)
+{
+    SessionHandle *ctx = msg->ctx;
+
+    if (!len || !ctx->write_func) {
+        return 0;
+    }
+    if ((ctx->write_func)((char *)buf, 1, len, ctx->write_ctx) != len) {
+        msg->error = CURLE_WRITE_ERROR;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Decompress the next len bytes of the body and pass the result to
+ * the user, one INFLATE_CHUNK_SZ piece at a time.  The window bits
+ * ask zlib to detect a gzip or zlib header.  Some servers send
+ * deflate data without the zlib wrapper, which is only found out
+ * by the first bytes of the body, so those are decompressed again
+ * as raw deflate data.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+static int murl_http_inflate_body (http_msg *msg, const char *buf, size_t len)
+{
+    char out[INFLATE_CHUNK_SZ];
+    int first = (msg->zs.total_in == 0);
+    int zrv;
+
+    if (msg->inflate_done) {
+        /* Anything after the compressed data is ignored */
+        return 0;
+    }
+    msg->zs.next_in = (Bytef *)buf;
+    msg->zs.avail_in = len;
+    do {
+        msg->zs.next_out = (Bytef *)out;
+        msg->zs.avail_out = sizeof(out);
+        zrv = inflate(&msg->zs, Z_NO_FLUSH);
+        if (zrv == Z_BUF_ERROR) {
+            /* All the output so far was passed on, wait for more input */
+            break;
+        }
+        if (zrv == Z_DATA_ERROR && first && !msg->zs.total_out && !msg->inflate_raw) {
+            inflateEnd(&msg->zs);
+            memset(&msg->zs, 0, sizeof(msg->zs));
+            if (inflateInit2(&msg->zs, -15) != Z_OK) {
+                msg->inflating = 0;
+                msg->error = CURLE_OUT_OF_MEMORY;
+                return -1;
+            }
+            msg->inflate_raw = 1;
+            return murl_http_inflate_body(msg, buf, len);
+        }
+        if (zrv != Z_OK && zrv != Z_STREAM_END) {
+            fprintf(stderr, "Unable to decode the HTTP body\n");
+            msg->error = CURLE_BAD_CONTENT_ENCODING;
+            return -1;
+        }
+        if (murl_http_write_body(msg, out, sizeof(out) - msg->zs.avail_out)) {
+            return -1;
+        }
+        if (zrv == Z_STREAM_END) {
+            msg->inflate_done = 1;
+            break;
+        }
+    } while (msg->zs.avail_in || !msg->zs.avail_out);
+    return 0;
+}
+
 int body_cb (http_parser *p, const char *buf, size_t len)
 {
     http_msg *msg = p->data;
+    int rv;
 
-    if (msg->body_size + len >= MAX_BODY_SIZE) {
-        fprintf(stderr, "Maximum HTTP body size exceeded\n");
-        return -1;
+    /*
+     * The parser already took off the chunked transfer encoding, if
+     * any, so this is the body itself.
+     */
+    if (msg->inflating) {
+        rv = murl_http_inflate_body(msg, buf, len);
+    } else {
+        rv = murl_http_write_body(msg, buf, len);
     }
-    strncat(msg->body, buf, len);
     msg->body_size += len;
-    return 0;
+    return rv;
 }
 
 int count_body_cb (http_parser *p, const char *buf, size_t len)
@@ -218,6 +302,49 @@ int message_begin_cb (http_parser *p)
     return 0;
 }
 
+/*
+ * Returns the value of the named header in the response, or NULL
+ */
+static const char *murl_http_get_header (http_msg *msg, const char *name)
+{
+    int i;
+
+    for (i=0; i<msg->num_headers; i++) {
+	if (!strcasecmp(msg->headers[i][0], name)) {
+	    return msg->headers[i][1];
+	}
+    }
+    return NULL;
+}
+
+/*
+ * Once the headers were parsed, get ready to decompress the body if
+ * it's encoded the way the user asked for.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+static int murl_http_start_decoding (http_msg *msg)
+{
+    const char *encoding;
+
+    encoding = murl_http_get_header(msg, "Content-Encoding");
+    if (!msg->ctx->accept_encoding || !encoding || !strcasecmp(encoding, "identity")) {
+        return 0;
+    }
+    if (strcasecmp(encoding, "gzip") && strcasecmp(encoding, "x-gzip") &&
+        strcasecmp(encoding, "deflate")) {
+        fprintf(stderr, "Unsupported Content-Encoding: %s\n", encoding);
+        msg->error = CURLE_BAD_CONTENT_ENCODING;
+        return -1;
+    }
+    if (inflateInit2(&msg->zs, 15 + 32) != Z_OK) {
+        msg->error = CURLE_OUT_OF_MEMORY;
+        return -1;
+    }
+    msg->inflating = 1;
+    return 0;
+}
+
 int headers_complete_cb (http_parser *p)
 {
     http_msg *msg = p->data;
@@ -228,7 +355,7 @@ int headers_complete_cb (http_parser *p)
     msg->http_minor = p->http_minor;
     msg->headers_complete_cb_called = 1;
     msg->should_keep_alive = http_should_keep_alive(p);
-    return 0;
+    return murl_http_start_decoding(msg);
 }
 
 int message_complete_cb (http_parser *p)
@@ -244,7 +371,7 @@ int message_complete_cb (http_parser *p)
     }
     msg->message_complete_cb_called = 1;
 
-    msg->message_complete_on_eof = currently_parsing_eof;
+    msg->message_complete_on_eof = msg->currently_parsing_eof;
 
     return 0;
 }
@@ -287,88 +414,117 @@ void murl_http_parser_free (http_parser *parser)
 size_t murl_http_parse (http_parser *parser, const char *buf, size_t len)
 {
     size_t nparsed;
-    currently_parsing_eof = (len == 0);
+    http_msg *msg = parser->data;
+
+    /* Tracked per message so several threads can be parsing at once */
+    msg->currently_parsing_eof = (len == 0);
     nparsed = http_parser_execute(parser, &settings, buf, len);
     return nparsed;
 }
 
 /*
- * This routine will perform HTTP parsing on the data provided.
+ * Release the state of the response being parsed, if any.
+ */
+void murl_http_response_free (SessionHandle *ctx)
+{
+    if (ctx->http_parser) {
+	murl_http_parser_free(ctx->http_parser);
+	ctx->http_parser = NULL;
+    }
+    if (ctx->http_msg) {
+	if (ctx->http_msg->inflating) {
+	    inflateEnd(&ctx->http_msg->zs);
+	}
+	free(ctx->http_msg);
+	ctx->http_msg = NULL;
+    }
+}
+
+/*
+ * Get ready to parse the next response from the server.  A new
+ * parser is used for each response, even when the connection is
+ * reused.
  *
- * Returns 0 on success, non-zero on error.
+ * Returns CURLE_OK on success, or the error.
  */
-int murl_http_parse_response (SessionHandle *ctx, const char *buf)
+CURLcode murl_http_response_begin (SessionHandle *ctx)
 {
-    size_t parsed;
-    int rv;
-    int len;
-    http_parser *parser;
-    http_msg *msg;
+    murl_http_response_free(ctx);
 
-    msg = calloc(1, sizeof(http_msg));
-    if (!msg) {
+    ctx->http_msg = calloc(1, sizeof(http_msg));
+    if (!ctx->http_msg) {
         fprintf(stderr, "malloc failed (%s)\n", __FUNCTION__);
-	return 1;
+	return CURLE_OUT_OF_MEMORY;
     }
-
-    /*
-     * Initialize the parser
-     */
-    parser = murl_http_parser_init(HTTP_RESPONSE, msg);
-    if (!parser) {
+    ctx->http_msg->ctx = ctx;
+    ctx->http_parser = murl_http_parser_init(HTTP_RESPONSE, ctx->http_msg);
+    if (!ctx->http_parser) {
         fprintf(stderr, "murl_http_parser_init failed (%s)\n", __FUNCTION__);
-	free(msg);
-	return 1;
+	murl_http_response_free(ctx);
+	return CURLE_OUT_OF_MEMORY;
     }
+    return CURLE_OK;
+}
 
-    /*
-     * Parse the data
-     */
-    parsed = murl_http_parse(parser, buf, strlen(buf));
+/*
+ * This routine will perform HTTP parsing on the len bytes of data
+ * provided, which are the next ones received from the server.  A len
+ * of zero tells the parser the server closed the connection.  Since
+ * the connection stays open with HTTP/1.1, done is set once the
+ * whole response has been parsed.  When the server closed the
+ * connection before that, done is left clear for the caller to fail
+ * the transfer with CURLE_PARTIAL_FILE.
+ *
+ * The body is passed to the write callback of the handle as it is
+ * parsed, decompressed if the user asked for a compressed response.
+ *
+ * Returns CURLE_OK on success, or the error.
+ */
+CURLcode murl_http_response_feed (SessionHandle *ctx, const char *buf, int len, int *done)
+{
+    size_t parsed;
 
-    /*
-     * check that all of it was parsed
-     */
-    rv = (parsed == strlen(buf));
-    parsed = murl_http_parse(parser, NULL, 0);
-    rv &= (parsed == 0);
+    parsed = murl_http_parse(ctx->http_parser, buf, len);
+    if (!len && parsed) {
+	/* Closed in the middle of the response */
+	*done = 0;
+	return CURLE_OK;
+    }
 
     /*
-     * Save the HTTP status code sent by the server
+     * check that all of it was parsed
      */
-    ctx->http_status_code = parser->status_code;
-    murl_http_parser_free(parser);
-
-    if (!rv) {
+    if (parsed != (size_t)len) {
+	if (ctx->http_msg->error != CURLE_OK) {
+	    return ctx->http_msg->error;
+	}
         fprintf(stderr, "HTTP parsing failed\n");
-	free(msg);
-        return 1;
-    }
-
-    len = msg->body_size;
-    if (ctx->recv_buf) {
-	free(ctx->recv_buf); 
-	ctx->recv_buf = NULL;
-	ctx->recv_ctr = 0;
-    }
-    ctx->recv_buf = calloc(1, len+1);
-    if (!ctx->recv_buf) {
-        fprintf(stderr, "\nmalloc failed in curl write reg func\n");
-	free(msg);
-        return 1;
+        return CURLE_HTTP2;
     }
-
-    /*
-     * Copy the data to the Murl context
-     */
-    memcpy(ctx->recv_buf, msg->body, len);
-    ctx->recv_buf[len] = 0;
-    ctx->recv_ctr += len;
-    free(msg);
-
-    return 0;
+    *done = ctx->http_msg->message_complete_cb_called;
+    return CURLE_OK;
 }
 
+/*
+ * Once the whole response was parsed, save the HTTP status code sent
+ * by the server.  keep_alive is set when the server left the
+ * connection open for the next request.
+ *
+ * Returns CURLE_OK on success, or the error.
+ */
+CURLcode murl_http_response_finish (SessionHandle *ctx, int *keep_alive)
+{
+    http_msg *msg = ctx->http_msg;
+    CURLcode crv = CURLE_OK;
 
+    ctx->http_status_code = ctx->http_parser->status_code;
+    *keep_alive = msg->should_keep_alive;
 
+    if (msg->inflating && msg->body_size && !msg->inflate_done) {
+	fprintf(stderr, "Unable to decode the HTTP body\n");
+	crv = CURLE_BAD_CONTENT_ENCODING;
+    }
+    murl_http_response_free(ctx);
 
+    return crv;
+}
@@ -36,10 +36,49 @@ extern "C" {
 #define MURL_POST_MAX	64*1024*1024
 /* Maximum size of HTTP request, minus the POST data */
 #define MURL_HDR_MAX	64*1024
-#define MURL_RCV_MAX	MURL_POST_MAX
 
 #define MURL_HOSTNAME_MAX   256
 
+/* Encodings murl can decode, asked for when CURLOPT_ACCEPT_ENCODING is "" */
+#define MURL_ACCEPT_ENCODING	"gzip, deflate"
+
+/*
+ * An SSL_CTX shared by the handles using the same TLS settings, so
+ * the trust anchors and client certificate are only loaded once.
+ * The last TLS session with a server is kept to be resumed by the
+ * next connection to it.  A resumed handshake doesn't check the
+ * certificate again, so the session is only resumed by a handle
+ * expecting the same name it was verified for.
+ */
+typedef struct murl_ssl_ctx_ {
+    SSL_CTX		    *ssl_ctx;
+    char		    *ca_file; /* NULL unless the peer is verified */
+    char		    *cert_file;
+    char		    *key_file;
+    int			    verify_peer;
+    int			    verify_hostname;
+    int			    refs; /* handles using the SSL_CTX */
+    SSL_SESSION		    *session;
+    char		    session_host[MURL_HOSTNAME_MAX];
+    int			    session_port;
+    char		    session_name[MURL_HOSTNAME_MAX]; /* name verified, "" if none */
+    struct murl_ssl_ctx_    *next;
+} MURL_SSL_CTX;
+
+/*
+ * Where the request of a handle is at, see murl_xfer_perform()
+ */
+typedef enum {
+    MURL_XFER_IDLE = 0,	/* no request started */
+    MURL_XFER_CONNECT,	/* TCP connection being opened */
+    MURL_XFER_HANDSHAKE,	/* TLS handshake */
+    MURL_XFER_SEND,	/* sending the request */
+    MURL_XFER_RECV,	/* reading the response */
+    MURL_XFER_DONE	/* finished, with xfer_result */
+} MURL_XFER_STATE;
+
+struct murl_multi_;
+
 /*
  * Local murl context for a session
  */
@@ -60,20 +99,69 @@ typedef struct SessionHandle_ {
     char		    *ssl_key_type;  /* "PEM" and "DER" are valid values */
     void		    *write_ctx;
     struct curl_slist	    *headers;
+    char		    *accept_encoding; /* NULL to not ask for compressed responses */
     curl_write_callback	    write_func;
 
-    SSL	*ssl;
+    MURL_SSL_CTX	*ssl_ctx; /* shared with other handles, see murl_ssl_ctx_get() */
+
+    /* The connection to the server, kept open between requests */
+    SSL			*ssl;
+    char		conn_host[MURL_HOSTNAME_MAX]; /* server the connection is to */
+    int			conn_port;
 
     /* The following members are for HTTP parsing */
     int			http_status_code;  /* HTTP response from server */
-    char		*recv_buf;
-    int			recv_ctr;
     char		path_segment[256]; //FIXME: use a pointer
     char		host_name[MURL_HOSTNAME_MAX]; //FIXME: use a pointer
     int			server_port;
+    struct message	*http_msg; /* response being parsed */
+    struct http_parser	*http_parser;
+
+    /* The request in progress, driven without blocking */
+    MURL_XFER_STATE	xfer_state;
+    CURLcode		xfer_result;
+    char		*req; /* the headers followed by the POST data */
+    int			req_len;
+    int			req_sent;
+    int			reused; /* sent on a connection kept from before */
+    int			received; /* something came back from the server */
+    int			sock; /* socket being connected, -1 if none */
+    struct addrinfo	*addrs; /* server addresses left to try */
+    struct addrinfo	*next_addr;
+    short		want; /* POLLIN or POLLOUT to wait for, zero if not waiting */
+
+    void		*private_data;
+
+    /* Set while the handle is in a multi handle */
+    struct murl_multi_	*multi;
+    struct SessionHandle_ *multi_next;
+    CURLMsg		multi_msg;
+    int			msg_read; /* the done message was handed out */
+    int			sock_fd; /* socket handed to the socket callback */
+    int			sock_what; /* CURL_POLL_* it was handed with, zero if none */
 } SessionHandle;
 
-int murl_http_parse_response(SessionHandle *ctx, const char *buf);
+/*
+ * Local murl context for a multi handle
+ */
+typedef struct murl_multi_ {
+    SessionHandle	*easy; /* the handles added */
+    curl_socket_callback socket_func;
+    void		*socket_data;
+    curl_multi_timer_callback timer_func;
+    void		*timer_data;
+    long		timer; /* timeout last handed to the timer callback */
+} MURL_MULTI;
+
+CURLcode murl_http_response_begin(SessionHandle *ctx);
+CURLcode murl_http_response_feed(SessionHandle *ctx, const char *buf, int len, int *done);
+CURLcode murl_http_response_finish(SessionHandle *ctx, int *keep_alive);
+void murl_http_response_free(SessionHandle *ctx);
+
+CURLcode murl_xfer_start(SessionHandle *ctx);
+CURLcode murl_xfer_perform(SessionHandle *ctx);
+int murl_xfer_fd(SessionHandle *ctx);
+void murl_xfer_abort(SessionHandle *ctx);
 
 #ifdef  __cplusplus
 }
@@ -0,0 +1,463 @@
+/*
+   Copyright (c) 2016, Cisco Systems, Inc.
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without modification,
+   are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+   DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+   FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+   DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+   CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+   OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+   USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * The subset of the Curl multi interface provided by murl.  The
+ * requests of all the handles added to a multi handle are moved along
+ * without blocking by curl_multi_perform(), and curl_multi_wait()
+ * waits on all their sockets at once with poll().  Applications with
+ * their own event loop instead set CURLMOPT_SOCKETFUNCTION and
+ * CURLMOPT_TIMERFUNCTION to be told which sockets to wait on, and
+ * call curl_multi_socket_action().  A multi handle must only be used
+ * by one thread at a time.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <poll.h>
+#include "murl.h"
+#include "murl_lcl.h"
+
+CURLM *curl_multi_init(void)
+{
+    MURL_MULTI *multi;
+
+    multi = calloc(1, sizeof(MURL_MULTI));
+    if (multi) {
+	multi->timer = -1;
+    }
+    return multi;
+}
+
+CURLMcode curl_multi_setopt(CURLM *multi_handle, CURLMoption option, ...)
+{
+    MURL_MULTI *multi = (MURL_MULTI *)multi_handle;
+    CURLMcode rv = CURLM_OK;
+    va_list arg;
+
+    if (!multi) {
+	return CURLM_BAD_HANDLE;
+    }
+    va_start(arg, option);
+    switch (option) {
+    case CURLMOPT_SOCKETFUNCTION:
+	multi->socket_func = va_arg(arg, curl_socket_callback);
+	break;
+    case CURLMOPT_SOCKETDATA:
+	multi->socket_data = va_arg(arg, void *);
+	break;
+    case CURLMOPT_TIMERFUNCTION:
+	multi->timer_func = va_arg(arg, curl_multi_timer_callback);
+	break;
+    case CURLMOPT_TIMERDATA:
+	multi->timer_data = va_arg(arg, void *);
+	break;
+    default:
+	rv = CURLM_UNKNOWN_OPTION;
+	break;
+    }
+    va_end(arg);
+    return rv;
+}
+
+/*
+ * The socket the request of a handle waits on and what for, as
+ * CURL_POLL_* flags, or zero if it isn't waiting on its socket.
+ */
+static int murl_multi_want(SessionHandle *ctx, int *fd)
+{
+    int what = 0;
+
+    *fd = -1;
+    if (ctx->xfer_state == MURL_XFER_DONE || !ctx->want) {
+	return 0;
+    }
+    *fd = murl_xfer_fd(ctx);
+    if (*fd < 0) {
+	return 0;
+    }
+    if (ctx->want & POLLIN) what |= CURL_POLL_IN;
+    if (ctx->want & POLLOUT) what |= CURL_POLL_OUT;
+    return what;
+}
+
+/*
+ * Tell the socket callback about the sockets that the requests no
+ * longer wait on, then about the ones they now wait on, so a socket
+ * number that went from one handle to another is not left out.  The
+ * timer callback is told to have curl_multi_socket_action() called
+ * right away while a request can be moved along without waiting.
+ */
+static void murl_multi_update(MURL_MULTI *multi)
+{
+    SessionHandle *ctx;
+    long timer = -1;
+    int fd, what;
+
+    if (multi->socket_func) {
+	for (ctx = multi->easy; ctx; ctx = ctx->multi_next) {
+	    what = murl_multi_want(ctx, &fd);
+	    if (ctx->sock_what && (!what || fd != ctx->sock_fd)) {
+		(multi->socket_func)(ctx, ctx->sock_fd, CURL_POLL_REMOVE, multi->socket_data, NULL);
+		ctx->sock_what = 0;
+	    }
+	}
+	for (ctx = multi->easy; ctx; ctx = ctx->multi_next) {
+	    what = murl_multi_want(ctx, &fd);
+	    if (what && what != ctx->sock_what) {
+		(multi->socket_func)(ctx, fd, what, multi->socket_data, NULL);
+		ctx->sock_fd = fd;
+		ctx->sock_what = what;
+	    }
+	}
+    }
+    for (ctx = multi->easy; ctx; ctx = ctx->multi_next) {
+	if (ctx->xfer_state != MURL_XFER_DONE && !ctx->want) {
+	    timer = 0;
+	    break;
+	}
+    }
+    if (multi->timer_func && timer != multi->timer) {
+	multi->timer = timer;
+	(multi->timer_func)(multi, timer, multi->timer_data);
+    }
+}
+
+/*
+ * The request set up on the handle is started right away, and
+ * carried on by curl_multi_perform().
+ */
+CURLMcode curl_multi_add_handle(CURLM *multi_handle, CURL *curl_handle)
+{
+    MURL_MULTI *multi = (MURL_MULTI *)multi_handle;
+    SessionHandle *ctx = (SessionHandle *)curl_handle;
+
+    if (!multi) {
+	return CURLM_BAD_HANDLE;
+    }
+    if (!ctx) {
+	return CURLM_BAD_EASY_HANDLE;
+    }
+    if (ctx->multi) {
+	return CURLM_ADDED_ALREADY;
+    }
+    ctx->multi = multi;
+    ctx->msg_read = 0;
+    ctx->sock_what = 0;
+    ctx->multi_next = multi->easy;
+    multi->easy = ctx;
+
+    /* A request that fails to start is reported as done */
+    murl_xfer_start(ctx);
+    murl_multi_update(multi);
+    return CURLM_OK;
+}
+
+/*
+ * A request that didn't finish is dropped along with its connection.
+ */
+CURLMcode curl_multi_remove_handle(CURLM *multi_handle, CURL *curl_handle)
+{
+    MURL_MULTI *multi = (MURL_MULTI *)multi_handle;
+    SessionHandle *ctx = (SessionHandle *)curl_handle;
+    SessionHandle **prev;
+
+    if (!multi) {
+	return CURLM_BAD_HANDLE;
+    }
+    if (!ctx) {
+	return CURLM_BAD_EASY_HANDLE;
+    }
+    if (ctx->multi != multi) {
+	/* Not in this multi handle, nothing to do */
+	return CURLM_OK;
+    }
+    if (ctx->sock_what && multi->socket_func) {
+	(multi->socket_func)(ctx, ctx->sock_fd, CURL_POLL_REMOVE, multi->socket_data, NULL);
+    }
+    ctx->sock_what = 0;
+    for (prev = &multi->easy; *prev; prev = &(*prev)->multi_next) {
+	if (*prev == ctx) {
+	    *prev = ctx->multi_next;
+	    break;
+	}
+    }
+    murl_xfer_abort(ctx);
+    ctx->multi = NULL;
+    ctx->multi_next = NULL;
+    return CURLM_OK;
+}
+
+CURLMcode curl_multi_perform(CURLM *multi_handle, int *running_handles)
+{
+    MURL_MULTI *multi = (MURL_MULTI *)multi_handle;
+    SessionHandle *ctx;
+    int running = 0;
+
+    if (!multi) {
+	return CURLM_BAD_HANDLE;
+    }
+    for (ctx = multi->easy; ctx; ctx = ctx->multi_next) {
+	if (ctx->xfer_state == MURL_XFER_DONE) {
+	    continue;
+	}
+	if (murl_xfer_perform(ctx) == CURLE_AGAIN) {
+	    running++;
+	}
+    }
+    murl_multi_update(multi);
+    if (running_handles) {
+	*running_handles = running;
+    }
+    return CURLM_OK;
+}
+
+/*
+ * Move along the requests waiting on socket s, or all of them when s
+ * is CURL_SOCKET_TIMEOUT.  Murl finds out what the socket is ready
+ * for by trying, so ev_bitmask is not needed.
+ */
+CURLMcode curl_multi_socket_action(CURLM *multi_handle, curl_socket_t s,
+                                   int ev_bitmask, int *running_handles)
+{
+    MURL_MULTI *multi = (MURL_MULTI *)multi_handle;
+    SessionHandle *ctx;
+    int running = 0;
+
+    (void)ev_bitmask;
+    if (!multi) {
+	return CURLM_BAD_HANDLE;
+    }
+    for (ctx = multi->easy; ctx; ctx = ctx->multi_next) {
+	if (ctx->xfer_state == MURL_XFER_DONE) {
+	    continue;
+	}
+	if (s == CURL_SOCKET_TIMEOUT || murl_xfer_fd(ctx) == s) {
+	    if (murl_xfer_perform(ctx) != CURLE_AGAIN) {
+		continue;
+	    }
+	}
+	running++;
+    }
+    murl_multi_update(multi);
+    if (running_handles) {
+	*running_handles = running;
+    }
+    return CURLM_OK;
+}
+
+/*
+ * Wait for one of the sockets of the requests in progress, or of the
+ * extra descriptors, to be ready, or for timeout_ms to expire.  This
+ * returns right away if there is nothing to wait for, or if a request
+ * can be moved along without waiting.
+ */
+CURLMcode curl_multi_wait(CURLM *multi_handle, struct curl_waitfd extra_fds[],
+                          unsigned int extra_nfds, int timeout_ms, int *ret)
+{
+    MURL_MULTI *multi = (MURL_MULTI *)multi_handle;
+    SessionHandle *ctx;
+    struct pollfd *pfds;
+    unsigned int i, nfds = 0;
+    int rv;
+
+    if (!multi) {
+	return CURLM_BAD_HANDLE;
+    }
+    if (ret) {
+	*ret = 0;
+    }
+    for (ctx = multi->easy; ctx; ctx = ctx->multi_next) {
+	if (ctx->xfer_state == MURL_XFER_DONE) {
+	    continue;
+	}
+	if (!ctx->want) {
+	    /* Not waiting for its socket */
+	    timeout_ms = 0;
+	}
+	nfds++;
+    }
+    nfds += extra_nfds;
+    if (!nfds) {
+	return CURLM_OK;
+    }
+
+    pfds = calloc(nfds, sizeof(struct pollfd));
+    if (!pfds) {
+	return CURLM_OUT_OF_MEMORY;
+    }
+    nfds = 0;
+    for (ctx = multi->easy; ctx; ctx = ctx->multi_next) {
+	if (ctx->xfer_state == MURL_XFER_DONE || !ctx->want) {
+	    continue;
+	}
+	pfds[nfds].fd = murl_xfer_fd(ctx);
+	pfds[nfds].events = ctx->want;
+	nfds++;
+    }
+    for (i = 0; i < extra_nfds; i++) {
+	pfds[nfds + i].fd = extra_fds[i].fd;
+	if (extra_fds[i].events & CURL_WAIT_POLLIN) pfds[nfds + i].events |= POLLIN;
+	if (extra_fds[i].events & CURL_WAIT_POLLPRI) pfds[nfds + i].events |= POLLPRI;
+	if (extra_fds[i].events & CURL_WAIT_POLLOUT) pfds[nfds + i].events |= POLLOUT;
+    }
+
+    rv = poll(pfds, nfds + extra_nfds, timeout_ms);
+    if (rv < 0) {
+	free(pfds);
+	return (errno == EINTR) ? CURLM_OK : CURLM_INTERNAL_ERROR;
+    }
+    for (i = 0; i < extra_nfds; i++) {
+	extra_fds[i].revents = 0;
+	if (pfds[nfds + i].revents & POLLIN) extra_fds[i].revents |= CURL_WAIT_POLLIN;
+	if (pfds[nfds + i].revents & POLLPRI) extra_fds[i].revents |= CURL_WAIT_POLLPRI;
+	if (pfds[nfds + i].revents & POLLOUT) extra_fds[i].revents |= CURL_WAIT_POLLOUT;
+    }
+    free(pfds);
+    if (ret) {
+	*ret = rv;
+    }
+    return CURLM_OK;
+}
+
+/*
+ * Murl has no timers, so curl_multi_perform() only needs to be called
+ * right away when a request can be moved along without waiting for
+ * its socket.  Otherwise this gives -1 and the caller waits for the
+ * sockets.
+ */
+CURLMcode curl_multi_timeout(CURLM *multi_handle, long *milliseconds)
+{
+    MURL_MULTI *multi = (MURL_MULTI *)multi_handle;
+    SessionHandle *ctx;
+
+    if (!multi) {
+	return CURLM_BAD_HANDLE;
+    }
+    *milliseconds = -1;
+    for (ctx = multi->easy; ctx; ctx = ctx->multi_next) {
+	if (ctx->xfer_state != MURL_XFER_DONE && !ctx->want) {
+	    *milliseconds = 0;
+	    break;
+	}
+    }
+    return CURLM_OK;
+}
+
+/*
+ * Hand out the message of the next request that finished.  The
+ * message is kept in the handle, it is valid until the handle is
+ * removed or cleaned up.
+ */
+CURLMsg *curl_multi_info_read(CURLM *multi_handle, int *msgs_in_queue)
+{
+    MURL_MULTI *multi = (MURL_MULTI *)multi_handle;
+    SessionHandle *ctx, *found = NULL;
+    int left = 0;
+
+    if (msgs_in_queue) {
+	*msgs_in_queue = 0;
+    }
+    if (!multi) {
+	return NULL;
+    }
+    for (ctx = multi->easy; ctx; ctx = ctx->multi_next) {
+	if (ctx->xfer_state != MURL_XFER_DONE || ctx->msg_read) {
+	    continue;
+	}
+	if (found) {
+	    left++;
+	} else {
+	    found = ctx;
+	}
+    }
+    if (!found) {
+	return NULL;
+    }
+    found->msg_read = 1;
+    found->multi_msg.msg = CURLMSG_DONE;
+    found->multi_msg.easy_handle = found;
+    found->multi_msg.data.result = found->xfer_result;
+    if (msgs_in_queue) {
+	*msgs_in_queue = left;
+    }
+    return &found->multi_msg;
+}
+
+/*
+ * As with Curl, the handles still in the multi handle are removed
+ * from it, but not cleaned up.
+ */
+CURLMcode curl_multi_cleanup(CURLM *multi_handle)
+{
+    MURL_MULTI *multi = (MURL_MULTI *)multi_handle;
+
+    if (!multi) {
+	return CURLM_BAD_HANDLE;
+    }
+    while (multi->easy) {
+	curl_multi_remove_handle(multi, multi->easy);
+    }
+    free(multi);
+    return CURLM_OK;
+}
+
+const char *curl_multi_strerror(CURLMcode error)
+{
+    switch (error) {
+    case CURLM_CALL_MULTI_PERFORM:
+        return "Please call curl_multi_perform() soon";
+
+    case CURLM_OK:
+        return "No error";
+
+    case CURLM_BAD_HANDLE:
+        return "Invalid multi handle";
+
+    case CURLM_BAD_EASY_HANDLE:
+        return "Invalid easy handle";
+
+    case CURLM_OUT_OF_MEMORY:
+        return "Out of memory";
+
+    case CURLM_INTERNAL_ERROR:
+        return "Internal error";
+
+    case CURLM_BAD_SOCKET:
+        return "Invalid socket argument";
+
+    case CURLM_UNKNOWN_OPTION:
+        return "Unknown option";
+
+    case CURLM_ADDED_ALREADY:
+        return "The easy handle is already added to a multi handle";
+
+    case CURLM_LAST:
+        break;
+    }
+
+    return "Unknown error";
+}
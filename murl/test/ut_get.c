@@ -47,6 +47,8 @@ static int dumby_ctx = 0;
 static size_t test_murl_get_body_cb(void *ptr, size_t size, size_t nmemb, void *userdata)
 {
     int *usr_ctx = (int *)userdata;
+    size_t len;
+    char *tmp;
 
     /*
      * Set the user context to a non-zero value.  Later this is checked to
@@ -59,14 +61,19 @@ static size_t test_murl_get_body_cb(void *ptr, size_t size, size_t nmemb, void *
         return 0;
     }
 
-    if (http_response) free(http_response);
-    http_response = calloc(1, nmemb);
-    if (!http_response) {
+    /*
+     * The body may come in several pieces, append them
+     */
+    len = http_response ? strlen(http_response) : 0;
+    tmp = realloc(http_response, len + nmemb + 1);
+    if (!tmp) {
 	fprintf(stderr, "malloc failed (%s)\n", __FUNCTION__);
 	exit(1);
     }
+    http_response = tmp;
 
-    memcpy(http_response, ptr, nmemb);
+    memcpy(http_response + len, ptr, nmemb);
+    http_response[len + nmemb] = 0;
 
     //printf("%s", (char *)ptr);
 
@@ -378,6 +385,68 @@ static int test_murl_missing_slash(void)
 }
 
 
+/*
+ * This function performs an HTTP GET using httpbin.org
+ * with a gzip compressed response.  The response should
+ * be decompressed by Murl before it's handed to us.
+ *
+ * Returns zero on success, non-zero on failure
+ */
+static int test_murl_gzip_get(void)
+{
+    CURL *hnd;
+    int rv = -1;
+    CURLcode crv;
+    long http_code = 0;
+    JSON_Value *val = NULL;
+
+    printf("\nTesting Murl with a gzip compressed response...\n");
+
+    /*
+     * Setup Murl
+     */
+    hnd = curl_easy_init();
+    curl_easy_setopt(hnd, CURLOPT_URL, "https://httpbin.org/gzip");
+    curl_easy_setopt(hnd, CURLOPT_USERAGENT, "murl");
+    curl_easy_setopt(hnd, CURLOPT_CAINFO, PUBLIC_ROOTS);
+    curl_easy_setopt(hnd, CURLOPT_SSL_VERIFYPEER, 1L);
+    curl_easy_setopt(hnd, CURLOPT_ACCEPT_ENCODING, "");
+    curl_easy_setopt(hnd, CURLOPT_WRITEDATA, &dumby_ctx);
+    curl_easy_setopt(hnd, CURLOPT_WRITEFUNCTION, &test_murl_get_body_cb);
+
+    /*
+     * Send the HTTP GET request
+     */
+    crv = curl_easy_perform(hnd);
+    curl_easy_getinfo (hnd, CURLINFO_RESPONSE_CODE, &http_code);
+    if (crv != CURLE_OK) {
+	printf("test failed, crv=%d\n", crv);
+    } else if (http_code != 200) {
+	printf("Invalid HTTP response from server: %d\n", (int)http_code);
+    } else {
+	/*
+	 * The server says whether it compressed the response
+	 */
+	val = json_parse_string(http_response);
+	if (val && json_object_get_boolean(json_value_get_object(val), "gzipped") == 1) {
+	    rv = 0;
+	} else {
+	    printf("Unexpected response from server:\n%s\n", http_response);
+	}
+	json_value_free(val);
+    }
+
+    curl_easy_cleanup(hnd);
+    hnd = NULL;
+    if (http_response) {
+	free(http_response);
+	http_response = NULL;
+    }
+
+    LOG_RESULT(rv);
+    return rv;
+}
+
 /*
  * This is the main entry point into the HTTPS GET
  * test suite.
@@ -405,6 +474,12 @@ int test_murl_get (void)
     rv = test_murl_missing_slash();
     if (rv) any_failures = 1;
 
+    /*
+     * Test a compressed response
+     */
+    rv = test_murl_gzip_get();
+    if (rv) any_failures = 1;
+
     return any_failures;
 }
 
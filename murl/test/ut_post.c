@@ -26,19 +26,27 @@ static char *http_response = NULL;
 
 static size_t test_murl_post_body_cb(void *ptr, size_t size, size_t nmemb, void *userdata)
 {
+    size_t len;
+    char *tmp;
+
     if (size != 1) {
         fprintf(stderr, "ERROR: murl size not 1 (%s)\n", __FUNCTION__);
         return 0;
     }
 
-    if (http_response) free(http_response);
-    http_response = calloc(1, nmemb);
-    if (!http_response) {
+    /*
+     * The body may come in several pieces, append them
+     */
+    len = http_response ? strlen(http_response) : 0;
+    tmp = realloc(http_response, len + nmemb + 1);
+    if (!tmp) {
 	fprintf(stderr, "malloc failed (%s)\n", __FUNCTION__);
 	exit(1);
     }
+    http_response = tmp;
 
-    memcpy(http_response, ptr, nmemb);
+    memcpy(http_response + len, ptr, nmemb);
+    http_response[len + nmemb] = 0;
 
     //printf("%s", (char *)ptr);
 
@@ -76,6 +84,14 @@ static int test_murl_post_http_post(char *url, char *post_data)
      */
     curl_easy_setopt(hnd, CURLOPT_WRITEFUNCTION, &test_murl_post_body_cb);
 
+    /*
+     * Forget the response to the last request
+     */
+    if (http_response) {
+	free(http_response);
+	http_response = NULL;
+    }
+
     /*
      * Send the HTTP GET request
      */
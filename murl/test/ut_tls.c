@@ -12,18 +12,25 @@ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
 */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <pthread.h>
 #include <unistd.h>
+#include <time.h>
 #include <openssl/ssl.h>
 #include <openssl/bio.h>
 #include <openssl/err.h>
+#include <openssl/x509v3.h>
+#include <zlib.h>
 #include <murl/murl.h>
 #include "parson.h"
 #include "ut_lcl.h"
 #include <sys/types.h> 
 #include <sys/socket.h>
 #include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
 
 #define SERVER_IP   "127.0.0.1"
 #define SERVER_PORT 29516
@@ -597,6 +604,1339 @@ static int test_murl_ipv6_address(void)
     return rv;
 }
 
+/*
+ * The stress test uses its own TLS server, since it has to take
+ * many connections at once.  Each connection is served by a thread
+ * of its own and can carry any number of requests.  A GET is answered
+ * with the path of the URL and a POST with the body it carried.  A
+ * gzip encoded body is decoded and sent back gzip encoded again.  The
+ * GETs of the STRESS_FRAMED_* paths are answered with a framed body
+ * instead, see stress_send_framed().  When stress_close_after is set,
+ * the server closes each connection after that many requests.
+ * The server certificate is made when the server starts, for
+ * localhost, so it can be verified however old the test certs are.
+ */
+#define STRESS_PORT (SERVER_PORT + 1)
+#define STRESS_CLIENTS 8
+#define STRESS_REQUESTS 24
+#define STRESS_REQS_PER_HANDLE 6
+#define STRESS_BODY_MAX 40000
+#define STRESS_PATH_MAX 64
+#define STRESS_FRAMED_LEN 3000
+#define STRESS_FRAMED_CHUNKED "/framed/chunked"
+#define STRESS_FRAMED_CLOSE "/framed/close"
+#define STRESS_FRAMED_TRUNCATED "/framed/truncated"
+
+static SSL_CTX *stress_ssl_ctx;
+static char stress_ca_file[] = "/tmp/murl-ut-XXXXXX";
+static int stress_sock = -1;
+static int stress_conns;
+static int stress_resumed; /* handshakes that resumed a TLS session */
+static int stress_accepted; /* connections accepted */
+static int stress_close_after; /* requests served per connection, 0 for any number */
+static pthread_mutex_t stress_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Read up to the end of the headers of the next request, along with
+ * whatever follows them.
+ *
+ * Returns the length of the headers, or -1 once the client is gone.
+ */
+static int stress_read_headers(SSL *ssl, char *buf, int max, int *len)
+{
+    char *end;
+    int rv;
+
+    while (1) {
+	buf[*len] = 0;
+	end = strstr(buf, "\r\n\r\n");
+	if (end) {
+	    return end - buf + 4;
+	}
+	if (*len == max) {
+	    return -1;
+	}
+	rv = SSL_read(ssl, buf + *len, max - *len);
+	if (rv <= 0) {
+	    return -1;
+	}
+	*len += rv;
+    }
+}
+
+/*
+ * Gzip encode in_len bytes of in into out.
+ *
+ * Returns the length of the encoded data, or -1 if it doesn't fit
+ */
+static int stress_gzip(const char *in, int in_len, char *out, int max)
+{
+    z_stream zs;
+    int zrv;
+
+    memset(&zs, 0, sizeof(zs));
+    /* 16 more window bits asks for a gzip header and trailer */
+    if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+	             Z_DEFAULT_STRATEGY) != Z_OK) {
+	return -1;
+    }
+    zs.next_in = (Bytef *)in;
+    zs.avail_in = in_len;
+    zs.next_out = (Bytef *)out;
+    zs.avail_out = max;
+    zrv = deflate(&zs, Z_FINISH);
+    deflateEnd(&zs);
+    return zrv == Z_STREAM_END ? (int)zs.total_out : -1;
+}
+
+/*
+ * Decode the gzip encoded in_len bytes of in into out.
+ *
+ * Returns the length of the decoded data, or -1 on failure
+ */
+static int stress_gunzip(const char *in, int in_len, char *out, int max)
+{
+    z_stream zs;
+    int zrv;
+
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit2(&zs, 15 + 16) != Z_OK) {
+	return -1;
+    }
+    zs.next_in = (Bytef *)in;
+    zs.avail_in = in_len;
+    zs.next_out = (Bytef *)out;
+    zs.avail_out = max;
+    zrv = inflate(&zs, Z_FINISH);
+    inflateEnd(&zs);
+    return zrv == Z_STREAM_END ? (int)zs.total_out : -1;
+}
+
+/*
+ * The body of the STRESS_FRAMED_* responses.
+ */
+static void stress_framed_body(char *body)
+{
+    int i;
+
+    for (i = 0; i < STRESS_FRAMED_LEN; i++) {
+	body[i] = 'a' + (i * 3 + i / 26) % 26;
+    }
+}
+
+/*
+ * Write len bytes of data in a TLS record of its own, and wait a bit
+ * so the client reads it on its own.
+ */
+static void stress_write_piece(SSL *ssl, const char *data, int len)
+{
+    SSL_write(ssl, data, len);
+    usleep(5000);
+}
+
+/*
+ * Answer the GET of one of the STRESS_FRAMED_* paths, sending the
+ * response in small pieces so the client has to put it together
+ * across reads:
+ *  - chunked, with the chunk sizes and the chunks split over pieces
+ *  - without a length, the body ending when the connection is closed
+ *  - with a Content-Length larger than the body sent before closing
+ *
+ * Returns 1 when the connection must be closed, 0 when it may be kept,
+ * or -1 when path isn't one of them.
+ */
+static int stress_send_framed(SSL *ssl, const char *path, int path_len)
+{
+    char body[STRESS_FRAMED_LEN], hdr[128];
+    int i, n;
+
+    stress_framed_body(body);
+    if (path_len == strlen(STRESS_FRAMED_CHUNKED) &&
+	!strncmp(path, STRESS_FRAMED_CHUNKED, path_len)) {
+	strcpy(hdr, "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n");
+	stress_write_piece(ssl, hdr, strlen(hdr));
+	for (i = 0; i < STRESS_FRAMED_LEN; i += n) {
+	    n = STRESS_FRAMED_LEN - i < 1000 ? STRESS_FRAMED_LEN - i : 1000;
+	    snprintf(hdr, sizeof(hdr), "%x\r\n", n);
+	    /* Split the size line, then the chunk and its CRLF */
+	    stress_write_piece(ssl, hdr, 1);
+	    stress_write_piece(ssl, hdr + 1, strlen(hdr) - 1);
+	    stress_write_piece(ssl, body + i, n / 2);
+	    stress_write_piece(ssl, body + i + n / 2, n - n / 2);
+	    stress_write_piece(ssl, "\r", 1);
+	    stress_write_piece(ssl, "\n", 1);
+	}
+	stress_write_piece(ssl, "0\r\n", 3);
+	stress_write_piece(ssl, "\r\n", 2);
+	return 0;
+    }
+    if (path_len == strlen(STRESS_FRAMED_CLOSE) &&
+	!strncmp(path, STRESS_FRAMED_CLOSE, path_len)) {
+	strcpy(hdr, "HTTP/1.1 200 OK\r\nConnection: close\r\n\r\n");
+	stress_write_piece(ssl, hdr, strlen(hdr));
+	for (i = 0; i < STRESS_FRAMED_LEN; i += 1000) {
+	    stress_write_piece(ssl, body + i, 1000);
+	}
+	return 1;
+    }
+    if (path_len == strlen(STRESS_FRAMED_TRUNCATED) &&
+	!strncmp(path, STRESS_FRAMED_TRUNCATED, path_len)) {
+	snprintf(hdr, sizeof(hdr), "HTTP/1.1 200 OK\r\nContent-Length: %d\r\n\r\n",
+	         STRESS_FRAMED_LEN);
+	stress_write_piece(ssl, hdr, strlen(hdr));
+	stress_write_piece(ssl, body, STRESS_FRAMED_LEN / 2);
+	return 1;
+    }
+    return -1;
+}
+
+static void* stress_conn_thread (void *arg)
+{
+    int conn = (int)(long)arg;
+    SSL *ssl;
+    char *buf, *zbuf, *cl, *ce, *path_end, hdr[128];
+    int max = STRESS_BODY_MAX + 4096;
+    int len = 0, hlen, body_len, text_len, rv, served = 0;
+
+    buf = malloc(max + 1);
+    zbuf = malloc(2 * max);
+    ssl = SSL_new(stress_ssl_ctx);
+    if (!buf || !zbuf || !ssl) {
+	goto cleanup;
+    }
+    SSL_set_fd(ssl, conn);
+    if (SSL_accept(ssl) <= 0) {
+	goto cleanup;
+    }
+    if (SSL_session_reused(ssl)) {
+	pthread_mutex_lock(&stress_lock);
+	stress_resumed++;
+	pthread_mutex_unlock(&stress_lock);
+    }
+
+    while ((hlen = stress_read_headers(ssl, buf, max, &len)) > 0) {
+	cl = strstr(buf, "Content-Length: ");
+	body_len = (cl && cl < buf + hlen) ? atoi(cl + 16) : 0;
+	if (body_len < 0 || hlen + body_len > max) {
+	    break;
+	}
+	while (len < hlen + body_len) {
+	    rv = SSL_read(ssl, buf + len, max - len);
+	    if (rv <= 0) {
+		goto cleanup;
+	    }
+	    len += rv;
+	}
+
+	ce = strstr(buf, "Content-Encoding: gzip");
+	if (!strncmp(buf, "POST ", 5) && ce && ce < buf + hlen) {
+	    text_len = stress_gunzip(buf + hlen, body_len, zbuf, max);
+	    rv = text_len < 0 ? -1 : stress_gzip(zbuf, text_len, zbuf + max, max);
+	    if (rv < 0) {
+		break;
+	    }
+	    snprintf(hdr, sizeof(hdr), "HTTP/1.1 200 OK\r\nContent-Encoding: gzip\r\n"
+	             "Content-Length: %d\r\n\r\n", rv);
+	    SSL_write(ssl, hdr, strlen(hdr));
+	    SSL_write(ssl, zbuf + max, rv);
+	} else if (!strncmp(buf, "POST ", 5)) {
+	    snprintf(hdr, sizeof(hdr), "HTTP/1.1 200 OK\r\nContent-Length: %d\r\n\r\n", body_len);
+	    SSL_write(ssl, hdr, strlen(hdr));
+	    if (body_len) SSL_write(ssl, buf + hlen, body_len);
+	} else {
+	    path_end = strchr(buf + 4, ' ');
+	    if (strncmp(buf, "GET ", 4) || !path_end) {
+		break;
+	    }
+	    rv = stress_send_framed(ssl, buf + 4, path_end - buf - 4);
+	    if (rv > 0) {
+		break;
+	    }
+	    if (rv < 0) {
+		snprintf(hdr, sizeof(hdr), "HTTP/1.1 200 OK\r\nContent-Length: %d\r\n\r\n",
+		         (int)(path_end - buf - 4));
+		SSL_write(ssl, hdr, strlen(hdr));
+		SSL_write(ssl, buf + 4, path_end - buf - 4);
+	    }
+	}
+	if (++served == stress_close_after) {
+	    /* Give the next request the time to race with the close */
+	    usleep(20000);
+	    break;
+	}
+
+	/*
+	 * Keep what was read past this request for the next one
+	 */
+	len -= hlen + body_len;
+	memmove(buf, buf + hlen + body_len, len);
+    }
+
+cleanup:
+    if (ssl) {
+	SSL_shutdown(ssl);
+	SSL_free(ssl);
+    }
+    free(buf);
+    free(zbuf);
+    close(conn);
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+    ERR_remove_thread_state(NULL);
+#endif
+    pthread_mutex_lock(&stress_lock);
+    stress_conns--;
+    pthread_mutex_unlock(&stress_lock);
+    return NULL;
+}
+
+/*
+ * Accept connections until the listening socket is shut down.
+ */
+static void* stress_server_thread (void *arg)
+{
+    pthread_t thread;
+    int conn, on = 1;
+
+    while ((conn = accept(stress_sock, NULL, NULL)) >= 0) {
+	/* The headers and body are written apart, don't hold the body back */
+	setsockopt(conn, IPPROTO_TCP, TCP_NODELAY, (const char*)&on, sizeof(on));
+	pthread_mutex_lock(&stress_lock);
+	stress_conns++;
+	stress_accepted++;
+	pthread_mutex_unlock(&stress_lock);
+	if (pthread_create(&thread, NULL, stress_conn_thread, (void *)(long)conn)) {
+	    close(conn);
+	    pthread_mutex_lock(&stress_lock);
+	    stress_conns--;
+	    pthread_mutex_unlock(&stress_lock);
+	    continue;
+	}
+	pthread_detach(thread);
+    }
+    return NULL;
+}
+
+/*
+ * Make a self-signed P-256 certificate for localhost, valid for a day,
+ * for the server to use.  The certificate is also written to
+ * stress_ca_file, to be used as the trust anchor by the clients.
+ *
+ * Returns zero on success, non-zero on failure
+ */
+static int stress_make_cert(SSL_CTX *ssl_ctx)
+{
+    EVP_PKEY_CTX *kctx = NULL;
+    EVP_PKEY *pkey = NULL;
+    X509 *x = NULL;
+    X509_NAME *name;
+    X509_EXTENSION *ext = NULL;
+    X509V3_CTX v3;
+    FILE *fp = NULL;
+    int fd = -1, rv = -1;
+
+    kctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, NULL);
+    if (!kctx || EVP_PKEY_keygen_init(kctx) <= 0 ||
+	EVP_PKEY_CTX_set_ec_paramgen_curve_nid(kctx, NID_X9_62_prime256v1) <= 0 ||
+	EVP_PKEY_keygen(kctx, &pkey) <= 0) {
+	goto cleanup;
+    }
+
+    x = X509_new();
+    if (!x || !X509_set_version(x, 2) ||
+	!ASN1_INTEGER_set(X509_get_serialNumber(x), 1) ||
+	!X509_gmtime_adj(X509_get_notBefore(x), -3600) ||
+	!X509_gmtime_adj(X509_get_notAfter(x), 86400) ||
+	!X509_set_pubkey(x, pkey)) {
+	goto cleanup;
+    }
+    name = X509_get_subject_name(x);
+    if (!X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+	                            (unsigned char *)"localhost", -1, -1, 0) ||
+	!X509_set_issuer_name(x, name)) {
+	goto cleanup;
+    }
+    X509V3_set_ctx(&v3, x, x, NULL, NULL, 0);
+    ext = X509V3_EXT_conf_nid(NULL, &v3, NID_subject_alt_name, "DNS:localhost");
+    if (!ext || !X509_add_ext(x, ext, -1) ||
+	!X509_sign(x, pkey, EVP_sha256())) {
+	goto cleanup;
+    }
+
+    fd = mkstemp(stress_ca_file);
+    if (fd < 0) {
+	goto cleanup;
+    }
+    fp = fdopen(fd, "w");
+    if (!fp) {
+	close(fd);
+	goto cleanup;
+    }
+    if (!PEM_write_X509(fp, x) ||
+	SSL_CTX_use_certificate(ssl_ctx, x) != 1 ||
+	SSL_CTX_use_PrivateKey(ssl_ctx, pkey) != 1) {
+	goto cleanup;
+    }
+    rv = 0;
+
+cleanup:
+    if (fp) fclose(fp);
+    if (rv && fd >= 0) unlink(stress_ca_file);
+    if (ext) X509_EXTENSION_free(ext);
+    if (x) X509_free(x);
+    if (pkey) EVP_PKEY_free(pkey);
+    if (kctx) EVP_PKEY_CTX_free(kctx);
+    return rv;
+}
+
+static int stress_resumed_count(void)
+{
+    int resumed;
+
+    pthread_mutex_lock(&stress_lock);
+    resumed = stress_resumed;
+    pthread_mutex_unlock(&stress_lock);
+    return resumed;
+}
+
+static int stress_accepted_count(void)
+{
+    int accepted;
+
+    pthread_mutex_lock(&stress_lock);
+    accepted = stress_accepted;
+    pthread_mutex_unlock(&stress_lock);
+    return accepted;
+}
+
+static int stress_start_server(pthread_t *thread)
+{
+    struct sockaddr_in sin;
+    int on = 1;
+
+    strcpy(stress_ca_file, "/tmp/murl-ut-XXXXXX");
+    stress_resumed = 0;
+    stress_accepted = 0;
+    stress_ssl_ctx = SSL_CTX_new(SSLv23_server_method());
+    if (!stress_ssl_ctx || stress_make_cert(stress_ssl_ctx)) {
+	printf("Failed to setup the stress test server\n");
+	ERR_print_errors_fp(stderr);
+	if (stress_ssl_ctx) SSL_CTX_free(stress_ssl_ctx);
+	return -1;
+    }
+    SSL_CTX_set_mode(stress_ssl_ctx, SSL_MODE_AUTO_RETRY);
+
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_port = htons(STRESS_PORT);
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    stress_sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (stress_sock < 0 ||
+	setsockopt(stress_sock, SOL_SOCKET, SO_REUSEADDR, (const char*)&on, sizeof(on)) ||
+	bind(stress_sock, (struct sockaddr *)&sin, sizeof(sin)) ||
+	listen(stress_sock, STRESS_CLIENTS * 2) ||
+	pthread_create(thread, NULL, stress_server_thread, NULL)) {
+	printf("Unable to start the stress test server\n");
+	if (stress_sock >= 0) close(stress_sock);
+	SSL_CTX_free(stress_ssl_ctx);
+	unlink(stress_ca_file);
+	return -1;
+    }
+    return 0;
+}
+
+/*
+ * Stop accepting connections and wait for the open ones to be
+ * closed by the clients.
+ */
+static void stress_stop_server(pthread_t thread)
+{
+    int conns;
+
+    shutdown(stress_sock, SHUT_RDWR);
+    pthread_join(thread, NULL);
+    close(stress_sock);
+    do {
+	pthread_mutex_lock(&stress_lock);
+	conns = stress_conns;
+	pthread_mutex_unlock(&stress_lock);
+	if (conns) usleep(10000);
+    } while (conns);
+    SSL_CTX_free(stress_ssl_ctx);
+    unlink(stress_ca_file);
+}
+
+typedef struct stress_buf_t {
+    char *data;
+    size_t len;
+} STRESS_BUF;
+
+static size_t stress_write_cb(void *ptr, size_t size, size_t nmemb, void *userdata)
+{
+    STRESS_BUF *rsp = (STRESS_BUF *)userdata;
+    char *tmp;
+
+    tmp = realloc(rsp->data, rsp->len + size * nmemb + 1);
+    if (!tmp) {
+	return 0;
+    }
+    rsp->data = tmp;
+    memcpy(rsp->data + rsp->len, ptr, size * nmemb);
+    rsp->len += size * nmemb;
+    rsp->data[rsp->len] = 0;
+    return size * nmemb;
+}
+
+static CURL *stress_new_handle(STRESS_BUF *rsp)
+{
+    CURL *hnd;
+
+    hnd = curl_easy_init();
+    if (!hnd) {
+	return NULL;
+    }
+    curl_easy_setopt(hnd, CURLOPT_USERAGENT, "murl");
+    /*
+     * The test certs may have expired, and verification is
+     * covered by the other test cases.
+     */
+    curl_easy_setopt(hnd, CURLOPT_CAINFO, COMMON_ROOT);
+    curl_easy_setopt(hnd, CURLOPT_SSL_VERIFYPEER, 0L);
+    curl_easy_setopt(hnd, CURLOPT_WRITEFUNCTION, stress_write_cb);
+    curl_easy_setopt(hnd, CURLOPT_WRITEDATA, rsp);
+    return hnd;
+}
+
+/*
+ * Set up request i of client id on the handle, alternating GETs and
+ * POSTs of various sizes.  path and body hold what the server is
+ * expected to send back.
+ *
+ * Returns the expected response body.
+ */
+static const char *stress_setup_request(CURL *hnd, long id, int i, char *path, char *body)
+{
+    char url[128];
+    int j, body_len;
+
+    snprintf(path, STRESS_PATH_MAX, "/stress/%ld/%d", id, i);
+    snprintf(url, sizeof(url), "https://%s:%d%s", SERVER_IP, STRESS_PORT, path);
+    curl_easy_setopt(hnd, CURLOPT_URL, url);
+    if (i % 2) {
+	body_len = (id * 7919 + i * 4099) % STRESS_BODY_MAX + 1;
+	for (j = 0; j < body_len; j++) {
+	    body[j] = 'a' + (id + i + j) % 26;
+	}
+	body[body_len] = 0;
+	curl_easy_setopt(hnd, CURLOPT_POSTFIELDS, body);
+	return body;
+    }
+    curl_easy_setopt(hnd, CURLOPT_HTTPGET, 1L);
+    return path;
+}
+
+/*
+ * Returns zero if the request went as expected, 1 otherwise
+ */
+static int stress_check_response(CURL *hnd, CURLcode crv, STRESS_BUF *rsp,
+                                 const char *expect, long id, int i)
+{
+    long http_code = 0;
+
+    curl_easy_getinfo(hnd, CURLINFO_RESPONSE_CODE, &http_code);
+    if (crv != CURLE_OK || http_code != 200 || !rsp->data ||
+	rsp->len != strlen(expect) || memcmp(rsp->data, expect, rsp->len)) {
+	printf("stress client %ld request %d failed, crv=%d code=%d\n",
+	       id, i, crv, (int)http_code);
+	return 1;
+    }
+    return 0;
+}
+
+/*
+ * Each client thread replaces its handle every few requests, so the
+ * threads keep sharing and resuming the same SSL_CTX and TLS session
+ * while they run.
+ *
+ * Returns the number of failed requests.
+ */
+static void* stress_client_thread (void *arg)
+{
+    long id = (long)arg;
+    long failures = 0;
+    CURL *hnd = NULL;
+    CURLcode crv;
+    STRESS_BUF rsp;
+    char path[STRESS_PATH_MAX], *body;
+    const char *expect;
+    int i;
+
+    body = malloc(STRESS_BODY_MAX + 1);
+    if (!body) {
+	return (void *)(long)STRESS_REQUESTS;
+    }
+    for (i = 0; i < STRESS_REQUESTS; i++) {
+	if (!hnd) {
+	    hnd = stress_new_handle(&rsp);
+	    if (!hnd) {
+		failures++;
+		continue;
+	    }
+	}
+
+	expect = stress_setup_request(hnd, id, i, path, body);
+	rsp.data = NULL;
+	rsp.len = 0;
+	crv = curl_easy_perform(hnd);
+	failures += stress_check_response(hnd, crv, &rsp, expect, id, i);
+	free(rsp.data);
+
+	if ((i + 1) % STRESS_REQS_PER_HANDLE == 0) {
+	    curl_easy_cleanup(hnd);
+	    hnd = NULL;
+	}
+    }
+    if (hnd) curl_easy_cleanup(hnd);
+    free(body);
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+    ERR_remove_thread_state(NULL);
+#endif
+    return (void *)failures;
+}
+
+/*
+ * This function runs GETs and POSTs from many threads at the
+ * same time against a local server.
+ *
+ * Returns zero on success, non-zero on failure
+ */
+static int test_murl_threads(void)
+{
+    pthread_t server, clients[STRESS_CLIENTS];
+    void *failures;
+    int rv = 0;
+    int i, started = 0;
+
+    printf("\nTesting Murl with %d threads...\n", STRESS_CLIENTS);
+
+    if (stress_start_server(&server)) {
+	rv = -1;
+	LOG_RESULT(rv);
+	return rv;
+    }
+
+    for (i = 0; i < STRESS_CLIENTS; i++) {
+	if (pthread_create(&clients[i], NULL, stress_client_thread, (void *)(long)i)) {
+	    printf("Unable to start client thread %d\n", i);
+	    rv = -1;
+	    break;
+	}
+	started++;
+    }
+    for (i = 0; i < started; i++) {
+	pthread_join(clients[i], &failures);
+	if (failures) rv = -1;
+    }
+
+    stress_stop_server(server);
+
+    LOG_RESULT(rv);
+    return rv;
+}
+
+/*
+ * A request driven by the multi handle
+ */
+typedef struct stress_xfer_t {
+    CURL *hnd;
+    STRESS_BUF rsp;
+    char path[STRESS_PATH_MAX];
+    char *body;
+    const char *expect;
+    int i; /* request number */
+} STRESS_XFER;
+
+static int stress_multi_start(CURLM *multi, STRESS_XFER *x, long id)
+{
+    x->expect = stress_setup_request(x->hnd, id, x->i, x->path, x->body);
+    x->rsp.data = NULL;
+    x->rsp.len = 0;
+    return (curl_multi_add_handle(multi, x->hnd) == CURLM_OK) ? 0 : -1;
+}
+
+/*
+ * This function runs the GETs and POSTs of several handles at the
+ * same time from one thread with a multi handle.  The handles must
+ * all be waiting on their sockets at once.
+ *
+ * Returns zero on success, non-zero on failure
+ */
+static int test_murl_multi(void)
+{
+    pthread_t server;
+    CURLM *multi = NULL;
+    CURLMsg *msg;
+    CURLcode crv;
+    STRESS_XFER xfers[STRESS_CLIENTS], *x;
+    char *priv;
+    time_t deadline;
+    int rv = 0;
+    int i, running, left, numfds, done = 0, max_running = 0;
+
+    printf("\nTesting Murl multi handle with %d transfers...\n", STRESS_CLIENTS);
+
+    memset(xfers, 0, sizeof(xfers));
+    if (stress_start_server(&server)) {
+	rv = -1;
+	LOG_RESULT(rv);
+	return rv;
+    }
+
+    multi = curl_multi_init();
+    if (!multi) {
+	rv = -1;
+	goto cleanup;
+    }
+    for (i = 0; i < STRESS_CLIENTS; i++) {
+	x = &xfers[i];
+	x->body = malloc(STRESS_BODY_MAX + 1);
+	x->hnd = stress_new_handle(&x->rsp);
+	if (!x->body || !x->hnd) {
+	    rv = -1;
+	    goto cleanup;
+	}
+	curl_easy_setopt(x->hnd, CURLOPT_PRIVATE, x);
+	if (stress_multi_start(multi, x, i)) {
+	    rv = -1;
+	    goto cleanup;
+	}
+    }
+
+    deadline = time(NULL) + 60;
+    while (done < STRESS_CLIENTS) {
+	if (curl_multi_perform(multi, &running) != CURLM_OK) {
+	    rv = -1;
+	    break;
+	}
+	if (running > max_running) max_running = running;
+
+	while ((msg = curl_multi_info_read(multi, &left))) {
+	    priv = NULL;
+	    curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &priv);
+	    x = (STRESS_XFER *)priv;
+	    crv = msg->data.result;
+	    curl_multi_remove_handle(multi, x->hnd);
+	    if (stress_check_response(x->hnd, crv, &x->rsp, x->expect, x - xfers, x->i)) {
+		rv = -1;
+	    }
+	    free(x->rsp.data);
+	    x->rsp.data = NULL;
+	    if (++x->i < STRESS_REQUESTS) {
+		if (stress_multi_start(multi, x, x - xfers)) rv = -1;
+	    } else {
+		done++;
+	    }
+	}
+	if (rv || done == STRESS_CLIENTS) {
+	    break;
+	}
+	if (time(NULL) > deadline) {
+	    printf("Transfers didn't finish in time\n");
+	    rv = -1;
+	    break;
+	}
+	if (curl_multi_wait(multi, NULL, 0, 1000, &numfds) != CURLM_OK) {
+	    rv = -1;
+	    break;
+	}
+    }
+    if (max_running < STRESS_CLIENTS) {
+	printf("Only %d of %d transfers were in progress at once\n", max_running, STRESS_CLIENTS);
+	rv = -1;
+    }
+
+cleanup:
+    if (multi) curl_multi_cleanup(multi);
+    for (i = 0; i < STRESS_CLIENTS; i++) {
+	if (xfers[i].hnd) curl_easy_cleanup(xfers[i].hnd);
+	free(xfers[i].body);
+    }
+    stress_stop_server(server);
+
+    LOG_RESULT(rv);
+    return rv;
+}
+
+/*
+ * The sockets the multi handle asked to wait on, kept by the socket
+ * callback, and the timeout from the timer callback
+ */
+typedef struct stress_socks_t {
+    struct pollfd pfds[STRESS_CLIENTS];
+    int nfds;
+    int max_nfds;
+    int bad; /* set when the callbacks were given something unexpected */
+    long timer;
+} STRESS_SOCKS;
+
+static int stress_socket_cb(CURL *easy, curl_socket_t s, int what, void *userp, void *socketp)
+{
+    STRESS_SOCKS *socks = (STRESS_SOCKS *)userp;
+    int i;
+
+    (void)easy;
+    (void)socketp;
+    for (i = 0; i < socks->nfds; i++) {
+	if (socks->pfds[i].fd == s) {
+	    break;
+	}
+    }
+    if (what == CURL_POLL_REMOVE) {
+	if (i == socks->nfds) {
+	    socks->bad = 1;
+	    return 0;
+	}
+	socks->pfds[i] = socks->pfds[--socks->nfds];
+	return 0;
+    }
+    if (i == socks->nfds) {
+	if (socks->nfds == STRESS_CLIENTS) {
+	    socks->bad = 1;
+	    return 0;
+	}
+	socks->nfds++;
+    }
+    socks->pfds[i].fd = s;
+    socks->pfds[i].events = 0;
+    if (what & CURL_POLL_IN) socks->pfds[i].events |= POLLIN;
+    if (what & CURL_POLL_OUT) socks->pfds[i].events |= POLLOUT;
+    if (socks->nfds > socks->max_nfds) socks->max_nfds = socks->nfds;
+    return 0;
+}
+
+static int stress_timer_cb(CURLM *multi, long timeout_ms, void *userp)
+{
+    STRESS_SOCKS *socks = (STRESS_SOCKS *)userp;
+
+    (void)multi;
+    socks->timer = timeout_ms;
+    return 0;
+}
+
+/*
+ * This function runs the same transfers as test_murl_multi(), but
+ * waits on the sockets the multi handle hands to the socket callback
+ * and only moves along the ones that are ready, with
+ * curl_multi_socket_action().  The handles must all be waiting on
+ * their own socket at once.
+ *
+ * Returns zero on success, non-zero on failure
+ */
+static int test_murl_multi_socket(void)
+{
+    pthread_t server;
+    CURLM *multi = NULL;
+    CURLMsg *msg;
+    STRESS_XFER xfers[STRESS_CLIENTS], *x;
+    STRESS_SOCKS socks;
+    struct pollfd pfds[STRESS_CLIENTS];
+    char *priv;
+    time_t deadline;
+    int rv = 0;
+    int i, n, ev, running, left, done = 0;
+
+    printf("\nTesting Murl multi handle socket callbacks with %d transfers...\n", STRESS_CLIENTS);
+
+    memset(xfers, 0, sizeof(xfers));
+    memset(&socks, 0, sizeof(socks));
+    socks.timer = -1;
+    if (stress_start_server(&server)) {
+	rv = -1;
+	LOG_RESULT(rv);
+	return rv;
+    }
+
+    multi = curl_multi_init();
+    if (!multi ||
+	curl_multi_setopt(multi, CURLMOPT_SOCKETFUNCTION, stress_socket_cb) != CURLM_OK ||
+	curl_multi_setopt(multi, CURLMOPT_SOCKETDATA, &socks) != CURLM_OK ||
+	curl_multi_setopt(multi, CURLMOPT_TIMERFUNCTION, stress_timer_cb) != CURLM_OK ||
+	curl_multi_setopt(multi, CURLMOPT_TIMERDATA, &socks) != CURLM_OK) {
+	rv = -1;
+	goto cleanup;
+    }
+    for (i = 0; i < STRESS_CLIENTS; i++) {
+	x = &xfers[i];
+	x->body = malloc(STRESS_BODY_MAX + 1);
+	x->hnd = stress_new_handle(&x->rsp);
+	if (!x->body || !x->hnd) {
+	    rv = -1;
+	    goto cleanup;
+	}
+	curl_easy_setopt(x->hnd, CURLOPT_PRIVATE, x);
+	if (stress_multi_start(multi, x, i)) {
+	    rv = -1;
+	    goto cleanup;
+	}
+    }
+
+    deadline = time(NULL) + 60;
+    while (done < STRESS_CLIENTS) {
+	if (socks.timer == 0) {
+	    if (curl_multi_socket_action(multi, CURL_SOCKET_TIMEOUT, 0, &running) != CURLM_OK) {
+		rv = -1;
+		break;
+	    }
+	} else {
+	    /* The callbacks may change the sockets while they are handled */
+	    n = socks.nfds;
+	    memcpy(pfds, socks.pfds, n * sizeof(struct pollfd));
+	    if (poll(pfds, n, 1000) < 0) {
+		rv = -1;
+		break;
+	    }
+	    for (i = 0; i < n; i++) {
+		if (!pfds[i].revents) {
+		    continue;
+		}
+		ev = 0;
+		if (pfds[i].revents & POLLIN) ev |= CURL_CSELECT_IN;
+		if (pfds[i].revents & POLLOUT) ev |= CURL_CSELECT_OUT;
+		if (pfds[i].revents & (POLLERR | POLLHUP)) ev |= CURL_CSELECT_ERR;
+		if (curl_multi_socket_action(multi, pfds[i].fd, ev, &running) != CURLM_OK) {
+		    rv = -1;
+		    break;
+		}
+	    }
+	}
+
+	while ((msg = curl_multi_info_read(multi, &left))) {
+	    priv = NULL;
+	    curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &priv);
+	    x = (STRESS_XFER *)priv;
+	    curl_multi_remove_handle(multi, x->hnd);
+	    if (stress_check_response(x->hnd, msg->data.result, &x->rsp, x->expect, x - xfers, x->i)) {
+		rv = -1;
+	    }
+	    free(x->rsp.data);
+	    x->rsp.data = NULL;
+	    if (++x->i < STRESS_REQUESTS) {
+		if (stress_multi_start(multi, x, x - xfers)) rv = -1;
+	    } else {
+		done++;
+	    }
+	}
+	if (rv || socks.bad || done == STRESS_CLIENTS) {
+	    break;
+	}
+	if (time(NULL) > deadline) {
+	    printf("Transfers didn't finish in time\n");
+	    rv = -1;
+	    break;
+	}
+    }
+    if (socks.bad) {
+	printf("Unexpected socket callback\n");
+	rv = -1;
+    }
+    if (!rv && socks.nfds) {
+	printf("%d sockets left to wait on once the transfers finished\n", socks.nfds);
+	rv = -1;
+    }
+    if (socks.max_nfds < STRESS_CLIENTS) {
+	printf("Only waited on %d of %d sockets at once\n", socks.max_nfds, STRESS_CLIENTS);
+	rv = -1;
+    }
+
+cleanup:
+    if (multi) curl_multi_cleanup(multi);
+    for (i = 0; i < STRESS_CLIENTS; i++) {
+	if (xfers[i].hnd) curl_easy_cleanup(xfers[i].hnd);
+	free(xfers[i].body);
+    }
+    stress_stop_server(server);
+
+    LOG_RESULT(rv);
+    return rv;
+}
+
+/*
+ * GET the path from the stress test server at host with a new handle
+ * verifying the server certificate, checking its name if check_name
+ * is set.  The handle is left open, so the SSL_CTX and TLS session
+ * it used stay in the cache.
+ *
+ * Returns the result of curl_easy_perform(), or -1 on a bad response.
+ */
+static int stress_verified_get(CURL **hnd, STRESS_BUF *rsp, const char *host, long check_name)
+{
+    char url[128];
+    long http_code = 0;
+    CURLcode crv;
+
+    *hnd = stress_new_handle(rsp);
+    if (!*hnd) {
+	return -1;
+    }
+    snprintf(url, sizeof(url), "https://%s:%d/resume", host, STRESS_PORT);
+    curl_easy_setopt(*hnd, CURLOPT_URL, url);
+    curl_easy_setopt(*hnd, CURLOPT_CAINFO, stress_ca_file);
+    curl_easy_setopt(*hnd, CURLOPT_SSL_VERIFYPEER, 1L);
+    curl_easy_setopt(*hnd, CURLOPT_SSL_VERIFY_HOSTNAME, check_name);
+    rsp->data = NULL;
+    rsp->len = 0;
+    crv = curl_easy_perform(*hnd);
+    curl_easy_getinfo(*hnd, CURLINFO_RESPONSE_CODE, &http_code);
+    if (crv == CURLE_OK &&
+	(http_code != 200 || !rsp->data || strcmp(rsp->data, "/resume"))) {
+	crv = -1;
+    }
+    free(rsp->data);
+    return crv;
+}
+
+/*
+ * This function checks that a new connection resumes the TLS session
+ * of an earlier one, but only when the server name was verified the
+ * same way.  A resumed handshake doesn't check the certificate.
+ *
+ * Returns zero on success, non-zero on failure
+ */
+static int test_murl_session_resume(void)
+{
+    pthread_t server;
+    CURL *hnd[4] = { NULL, NULL, NULL, NULL };
+    STRESS_BUF rsp;
+    int rv = 0;
+    int crv, i;
+
+    printf("\nTesting Murl TLS session resumption...\n");
+
+    if (stress_start_server(&server)) {
+	rv = -1;
+	LOG_RESULT(rv);
+	return rv;
+    }
+
+    /*
+     * The second connection to localhost resumes the session of the
+     * first one
+     */
+    crv = stress_verified_get(&hnd[0], &rsp, "localhost", 1L);
+    if (crv != CURLE_OK || stress_resumed_count() != 0) {
+	printf("First GET failed, crv=%d resumed=%d\n", crv, stress_resumed_count());
+	rv = -1;
+	goto cleanup;
+    }
+    crv = stress_verified_get(&hnd[1], &rsp, "localhost", 1L);
+    if (crv != CURLE_OK || stress_resumed_count() != 1) {
+	printf("Session not resumed, crv=%d resumed=%d\n", crv, stress_resumed_count());
+	rv = -1;
+	goto cleanup;
+    }
+
+    /*
+     * The certificate isn't for 127.0.0.1, which is fine as long as
+     * the name isn't checked.  A handle checking the name must not
+     * resume that session and skip the check.
+     */
+    crv = stress_verified_get(&hnd[2], &rsp, SERVER_IP, 0L);
+    if (crv != CURLE_OK) {
+	printf("GET without name check failed, crv=%d\n", crv);
+	rv = -1;
+	goto cleanup;
+    }
+    crv = stress_verified_get(&hnd[3], &rsp, SERVER_IP, 1L);
+    if (crv == CURLE_OK || stress_resumed_count() != 1) {
+	printf("Name check skipped, crv=%d resumed=%d\n", crv, stress_resumed_count());
+	rv = -1;
+    }
+
+cleanup:
+    for (i = 0; i < 4; i++) {
+	if (hnd[i]) curl_easy_cleanup(hnd[i]);
+    }
+    stress_stop_server(server);
+
+    LOG_RESULT(rv);
+    return rv;
+}
+
+/*
+ * This function sends several requests with one handle to the local
+ * server, which closes each connection after STRESS_CLOSE_AFTER of
+ * them.  The request after that must be sent on a new connection,
+ * both when the close has already arrived and when the request races
+ * with it.
+ *
+ * Returns zero on success, non-zero on failure
+ */
+#define STRESS_CLOSE_AFTER 2
+#define STRESS_CLOSE_ROUNDS 4
+static int test_murl_server_close(void)
+{
+    pthread_t server;
+    CURL *hnd = NULL;
+    CURLcode crv;
+    STRESS_BUF rsp = { NULL, 0 };
+    char url[128], path[STRESS_PATH_MAX];
+    long http_code = 0;
+    int rv = -1, i, n = STRESS_CLOSE_AFTER * STRESS_CLOSE_ROUNDS + 1;
+
+    printf("\nTesting Murl reconnect after the server closed the connection...\n");
+
+    stress_close_after = STRESS_CLOSE_AFTER;
+    if (stress_start_server(&server)) {
+	stress_close_after = 0;
+	LOG_RESULT(rv);
+	return rv;
+    }
+
+    hnd = stress_new_handle(&rsp);
+    if (!hnd) {
+	printf("Failed to create the handle\n");
+	goto cleanup;
+    }
+    for (i = 0; i < n; i++) {
+	if (i % (2 * STRESS_CLOSE_AFTER) == STRESS_CLOSE_AFTER) {
+	    /* Let the close arrive before the next request every other time */
+	    usleep(50000);
+	}
+	snprintf(path, sizeof(path), "/close/%d", i);
+	snprintf(url, sizeof(url), "https://%s:%d%s", SERVER_IP, STRESS_PORT, path);
+	curl_easy_setopt(hnd, CURLOPT_URL, url);
+	rsp.len = 0;
+	crv = curl_easy_perform(hnd);
+	curl_easy_getinfo(hnd, CURLINFO_RESPONSE_CODE, &http_code);
+	if (crv != CURLE_OK || http_code != 200 || rsp.len != strlen(path) ||
+	    memcmp(rsp.data, path, rsp.len)) {
+	    printf("GET %d failed, crv=%d code=%d\n", i, crv, (int)http_code);
+	    goto cleanup;
+	}
+	/* Each connection carries STRESS_CLOSE_AFTER requests */
+	if (stress_accepted_count() != i / STRESS_CLOSE_AFTER + 1) {
+	    printf("GET %d used %d connections\n", i, stress_accepted_count());
+	    goto cleanup;
+	}
+    }
+    rv = 0;
+
+cleanup:
+    if (hnd) curl_easy_cleanup(hnd);
+    free(rsp.data);
+    stress_stop_server(server);
+    stress_close_after = 0;
+
+    LOG_RESULT(rv);
+    return rv;
+}
+
+/*
+ * This function POSTs a gzip encoded body, which is binary, to the
+ * local server.  The server decodes it and sends it back gzip encoded,
+ * which murl must decode since any encoding is accepted.
+ *
+ * Returns zero on success, non-zero on failure
+ */
+static int test_murl_gzip(void)
+{
+    pthread_t server;
+    CURL *hnd = NULL;
+    CURLcode crv;
+    STRESS_BUF rsp = { NULL, 0 };
+    struct curl_slist *hdrs = NULL;
+    char url[128], *text = NULL, *gz = NULL;
+    int text_len = STRESS_BODY_MAX / 2, gz_len, j;
+    long http_code = 0;
+    int rv = -1;
+
+    printf("\nTesting Murl gzip encoded bodies...\n");
+
+    if (stress_start_server(&server)) {
+	LOG_RESULT(rv);
+	return rv;
+    }
+
+    text = malloc(text_len);
+    gz = malloc(STRESS_BODY_MAX);
+    hnd = stress_new_handle(&rsp);
+    if (!text || !gz || !hnd) {
+	printf("Failed to setup the request\n");
+	goto cleanup;
+    }
+    for (j = 0; j < text_len; j++) {
+	text[j] = "0123456789ABCDEF"[(j * 7 + j / 64) % 16];
+    }
+    gz_len = stress_gzip(text, text_len, gz, STRESS_BODY_MAX);
+    if (gz_len <= 0 || !memchr(gz, 0, gz_len)) {
+	/* The body must hold zero bytes to show it isn't taken as a string */
+	printf("Failed to gzip the request body\n");
+	goto cleanup;
+    }
+
+    snprintf(url, sizeof(url), "https://%s:%d/gzip", SERVER_IP, STRESS_PORT);
+    hdrs = curl_slist_append(NULL, "Content-Encoding: gzip");
+    curl_easy_setopt(hnd, CURLOPT_URL, url);
+    curl_easy_setopt(hnd, CURLOPT_HTTPHEADER, hdrs);
+    curl_easy_setopt(hnd, CURLOPT_ACCEPT_ENCODING, "");
+    curl_easy_setopt(hnd, CURLOPT_POSTFIELDS, gz);
+    curl_easy_setopt(hnd, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)gz_len);
+    crv = curl_easy_perform(hnd);
+    curl_easy_getinfo(hnd, CURLINFO_RESPONSE_CODE, &http_code);
+    if (crv != CURLE_OK || http_code != 200 || rsp.len != (size_t)text_len ||
+	memcmp(rsp.data, text, text_len)) {
+	printf("gzip POST failed, crv=%d code=%d len=%d\n", crv, (int)http_code, (int)rsp.len);
+	goto cleanup;
+    }
+    rv = 0;
+
+cleanup:
+    if (hnd) curl_easy_cleanup(hnd);
+    if (hdrs) curl_slist_free_all(hdrs);
+    free(rsp.data);
+    free(text);
+    free(gz);
+    stress_stop_server(server);
+
+    LOG_RESULT(rv);
+    return rv;
+}
+
+/*
+ * GET path from the local server, with the response put in rsp.
+ *
+ * Returns the result of the transfer
+ */
+static CURLcode stress_get(const char *path, STRESS_BUF *rsp, long *http_code)
+{
+    CURL *hnd;
+    CURLcode crv;
+    char url[128];
+
+    *http_code = 0;
+    hnd = stress_new_handle(rsp);
+    if (!hnd) {
+	return CURLE_OUT_OF_MEMORY;
+    }
+    snprintf(url, sizeof(url), "https://%s:%d%s", SERVER_IP, STRESS_PORT, path);
+    curl_easy_setopt(hnd, CURLOPT_URL, url);
+    crv = curl_easy_perform(hnd);
+    curl_easy_getinfo(hnd, CURLINFO_RESPONSE_CODE, http_code);
+    curl_easy_cleanup(hnd);
+    return crv;
+}
+
+/*
+ * This function gets a chunked body from the local server, which
+ * sends the chunk sizes and the chunks split over several reads.
+ *
+ * Returns zero on success, non-zero on failure
+ */
+static int test_murl_chunked_split(void)
+{
+    pthread_t server;
+    CURLcode crv;
+    STRESS_BUF rsp = { NULL, 0 };
+    char body[STRESS_FRAMED_LEN];
+    long http_code;
+    int rv = -1;
+
+    printf("\nTesting Murl chunked body split across reads...\n");
+
+    if (stress_start_server(&server)) {
+	LOG_RESULT(rv);
+	return rv;
+    }
+
+    stress_framed_body(body);
+    crv = stress_get(STRESS_FRAMED_CHUNKED, &rsp, &http_code);
+    if (crv != CURLE_OK || http_code != 200 || rsp.len != STRESS_FRAMED_LEN ||
+	memcmp(rsp.data, body, STRESS_FRAMED_LEN)) {
+	printf("Chunked GET failed, crv=%d code=%d len=%d\n", crv, (int)http_code, (int)rsp.len);
+    } else {
+	rv = 0;
+    }
+
+    free(rsp.data);
+    stress_stop_server(server);
+
+    LOG_RESULT(rv);
+    return rv;
+}
+
+/*
+ * This function gets a body without a length from the local server,
+ * which ends it by closing the connection.
+ *
+ * Returns zero on success, non-zero on failure
+ */
+static int test_murl_read_to_close(void)
+{
+    pthread_t server;
+    CURLcode crv;
+    STRESS_BUF rsp = { NULL, 0 };
+    char body[STRESS_FRAMED_LEN];
+    long http_code;
+    int rv = -1;
+
+    printf("\nTesting Murl body ended by the connection closing...\n");
+
+    if (stress_start_server(&server)) {
+	LOG_RESULT(rv);
+	return rv;
+    }
+
+    stress_framed_body(body);
+    crv = stress_get(STRESS_FRAMED_CLOSE, &rsp, &http_code);
+    if (crv != CURLE_OK || http_code != 200 || rsp.len != STRESS_FRAMED_LEN ||
+	memcmp(rsp.data, body, STRESS_FRAMED_LEN)) {
+	printf("Read to close GET failed, crv=%d code=%d len=%d\n", crv, (int)http_code, (int)rsp.len);
+    } else {
+	rv = 0;
+    }
+
+    free(rsp.data);
+    stress_stop_server(server);
+
+    LOG_RESULT(rv);
+    return rv;
+}
+
+/*
+ * This function gets a body from the local server that closes the
+ * connection before all the bytes of its Content-Length were sent,
+ * which must fail rather than pass the short body off as complete.
+ *
+ * Returns zero on success, non-zero on failure
+ */
+static int test_murl_truncated_body(void)
+{
+    pthread_t server;
+    CURLcode crv;
+    STRESS_BUF rsp = { NULL, 0 };
+    long http_code;
+    int rv = -1;
+
+    printf("\nTesting Murl truncated Content-Length body...\n");
+
+    if (stress_start_server(&server)) {
+	LOG_RESULT(rv);
+	return rv;
+    }
+
+    crv = stress_get(STRESS_FRAMED_TRUNCATED, &rsp, &http_code);
+    if (crv != CURLE_PARTIAL_FILE) {
+	printf("Truncated GET gave crv=%d with %d bytes\n", crv, (int)rsp.len);
+    } else {
+	rv = 0;
+    }
+
+    free(rsp.data);
+    stress_stop_server(server);
+
+    LOG_RESULT(rv);
+    return rv;
+}
+
 /*
  * This is the main entry point into the HTTPS GET
  * test suite.
@@ -643,6 +1983,54 @@ int test_murl_tls (void)
     rv = test_murl_ipv6_address();
     if (rv) any_failures = 1;
 
+    /*
+     * Test many threads doing GETs and POSTs at the same time
+     */
+    rv = test_murl_threads();
+    if (rv) any_failures = 1;
+
+    /*
+     * Test several transfers at once with a multi handle
+     */
+    rv = test_murl_multi();
+    if (rv) any_failures = 1;
+
+    /*
+     * Test a multi handle driven from the socket callbacks
+     */
+    rv = test_murl_multi_socket();
+    if (rv) any_failures = 1;
+
+    /*
+     * Test TLS session resumption between handles
+     */
+    rv = test_murl_session_resume();
+    if (rv) any_failures = 1;
+
+    /*
+     * Test a connection closed by the server is replaced
+     */
+    rv = test_murl_server_close();
+    if (rv) any_failures = 1;
+
+    /*
+     * Test gzip encoded request and response bodies
+     */
+    rv = test_murl_gzip();
+    if (rv) any_failures = 1;
+
+    /*
+     * Test the framing of response bodies read in pieces
+     */
+    rv = test_murl_chunked_split();
+    if (rv) any_failures = 1;
+
+    rv = test_murl_read_to_close();
+    if (rv) any_failures = 1;
+
+    rv = test_murl_truncated_body();
+    if (rv) any_failures = 1;
+
     return any_failures;
 }
 
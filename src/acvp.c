@@ -32,6 +32,8 @@
 #include <Windows.h>
 #else
 #include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
 #endif
 #include "acvp.h"
 #include "acvp_lcl.h"
@@ -41,7 +43,6 @@
 /*
  * Forward prototypes for local functions
  */
-static ACVP_RESULT acvp_parse_login(ACVP_CTX *ctx);
 
 static ACVP_RESULT acvp_parse_vendors(ACVP_CTX *ctx);
 
@@ -53,11 +54,13 @@ static ACVP_RESULT acvp_parse_dependencies(ACVP_CTX *ctx, ACVP_DEPENDENCY_LIST *
 
 static ACVP_RESULT acvp_parse_test_session_register(ACVP_CTX *ctx);
 
-static ACVP_RESULT acvp_process_vsid(ACVP_CTX *ctx, char *vsid_url);
+static ACVP_RESULT acvp_parse_vector_set(ACVP_CTX *ctx, ACVP_VS_WORK *work, unsigned int *retry_period);
 
-static ACVP_RESULT acvp_process_vector_set(ACVP_CTX *ctx, JSON_Object *obj);
+static unsigned int acvp_retry_period(ACVP_CTX *ctx, unsigned int retry_period, unsigned int *backoff);
 
-static ACVP_RESULT acvp_dispatch_vector_set(ACVP_CTX *ctx, JSON_Object *obj);
+static ACVP_RESULT acvp_process_vector_set(ACVP_CTX *ctx, ACVP_VS_WORK *work, JSON_Object *obj);
+
+static ACVP_RESULT acvp_dispatch_vector_set(ACVP_CTX *ctx, ACVP_VS_WORK *work, JSON_Object *obj);
 
 static void acvp_cap_free_sl(ACVP_SL_LIST *list);
 
@@ -67,7 +70,11 @@ static void acvp_cap_free_strl(ACVP_STRING_LIST *list);
 
 static void acvp_cap_free_hash_pairs(ACVP_RSA_HASH_PAIR_LIST *list);
 
-static ACVP_RESULT acvp_get_result_test_session(ACVP_CTX *ctx, char *session_url);
+static ACVP_RESULT acvp_append_vsid_url(ACVP_CTX *ctx, char *vsid_url);
+
+static void acvp_async_free(ACVP_CTX *ctx);
+
+static void acvp_async_xfer_done(ACVP_CTX *ctx, ACVP_VS_WORK *work, ACVP_RESULT rv, void *arg);
 
 /*
  * This table maps ACVP operations to handlers within libacvp.
@@ -77,7 +84,9 @@ static ACVP_RESULT acvp_get_result_test_session(ACVP_CTX *ctx, char *session_url
  * ACVP operation.
  *
  * WARNING:
- * This table is not sparse, it must contain ACVP_OP_MAX entries.
+ * This table is not sparse, it must contain ACVP_ALG_MAX entries
+ * in ACVP_CIPHER order, and the entries sharing an algorithm name
+ * must be next to each other.  The lookups in acvp_util.c rely on it.
  */
 ACVP_ALG_HANDLER alg_tbl[ACVP_ALG_MAX] = {
     { ACVP_AES_GCM,           &acvp_aes_kat_handler,          ACVP_ALG_AES_GCM,           NULL                    },
@@ -171,12 +180,41 @@ ACVP_RESULT acvp_create_test_session(ACVP_CTX **ctx,
     if (!*ctx) {
         return ACVP_MALLOC_FAIL;
     }
+    if (acvp_mutex_init(&(*ctx)->jwt_lock)) {
+        free(*ctx);
+        *ctx = NULL;
+        return ACVP_MALLOC_FAIL;
+    }
+    if (acvp_mutex_init(&(*ctx)->hnd_lock)) {
+        acvp_mutex_destroy(&(*ctx)->jwt_lock);
+        free(*ctx);
+        *ctx = NULL;
+        return ACVP_MALLOC_FAIL;
+    }
+    if (acvp_mutex_init(&(*ctx)->stats_lock)) {
+        acvp_mutex_destroy(&(*ctx)->hnd_lock);
+        acvp_mutex_destroy(&(*ctx)->jwt_lock);
+        free(*ctx);
+        *ctx = NULL;
+        return ACVP_MALLOC_FAIL;
+    }
+    if (acvp_mutex_init(&(*ctx)->tg_lock)) {
+        acvp_mutex_destroy(&(*ctx)->stats_lock);
+        acvp_mutex_destroy(&(*ctx)->hnd_lock);
+        acvp_mutex_destroy(&(*ctx)->jwt_lock);
+        free(*ctx);
+        *ctx = NULL;
+        return ACVP_MALLOC_FAIL;
+    }
 
     if (progress_cb) {
         (*ctx)->test_progress_cb = progress_cb;
     }
 
     (*ctx)->debug = level;
+    (*ctx)->worker_count = 1;
+    (*ctx)->group_workers = 1;
+    (*ctx)->prefetch_depth = ACVP_PREFETCH_DEPTH_DEFAULT;
 
     return ACVP_SUCCESS;
 }
@@ -591,13 +629,21 @@ ACVP_RESULT acvp_free_test_session(ACVP_CTX *ctx) {
     ACVP_DEPENDENCY_LIST *dep_entry, *dep_e2;
 
     if (ctx) {
+        /*
+         * Stop a session still running first, its worker threads and
+         * requests use the capabilities, URLs and transport freed below
+         */
+        acvp_async_free(ctx);
+#ifndef WIN32
+        acvp_tg_pool_free(ctx);
+#endif
+        if (ctx->http_stats_report) {
+            acvp_http_stats_write_report(ctx, ctx->http_stats_report);
+            free(ctx->http_stats_report);
+        }
         if (ctx->reg_buf) { free(ctx->reg_buf); }
         if (ctx->ans_buf) { free(ctx->ans_buf); }
         if (ctx->login_buf) { free(ctx->login_buf); }
-        if (ctx->test_sess_buf) { free(ctx->test_sess_buf); }
-        if (ctx->kat_buf) { free(ctx->kat_buf); }
-        if (ctx->upld_buf) { free(ctx->upld_buf); }
-        if (ctx->kat_resp) { json_value_free(ctx->kat_resp); }
         if (ctx->server_name) { free(ctx->server_name); }
         if (ctx->vendor_url) { free(ctx->vendor_url); }
         if (ctx->module_url) { free(ctx->module_url); }
@@ -754,6 +800,12 @@ ACVP_RESULT acvp_free_test_session(ACVP_CTX *ctx) {
             }
         }
         if (ctx->jwt_token) { free(ctx->jwt_token); }
+        acvp_journal_free(ctx);
+        acvp_transport_free(ctx);
+        acvp_mutex_destroy(&ctx->tg_lock);
+        acvp_mutex_destroy(&ctx->stats_lock);
+        acvp_mutex_destroy(&ctx->hnd_lock);
+        acvp_mutex_destroy(&ctx->jwt_lock);
         free(ctx);
     } else {
         ACVP_LOG_STATUS("No ctx to free");
@@ -989,6 +1041,194 @@ ACVP_RESULT acvp_enable_debug_request(ACVP_CTX *ctx) {
     return ACVP_SUCCESS;
 }
 
+/*
+ * This function is used by the application to specify how many
+ * vector sets may be processed concurrently by acvp_process_tests().
+ */
+ACVP_RESULT acvp_set_worker_count(ACVP_CTX *ctx, int worker_count) {
+    if (!ctx) {
+        return ACVP_NO_CTX;
+    }
+    if (worker_count < 1 || worker_count > ACVP_WORKER_COUNT_MAX) {
+        ACVP_LOG_ERR("Worker count must be between 1 and %d", ACVP_WORKER_COUNT_MAX);
+        return ACVP_INVALID_ARG;
+    }
+    ctx->worker_count = worker_count;
+
+    return ACVP_SUCCESS;
+}
+
+/*
+ * This function is used by the application to specify how many test
+ * groups of a vector set may be processed concurrently.  One, the
+ * default, processes them one at a time.
+ */
+ACVP_RESULT acvp_set_group_workers(ACVP_CTX *ctx, int group_workers) {
+    if (!ctx) {
+        return ACVP_NO_CTX;
+    }
+    if (group_workers < 1 || group_workers > ACVP_WORKER_COUNT_MAX) {
+        ACVP_LOG_ERR("Test group worker count must be between 1 and %d", ACVP_WORKER_COUNT_MAX);
+        return ACVP_INVALID_ARG;
+    }
+    ctx->group_workers = group_workers;
+
+    return ACVP_SUCCESS;
+}
+
+/*
+ * This function is used by the application to specify how many
+ * vector sets acvp_process_tests() may download ahead of the ones
+ * being processed.  Zero disables prefetching.
+ */
+ACVP_RESULT acvp_set_prefetch_depth(ACVP_CTX *ctx, int prefetch_depth) {
+    if (!ctx) {
+        return ACVP_NO_CTX;
+    }
+    if (prefetch_depth < 0 || prefetch_depth > ACVP_PREFETCH_DEPTH_MAX) {
+        ACVP_LOG_ERR("Prefetch depth must be between 0 and %d", ACVP_PREFETCH_DEPTH_MAX);
+        return ACVP_INVALID_ARG;
+    }
+    ctx->prefetch_depth = prefetch_depth;
+
+    return ACVP_SUCCESS;
+}
+
+/*
+ * This function is used by the application to have the vector sets
+ * downloaded, and the responses uploaded, compressed.
+ */
+ACVP_RESULT acvp_set_compression(ACVP_CTX *ctx, ACVP_COMPRESSION compression) {
+    if (!ctx) {
+        return ACVP_NO_CTX;
+    }
+    if (compression & ~ACVP_COMPRESSION_ALL) {
+        ACVP_LOG_ERR("Invalid compression setting %d", (int)compression);
+        return ACVP_INVALID_ARG;
+    }
+    if ((compression & ACVP_COMPRESSION_UPLOADS) && ctx->transport) {
+        ACVP_LOG_ERR("Responses can't be compressed with a transport set with acvp_set_transport()");
+        return ACVP_INVALID_ARG;
+    }
+    ctx->compression = compression;
+
+    return ACVP_SUCCESS;
+}
+
+/*
+ * This function is used by the application to have the progress of
+ * the test session recorded to a journal, so the session can be
+ * resumed with acvp_resume_session() if it gets interrupted.
+ */
+ACVP_RESULT acvp_set_journal(ACVP_CTX *ctx, const char *journal_path) {
+    if (!ctx) {
+        return ACVP_NO_CTX;
+    }
+    if (!journal_path) {
+        return ACVP_INVALID_ARG;
+    }
+    if (strnlen_s(journal_path, ACVP_JOURNAL_PATH_MAX + 1) > ACVP_JOURNAL_PATH_MAX) {
+        ACVP_LOG_ERR("Journal path too long, max allowed=%d", ACVP_JOURNAL_PATH_MAX);
+        return ACVP_INVALID_ARG;
+    }
+
+    return acvp_journal_open(ctx, journal_path);
+}
+
+/*
+ * This function is used by the application to have the timing of
+ * the requests sent to the server written to a file when the session
+ * is freed.
+ */
+ACVP_RESULT acvp_set_http_stats_report(ACVP_CTX *ctx, const char *report_path) {
+    if (!ctx) {
+        return ACVP_NO_CTX;
+    }
+    if (!report_path) {
+        return ACVP_INVALID_ARG;
+    }
+    if (strnlen_s(report_path, ACVP_JOURNAL_PATH_MAX + 1) > ACVP_JOURNAL_PATH_MAX) {
+        ACVP_LOG_ERR("Report path too long, max allowed=%d", ACVP_JOURNAL_PATH_MAX);
+        return ACVP_INVALID_ARG;
+    }
+    if (ctx->http_stats_report) {
+        free(ctx->http_stats_report);
+    }
+    ctx->http_stats_report = calloc(ACVP_JOURNAL_PATH_MAX + 1, sizeof(char));
+    if (!ctx->http_stats_report) {
+        return ACVP_MALLOC_FAIL;
+    }
+    strcpy_s(ctx->http_stats_report, ACVP_JOURNAL_PATH_MAX + 1, report_path);
+
+    return ACVP_SUCCESS;
+}
+
+/*
+ * This function is used by the application to get the timing of the
+ * requests sent to the server so far.
+ */
+ACVP_RESULT acvp_get_http_stats(ACVP_CTX *ctx, ACVP_HTTP_STATS *stats, int max, int *count) {
+    if (!ctx) {
+        return ACVP_NO_CTX;
+    }
+    if (!count || max < 0 || (max && !stats)) {
+        return ACVP_INVALID_ARG;
+    }
+
+    acvp_mutex_lock(&ctx->stats_lock);
+    *count = ctx->http_stats_cnt;
+    if (max > ctx->http_stats_cnt) {
+        max = ctx->http_stats_cnt;
+    }
+    if (max) {
+        memcpy_s(stats, max * sizeof(ACVP_HTTP_STATS), ctx->http_stats, max * sizeof(ACVP_HTTP_STATS));
+    }
+    acvp_mutex_unlock(&ctx->stats_lock);
+
+    return ACVP_SUCCESS;
+}
+
+/*
+ * This function is used by the application to have the requests to
+ * the server sent by its own functions instead of curl.
+ */
+ACVP_RESULT acvp_set_transport(ACVP_CTX *ctx, const ACVP_TRANSPORT *transport) {
+    ACVP_TRANSPORT *tp = NULL;
+
+    if (!ctx) {
+        return ACVP_NO_CTX;
+    }
+    if (transport && (!transport->get || !transport->post)) {
+        return ACVP_INVALID_ARG;
+    }
+    /*
+     * The requests of the running session hold on to the transport
+     */
+    if (ctx->async) {
+        ACVP_LOG_ERR("The transport can't be changed while a test session is in progress");
+        return ACVP_INVALID_ARG;
+    }
+    /*
+     * The transport has no way to tell the server the body is
+     * compressed
+     */
+    if (transport && (ctx->compression & ACVP_COMPRESSION_UPLOADS)) {
+        ACVP_LOG_ERR("A transport can't be set while ACVP_COMPRESSION_UPLOADS is enabled");
+        return ACVP_INVALID_ARG;
+    }
+    if (transport) {
+        tp = calloc(1, sizeof(ACVP_TRANSPORT));
+        if (!tp) {
+            return ACVP_MALLOC_FAIL;
+        }
+        *tp = *transport;
+    }
+    acvp_transport_release(ctx);
+    ctx->transport = tp;
+
+    return ACVP_SUCCESS;
+}
+
 /*
  * This function is used by the application to specify the
  * ACVP server address and TCP port#.
@@ -1139,7 +1379,7 @@ ACVP_RESULT acvp_mark_as_sample(ACVP_CTX *ctx) {
  * second of the two-factor authentications using
  * a TOTP.
  */
-static ACVP_RESULT acvp_build_login(ACVP_CTX *ctx, char **login, int *login_len, int refresh) {
+ACVP_RESULT acvp_build_login(ACVP_CTX *ctx, char **login, int *login_len, int refresh) {
     ACVP_RESULT rv = ACVP_SUCCESS;
     JSON_Value *reg_arry_val = NULL;
     JSON_Value *ver_val = NULL;
@@ -1232,7 +1472,7 @@ ACVP_RESULT acvp_register(ACVP_CTX *ctx) {
         rv = acvp_send_login(ctx, login, login_len);
         if (rv == ACVP_SUCCESS) {
             ACVP_LOG_STATUS("200 OK %s", ctx->reg_buf);
-            rv = acvp_parse_login(ctx);
+            rv = acvp_parse_login(ctx, ctx->reg_buf);
         } else {
             ACVP_LOG_STATUS("Login Send Failed %s", ctx->reg_buf);
             goto end;
@@ -1340,6 +1580,10 @@ ACVP_RESULT acvp_register(ACVP_CTX *ctx) {
                 ACVP_LOG_ERR("Failed to parse test session response");
                 goto end;
             }
+            if (acvp_journal_start(ctx) != ACVP_SUCCESS) {
+                ACVP_LOG_ERR("Unable to journal the test session, continuing without it");
+                acvp_journal_free(ctx);
+            }
         } else {
             ACVP_LOG_ERR("Failed to send registration, err=%d, %s", rv, acvp_lookup_error_string(rv));
         }
@@ -1367,6 +1611,76 @@ end:
     return rv;
 }
 
+/*
+ * This function picks up a test session that was interrupted, from
+ * the journal written while it was running.  It is used instead of
+ * acvp_register(), the application then calls acvp_process_tests()
+ * as usual.  Vector sets that were uploaded are skipped, and the ones
+ * computed but never acknowledged by the server are uploaded again
+ * from the responses spooled next to the journal.
+ */
+ACVP_RESULT acvp_resume_session(ACVP_CTX *ctx, const char *journal_path) {
+    ACVP_JOURNAL *journal;
+    ACVP_RESULT rv;
+    int i, computed = 0, uploaded = 0;
+
+    if (!ctx) {
+        return ACVP_NO_CTX;
+    }
+    if (!journal_path) {
+        return ACVP_INVALID_ARG;
+    }
+    if (ctx->session_url || ctx->vsid_url_list) {
+        ACVP_LOG_ERR("A test session is already registered on this ctx");
+        return ACVP_INVALID_ARG;
+    }
+    if (strnlen_s(journal_path, ACVP_JOURNAL_PATH_MAX + 1) > ACVP_JOURNAL_PATH_MAX) {
+        ACVP_LOG_ERR("Journal path too long, max allowed=%d", ACVP_JOURNAL_PATH_MAX);
+        return ACVP_INVALID_ARG;
+    }
+
+    rv = acvp_journal_load(ctx, journal_path);
+    if (rv != ACVP_SUCCESS) {
+        return rv;
+    }
+    journal = ctx->journal;
+
+    ctx->session_url = calloc(ACVP_ATTR_URL_MAX + 1, sizeof(char));
+    if (!ctx->session_url) {
+        return ACVP_MALLOC_FAIL;
+    }
+    strcpy_s(ctx->session_url, ACVP_ATTR_URL_MAX, journal->session_url);
+
+    if (journal->jwt_token) {
+        acvp_mutex_lock(&ctx->jwt_lock);
+        if (ctx->jwt_token) free(ctx->jwt_token);
+        ctx->jwt_token = calloc(ACVP_JWT_TOKEN_MAX + 1, sizeof(char));
+        if (!ctx->jwt_token) {
+            acvp_mutex_unlock(&ctx->jwt_lock);
+            return ACVP_MALLOC_FAIL;
+        }
+        strcpy_s(ctx->jwt_token, ACVP_JWT_TOKEN_MAX, journal->jwt_token);
+        ctx->jwt_gen++;
+        acvp_mutex_unlock(&ctx->jwt_lock);
+    }
+
+    for (i = 0; i < journal->vs_cnt; i++) {
+        rv = acvp_append_vsid_url(ctx, journal->vs[i].vsid_url);
+        if (rv != ACVP_SUCCESS) {
+            return rv;
+        }
+        if (journal->vs[i].state == ACVP_JOURNAL_UPLOADED) {
+            uploaded++;
+        } else if (journal->vs[i].state == ACVP_JOURNAL_COMPUTED) {
+            computed++;
+        }
+    }
+
+    ACVP_LOG_STATUS("Resuming test session %s: %d vector sets, %d uploaded, %d waiting for upload",
+                    ctx->session_url, journal->vs_cnt, uploaded, computed);
+    return ACVP_SUCCESS;
+}
+
 /*
  * Append a VS identifier to the list of VS identifiers
  * that will need to be downloaded and processed later.
@@ -1431,13 +1745,13 @@ static JSON_Object *acvp_get_obj_from_rsp(JSON_Value *arry_val) {
 
 /*
  * This routine performs the JSON parsing of the login response
- * from the ACVP server.  The response should contain an initial
- * jwt which will be used once during registration.
+ * from the ACVP server in json_buf.  The response should contain an
+ * initial jwt which will be used once during registration, or the
+ * jwt that replaces the one that expired.
  */
-static ACVP_RESULT acvp_parse_login(ACVP_CTX *ctx) {
+ACVP_RESULT acvp_parse_login(ACVP_CTX *ctx, char *json_buf) {
     JSON_Value *val;
     JSON_Object *obj = NULL;
-    char *json_buf = ctx->reg_buf;
     const char *jwt;
     ACVP_RESULT rv = ACVP_SUCCESS;
 
@@ -1469,8 +1783,13 @@ static ACVP_RESULT acvp_parse_login(ACVP_CTX *ctx) {
             goto end;
         }
 
+        acvp_mutex_lock(&ctx->jwt_lock);
+        if (ctx->jwt_token) free(ctx->jwt_token);
         ctx->jwt_token = calloc(ACVP_JWT_TOKEN_MAX + 1, sizeof(char));
         strcpy_s(ctx->jwt_token, ACVP_JWT_TOKEN_MAX, jwt);
+        ctx->jwt_gen++;
+        acvp_journal_set_token(ctx, ctx->jwt_token);
+        acvp_mutex_unlock(&ctx->jwt_lock);
 
         ACVP_LOG_STATUS("JWT: %s", ctx->jwt_token);
     }
@@ -1708,212 +2027,1119 @@ end:
 }
 
 /*
- * This function is used by the application after registration
- * to commence the testing.  All the testing will be handled
- * by libacvp.  This function will block the caller.  Therefore,
- * it should be run on a separate thread if needed.
+ * Free the state of a test session.  The workers are stopped first,
+ * after they are done with the vector set they are processing.
  */
-ACVP_RESULT acvp_process_tests(ACVP_CTX *ctx) {
-    ACVP_RESULT rv = ACVP_SUCCESS;
-    ACVP_STRING_LIST *vs_entry = NULL;
+static void acvp_async_free(ACVP_CTX *ctx) {
+    ACVP_ASYNC *as = ctx->async;
+    int i;
 
-    if (!ctx) {
-        return ACVP_NO_CTX;
+    if (!as) {
+        return;
     }
-
-    /*
-     * Iterate through the VS identifiers the server sent to us
-     * in the test session register response.  Process each vector set and
-     * return the results to the server.
-     */
-    vs_entry = ctx->vsid_url_list;
-    if (!vs_entry) {
-        return ACVP_MISSING_ARG;
+#ifndef WIN32
+    if (as->worker_cnt) {
+        acvp_mutex_lock(&as->lock);
+        as->stopping = 1;
+        pthread_cond_broadcast(&as->cond);
+        acvp_mutex_unlock(&as->lock);
+        for (i = 0; i < as->worker_cnt; i++) {
+            pthread_join(as->workers[i], NULL);
+        }
     }
-    while (vs_entry) {
-        rv = acvp_process_vsid(ctx, vs_entry->string);
-        vs_entry = vs_entry->next;
+#endif
+    /* The requests in flight write to the works */
+    acvp_net_multi_free(as->net);
+    for (i = 0; i < as->vs_cnt; i++) {
+        acvp_vs_work_release(&as->vs[i].work);
     }
-
-    return rv;
+    acvp_vs_work_release(&as->results.work);
+    for (i = 0; i < as->details_cnt; i++) {
+        acvp_vs_work_release(&as->details[i].work);
+    }
+    free(as->details);
+    if (as->results_val) json_value_free(as->results_val);
+#ifndef WIN32
+    if (as->pipe_fd[0] >= 0) {
+        close(as->pipe_fd[0]);
+    }
+    if (as->pipe_fd[1] >= 0) {
+        close(as->pipe_fd[1]);
+    }
+    pthread_cond_destroy(&as->cond);
+#endif
+    acvp_mutex_destroy(&as->lock);
+    free(as->vs);
+    free(as);
+    ctx->async = NULL;
 }
 
 /*
- * This is a minimal retry handler, which pauses for a specific time.
- * This allows the server time to generate the vectors on behalf of
- * the client.
+ * Keep a byte in the pipe returned by acvp_get_fd() while there is
+ * work that is due, so the application's event loop wakes up for it.
+ * Called with the lock held, since the workers signal the pipe too.
  */
-static ACVP_RESULT acvp_retry_handler(ACVP_CTX *ctx, unsigned int retry_period) {
-    ACVP_LOG_STATUS("200 OK KAT values not ready, server requests we wait and try again...");
-    if (retry_period <= 0 || retry_period > ACVP_RETRY_TIME_MAX) {
-        retry_period = ACVP_RETRY_TIME_MAX;
-        ACVP_LOG_WARN("retry_period not found, using max retry period!");
+static void acvp_async_signal(ACVP_ASYNC *as, int ready) {
+#ifndef WIN32
+    char c = 0;
+
+    if (ready && !as->signaled) {
+        if (write(as->pipe_fd[1], &c, 1) == 1) {
+            as->signaled = 1;
+        }
+    } else if (!ready && as->signaled) {
+        if (read(as->pipe_fd[0], &c, 1) == 1) {
+            as->signaled = 0;
+        }
     }
-    #ifdef WIN32
-    Sleep(retry_period);
-    #else
-    sleep(retry_period);
-    #endif
+#endif
+}
 
-    return ACVP_KAT_DOWNLOAD_RETRY;
+static void acvp_async_vs_done(ACVP_CTX *ctx, ACVP_ASYNC_VS *vs, ACVP_RESULT rv) {
+    ACVP_ASYNC *as = ctx->async;
+    int vs_id = vs->work.vs_id;
+
+    if (rv == ACVP_SUCCESS) {
+        ACVP_LOG_STATUS("vsId %d: responses uploaded", vs_id);
+    } else if (vs_id) {
+        ACVP_LOG_ERR("vsId %d: %s", vs_id, acvp_lookup_error_string(rv));
+    } else {
+        ACVP_LOG_ERR("%s: %s", vs->work.vsid_url, acvp_lookup_error_string(rv));
+    }
+    vs->state = ACVP_ASYNC_DONE;
+    vs->rv = rv;
+    as->done++;
+    acvp_vs_work_release(&vs->work);
+    if (as->vs_done_cb) {
+        (as->vs_done_cb)(ctx, vs_id, rv);
+    }
 }
 
 /*
- * This routine will iterate through all the vector sets, requesting
- * the test result from the server for each set.
+ * Run a vector set through the crypto handlers.  The vectors are not
+ * needed while the responses wait to be uploaded, so they are freed.
  */
-ACVP_RESULT acvp_check_test_results(ACVP_CTX *ctx) {
-    ACVP_RESULT rv = ACVP_SUCCESS;
-
-    if (!ctx) {
-        return ACVP_NO_CTX;
-    }
+static ACVP_RESULT acvp_async_compute(ACVP_CTX *ctx, ACVP_ASYNC_VS *vs) {
+    ACVP_RESULT rv;
 
-    rv = acvp_get_result_test_session(ctx, ctx->session_url);
+    rv = acvp_run_vector_set(ctx, &vs->work);
+    json_value_free(vs->work.kat_val);
+    vs->work.kat_val = NULL;
     return rv;
 }
 
-/***************************************************************************************************************
-* Begin vector processing logic.  This code should probably go into another module.
-***************************************************************************************************************/
-
-ACVP_RESULT acvp_refresh(ACVP_CTX *ctx) {
-    char *login = NULL;
-    int login_len = 0;
-    ACVP_RESULT rv = ACVP_SUCCESS;
-
-    if (!ctx) {
-        return ACVP_NO_CTX;
-    }
+#ifndef WIN32
+/*
+ * The workers take the vector sets that were downloaded, in the
+ * order of the list, and run them through the crypto handlers.  Once
+ * the responses of a vector set are ready, the thread driving the
+ * session is woken up through the pipe to upload them.  All the state
+ * of the vector set is on its ACVP_VS_WORK, which the thread driving
+ * the session leaves alone while the vector set is RUNNING.
+ */
+static void *acvp_async_worker_main(void *arg) {
+    ACVP_ASYNC *as = (ACVP_ASYNC *)arg;
+    ACVP_ASYNC_VS *vs;
+    ACVP_RESULT rv;
+    int i;
 
-    if (ctx->totp_cb) {
-        rv = acvp_build_login(ctx, &login, &login_len, 1);
-        if (rv != ACVP_SUCCESS) {
-            ACVP_LOG_ERR("Unable to build login message");
-            goto end;
+    acvp_mutex_lock(&as->lock);
+    while (!as->stopping) {
+        vs = NULL;
+        for (i = 0; i < as->vs_cnt; i++) {
+            if (as->vs[i].state == ACVP_ASYNC_READY) {
+                vs = &as->vs[i];
+                break;
+            }
         }
-
-        if (ctx->debug >= ACVP_LOG_LVL_STATUS) {
-            printf("\nPOST %s\n", login);
-        } else {
-            ACVP_LOG_INFO("POST %s", login);
+        if (!vs) {
+            pthread_cond_wait(&as->cond, &as->lock);
+            continue;
         }
+        vs->state = ACVP_ASYNC_RUNNING;
+        as->running++;
+        acvp_mutex_unlock(&as->lock);
 
-        /*
-         * Send the login to the ACVP server and get the response,
-         */
-        rv = acvp_send_login(ctx, login, login_len);
-        if (rv == ACVP_SUCCESS) {
-            ACVP_LOG_STATUS("200 OK %s", ctx->reg_buf);
-            rv = acvp_parse_login(ctx);
-        } else {
-            ACVP_LOG_STATUS("Login Send Failed %s", ctx->reg_buf);
-            goto end;
-        }
-        if (rv != ACVP_SUCCESS) {
-            ACVP_LOG_STATUS("Login Response Failed, %d", rv);
-        }
+        rv = acvp_async_compute(as->ctx, vs);
+
+        acvp_mutex_lock(&as->lock);
+        vs->rv = rv;
+        vs->state = ACVP_ASYNC_COMPUTED;
+        as->running--;
+        acvp_async_signal(as, 1);
     }
-end:
-    free(login);
-    return rv;
+    acvp_mutex_unlock(&as->lock);
+    return NULL;
 }
+#endif
 
 /*
- * This function will process a single KAT vector set.  Each KAT
- * vector set has an identifier associated with it, called
- * the vs_id.  During registration, libacvp will receive the
- * list of vs_id's that need to be processed during the test
- * session.  This routine will execute the test flow for a single
- * vs_id.  The flow is:
- *	a) Download the KAT vector set from the server using the vs_id
- *	b) Parse the KAT vectors
- *	c) Process each test case in the KAT vector set
- *	d) Generate the response data
- *	e) Send the response data back to the ACVP server
+ * Set up a test session on the ctx, with worker_cnt worker threads.
+ * The session processes the vector sets when vectors is set, and
+ * then fetches the results of the test session when results is set.
+ * Nothing is sent to the server until the session is first advanced
+ * with acvp_async_step().
  */
-static ACVP_RESULT acvp_process_vsid(ACVP_CTX *ctx, char *vsid_url) {
-    ACVP_RESULT rv = ACVP_SUCCESS;
-    JSON_Value *val = NULL;
-    JSON_Object *obj = NULL;
-    char *json_buf = NULL;
-    int retry = 1;
+static ACVP_RESULT acvp_async_new(ACVP_CTX *ctx, int worker_cnt, int vectors, int results,
+                                  void (*vs_done_cb)(ACVP_CTX *ctx, int vs_id, ACVP_RESULT rv),
+                                  void (*done_cb)(ACVP_CTX *ctx, ACVP_RESULT rv)) {
+    ACVP_STRING_LIST *vs_entry = NULL;
+    ACVP_ASYNC *as = NULL;
+    ACVP_ASYNC_VS *vs = NULL;
+    ACVP_RESULT rv;
+    int i, vs_cnt = 0;
+
+    if (ctx->async) {
+        ACVP_LOG_ERR("A test session is already in progress");
+        return ACVP_INVALID_ARG;
+    }
+    if (vectors) {
+        vs_entry = ctx->vsid_url_list;
+        if (!vs_entry) {
+            return ACVP_MISSING_ARG;
+        }
+        while (vs_entry) {
+            vs_cnt++;
+            vs_entry = vs_entry->next;
+        }
+    }
+    if (results && !ctx->session_url) {
+        ACVP_LOG_ERR("Missing test session URL");
+        return ACVP_MISSING_ARG;
+    }
+
+    rv = acvp_transport_init(ctx);
+    if (rv != ACVP_SUCCESS) {
+        return rv;
+    }
+
+    as = calloc(1, sizeof(ACVP_ASYNC));
+    if (!as) {
+        return ACVP_MALLOC_FAIL;
+    }
+    if (vs_cnt) {
+        as->vs = calloc(vs_cnt, sizeof(ACVP_ASYNC_VS));
+        if (!as->vs) {
+            free(as);
+            return ACVP_MALLOC_FAIL;
+        }
+    }
+    if (acvp_mutex_init(&as->lock)) {
+        free(as->vs);
+        free(as);
+        return ACVP_MALLOC_FAIL;
+    }
+#ifndef WIN32
+    if (pthread_cond_init(&as->cond, NULL)) {
+        acvp_mutex_destroy(&as->lock);
+        free(as->vs);
+        free(as);
+        return ACVP_MALLOC_FAIL;
+    }
+#endif
+    as->ctx = ctx;
+    as->vs_cnt = vs_cnt;
+    as->want_results = results;
+    as->results.work.vsid_url = ctx->session_url;
+    as->vs_done_cb = vs_done_cb;
+    as->done_cb = done_cb;
+    as->pipe_fd[0] = -1;
+    as->pipe_fd[1] = -1;
+    ctx->async = as;
+    rv = acvp_net_multi_new(ctx, acvp_async_xfer_done, &as->net);
+    if (rv != ACVP_SUCCESS) {
+        acvp_async_free(ctx);
+        return rv;
+    }
+#ifndef WIN32
+    if (pipe(as->pipe_fd)) {
+        ACVP_LOG_ERR("Unable to create the event pipe");
+        as->pipe_fd[0] = -1;
+        as->pipe_fd[1] = -1;
+        acvp_async_free(ctx);
+        return ACVP_MALLOC_FAIL;
+    }
+    for (i = 0; i < 2; i++) {
+        fcntl(as->pipe_fd[i], F_SETFL, fcntl(as->pipe_fd[i], F_GETFL) | O_NONBLOCK);
+        fcntl(as->pipe_fd[i], F_SETFD, FD_CLOEXEC);
+    }
+#endif
+
+    vs_entry = ctx->vsid_url_list;
+    for (i = 0; i < vs_cnt; i++, vs_entry = vs_entry->next) {
+        vs = &as->vs[i];
+        vs->work.vsid_url = vs_entry->string;
 
-    //TODO: do we want to limit the number of retries?
-    while (retry) {
         /*
-         * Get the KAT vector set
+         * When resuming a session, skip what was done before
          */
-        rv = acvp_retrieve_vector_set(ctx, vsid_url);
+        switch (acvp_journal_vs_state(ctx, vs->work.vsid_url, &vs->work.vs_id)) {
+        case ACVP_JOURNAL_UPLOADED:
+            ACVP_LOG_STATUS("vsId %d: responses already uploaded", vs->work.vs_id);
+            vs->state = ACVP_ASYNC_DONE;
+            as->done++;
+            break;
+        case ACVP_JOURNAL_COMPUTED:
+            if (acvp_journal_load_responses(ctx, &vs->work) == ACVP_SUCCESS) {
+                vs->state = ACVP_ASYNC_COMPUTED;
+            } else {
+                ACVP_LOG_WARN("Unable to load the spooled responses, processing %s again",
+                              vs->work.vsid_url);
+            }
+            break;
+        case ACVP_JOURNAL_PENDING:
+        default:
+            break;
+        }
+    }
+
+#ifndef WIN32
+    for (i = 0; i < worker_cnt; i++) {
+        if (pthread_create(&as->workers[as->worker_cnt], NULL, acvp_async_worker_main, as)) {
+            ACVP_LOG_WARN("Unable to start worker thread %d", i);
+            continue;
+        }
+        as->worker_cnt++;
+    }
+    if (worker_cnt && !as->worker_cnt) {
+        ACVP_LOG_WARN("Processing the vector sets from the thread driving the session");
+    }
+#endif
+    acvp_mutex_lock(&as->lock);
+    acvp_async_signal(as, 1);
+    acvp_mutex_unlock(&as->lock);
+    return ACVP_SUCCESS;
+}
+
+/*
+ * The number of vector sets that may be downloaded and waiting to be
+ * processed.  That is ctx->prefetch_depth more than the workers that
+ * are idle, or than the one vector set the thread driving the session
+ * processes when there are no workers.
+ */
+static int acvp_async_fetch_limit(ACVP_CTX *ctx) {
+    ACVP_ASYNC *as = ctx->async;
+
+    if (!as->worker_cnt) {
+        return ctx->prefetch_depth + 1;
+    }
+    return ctx->prefetch_depth + as->worker_cnt - as->running;
+}
+
+/*
+ * Ask for the results of the test session once every vector set is
+ * done, and again each time the retry period the server asked for is
+ * over.  There is no point when the responses of a vector set could
+ * not be uploaded, since the server would never grade it.
+ */
+static void acvp_async_start_results(ACVP_CTX *ctx, time_t now) {
+    ACVP_ASYNC *as = ctx->async;
+    ACVP_ASYNC_VS *res = &as->results;
+    ACVP_RESULT rv;
+    int i;
+
+    if (!as->want_results || as->done < as->vs_cnt || res->state != ACVP_ASYNC_PENDING) {
+        return;
+    }
+    for (i = 0; i < as->vs_cnt; i++) {
+        if (as->vs[i].rv != ACVP_SUCCESS) {
+            ACVP_LOG_WARN("Not all the vector sets were uploaded, skipping the test session results");
+            res->state = ACVP_ASYNC_DONE;
+            return;
+        }
+    }
+    if (res->due > now) {
+        return;
+    }
+    res->state = ACVP_ASYNC_RESULTS;
+    rv = acvp_net_multi_get_result(as->net, &res->work, res->work.vsid_url, res);
+    if (rv != ACVP_SUCCESS) {
+        res->state = ACVP_ASYNC_DONE;
+        res->rv = rv;
+    }
+}
+
+/*
+ * Start the requests that are due: the uploads of the responses of
+ * the vector sets that were processed, and the downloads of the
+ * vector sets, the one the server asked us to come back for the
+ * earliest first.  Only as many vector sets as allowed by
+ * acvp_async_fetch_limit() are downloaded ahead of being processed,
+ * so memory use stays bounded.  The results of the test session come
+ * last.
+ */
+static void acvp_async_start_xfers(ACVP_CTX *ctx, time_t now) {
+    ACVP_ASYNC *as = ctx->async;
+    ACVP_ASYNC_VS *vs, *next;
+    ACVP_RESULT rv;
+    int i, held = 0;
+
+    for (i = 0; i < as->vs_cnt; i++) {
+        vs = &as->vs[i];
+        if (vs->state == ACVP_ASYNC_COMPUTED) {
+            if (vs->rv != ACVP_SUCCESS) {
+                acvp_async_vs_done(ctx, vs, vs->rv);
+                continue;
+            }
+            ACVP_LOG_STATUS("POST vector set response vsId: %d", vs->work.vs_id);
+            vs->state = ACVP_ASYNC_UPLOADING;
+            rv = acvp_net_multi_submit_responses(as->net, &vs->work, vs);
+            if (rv != ACVP_SUCCESS) {
+                acvp_async_vs_done(ctx, vs, rv);
+            }
+        } else if (vs->state == ACVP_ASYNC_FETCHING || vs->state == ACVP_ASYNC_READY) {
+            held++;
+        }
+    }
+    while (held < acvp_async_fetch_limit(ctx)) {
+        next = NULL;
+        for (i = 0; i < as->vs_cnt; i++) {
+            vs = &as->vs[i];
+            if (vs->state == ACVP_ASYNC_PENDING && vs->due <= now && (!next || vs->due < next->due)) {
+                next = vs;
+            }
+        }
+        if (!next) {
+            break;
+        }
+        next->state = ACVP_ASYNC_FETCHING;
+        rv = acvp_net_multi_get_vector_set(as->net, &next->work, next);
         if (rv != ACVP_SUCCESS) {
+            acvp_async_vs_done(ctx, next, rv);
+            continue;
+        }
+        held++;
+    }
+    acvp_async_start_results(ctx, now);
+}
+
+/*
+ * Log the body of a results response, all of it when verbose
+ */
+static void acvp_async_log_results(ACVP_CTX *ctx, const char *buf) {
+    if (ctx->debug == ACVP_LOG_LVL_VERBOSE) {
+        printf("%s\n", buf);
+    } else {
+        ACVP_LOG_ERR("%s", buf);
+    }
+}
+
+/*
+ * A request for the details of a vector set finished.  The results of
+ * the vector set are followed by its expected results in a sample
+ * session.  They are only logged.
+ */
+static void acvp_async_details_done(ACVP_CTX *ctx, ACVP_ASYNC_VS *vs, ACVP_RESULT rv) {
+    ACVP_ASYNC *as = ctx->async;
+
+    if (rv != ACVP_SUCCESS) {
+        ACVP_LOG_ERR("Transport failure.");
+        goto end;
+    }
+    if (vs->state == ACVP_ASYNC_EXPECTED) {
+        acvp_async_log_results(ctx, vs->work.sample_buf);
+        goto end;
+    }
+    acvp_async_log_results(ctx, vs->work.test_sess_buf);
+    if (ctx->is_sample) {
+        vs->state = ACVP_ASYNC_EXPECTED;
+        rv = acvp_net_multi_get_expected(as->net, &vs->work, vs->work.vsid_url, vs);
+        if (rv == ACVP_SUCCESS) {
+            return;
+        }
+    }
+
+end:
+    vs->state = ACVP_ASYNC_DONE;
+    vs->rv = rv;
+    as->details_done++;
+    acvp_vs_work_release(&vs->work);
+}
+
+/*
+ * The results of the test session were received.  Until the server
+ * has graded every vector set, they are asked for again after the
+ * retry period.  Once graded, the details of the vector sets that
+ * failed are fetched for the log, along with the expected results of a
+ * sample session.
+ */
+static void acvp_async_results_done(ACVP_CTX *ctx, ACVP_RESULT rv) {
+    ACVP_ASYNC *as = ctx->async;
+    ACVP_ASYNC_VS *res = &as->results, *vs;
+    JSON_Value *val = NULL;
+    JSON_Object *obj = NULL, *current = NULL;
+    JSON_Array *results = NULL;
+    unsigned int retry_period;
+    int i, count, diff = 1;
+
+    if (rv != ACVP_SUCCESS) {
+        ACVP_LOG_ERR("Transport failure.");
+        goto end;
+    }
+    acvp_async_log_results(ctx, res->work.test_sess_buf);
+    val = json_parse_string(res->work.test_sess_buf);
+    if (!val) {
+        ACVP_LOG_ERR("JSON parse error");
+        rv = ACVP_JSON_ERR;
+        goto end;
+    }
+    obj = acvp_get_obj_from_rsp(val);
+
+    if (json_object_get_boolean(obj, "passed")) {
+        ACVP_LOG_STATUS("Passed all vectors in test session");
+        goto end;
+    }
+
+    /*
+     * If we didn't pass all the vector sets, it could be because of
+     * a failure or the disposition being incomplete
+     */
+    results = json_object_get_array(obj, "results");
+    count = (int)json_array_get_count(results);
+    for (i = 0; i < count; i++) {
+        current = json_array_get_object(results, i);
+        strcmp_s("incomplete", 10, json_object_get_string(current, "status"), &diff);
+        if (!diff) {
+            retry_period = acvp_retry_period(ctx, json_object_get_number(obj, "retry"), &res->backoff);
+            ACVP_LOG_STATUS("Test session results not ready, asking again in %u seconds", retry_period);
+            res->due = time(NULL) + retry_period;
+            res->state = ACVP_ASYNC_PENDING;
+            json_value_free(val);
+            return;
+        }
+    }
+
+    if (ctx->debug >= ACVP_LOG_LVL_STATUS && count > 0) {
+        as->details = calloc(count, sizeof(ACVP_ASYNC_VS));
+        if (!as->details) {
+            rv = ACVP_MALLOC_FAIL;
             goto end;
         }
-        json_buf = ctx->kat_buf;
-        if (ctx->debug == ACVP_LOG_LVL_VERBOSE) {
-            printf("\n200 OK %s\n", ctx->kat_buf);
+        for (i = 0; i < count; i++) {
+            current = json_array_get_object(results, i);
+            diff = 1;
+            strcmp_s("fail", 4, json_object_get_string(current, "status"), &diff);
+            if (diff && !ctx->is_sample) {
+                continue;
+            }
+            vs = &as->details[as->details_cnt++];
+            vs->work.vsid_url = (char *)json_object_get_string(current, "vectorSetUrl");
+            if (!diff) {
+                ACVP_LOG_STATUS("Getting more details on failed vector set...");
+                vs->state = ACVP_ASYNC_RESULTS;
+                rv = acvp_net_multi_get_result(as->net, &vs->work, vs->work.vsid_url, vs);
+            } else {
+                vs->state = ACVP_ASYNC_EXPECTED;
+                rv = acvp_net_multi_get_expected(as->net, &vs->work, vs->work.vsid_url, vs);
+            }
+            if (rv != ACVP_SUCCESS) {
+                vs->state = ACVP_ASYNC_DONE;
+                vs->rv = rv;
+                as->details_done++;
+                rv = ACVP_SUCCESS;
+            }
+        }
+        /* The URLs of the details point into the results */
+        as->results_val = val;
+        val = NULL;
+    }
+    ACVP_LOG_STATUS("Received all dispositions for test session");
+
+end:
+    if (val) json_value_free(val);
+    res->state = ACVP_ASYNC_DONE;
+    res->rv = rv;
+}
+
+/*
+ * Called by the transport when a download or upload started by
+ * acvp_async_start_xfers() finished.
+ */
+static void acvp_async_xfer_done(ACVP_CTX *ctx, ACVP_VS_WORK *work, ACVP_RESULT rv, void *arg) {
+    ACVP_ASYNC_VS *vs = (ACVP_ASYNC_VS *)arg;
+    unsigned int retry_period = 0;
+
+    if (vs == &ctx->async->results) {
+        acvp_async_results_done(ctx, rv);
+        return;
+    }
+    if (vs->state == ACVP_ASYNC_RESULTS || vs->state == ACVP_ASYNC_EXPECTED) {
+        acvp_async_details_done(ctx, vs, rv);
+        return;
+    }
+    if (vs->state == ACVP_ASYNC_UPLOADING) {
+        if (rv == ACVP_SUCCESS) {
+            ACVP_LOG_STATUS("Finished POSTing KAT vector responses");
+            acvp_journal_uploaded(ctx, work);
         } else {
-            ACVP_LOG_STATUS("200 OK %s\n", ctx->kat_buf);
+            ACVP_LOG_ERR("Transport failure.");
         }
-        val = json_parse_string(json_buf);
-        if (!val) {
-            ACVP_LOG_ERR("JSON parse error");
-            rv = ACVP_JSON_ERR;
+        acvp_async_vs_done(ctx, vs, rv);
+        return;
+    }
+
+    if (rv == ACVP_SUCCESS) {
+        ACVP_LOG_STATUS("KAT vector set response received");
+        rv = acvp_parse_vector_set(ctx, work, &retry_period);
+    } else {
+        ACVP_LOG_ERR("Transport failure.");
+    }
+    if (rv == ACVP_KAT_DOWNLOAD_RETRY) {
+        retry_period = acvp_retry_period(ctx, retry_period, &vs->backoff);
+        ACVP_LOG_STATUS("KAT values not ready for %s, asking again in %u seconds",
+                        work->vsid_url, retry_period);
+        vs->due = time(NULL) + retry_period;
+        vs->state = ACVP_ASYNC_PENDING;
+    } else if (rv == ACVP_SUCCESS) {
+        vs->state = ACVP_ASYNC_READY;
+#ifndef WIN32
+        pthread_cond_signal(&ctx->async->cond);
+#endif
+    } else {
+        acvp_async_vs_done(ctx, vs, rv);
+    }
+}
+
+/*
+ * Returns 1 once every vector set is done and, when they are asked
+ * for, the results of the test session have been received.
+ */
+static int acvp_async_finished(ACVP_ASYNC *as) {
+    if (as->done < as->vs_cnt) {
+        return 0;
+    }
+    if (!as->want_results) {
+        return 1;
+    }
+    return as->results.state == ACVP_ASYNC_DONE && as->details_done == as->details_cnt;
+}
+
+/*
+ * Process the vector set that was downloaded first, when there are
+ * no workers to do it.  Returns 0 when there was none.
+ */
+static int acvp_async_run_one(ACVP_CTX *ctx) {
+    ACVP_ASYNC *as = ctx->async;
+    ACVP_ASYNC_VS *vs;
+    int i;
+
+    if (as->worker_cnt) {
+        return 0;
+    }
+    for (i = 0; i < as->vs_cnt; i++) {
+        vs = &as->vs[i];
+        if (vs->state == ACVP_ASYNC_READY) {
+            vs->rv = acvp_async_compute(ctx, vs);
+            vs->state = ACVP_ASYNC_COMPUTED;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Advance the test session as far as it can go without blocking.
+ * *finished is set once every vector set is done.  Otherwise
+ * *timeout_ms is set to when the session needs to be advanced again,
+ * if nothing woke up the caller before.
+ */
+static ACVP_RESULT acvp_async_step(ACVP_CTX *ctx, int *timeout_ms, int *finished) {
+    ACVP_ASYNC *as = ctx->async;
+    ACVP_ASYNC_VS *vs = NULL;
+    ACVP_RESULT rv = ACVP_SUCCESS;
+    time_t now, due = 0;
+    long net_timeout;
+    int i, ready = 0, held = 0, timeout;
+
+    *timeout_ms = -1;
+    *finished = 0;
+    acvp_mutex_lock(&as->lock);
+    if (!acvp_async_finished(as)) {
+        acvp_async_start_xfers(ctx, time(NULL));
+        rv = acvp_net_multi_perform(as->net);
+        if (rv != ACVP_SUCCESS) {
             goto end;
         }
-        obj = acvp_get_obj_from_rsp(val);
-        ctx->vsid_url = vsid_url;
+        if (acvp_async_run_one(ctx)) {
+            /* Get the upload of the responses going right away */
+            acvp_async_start_xfers(ctx, time(NULL));
+        }
+    }
 
-        /*
-         * Check if we received a retry response
-         */
-        unsigned int retry_period = json_object_get_number(obj, "retry");
-        if (retry_period) {
-            rv = acvp_retry_handler(ctx, retry_period);
-        } else {
+    if (acvp_async_finished(as)) {
+        *finished = 1;
+        goto end;
+    }
+
+    /* Work out when the session needs to be advanced again */
+    now = time(NULL);
+    for (i = 0; i < as->vs_cnt; i++) {
+        vs = &as->vs[i];
+        if (vs->state == ACVP_ASYNC_COMPUTED ||
+            (vs->state == ACVP_ASYNC_READY && !as->worker_cnt)) {
+            ready = 1;
+        }
+        if (vs->state == ACVP_ASYNC_READY || vs->state == ACVP_ASYNC_FETCHING) {
+            held++;
+        }
+    }
+    for (i = 0; i < as->vs_cnt; i++) {
+        vs = &as->vs[i];
+        if (vs->state == ACVP_ASYNC_PENDING) {
+            if (vs->due <= now) {
+                if (held < acvp_async_fetch_limit(ctx)) {
+                    ready = 1;
+                }
+            } else if (!due || vs->due < due) {
+                due = vs->due;
+            }
+        }
+    }
+    if (as->want_results && as->done == as->vs_cnt && as->results.state == ACVP_ASYNC_PENDING) {
+        if (as->results.due <= now) {
+            ready = 1;
+        } else if (!due || as->results.due < due) {
+            due = as->results.due;
+        }
+    }
+    timeout = due ? (int)(due - now) * 1000 : -1;
+    if (acvp_net_multi_count(as->net)) {
+        net_timeout = acvp_net_multi_timeout(as->net);
+        if (!as->wait_sockets && (net_timeout < 0 || net_timeout > ACVP_ASYNC_POLL_MS)) {
             /*
-             * Process the KAT vectors
+             * The caller doesn't wait on the sockets of the requests
+             * in flight, so come back soon to move them along.
              */
-            rv = acvp_process_vector_set(ctx, obj);
+            net_timeout = ACVP_ASYNC_POLL_MS;
+        }
+        if (net_timeout >= 0 && (timeout < 0 || net_timeout < timeout)) {
+            timeout = (int)net_timeout;
+        }
+    }
+    if (ready) {
+        timeout = 0;
+    }
+    acvp_async_signal(as, timeout == 0);
+    *timeout_ms = timeout;
+
+end:
+    acvp_mutex_unlock(&as->lock);
+    return rv;
+}
+
+/*
+ * Log how the vector sets of the session ended up, and return the
+ * result of the first vector set in the list that failed, or else of
+ * fetching the results of the test session.
+ */
+static ACVP_RESULT acvp_async_result(ACVP_CTX *ctx) {
+    ACVP_ASYNC *as = ctx->async;
+    ACVP_RESULT rv = ACVP_SUCCESS;
+    int i, done = 0;
+
+    for (i = 0; i < as->vs_cnt; i++) {
+        if (as->vs[i].rv == ACVP_SUCCESS) {
+            done++;
+        } else if (rv == ACVP_SUCCESS) {
+            rv = as->vs[i].rv;
+        }
+    }
+    if (as->vs_cnt) {
+        ACVP_LOG_STATUS("Uploaded responses for %d of %d vector sets", done, as->vs_cnt);
+    }
+    if (rv == ACVP_SUCCESS) {
+        rv = as->results.rv;
+    }
+    for (i = 0; i < as->details_cnt && rv == ACVP_SUCCESS; i++) {
+        rv = as->details[i].rv;
+    }
+    return rv;
+}
+
+/*
+ * Drive the session set up on the ctx from the calling thread until it
+ * is finished, waiting on the sockets of the requests in flight and on
+ * the workers in between, then free it.
+ */
+static ACVP_RESULT acvp_async_run(ACVP_CTX *ctx) {
+    ACVP_RESULT rv;
+    int timeout, finished = 0;
+
+    ctx->async->wait_sockets = 1;
+    while (1) {
+        rv = acvp_async_step(ctx, &timeout, &finished);
+        if (rv != ACVP_SUCCESS || finished) {
+            break;
+        }
+        rv = acvp_net_multi_wait(ctx->async->net, timeout, ctx->async->pipe_fd[0]);
+        if (rv != ACVP_SUCCESS) {
+            break;
+        }
+    }
+    if (finished) {
+        rv = acvp_async_result(ctx);
+    }
+    acvp_async_free(ctx);
+    return rv;
+}
+
+/*
+ * This function is used by the application after registration
+ * to commence the testing.  All the testing will be handled
+ * by libacvp.  This function will block the caller.  Therefore,
+ * it should be run on a separate thread if needed, or the session
+ * driven from the application's event loop with
+ * acvp_process_tests_start() and acvp_poll() instead.
+ *
+ * The calling thread keeps the downloads and uploads in flight
+ * without blocking on any one of them, the same as acvp_poll(), and
+ * waits on their sockets in between.  When a worker count greater
+ * than one, or a prefetch depth, has been set, the vector sets are
+ * run through the crypto handlers by worker threads, so the requests
+ * keep going while they are processed.
+ */
+ACVP_RESULT acvp_process_tests(ACVP_CTX *ctx) {
+    ACVP_STRING_LIST *vs_entry = NULL;
+    ACVP_RESULT rv = ACVP_SUCCESS;
+    int vs_cnt = 0, workers = 0;
+
+    if (!ctx) {
+        return ACVP_NO_CTX;
+    }
+
+    /*
+     * Iterate through the VS identifiers the server sent to us
+     * in the test session register response.  Process each vector set and
+     * return the results to the server.
+     */
+    vs_entry = ctx->vsid_url_list;
+    if (!vs_entry) {
+        return ACVP_MISSING_ARG;
+    }
+    while (vs_entry) {
+        vs_cnt++;
+        vs_entry = vs_entry->next;
+    }
+
+    if (vs_cnt > 1 && (ctx->worker_count > 1 || ctx->prefetch_depth > 0)) {
+#ifndef WIN32
+        workers = ctx->worker_count < vs_cnt ? ctx->worker_count : vs_cnt;
+        ACVP_LOG_STATUS("Processing %d vector sets with %d workers, prefetch depth %d",
+                        vs_cnt, workers, ctx->prefetch_depth);
+#else
+        if (ctx->worker_count > 1) {
+            ACVP_LOG_WARN("Worker threads are not supported on this platform, processing serially");
+        }
+#endif
+    }
+
+    rv = acvp_async_new(ctx, workers, 1, 0, NULL, NULL);
+    if (rv != ACVP_SUCCESS) {
+        return rv;
+    }
+    return acvp_async_run(ctx);
+}
+
+/*
+ * Start a test session that the application drives with acvp_poll().
+ * Nothing is sent to the server until the first call to acvp_poll().
+ * The vector sets are always run through the crypto handlers by
+ * worker threads, so acvp_poll() doesn't hold up the event loop it is
+ * called from, and the results of the test session are asked for
+ * once the vector sets are done.
+ */
+ACVP_RESULT acvp_process_tests_start(ACVP_CTX *ctx,
+                                     void (*vs_done_cb)(ACVP_CTX *ctx, int vs_id, ACVP_RESULT rv),
+                                     void (*done_cb)(ACVP_CTX *ctx, ACVP_RESULT rv)) {
+    ACVP_STRING_LIST *vs_entry = NULL;
+    ACVP_RESULT rv;
+    int vs_cnt = 0, workers = 0;
+
+    if (!ctx) {
+        return ACVP_NO_CTX;
+    }
+    for (vs_entry = ctx->vsid_url_list; vs_entry; vs_entry = vs_entry->next) {
+        vs_cnt++;
+    }
+#ifndef WIN32
+    workers = ctx->worker_count > 1 ? ctx->worker_count : 1;
+    if (workers > vs_cnt) {
+        workers = vs_cnt;
+    }
+#endif
+    rv = acvp_async_new(ctx, workers, 1, 1, vs_done_cb, done_cb);
+    if (rv != ACVP_SUCCESS) {
+        return rv;
+    }
+    ACVP_LOG_STATUS("Started processing %d vector sets", ctx->async->vs_cnt);
+    return ACVP_SUCCESS;
+}
+
+/*
+ * Advance the session started with acvp_process_tests_start() as far
+ * as it can go without blocking.  The downloads and uploads are kept
+ * in flight between calls, while the workers process the vector sets.
+ * Only when no worker could be started does each call run at most one
+ * vector set through the crypto handlers.
+ */
+ACVP_RESULT acvp_poll(ACVP_CTX *ctx, int *timeout_ms) {
+    void (*done_cb)(ACVP_CTX *ctx, ACVP_RESULT rv);
+    ACVP_RESULT rv;
+    int timeout, finished;
+
+    if (!ctx) {
+        return ACVP_NO_CTX;
+    }
+    if (timeout_ms) {
+        *timeout_ms = -1;
+    }
+    if (!ctx->async) {
+        return ACVP_NO_DATA;
+    }
+
+    rv = acvp_async_step(ctx, &timeout, &finished);
+    if (rv != ACVP_SUCCESS) {
+        return rv;
+    }
+    if (finished) {
+        /* Same result as acvp_process_tests() */
+        rv = acvp_async_result(ctx);
+        ACVP_LOG_STATUS("Finished processing %d vector sets", ctx->async->vs_cnt);
+        done_cb = ctx->async->done_cb;
+        acvp_async_free(ctx);
+        if (done_cb) {
+            (done_cb)(ctx, rv);
+        }
+        return ACVP_SUCCESS;
+    }
+    if (timeout_ms) {
+        *timeout_ms = timeout;
+    }
+    return ACVP_SUCCESS;
+}
+
+/*
+ * Return the descriptor the application's event loop waits on
+ * for a session started with acvp_process_tests_start().
+ */
+int acvp_get_fd(ACVP_CTX *ctx) {
+    if (!ctx || !ctx->async) {
+        return -1;
+    }
+    return ctx->async->pipe_fd[0];
+}
+
+/*
+ * Return the descriptors the application's event loop waits on for a
+ * session started with acvp_process_tests_start(): the one returned
+ * by acvp_get_fd(), then the sockets of the requests in flight.  Once
+ * the application waits on the sockets, acvp_poll() no longer asks to
+ * be called back every ACVP_ASYNC_POLL_MS to move the requests along.
+ */
+int acvp_get_fds(ACVP_CTX *ctx, ACVP_POLLFD *fds, int max) {
+    ACVP_ASYNC *as;
+    int n = 0;
+
+    if (!ctx || !ctx->async || max < 0 || (max && !fds)) {
+        return -1;
+    }
+    as = ctx->async;
+    acvp_mutex_lock(&as->lock);
+    as->wait_sockets = 1;
+    if (as->pipe_fd[0] >= 0) {
+        if (n < max) {
+            fds[n].fd = as->pipe_fd[0];
+            fds[n].events = ACVP_POLL_IN;
+        }
+        n++;
+    }
+    n += acvp_net_multi_fds(as->net, n < max ? fds + n : NULL, n < max ? max - n : 0);
+    acvp_mutex_unlock(&as->lock);
+    return n;
+}
+
+/*
+ * Work out how long to wait before asking the server again.  This is
+ * normally the retry period sent by the server.  When the server
+ * doesn't send a usable one, back off exponentially from
+ * ACVP_RETRY_TIME_MIN up to ACVP_RETRY_TIME_MAX.  *backoff holds the
+ * previous wait for the request being retried and starts at zero.
+ */
+static unsigned int acvp_retry_period(ACVP_CTX *ctx, unsigned int retry_period, unsigned int *backoff) {
+    if (retry_period > 0 && retry_period <= ACVP_RETRY_TIME_MAX) {
+        return retry_period;
+    }
+    if (!*backoff) {
+        *backoff = ACVP_RETRY_TIME_MIN;
+    } else if (*backoff < ACVP_RETRY_TIME_MAX / 2) {
+        *backoff *= 2;
+    } else {
+        *backoff = ACVP_RETRY_TIME_MAX;
+    }
+    ACVP_LOG_WARN("retry_period not found, backing off for %u seconds", *backoff);
+    return *backoff;
+}
+
+/*
+ * This routine asks the server for the results of the test session
+ * until every vector set has been graded.  The requests go through
+ * the same engine as acvp_process_tests(), with the retry period the
+ * server asks for as their deadline.
+ */
+ACVP_RESULT acvp_check_test_results(ACVP_CTX *ctx) {
+    ACVP_RESULT rv = ACVP_SUCCESS;
+
+    if (!ctx) {
+        return ACVP_NO_CTX;
+    }
+
+    rv = acvp_async_new(ctx, 0, 0, 1, NULL, NULL);
+    if (rv != ACVP_SUCCESS) {
+        return rv;
+    }
+    return acvp_async_run(ctx);
+}
+
+/***************************************************************************************************************
+* Begin vector processing logic.  This code should probably go into another module.
+***************************************************************************************************************/
+
+ACVP_RESULT acvp_refresh(ACVP_CTX *ctx) {
+    char *login = NULL;
+    int login_len = 0;
+    ACVP_RESULT rv = ACVP_SUCCESS;
+
+    if (!ctx) {
+        return ACVP_NO_CTX;
+    }
+
+    /*
+     * Only one thread may log in again at a time
+     */
+    acvp_mutex_lock(&ctx->jwt_lock);
+    if (ctx->totp_cb) {
+        rv = acvp_build_login(ctx, &login, &login_len, 1);
+        if (rv != ACVP_SUCCESS) {
+            ACVP_LOG_ERR("Unable to build login message");
+            goto end;
+        }
+
+        if (ctx->debug >= ACVP_LOG_LVL_STATUS) {
+            printf("\nPOST %s\n", login);
+        } else {
+            ACVP_LOG_INFO("POST %s", login);
         }
-        json_value_free(val);
 
         /*
-         * Check if we need to retry the download because
-         * the KAT values were not ready
+         * Send the login to the ACVP server and get the response,
          */
-        if (ACVP_KAT_DOWNLOAD_RETRY == rv) {
-            retry = 1;
-        } else if (rv != ACVP_SUCCESS) {
-            return rv;
+        rv = acvp_send_login(ctx, login, login_len);
+        if (rv == ACVP_SUCCESS) {
+            ACVP_LOG_STATUS("200 OK %s", ctx->reg_buf);
+            rv = acvp_parse_login(ctx, ctx->reg_buf);
         } else {
-            retry = 0;
+            ACVP_LOG_STATUS("Login Send Failed %s", ctx->reg_buf);
+            goto end;
+        }
+        if (rv != ACVP_SUCCESS) {
+            ACVP_LOG_STATUS("Login Response Failed, %d", rv);
         }
     }
+end:
+    acvp_mutex_unlock(&ctx->jwt_lock);
+    free(login);
+    return rv;
+}
+
+/*
+ * Parse the KAT vector set downloaded into work->kat_buf.  Returns
+ * ACVP_KAT_DOWNLOAD_RETRY along with the retry period when the server
+ * asked us to come back later.
+ */
+static ACVP_RESULT acvp_parse_vector_set(ACVP_CTX *ctx, ACVP_VS_WORK *work, unsigned int *retry_period) {
+    JSON_Object *obj = NULL;
+
+    if (ctx->debug == ACVP_LOG_LVL_VERBOSE) {
+        printf("\n200 OK %s\n", work->kat_buf);
+    } else {
+        ACVP_LOG_STATUS("200 OK %s\n", work->kat_buf);
+    }
+    /*
+     * The vector set was normally parsed while it was downloaded
+     */
+    if (work->kat_stream) {
+        work->kat_val = acvp_json_stream_finish(work->kat_stream);
+        acvp_json_stream_free(work->kat_stream);
+        work->kat_stream = NULL;
+    }
+    if (!work->kat_val) {
+        work->kat_val = json_parse_string(work->kat_buf);
+    }
+    if (!work->kat_val) {
+        ACVP_LOG_ERR("JSON parse error");
+        return ACVP_JSON_ERR;
+    }
+    obj = acvp_get_obj_from_rsp(work->kat_val);
 
     /*
-     * Send the responses to the ACVP server
+     * Check if we received a retry response
      */
-    ACVP_LOG_STATUS("POST vector set response vsId: %d", ctx->vs_id);
-    rv = acvp_submit_vector_responses(ctx);
-end:
-    return rv;
+    if (json_object_has_value(obj, "retry")) {
+        *retry_period = json_object_get_number(obj, "retry");
+        json_value_free(work->kat_val);
+        work->kat_val = NULL;
+        return ACVP_KAT_DOWNLOAD_RETRY;
+    }
+
+    /*
+     * The raw download is no longer needed once parsed, don't keep
+     * it around while the vector set waits to be processed.
+     */
+    free(work->kat_buf);
+    work->kat_buf = NULL;
+    work->kat_buf_size = 0;
+    return ACVP_SUCCESS;
+}
+
+/*
+ * This function will process the test cases of a vector set
+ * previously downloaded and parsed by acvp_parse_vector_set(), leaving the
+ * responses in work->kat_resp, ready to be uploaded.
+ */
+ACVP_RESULT acvp_run_vector_set(ACVP_CTX *ctx, ACVP_VS_WORK *work) {
+    ACVP_RESULT rv;
+
+    /*
+     * Process the KAT vectors
+     */
+    rv = acvp_process_vector_set(ctx, work, acvp_get_obj_from_rsp(work->kat_val));
+    if (rv != ACVP_SUCCESS) {
+        return rv;
+    }
+    if (!work->kat_resp) {
+        ACVP_LOG_ERR("Missing vector set responses");
+        return ACVP_MISSING_ARG;
+    }
+
+    /* A journal failure is logged but doesn't fail the vector set */
+    acvp_journal_computed(ctx, work);
+    return ACVP_SUCCESS;
 }
 
 /*
  * This function is used to invoke the appropriate handler function
  * for a given ACV operation.  The operation is specified in the
  * KAT vector set that was previously downloaded.  The handler function
- * is looked up in the alg_tbl[] and invoked here.
+ * is looked up in the alg_tbl[] by acvp_lookup_alg_handler() and
+ * invoked here.
  */
-static ACVP_RESULT acvp_dispatch_vector_set(ACVP_CTX *ctx, JSON_Object *obj) {
-    int i;
+static ACVP_RESULT acvp_dispatch_vector_set(ACVP_CTX *ctx, ACVP_VS_WORK *work, JSON_Object *obj) {
     const char *alg = json_object_get_string(obj, "algorithm");
     const char *mode = json_object_get_string(obj, "mode");
     int vs_id = json_object_get_number(obj, "vsId");
-    int diff = 1;
+    ACVP_ALG_HANDLER *entry;
 
-    ctx->vs_id = vs_id;
-    ACVP_RESULT rv;
+    work->vs_id = vs_id;
 
     if (!alg) {
         ACVP_LOG_ERR("JSON parse error: ACV algorithm not found");
@@ -1924,35 +3150,18 @@ static ACVP_RESULT acvp_dispatch_vector_set(ACVP_CTX *ctx, JSON_Object *obj) {
     ACVP_LOG_STATUS("ACV Operation: %s", alg);
     ACVP_LOG_INFO("ACV version: %s", json_object_get_string(obj, "acvVersion"));
 
-    for (i = 0; i < ACVP_ALG_MAX; i++) {
-        strcmp_s(alg_tbl[i].name,
-                 strnlen_s(alg_tbl[i].name, ACVP_ALG_NAME_MAX),
-                 alg, &diff);
-        if (!diff) {
-            if (mode == NULL) {
-                rv = (alg_tbl[i].handler)(ctx, obj);
-                return rv;
-            }
-
-            if (alg_tbl[i].mode != NULL) {
-                strcmp_s(alg_tbl[i].mode,
-                        strnlen_s(alg_tbl[i].mode, ACVP_ALG_MODE_MAX),
-                        mode, &diff);
-                if (!diff) {
-                    rv = (alg_tbl[i].handler)(ctx, obj);
-                    return rv;
-                }
-            }
-        }
+    entry = acvp_lookup_alg_handler(alg, mode);
+    if (!entry) {
+        return ACVP_UNSUPPORTED_OP;
     }
-    return ACVP_UNSUPPORTED_OP;
+    return (entry->handler)(ctx, work, obj);
 }
 
 /*
  * This function is used to process the test cases for
  * a given KAT vector set.  This is invoked after the
  * KAT vector set has been downloaded from the server.  The
- * vectors are stored on the ACVP_CTX in one of the
+ * vectors are stored on the ACVP_VS_WORK in one of the
  * transitory fields.  Therefore, the vs_id isn't needed
  * here to know which vectors need to be processed.
  *
@@ -1962,10 +3171,10 @@ static ACVP_RESULT acvp_dispatch_vector_set(ACVP_CTX *ctx, JSON_Object *obj) {
  *	c) Dispatch the vectors to the handler for the
  *	   specified ACVP operation.
  */
-static ACVP_RESULT acvp_process_vector_set(ACVP_CTX *ctx, JSON_Object *obj) {
+static ACVP_RESULT acvp_process_vector_set(ACVP_CTX *ctx, ACVP_VS_WORK *work, JSON_Object *obj) {
     ACVP_RESULT rv;
 
-    rv = acvp_dispatch_vector_set(ctx, obj);
+    rv = acvp_dispatch_vector_set(ctx, work, obj);
     if (rv != ACVP_SUCCESS) {
         return rv;
     }
@@ -1974,117 +3183,6 @@ static ACVP_RESULT acvp_process_vector_set(ACVP_CTX *ctx, JSON_Object *obj) {
     return ACVP_SUCCESS;
 }
 
-/*
- * This function will get the test results for a single KAT vector set.
- */
-static ACVP_RESULT acvp_get_result_test_session(ACVP_CTX *ctx, char *session_url) {
-    ACVP_RESULT rv = ACVP_SUCCESS;
-    JSON_Value *val = NULL;
-    JSON_Object *obj = NULL;
-    char *json_buf = NULL;
-    int retry = 1, count = 0, i, passed;
-    JSON_Array *results = NULL;
-    JSON_Object *current = NULL;
-    int diff = 1;
-
-    while (retry) {
-        /*
-         * Get the KAT vector set
-         */
-        rv = acvp_retrieve_result(ctx, session_url);
-        if (rv != ACVP_SUCCESS) {
-            goto end;
-        }
-        json_buf = ctx->test_sess_buf;
-
-        if (ctx->debug == ACVP_LOG_LVL_VERBOSE) {
-            printf("%s\n", ctx->test_sess_buf);
-        } else {
-            ACVP_LOG_ERR("%s", ctx->test_sess_buf);
-        }
-        val = json_parse_string(json_buf);
-        if (!val) {
-            ACVP_LOG_ERR("JSON parse error");
-            return ACVP_JSON_ERR;
-        }
-        obj = acvp_get_obj_from_rsp(val);
-
-        results = json_object_get_array(obj, "results");
-        count = (int)json_array_get_count(results);
-
-        passed = json_object_get_boolean(obj, "passed");
-        if (passed) {
-            ACVP_LOG_STATUS("Passed all vectors in test session");
-            goto end;
-        }
-
-        /*
-         * If we didn't pass all the vector sets, it could be because of
-         * a failure or the disposition being incomplete
-         */
-        for (i = 0; i < count; i++) {
-            current = json_array_get_object(results, i);
-
-            strcmp_s("incomplete", 10,
-                     json_object_get_string(current, "status"), &diff);
-
-            if (!diff) {
-                rv = acvp_retry_handler(ctx, 30);
-                if (ACVP_KAT_DOWNLOAD_RETRY == rv) {
-                    retry = 1;
-                } else if (rv != ACVP_SUCCESS) {
-                    goto end;
-                } else {
-                    retry = 0;
-                }
-                if (val) json_value_free(val);
-                val = NULL;
-                break;
-            } else {
-                retry = 0;
-                if (ctx->debug >= ACVP_LOG_LVL_STATUS) {
-                    strcmp_s("fail", 4,
-                             json_object_get_string(current, "status"), &diff);
-
-                    if (!diff) {
-                        ACVP_LOG_STATUS("Getting more details on failed vector set...");
-                        rv = acvp_retrieve_result(ctx, (char *)json_object_get_string(current, "vectorSetUrl"));
-                        if (rv != ACVP_SUCCESS) {
-                            goto end;
-                        }
-                        json_buf = ctx->test_sess_buf;
-
-                        if (ctx->debug == ACVP_LOG_LVL_VERBOSE) {
-                            printf("%s\n", ctx->test_sess_buf);
-                        } else {
-                            ACVP_LOG_ERR("%s", ctx->test_sess_buf);
-                        }
-                    }
-                    if (ctx->is_sample) {
-                        rv = acvp_retrieve_expected_result(ctx, (char *)json_object_get_string(current, "vectorSetUrl"));
-                        if (rv != ACVP_SUCCESS) {
-                            goto end;
-                        }
-                        if (ctx->debug == ACVP_LOG_LVL_VERBOSE) {
-                            printf("%s\n", ctx->sample_buf);
-                        } else {
-                            ACVP_LOG_ERR("%s", ctx->sample_buf);
-                        }
-                        free(ctx->sample_buf);
-                        ctx->sample_buf = NULL;
-                    }
-                }
-            }
-        }
-    }
-
-    ACVP_LOG_STATUS("Received all dispositions for test session");
-
-end:
-    if (val) json_value_free(val);
-    return rv;
-}
-
 char *acvp_version(void) {
     return ACVP_LIBRARY_VERSION;
 }
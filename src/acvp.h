@@ -31,6 +31,8 @@
 #ifndef acvp_h
 #define acvp_h
 
+#include <time.h>
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -52,6 +54,95 @@ typedef enum acvp_log_lvl {
     ACVP_LOG_LVL_VERBOSE,
 } ACVP_LOG_LVL;
 
+/*! @enum ACVP_COMPRESSION
+ * @brief This enum defines which HTTP messages exchanged with
+ * the ACVP server are compressed, see acvp_set_compression()
+ */
+typedef enum acvp_compression {
+    ACVP_COMPRESSION_NONE = 0,
+    ACVP_COMPRESSION_DOWNLOADS = 1, /**< Accept compressed responses from the server */
+    ACVP_COMPRESSION_UPLOADS = 2,   /**< Compress the vector set responses sent */
+    ACVP_COMPRESSION_ALL = 3
+} ACVP_COMPRESSION;
+
+/*! @enum ACVP_NET_ACTION
+ * @brief This enum defines the kinds of requests sent to
+ * the ACVP server, as recorded in ACVP_HTTP_STATS
+ */
+typedef enum acvp_net_action {
+    ACVP_NET_ACTION_GET_RESULT = 1,
+    ACVP_NET_ACTION_GET_VECTOR_SET,
+    ACVP_NET_ACTION_GET_SAMPLE,
+    ACVP_NET_ACTION_POST_VECTOR_RESP,
+    ACVP_NET_ACTION_LOGIN,
+    ACVP_NET_ACTION_REGISTER
+} ACVP_NET_ACTION;
+
+#define ACVP_POLL_IN  1     /**< wait for the descriptor to become readable */
+#define ACVP_POLL_OUT 2     /**< wait for the descriptor to become writable */
+
+/*! @struct ACVP_POLLFD
+ * @brief This struct holds a descriptor the application's event loop
+ * waits on for a session started with acvp_process_tests_start(),
+ * see acvp_get_fds()
+ */
+typedef struct acvp_pollfd_t {
+    int fd;
+    short events;           /**< ACVP_POLL_IN, ACVP_POLL_OUT or both */
+} ACVP_POLLFD;
+
+/*! @struct ACVP_HTTP_STATS
+ * @brief This struct holds the timing of one request sent to
+ * the ACVP server, see acvp_get_http_stats()
+ *
+ * The times are in microseconds from the start of the request, as
+ * measured by curl.  The DNS, connect and TLS times are zero when an
+ * existing connection was reused.  Only the action, vsId, HTTP status
+ * and time are known when libacvp is built with murl, and only those
+ * and the bytes sent with a transport set with acvp_set_transport().
+ */
+typedef struct acvp_http_stats_t {
+    ACVP_NET_ACTION action;
+    int vs_id;              /**< vsId the request was for, zero if none */
+    long http_code;         /**< HTTP status, zero if the request failed */
+    time_t time;            /**< when the request completed */
+    long dns_us;            /**< host name resolved */
+    long connect_us;        /**< TCP connection established */
+    long tls_us;            /**< TLS handshake completed */
+    long pretransfer_us;    /**< about to send the request */
+    long first_byte_us;     /**< first byte of the response received, or of
+                                 a streamed request body sent */
+    long total_us;          /**< response fully received */
+    long bytes_sent;        /**< size of the request body */
+    long bytes_received;    /**< size of the response body */
+} ACVP_HTTP_STATS;
+
+/*! @brief ACVP_TRANSPORT_WRITE_FN is the type of the function a transport
+ * passes the body of a response to.  It returns the number of bytes it
+ * took, and the request must fail when that is less than size * nmemb.
+ */
+typedef size_t (*ACVP_TRANSPORT_WRITE_FN)(void *ptr, size_t size, size_t nmemb, void *write_arg);
+
+/*! @struct ACVP_TRANSPORT
+ * @brief This struct holds the functions used to send requests to the
+ * ACVP server in place of libcurl, see acvp_set_transport()
+ *
+ * get and post send a request to the URL and return the HTTP status
+ * of the response, or zero if the request could not be sent.  token is
+ * the JWT to send as a bearer token, or NULL before logging in.  The
+ * body of the response is passed to write_fn with write_arg, in as
+ * many pieces as convenient.  The functions are only called from the
+ * thread that calls into libacvp, never from its worker threads.
+ */
+typedef struct acvp_transport_t {
+    long (*get)(void *data, const char *url, const char *token,
+                ACVP_TRANSPORT_WRITE_FN write_fn, void *write_arg);
+    long (*post)(void *data, const char *url, const char *token, const char *body, int body_len,
+                 ACVP_TRANSPORT_WRITE_FN write_fn, void *write_arg);
+    void (*free)(void *data);   /**< called when the transport is released, may be NULL */
+    void *data;                 /**< passed to each of the functions */
+} ACVP_TRANSPORT;
+
 /*! @struct ACVP_KV_LIST
  * @brief This struct is a list of key/value pairs
  * to be added to flexible JSON objects during registration
@@ -1398,6 +1489,7 @@ enum acvp_result {
     ACVP_DUPLICATE_CTX,
     ACVP_JWT_EXPIRED,
     ACVP_JWT_INVALID,
+    ACVP_JOURNAL_FAIL,
     ACVP_RESULT_MAX
 };
 
@@ -2569,6 +2661,46 @@ ACVP_RESULT acvp_mark_as_sample(ACVP_CTX *ctx);
  */
 ACVP_RESULT acvp_register(ACVP_CTX *ctx);
 
+/*! @brief acvp_set_journal() enables the session journal.
+
+    When enabled, acvp_register() writes a journal of the test session
+    to the given path, and acvp_process_tests() keeps it up to date as
+    each vector set is computed and uploaded.  The responses computed
+    for each vector set are spooled to files next to the journal until
+    the server acknowledges them.  If the application dies part way
+    through the session, acvp_resume_session() picks it up from the
+    journal.  This function should be called before acvp_register().
+
+    @param ctx Pointer to ACVP_CTX that was previously created by
+        calling acvp_create_test_session.
+    @param journal_path Path of the journal file.
+
+    @return ACVP_RESULT
+ */
+ACVP_RESULT acvp_set_journal(ACVP_CTX *ctx, const char *journal_path);
+
+/*! @brief acvp_resume_session() resumes an interrupted test session.
+
+    This function is used instead of acvp_register() to continue a
+    test session from the journal written by an earlier run, see
+    acvp_set_journal().  The application then calls acvp_process_tests()
+    and acvp_check_test_results() as usual.  Vector sets already
+    uploaded are not processed again, and vector sets that were
+    computed but never acknowledged by the server are uploaded from the
+    spooled responses without being computed again.  The journal keeps
+    being updated as the session progresses.
+
+    The ctx must have the same server, capabilities and 2FA callback
+    as the original run, so the JWT can be refreshed if it expired.
+
+    @param ctx Pointer to ACVP_CTX that was previously created by
+        calling acvp_create_test_session.
+    @param journal_path Path of the journal file.
+
+    @return ACVP_RESULT
+ */
+ACVP_RESULT acvp_resume_session(ACVP_CTX *ctx, const char *journal_path);
+
 /*! @brief acvp_process_tests() performs the ACVP testing procedures.
 
     This function will commence the test session after the DUT has
@@ -2584,6 +2716,312 @@ ACVP_RESULT acvp_register(ACVP_CTX *ctx);
  */
 ACVP_RESULT acvp_process_tests(ACVP_CTX *ctx);
 
+/*! @brief acvp_process_tests_start() starts the ACVP testing procedures
+    without blocking the caller.
+
+    This is an alternative to acvp_process_tests() for applications
+    that run an event loop.  It prepares the test session and returns
+    right away.  The application then calls acvp_poll() each time one
+    of the descriptors returned by acvp_get_fds() is ready, or the
+    timeout returned by the previous acvp_poll() expires.  One thread
+    can drive the sessions of several ACVP_CTX this way.
+
+    The vector sets are run through the crypto handlers by worker
+    threads, as many as set with acvp_set_worker_count() and at least
+    one, so the crypto handlers are never called from acvp_poll().
+    Once every vector set is done, the results of the test session are
+    asked for, as acvp_check_test_results() does, so there is no need
+    to call it afterwards.
+
+    @param ctx Pointer to ACVP_CTX that was previously created by
+        calling acvp_create_test_session.
+    @param vs_done_cb Optional callback invoked from acvp_poll() each
+        time a vector set has been uploaded or has failed, with its
+        vsId (zero if it could not be downloaded) and result.
+    @param done_cb Optional callback invoked from acvp_poll() once every
+        vector set is done and the server graded the test session, with
+        the result acvp_process_tests() followed by
+        acvp_check_test_results() would have returned.  The ctx may be
+        freed from this callback.
+
+    @return ACVP_RESULT
+ */
+ACVP_RESULT acvp_process_tests_start(ACVP_CTX *ctx,
+                                     void (*vs_done_cb)(ACVP_CTX *ctx, int vs_id, ACVP_RESULT rv),
+                                     void (*done_cb)(ACVP_CTX *ctx, ACVP_RESULT rv));
+
+/*! @brief acvp_poll() advances a session started with
+    acvp_process_tests_start().
+
+    Each call starts the downloads and uploads that are due, moves the
+    ones in flight along without blocking, and hands the downloaded
+    vector sets to the workers.  Up to the prefetch depth set with
+    acvp_set_prefetch_depth() vector sets are downloaded while the
+    workers are busy.  Vector sets the server is not done generating,
+    and the results of the test session until the server graded it,
+    are asked for again after the retry period the server sent, without
+    holding up anything else.  When the JWT expires, it is refreshed
+    with a login sent the same way, while the requests the server
+    turned away wait for it.  The 2fa callback set with
+    acvp_set_2fa_callback() is called from acvp_poll() then.
+
+    @param ctx Pointer to ACVP_CTX that was previously created by
+        calling acvp_create_test_session.
+    @param timeout_ms Optional, set to the number of milliseconds after
+        which acvp_poll() should be called again if none of the
+        descriptors from acvp_get_fds() is ready first: 0 when there is
+        more work to do right away, -1 when there is no deadline and
+        once the session is done.  While requests are in flight and the
+        application hasn't called acvp_get_fds(), it is never more than
+        a short interval.
+
+    @return ACVP_RESULT, ACVP_NO_DATA when no session is in progress.
+        The results of the vector sets are reported to the callbacks.
+ */
+ACVP_RESULT acvp_poll(ACVP_CTX *ctx, int *timeout_ms);
+
+/*! @brief acvp_get_fd() returns the descriptor to wait on for a session
+    started with acvp_process_tests_start().
+
+    The descriptor is readable while acvp_poll() has work to do right
+    away, which includes when a worker is done with a vector set.  The
+    application must not read from it or close it.  Waiting on this
+    descriptor alone, acvp_poll() has to be called back every short
+    interval while requests are in flight, see acvp_get_fds().
+
+    @param ctx Pointer to ACVP_CTX that was previously created by
+        calling acvp_create_test_session.
+
+    @return a file descriptor, or -1 when no session is in progress or
+        on platforms without pipes, in which case the application relies
+        on the timeout returned by acvp_poll().
+ */
+int acvp_get_fd(ACVP_CTX *ctx);
+
+/*! @brief acvp_get_fds() returns all the descriptors to wait on for a
+    session started with acvp_process_tests_start().
+
+    These are the descriptor returned by acvp_get_fd(), waited on for
+    ACVP_POLL_IN, followed by the sockets of the requests in flight,
+    each with what to wait for on it.  They change as requests start
+    and finish, so the application asks for them again after each call
+    to acvp_poll(), and calls acvp_poll() when any of them is ready.
+    The application must not read from, write to, or close them.
+
+    @param ctx Pointer to ACVP_CTX that was previously created by
+        calling acvp_create_test_session.
+    @param fds Array filled with up to max descriptors.
+    @param max Number of entries in fds.
+
+    @return the number of descriptors, which may be more than max, in
+        which case the application asks again with a larger array, or
+        -1 when no session is in progress.
+ */
+int acvp_get_fds(ACVP_CTX *ctx, ACVP_POLLFD *fds, int max);
+
+/*! @brief acvp_process_vector_files() processes vector sets saved to
+    files, without an ACVP server.
+
+    Every file named *.json in the input directory is expected to hold
+    one vector set, as downloaded from the server.  Each vector set is
+    processed by the crypto handlers registered with the acvp_enable_*
+    functions, and its responses are written to a file of the same name
+    with the .rsp.json extension.  There is no need to call
+    acvp_register() first.  The files are processed by the number of
+    threads set with acvp_set_worker_count().
+
+    @param ctx Pointer to ACVP_CTX that was previously created by
+        calling acvp_create_test_session.
+    @param in_dir Directory holding the vector set files.
+    @param out_dir Directory the response files are written to, or NULL
+        to write them to in_dir.
+
+    @return ACVP_RESULT of the first file, in name order, that could not
+        be processed, or ACVP_SUCCESS
+ */
+ACVP_RESULT acvp_process_vector_files(ACVP_CTX *ctx, const char *in_dir, const char *out_dir);
+
+/*! @brief acvp_set_worker_count() sets the number of vector sets that
+    acvp_process_tests() will process concurrently.
+
+    By default the vector sets are processed one at a time.  When a
+    worker count greater than one is set, that many worker threads run
+    the downloaded vector sets through the crypto handlers at once,
+    while the thread that called acvp_process_tests() keeps the
+    downloads and uploads of all the vector sets in flight.  The crypto
+    handlers registered with the acvp_enable_* functions will then be
+    invoked from several threads and must be reentrant.  The worker
+    threads exit when the vector sets are done, see
+    acvp_set_group_workers() about the state handlers keep per thread.
+
+    @param ctx Pointer to ACVP_CTX that was previously created by
+        calling acvp_create_test_session.
+    @param worker_count Number of worker threads, from 1 to 32.
+
+    @return ACVP_RESULT
+ */
+ACVP_RESULT acvp_set_worker_count(ACVP_CTX *ctx, int worker_count);
+
+/*! @brief acvp_set_group_workers() sets the number of test groups of a
+    vector set that are processed concurrently.
+
+    By default the test groups of a vector set are processed one at a
+    time.  When a count greater than one is set, the test groups of the
+    AES, HMAC and ECDSA vector sets are spread over that many threads.
+    The responses are gathered in the order of the test groups, so they
+    are the same as when processed one at a time.  The crypto handlers
+    must be reentrant, and state they keep across the test cases of a
+    group, such as for the Monte Carlo tests, must be kept per thread.
+
+    The threads are started the first time a vector set needs them and
+    are kept for the following vector sets until
+    acvp_free_test_session() stops them.  State a handler keeps per
+    thread is not freed by libacvp.  The application must free it when
+    the thread exits, for instance with the destructor of a key created
+    with pthread_key_create(), or it leaks with every thread that exits.
+
+    @param ctx Pointer to ACVP_CTX that was previously created by
+        calling acvp_create_test_session.
+    @param group_workers Number of threads per vector set, from 1 to 32.
+
+    @return ACVP_RESULT
+ */
+ACVP_RESULT acvp_set_group_workers(ACVP_CTX *ctx, int group_workers);
+
+/*! @brief acvp_set_prefetch_depth() sets how many vector sets
+    acvp_process_tests() may download ahead of the ones being processed.
+
+    While a vector set is run through the crypto handlers, the next
+    ones are downloaded and parsed.  The server is asked again for all
+    the vector sets that are not ready yet, each one at the retry period
+    the server asked for, so the waits overlap.  The depth is the number
+    of downloaded vector sets that may be held waiting for a worker.
+    The default depth is 0, which downloads each vector set only when a
+    worker is ready for it.  With acvp_process_tests(), a depth greater
+    than 0 runs the crypto handlers on a worker thread, so an application
+    opting in must allow its handlers to be called from a thread other
+    than the one that called acvp_process_tests().  Prefetching is not
+    available on platforms without pthreads.
+
+    @param ctx Pointer to ACVP_CTX that was previously created by
+        calling acvp_create_test_session.
+    @param prefetch_depth Number of vector sets to download ahead,
+        from 0 to 8.
+
+    @return ACVP_RESULT
+ */
+ACVP_RESULT acvp_set_prefetch_depth(ACVP_CTX *ctx, int prefetch_depth);
+
+/*! @brief acvp_set_compression() sets which HTTP messages exchanged
+    with the ACVP server are compressed.
+
+    Vector sets and their responses are mostly hex strings, which
+    compress several times over.  With ACVP_COMPRESSION_DOWNLOADS, the
+    requests ask the server for gzip or deflate encoded responses,
+    which are decoded as they are received.  With
+    ACVP_COMPRESSION_UPLOADS, the vector set responses are sent gzip
+    encoded, which the server must support.  Responses are sent
+    uncompressed when they were loaded back from the session journal.
+    A transport set with acvp_set_transport() has no way to tell the
+    server the body is compressed, so ACVP_COMPRESSION_UPLOADS can't be
+    used with one.  By default nothing is compressed.  This function
+    should be called before acvp_register().
+
+    @param ctx Pointer to ACVP_CTX that was previously created by
+        calling acvp_create_test_session.
+    @param compression Which messages to compress.
+
+    @return ACVP_RESULT, ACVP_INVALID_ARG when ACVP_COMPRESSION_UPLOADS
+        is asked for while a transport is set.
+ */
+ACVP_RESULT acvp_set_compression(ACVP_CTX *ctx, ACVP_COMPRESSION compression);
+
+/*! @brief acvp_get_http_stats() returns the timing of the requests sent
+    to the ACVP server so far.
+
+    Each request sent to the server is recorded, including the ones
+    retried because the vector set was not ready yet or the JWT had
+    expired, so the time the server took to answer can be told apart
+    from the time spent on the network.  The records are in the order
+    the requests completed.
+
+    @param ctx Pointer to ACVP_CTX that was previously created by
+        calling acvp_create_test_session.
+    @param stats Array the records are copied to, may be NULL when max
+        is zero.
+    @param max Number of records the array can hold.
+    @param count Set to the number of requests recorded, which may be
+        more than max.  Only the first max records are copied.
+
+    @return ACVP_RESULT
+ */
+ACVP_RESULT acvp_get_http_stats(ACVP_CTX *ctx, ACVP_HTTP_STATS *stats, int max, int *count);
+
+/*! @brief acvp_set_http_stats_report() has the timing of the requests
+    sent to the ACVP server written to a file at the end of the session.
+
+    The report is written in JSON when the ctx is freed.  It lists
+    every request, as returned by acvp_get_http_stats(), and totals
+    for each kind of request.  The wait time in the totals is the time
+    from sending the request to the response, which is mostly the
+    server's.
+
+    @param ctx Pointer to ACVP_CTX that was previously created by
+        calling acvp_create_test_session.
+    @param report_path Path of the report file.
+
+    @return ACVP_RESULT
+ */
+ACVP_RESULT acvp_set_http_stats_report(ACVP_CTX *ctx, const char *report_path);
+
+/*! @brief acvp_set_transport() has the requests to the ACVP server sent
+    with the functions in transport instead of libcurl.
+
+    The struct is copied, and the free function in it, if any, is
+    called with the data when the transport is replaced or the ctx is
+    freed.  Request bodies are not compressed, and the requests of a
+    session started with acvp_process_tests_start() are sent one at a
+    time since the functions block.
+
+    @param ctx Pointer to ACVP_CTX that was previously created by
+        calling acvp_create_test_session.
+    @param transport The functions to use, or NULL to go back to
+        libcurl.
+
+    @return ACVP_RESULT, ACVP_INVALID_ARG when ACVP_COMPRESSION_UPLOADS
+        was set with acvp_set_compression() or a session started with
+        acvp_process_tests_start() is still running.
+ */
+ACVP_RESULT acvp_set_transport(ACVP_CTX *ctx, const ACVP_TRANSPORT *transport);
+
+/*! @brief acvp_set_loopback_transport() has the ctx talk to a server
+    in the same process, which serves the vector sets saved to a
+    directory and writes the responses to files.
+
+    This runs the whole of acvp_register(), acvp_process_tests() and
+    acvp_check_test_results() with no network, to benchmark or test the
+    crypto module and libacvp.  The directory is laid out as for
+    acvp_process_vector_files(): each *.json file holds one vector set,
+    and the responses to it are written to a *.rsp.json file of the
+    same name.  The server, API context and path segment must still be
+    set, since they are part of the URLs.
+
+    A vector set passes once its responses are received.  If the input
+    directory also holds the *.rsp.json file of a vector set when the
+    responses are received, say from an earlier run against a known good
+    module, the responses must match it instead.
+
+    @param ctx Pointer to ACVP_CTX that was previously created by
+        calling acvp_create_test_session.
+    @param in_dir Directory holding the vector set files.
+    @param out_dir Directory the response files are written to, or NULL
+        for in_dir.
+
+    @return ACVP_RESULT, ACVP_INVALID_ARG when a session started with
+        acvp_process_tests_start() is still running.
+ */
+ACVP_RESULT acvp_set_loopback_transport(ACVP_CTX *ctx, const char *in_dir, const char *out_dir);
+
 /*! @brief acvp_set_vendor_info() specifies the vendor attributes
     for the test session.
 
@@ -2647,6 +3085,10 @@ ACVP_RESULT acvp_add_oe_dependency(ACVP_CTX *ctx,
 /*! @brief acvp_check_test_results() allows the application to fetch vector
         set results from the server during a test session.
 
+   The results are asked for again, after the retry period the server
+   sends, until every vector set has been graded.  This function blocks
+   the caller until then.
+
    @param ctx Address of pointer to a previously allocated ACVP_CTX.
 
    @return ACVP_RESULT
@@ -72,10 +72,17 @@ static ACVP_RESULT acvp_aes_release_tc(ACVP_SYM_CIPHER_TC *stc);
 #define IV_ROW_LEN 16
 #define TEXT_COL_LEN 1001
 #define TEXT_ROW_LEN 32
-static unsigned char key[KEY_COL_LEN][KEY_ROW_LEN];
-static unsigned char iv[IV_COL_LEN][IV_ROW_LEN];
-static unsigned char ptext[TEXT_COL_LEN][TEXT_ROW_LEN];
-static unsigned char ctext[TEXT_COL_LEN][TEXT_ROW_LEN];
+
+/*
+ * Scratch space for one Monte Carlo test case.  This is allocated
+ * per test case so test groups can be processed concurrently.
+ */
+typedef struct acvp_aes_mct_buf_t {
+    unsigned char key[KEY_COL_LEN][KEY_ROW_LEN];
+    unsigned char iv[IV_COL_LEN][IV_ROW_LEN];
+    unsigned char ptext[TEXT_COL_LEN][TEXT_ROW_LEN];
+    unsigned char ctext[TEXT_COL_LEN][TEXT_ROW_LEN];
+} ACVP_AES_MCT_BUF;
 
 #define gb(a, b) (((a)[(b) / 8] >> (7 - (b) % 8)) & 1)
 #define sb(a, b, v) ((a)[(b) / 8] = ((a)[(b) / 8] & ~(1 << (7 - (b) % 8))) | (!!(v) << (7 - (b) % 8)))
@@ -85,28 +92,31 @@ static unsigned char ctext[TEXT_COL_LEN][TEXT_ROW_LEN];
  * and/or pt/ct information may need to be modified.  This function
  * performs the iteration depdedent upon the cipher type and direction.
  */
-static ACVP_RESULT acvp_aes_mct_iterate_tc(ACVP_CTX *ctx, ACVP_SYM_CIPHER_TC *stc, int i) {
+static ACVP_RESULT acvp_aes_mct_iterate_tc(ACVP_CTX *ctx,
+                                           ACVP_SYM_CIPHER_TC *stc,
+                                           ACVP_AES_MCT_BUF *mct,
+                                           int i) {
     int j = stc->mct_index;
 
 
     if (stc->cipher != ACVP_AES_CFB1) {
-        memcpy_s(ctext[j], TEXT_ROW_LEN, stc->ct, stc->ct_len);
-        memcpy_s(ptext[j], TEXT_ROW_LEN, stc->pt, stc->pt_len);
+        memcpy_s(mct->ctext[j], TEXT_ROW_LEN, stc->ct, stc->ct_len);
+        memcpy_s(mct->ptext[j], TEXT_ROW_LEN, stc->pt, stc->pt_len);
     } else {
-        ctext[j][0] = stc->ct[0];
-        ptext[j][0] = stc->pt[0];
+        mct->ctext[j][0] = stc->ct[0];
+        mct->ptext[j][0] = stc->pt[0];
     }
     if (j == 0) {
-        memcpy_s(key[j], KEY_ROW_LEN, stc->key, stc->key_len / 8);
+        memcpy_s(mct->key[j], KEY_ROW_LEN, stc->key, stc->key_len / 8);
     }
 
     switch (stc->cipher) {
     case ACVP_AES_ECB:
 
         if (stc->direction == ACVP_SYM_CIPH_DIR_ENCRYPT) {
-            memcpy_s(stc->pt, ACVP_SYM_PT_BYTE_MAX, ctext[j], stc->ct_len);
+            memcpy_s(stc->pt, ACVP_SYM_PT_BYTE_MAX, mct->ctext[j], stc->ct_len);
         } else {
-            memcpy_s(stc->ct, ACVP_SYM_CT_BYTE_MAX, ptext[j], stc->ct_len);
+            memcpy_s(stc->ct, ACVP_SYM_CT_BYTE_MAX, mct->ptext[j], stc->ct_len);
         }
         break;
 
@@ -121,11 +131,11 @@ static ACVP_RESULT acvp_aes_mct_iterate_tc(ACVP_CTX *ctx, ACVP_SYM_CIPHER_TC *st
             }
         } else {
             if (stc->direction == ACVP_SYM_CIPH_DIR_ENCRYPT) {
-                memcpy_s(stc->pt, ACVP_SYM_PT_BYTE_MAX, ctext[j - 1], stc->ct_len);
-                memcpy_s(stc->iv, ACVP_SYM_IV_BYTE_MAX, ctext[j], stc->ct_len);
+                memcpy_s(stc->pt, ACVP_SYM_PT_BYTE_MAX, mct->ctext[j - 1], stc->ct_len);
+                memcpy_s(stc->iv, ACVP_SYM_IV_BYTE_MAX, mct->ctext[j], stc->ct_len);
             } else {
-                memcpy_s(stc->ct, ACVP_SYM_CT_BYTE_MAX, ptext[j - 1], stc->ct_len);
-                memcpy_s(stc->iv, ACVP_SYM_IV_BYTE_MAX, ptext[j], stc->ct_len);
+                memcpy_s(stc->ct, ACVP_SYM_CT_BYTE_MAX, mct->ptext[j - 1], stc->ct_len);
+                memcpy_s(stc->iv, ACVP_SYM_IV_BYTE_MAX, mct->ptext[j], stc->ct_len);
             }
         }
         break;
@@ -135,13 +145,13 @@ static ACVP_RESULT acvp_aes_mct_iterate_tc(ACVP_CTX *ctx, ACVP_SYM_CIPHER_TC *st
             if (j < 16) {
                 memcpy_s(stc->pt, ACVP_SYM_PT_BYTE_MAX, &stc->iv[j], stc->pt_len);
             } else {
-                memcpy_s(stc->pt, ACVP_SYM_PT_BYTE_MAX, ctext[j - 16], stc->pt_len);
+                memcpy_s(stc->pt, ACVP_SYM_PT_BYTE_MAX, mct->ctext[j - 16], stc->pt_len);
             }
         } else {
             if (j < 16) {
                 memcpy_s(stc->ct, ACVP_SYM_CT_BYTE_MAX, &stc->iv[j], stc->ct_len);
             } else {
-                memcpy_s(stc->ct, ACVP_SYM_CT_BYTE_MAX, ptext[j - 16], stc->ct_len);
+                memcpy_s(stc->ct, ACVP_SYM_CT_BYTE_MAX, mct->ptext[j - 16], stc->ct_len);
             }
         }
         break;
@@ -149,18 +159,18 @@ static ACVP_RESULT acvp_aes_mct_iterate_tc(ACVP_CTX *ctx, ACVP_SYM_CIPHER_TC *st
     case ACVP_AES_CFB1:
         if (stc->direction == ACVP_SYM_CIPH_DIR_ENCRYPT) {
             if (j < 128) {
-                sb(ptext[j + 1], 0, gb(iv[i], j));
+                sb(mct->ptext[j + 1], 0, gb(mct->iv[i], j));
             } else {
-                sb(ptext[j + 1], 0, gb(ctext[j - 128], 0));
+                sb(mct->ptext[j + 1], 0, gb(mct->ctext[j - 128], 0));
             }
-            stc->pt[0] = ptext[j + 1][0];
+            stc->pt[0] = mct->ptext[j + 1][0];
         } else {
             if (j < 128) {
-                sb(ctext[j + 1], 0, gb(iv[i], j));
+                sb(mct->ctext[j + 1], 0, gb(mct->iv[i], j));
             } else {
-                sb(ctext[j + 1], 0, gb(ptext[j - 128], 0));
+                sb(mct->ctext[j + 1], 0, gb(mct->ptext[j - 128], 0));
             }
-            stc->ct[0] = ctext[j + 1][0];
+            stc->ct[0] = mct->ctext[j + 1][0];
         }
         break;
     default:
@@ -252,11 +262,12 @@ end:
  * parsed, processed, and a response is generated to be sent
  * back to the ACV server by the transport layer.
  */
-static ACVP_RESULT acvp_aes_mct_tc(ACVP_CTX *ctx,
-                                   ACVP_CAPS_LIST *cap,
-                                   ACVP_TEST_CASE *tc,
-                                   ACVP_SYM_CIPHER_TC *stc,
-                                   JSON_Array *res_array) {
+static ACVP_RESULT acvp_aes_mct_run(ACVP_CTX *ctx,
+                                    ACVP_CAPS_LIST *cap,
+                                    ACVP_TEST_CASE *tc,
+                                    ACVP_SYM_CIPHER_TC *stc,
+                                    ACVP_AES_MCT_BUF *mct,
+                                    JSON_Array *res_array) {
     int i, j, n, n1, n2;
     ACVP_RESULT rv;
     JSON_Value *r_tval = NULL;  /* Response testval */
@@ -267,11 +278,11 @@ static ACVP_RESULT acvp_aes_mct_tc(ACVP_CTX *ctx,
 
     tmp = calloc(1, ACVP_SYM_CT_MAX + 1);
     if (!tmp) {
-        ACVP_LOG_ERR("Unable to malloc in acvp_aes_mct_tc");
+        ACVP_LOG_ERR("Unable to malloc in acvp_aes_mct_run");
         return ACVP_MALLOC_FAIL;
     }
 
-    memcpy_s(iv[0], IV_ROW_LEN, stc->iv, stc->iv_len);
+    memcpy_s(mct->iv[0], IV_ROW_LEN, stc->iv, stc->iv_len);
     for (i = 0; i < ACVP_AES_MCT_OUTER; ++i) {
         /*
          * Create a new test case in the response
@@ -303,7 +314,7 @@ static ACVP_RESULT acvp_aes_mct_tc(ACVP_CTX *ctx,
             /*
              * Adjust the parameters for next iteration if needed.
              */
-            rv = acvp_aes_mct_iterate_tc(ctx, stc, i);
+            rv = acvp_aes_mct_iterate_tc(ctx, stc, mct, i);
             if (rv != ACVP_SUCCESS) {
                 ACVP_LOG_ERR("Failed the MCT iteration changes");
                 free(tmp);
@@ -334,37 +345,37 @@ static ACVP_RESULT acvp_aes_mct_tc(ACVP_CTX *ctx,
             if (stc->cipher == ACVP_AES_CFB8) {
                 /* ct = CT[j-15] || CT[j-14] || ... || CT[j] */
                 for (n1 = 0, n2 = stc->key_len / 8 - 1; n1 < stc->key_len / 8; ++n1, --n2) {
-                    ciphertext[n1] = ctext[j - n2][0];
+                    ciphertext[n1] = mct->ctext[j - n2][0];
                 }
 
                 /* IV[i+1] = ct */
                 for (n1 = 0, n2 = 15; n1 < 16; ++n1, --n2) {
-                    stc->iv[n1] = ctext[j - n2][0];
+                    stc->iv[n1] = mct->ctext[j - n2][0];
                 }
-                ptext[0][0] = ctext[j - 16][0];
+                mct->ptext[0][0] = mct->ctext[j - 16][0];
             } else if (stc->cipher == ACVP_AES_CFB1) {
                 for (n1 = 0, n2 = stc->key_len - 1; n1 < stc->key_len; ++n1, --n2) {
-                    sb(ciphertext, n1, gb(ctext[j - n2], 0));
+                    sb(ciphertext, n1, gb(mct->ctext[j - n2], 0));
                 }
 
                 for (n1 = 0, n2 = 127; n1 < 128; ++n1, --n2) {
-                    sb(iv[i + 1], n1, gb(ctext[j - n2], 0));
+                    sb(mct->iv[i + 1], n1, gb(mct->ctext[j - n2], 0));
                 }
-                ptext[0][0] = ctext[j - 128][0] & 0x80;
-                stc->pt[0] = ptext[0][0];
-                memcpy_s(stc->iv, ACVP_SYM_IV_BYTE_MAX, iv[i + 1], stc->iv_len);
+                mct->ptext[0][0] = mct->ctext[j - 128][0] & 0x80;
+                stc->pt[0] = mct->ptext[0][0];
+                memcpy_s(stc->iv, ACVP_SYM_IV_BYTE_MAX, mct->iv[i + 1], stc->iv_len);
             } else {
                 switch (stc->key_len) {
                 case 128:
-                    memcpy_s(ciphertext, MCT_CT_LEN, ctext[j], 16);
+                    memcpy_s(ciphertext, MCT_CT_LEN, mct->ctext[j], 16);
                     break;
                 case 192:
-                    memcpy_s(ciphertext, MCT_CT_LEN, ctext[j - 1] + 8, 8);
-                    memcpy_s(ciphertext + 8, (MCT_CT_LEN - 8), ctext[j], 16);
+                    memcpy_s(ciphertext, MCT_CT_LEN, mct->ctext[j - 1] + 8, 8);
+                    memcpy_s(ciphertext + 8, (MCT_CT_LEN - 8), mct->ctext[j], 16);
                     break;
                 case 256:
-                    memcpy_s(ciphertext, MCT_CT_LEN, ctext[j - 1], 16);
-                    memcpy_s(ciphertext + 16, (MCT_CT_LEN - 16), ctext[j], 16);
+                    memcpy_s(ciphertext, MCT_CT_LEN, mct->ctext[j - 1], 16);
+                    memcpy_s(ciphertext + 16, (MCT_CT_LEN - 16), mct->ctext[j], 16);
                     break;
                 }
             }
@@ -394,36 +405,36 @@ static ACVP_RESULT acvp_aes_mct_tc(ACVP_CTX *ctx,
             if (stc->cipher == ACVP_AES_CFB8) {
                 /* ct = CT[j-15] || CT[j-14] || ... || CT[j] */
                 for (n1 = 0, n2 = stc->key_len / 8 - 1; n1 < stc->key_len / 8; ++n1, --n2) {
-                    ciphertext[n1] = ptext[j - n2][0];
+                    ciphertext[n1] = mct->ptext[j - n2][0];
                 }
 
                 for (n1 = 0, n2 = 15; n1 < 16; ++n1, --n2) {
-                    stc->iv[n1] = ptext[j - n2][0];
+                    stc->iv[n1] = mct->ptext[j - n2][0];
                 }
-                ctext[0][0] = ptext[j - 16][0];
+                mct->ctext[0][0] = mct->ptext[j - 16][0];
             } else if (stc->cipher == ACVP_AES_CFB1) {
                 for (n1 = 0, n2 = stc->key_len - 1; n1 < stc->key_len; ++n1, --n2) {
-                    sb(ciphertext, n1, gb(ptext[j - n2], 0));
+                    sb(ciphertext, n1, gb(mct->ptext[j - n2], 0));
                 }
 
                 for (n1 = 0, n2 = 127; n1 < 128; ++n1, --n2) {
-                    sb(iv[i + 1], n1, gb(ptext[j - n2], 0));
+                    sb(mct->iv[i + 1], n1, gb(mct->ptext[j - n2], 0));
                 }
-                ctext[0][0] = ptext[j - 128][0] & 0x80;
-                stc->ct[0] = ctext[0][0];
-                memcpy_s(stc->iv, ACVP_SYM_IV_BYTE_MAX, iv[i + 1], stc->iv_len);
+                mct->ctext[0][0] = mct->ptext[j - 128][0] & 0x80;
+                stc->ct[0] = mct->ctext[0][0];
+                memcpy_s(stc->iv, ACVP_SYM_IV_BYTE_MAX, mct->iv[i + 1], stc->iv_len);
             } else {
                 switch (stc->key_len) {
                 case 128:
-                    memcpy_s(ciphertext, MCT_CT_LEN, ptext[j], 16);
+                    memcpy_s(ciphertext, MCT_CT_LEN, mct->ptext[j], 16);
                     break;
                 case 192:
-                    memcpy_s(ciphertext, MCT_CT_LEN, ptext[j - 1] + 8, 8);
-                    memcpy_s(ciphertext + 8, (MCT_CT_LEN - 8), ptext[j], 16);
+                    memcpy_s(ciphertext, MCT_CT_LEN, mct->ptext[j - 1] + 8, 8);
+                    memcpy_s(ciphertext + 8, (MCT_CT_LEN - 8), mct->ptext[j], 16);
                     break;
                 case 256:
-                    memcpy_s(ciphertext, MCT_CT_LEN, ptext[j - 1], 16);
-                    memcpy_s(ciphertext + 16, (MCT_CT_LEN - 16), ptext[j], 16);
+                    memcpy_s(ciphertext, MCT_CT_LEN, mct->ptext[j - 1], 16);
+                    memcpy_s(ciphertext + 16, (MCT_CT_LEN - 16), mct->ptext[j], 16);
                     break;
                 }
             }
@@ -431,7 +442,7 @@ static ACVP_RESULT acvp_aes_mct_tc(ACVP_CTX *ctx,
 
         /* create the key for the next loop */
         for (n = 0; n < stc->key_len / 8; ++n) {
-            stc->key[n] = key[0][n] ^ ciphertext[n];
+            stc->key[n] = mct->key[0][n] ^ ciphertext[n];
         }
 
         /* Append the test response value to array */
@@ -442,6 +453,24 @@ static ACVP_RESULT acvp_aes_mct_tc(ACVP_CTX *ctx,
     return ACVP_SUCCESS;
 }
 
+static ACVP_RESULT acvp_aes_mct_tc(ACVP_CTX *ctx,
+                                   ACVP_CAPS_LIST *cap,
+                                   ACVP_TEST_CASE *tc,
+                                   ACVP_SYM_CIPHER_TC *stc,
+                                   JSON_Array *res_array) {
+    ACVP_AES_MCT_BUF *mct = NULL;
+    ACVP_RESULT rv;
+
+    mct = calloc(1, sizeof(ACVP_AES_MCT_BUF));
+    if (!mct) {
+        ACVP_LOG_ERR("Unable to malloc in acvp_aes_mct_tc");
+        return ACVP_MALLOC_FAIL;
+    }
+    rv = acvp_aes_mct_run(ctx, cap, tc, stc, mct, res_array);
+    free(mct);
+    return rv;
+}
+
 /**
  * @brief Read the \p str reprenting the ivgen mode and
  *        convert to enum.
@@ -567,501 +596,513 @@ static ACVP_SYM_CIPH_DIR read_direction(const char *str) {
 }
 
 /*
- * This is the handler for AES KAT values.  This will parse
- * a JSON encoded vector set for AES.  Each test case is
- * parsed, processed, and a response is generated to be sent
- * back to the ACV server by the transport layer.
+ * Process a single test group of an AES vector set, see
+ * acvp_process_test_groups().
  */
-ACVP_RESULT acvp_aes_kat_handler(ACVP_CTX *ctx, JSON_Object *obj) {
-    JSON_Value *groupval;
-    JSON_Object *groupobj = NULL;
+static ACVP_RESULT acvp_aes_tg_handler(ACVP_CTX *ctx,
+                                       ACVP_CAPS_LIST *cap,
+                                       JSON_Object *groupobj,
+                                       int idx,
+                                       JSON_Value **r_gval) {
+    const char *test_type_str = NULL, *dir_str = NULL, *kwcipher_str = NULL,
+               *iv_gen_str = NULL, *iv_gen_mode_str = NULL;
+    unsigned int keylen = 0, ivlen = 0, ptlen = 0, datalen = 0, aadlen = 0, taglen = 0;
+    int tgId = 0;
+    ACVP_SYM_CIPH_DIR dir = 0;
+    ACVP_SYM_CIPH_TESTTYPE test_type = 0;
+    ACVP_SYM_KW_MODE kwcipher = 0;
+    ACVP_SYM_CIPH_IVGEN_SRC iv_gen = ACVP_SYM_CIPH_IVGEN_SRC_NA;
+    ACVP_SYM_CIPH_IVGEN_MODE iv_gen_mode = ACVP_SYM_CIPH_IVGEN_MODE_NA;
+    unsigned int ovrflw_ctr = 0, incr_ctr = 0;  /* assume false */
+    ACVP_CIPHER alg_id = cap->cipher;
     JSON_Value *testval;
     JSON_Object *testobj = NULL;
-    JSON_Array *groups;
     JSON_Array *tests;
-
-    JSON_Value *reg_arry_val = NULL;
-    JSON_Object *reg_obj = NULL;
-    JSON_Array *reg_arry = NULL;
-
-    int i, g_cnt;
     int j, t_cnt;
-    JSON_Value *r_vs_val = NULL;
-    JSON_Object *r_vs = NULL;
-    JSON_Array *r_tarr = NULL, *r_garr = NULL;  /* Response testarray, grouparray */
+    JSON_Array *r_tarr = NULL;                  /* Response testarray */
     JSON_Array *res_tarr = NULL;                /* Response resultsArray */
-    JSON_Value *r_tval = NULL, *r_gval = NULL;  /* Response testval, groupval */
+    JSON_Value *r_tval = NULL;                  /* Response testval */
     JSON_Object *r_tobj = NULL, *r_gobj = NULL; /* Response testobj, groupobj */
-    ACVP_CAPS_LIST *cap;
     ACVP_SYM_CIPHER_TC stc;
     ACVP_TEST_CASE tc;
     ACVP_RESULT rv;
-    unsigned int ovrflw_ctr = 0, incr_ctr = 0;  /* assume false */
-    char *json_result = NULL;
-    const char *alg_str = NULL;
-    ACVP_CIPHER alg_id = 0;
-
-    if (!ctx) {
-        ACVP_LOG_ERR("No ctx for handler operation");
-        return ACVP_NO_CTX;
-    }
-
-    alg_str = json_object_get_string(obj, "algorithm");
-    if (!alg_str) {
-        ACVP_LOG_ERR("unable to parse 'algorithm' from JSON");
-        return ACVP_MALFORMED_JSON;
-    }
 
     tc.tc.symmetric = &stc;
 
     /*
-     * Get the crypto module handler for AES mode
+     * Create a new group in the response with the tgid
+     * and an array of tests
      */
-    alg_id = acvp_lookup_cipher_index(alg_str);
-    if (alg_id < ACVP_CIPHER_START) {
-        ACVP_LOG_ERR("unsupported algorithm (%s)", alg_str);
-        return ACVP_UNSUPPORTED_OP;
+    *r_gval = json_value_init_object();
+    r_gobj = json_value_get_object(*r_gval);
+    tgId = json_object_get_number(groupobj, "tgId");
+    if (!tgId) {
+        ACVP_LOG_ERR("Missing tgid from server JSON groub obj");
+        rv = ACVP_MALFORMED_JSON;
+        goto err;
     }
-    cap = acvp_locate_cap_entry(ctx, alg_id);
-    if (!cap) {
-        ACVP_LOG_ERR("ACVP server requesting unsupported capability");
-        return ACVP_UNSUPPORTED_OP;
+    json_object_set_number(r_gobj, "tgId", tgId);
+    json_object_set_value(r_gobj, "tests", json_value_init_array());
+    r_tarr = json_object_get_array(r_gobj, "tests");
+
+    dir_str = json_object_get_string(groupobj, "direction");
+    if (!dir_str) {
+        ACVP_LOG_ERR("Server JSON missing 'direction'");
+        rv = ACVP_MISSING_ARG;
+        goto err;
     }
 
-    /*
-     * Create ACVP array for response
-     */
-    rv = acvp_create_array(&reg_obj, &reg_arry_val, &reg_arry);
-    if (rv != ACVP_SUCCESS) {
-        ACVP_LOG_ERR("Failed to create JSON response struct. ");
-        return rv;
+    dir = read_direction(dir_str);
+    if (!dir) {
+        ACVP_LOG_ERR("Server JSON invalid 'direction'");
+        rv = ACVP_INVALID_ARG;
+        goto err;
     }
 
-    /*
-     * Start to build the JSON response
-     */
-    rv = acvp_setup_json_rsp_group(&ctx, &reg_arry_val, &r_vs_val, &r_vs, alg_str, &r_garr);
-    if (rv != ACVP_SUCCESS) {
-        ACVP_LOG_ERR("Failed to setup json response");
-        return rv;
+    test_type_str = json_object_get_string(groupobj, "testType");
+    if (!test_type_str) {
+        ACVP_LOG_ERR("Server JSON missing 'testType'");
+        rv = ACVP_MISSING_ARG;
+        goto err;
     }
-
-    groups = json_object_get_array(obj, "testGroups");
-    g_cnt = json_array_get_count(groups);
-    for (i = 0; i < g_cnt; i++) {
-        const char *test_type_str = NULL, *dir_str = NULL, *kwcipher_str = NULL,
-                   *iv_gen_str = NULL, *iv_gen_mode_str = NULL;
-        unsigned int keylen = 0, ivlen = 0, ptlen = 0, datalen = 0, aadlen = 0, taglen = 0;
-        int tgId = 0;
-        ACVP_SYM_CIPH_DIR dir = 0;
-        ACVP_SYM_CIPH_TESTTYPE test_type = 0;
-        ACVP_SYM_KW_MODE kwcipher = 0;
-        ACVP_SYM_CIPH_IVGEN_SRC iv_gen = ACVP_SYM_CIPH_IVGEN_SRC_NA;
-        ACVP_SYM_CIPH_IVGEN_MODE iv_gen_mode = ACVP_SYM_CIPH_IVGEN_MODE_NA;
-
-        groupval = json_array_get_value(groups, i);
-        groupobj = json_value_get_object(groupval);
-
-        /*
-         * Create a new group in the response with the tgid
-         * and an array of tests
-         */
-        r_gval = json_value_init_object();
-        r_gobj = json_value_get_object(r_gval);
-        tgId = json_object_get_number(groupobj, "tgId");
-        if (!tgId) {
-            ACVP_LOG_ERR("Missing tgid from server JSON groub obj");
+    test_type = read_test_type(test_type_str);
+    if (!test_type) {
+        ACVP_LOG_ERR("Server JSON invalid 'testType'");
+        rv = ACVP_INVALID_ARG;
+        goto err;
+    }
+    if (test_type == ACVP_SYM_TEST_TYPE_CTR) {
+        /* TODO: NIST needs to fix these keywords, ie add Counter at the end */
+        incr_ctr = json_object_get_boolean(groupobj, "incremental");
+        ovrflw_ctr = json_object_get_boolean(groupobj, "overflow");
+        if (ovrflw_ctr != 0 && ovrflw_ctr != 1) {
+            ACVP_LOG_ERR("Server JSON invalid 'overflowCounter'");
+            rv = ACVP_MALFORMED_JSON;
+            goto err;
+        }
+        if (incr_ctr != 0 && incr_ctr != 1) {
+            ACVP_LOG_ERR("Server JSON invalid 'incrementalCounter'");
             rv = ACVP_MALFORMED_JSON;
             goto err;
         }
-        json_object_set_number(r_gobj, "tgId", tgId);
-        json_object_set_value(r_gobj, "tests", json_value_init_array());
-        r_tarr = json_object_get_array(r_gobj, "tests");
+    }
 
-        dir_str = json_object_get_string(groupobj, "direction");
-        if (!dir_str) {
-            ACVP_LOG_ERR("Server JSON missing 'direction'");
+    if ((alg_id == ACVP_AES_KW) || (alg_id == ACVP_TDES_KW) ||
+        (alg_id == ACVP_AES_KWP)) {
+        kwcipher_str = json_object_get_string(groupobj, "kwCipher");
+        if (!kwcipher_str) {
+            ACVP_LOG_ERR("Server JSON missing 'kwCipher'");
             rv = ACVP_MISSING_ARG;
             goto err;
         }
 
-        dir = read_direction(dir_str);
-        if (!dir) {
-            ACVP_LOG_ERR("Server JSON invalid 'direction'");
+        kwcipher = read_kw_mode(kwcipher_str);
+        if (!kwcipher) {
+            ACVP_LOG_ERR("Server JSON invalid 'kwCipher'");
             rv = ACVP_INVALID_ARG;
             goto err;
         }
+    }
+
+    keylen = (unsigned int)json_object_get_number(groupobj, "keyLen");
+    if (keylen != 128 && keylen != 192 && keylen != 256) {
+        ACVP_LOG_ERR("Server JSON invalid 'keyLen', (%u)", keylen);
+        rv = ACVP_INVALID_ARG;
+        goto err;
+    }
 
-        test_type_str = json_object_get_string(groupobj, "testType");
-        if (!test_type_str) {
-            ACVP_LOG_ERR("Server JSON missing 'testType'");
+    if ((alg_id != ACVP_AES_ECB) && (alg_id != ACVP_AES_KW) &&
+        (alg_id != ACVP_AES_KWP)) {
+        ivlen = 128;
+    }
+    if (alg_id == ACVP_AES_GCM || alg_id == ACVP_AES_CCM) {
+        ivlen = (unsigned int)json_object_get_number(groupobj, "ivLen");
+        if (!ivlen) {
+            ACVP_LOG_ERR("Server JSON missing 'ivlen'");
             rv = ACVP_MISSING_ARG;
             goto err;
         }
-        test_type = read_test_type(test_type_str);
-        if (!test_type) {
-            ACVP_LOG_ERR("Server JSON invalid 'testType'");
-            rv = ACVP_INVALID_ARG;
-            goto err;
-        }
-        if (test_type == ACVP_SYM_TEST_TYPE_CTR) {
-            /* TODO: NIST needs to fix these keywords, ie add Counter at the end */
-            incr_ctr = json_object_get_boolean(groupobj, "incremental");
-            ovrflw_ctr = json_object_get_boolean(groupobj, "overflow");
-            if (ovrflw_ctr != 0 && ovrflw_ctr != 1) {
-                ACVP_LOG_ERR("Server JSON invalid 'overflowCounter'");
-                rv = ACVP_MALFORMED_JSON;
-                goto err;
-            }
-            if (incr_ctr != 0 && incr_ctr != 1) {
-                ACVP_LOG_ERR("Server JSON invalid 'incrementalCounter'");
-                rv = ACVP_MALFORMED_JSON;
+
+        if (alg_id == ACVP_AES_GCM) {
+            if (!(ivlen >= ACVP_AES_GCM_IV_BIT_MIN &&
+                  ivlen <= ACVP_AES_GCM_IV_BIT_MAX)) {
+                ACVP_LOG_ERR("Server JSON invalid 'ivlen', (%u)", ivlen);
+                rv = ACVP_INVALID_ARG;
                 goto err;
             }
-        }
 
-        if ((alg_id == ACVP_AES_KW) || (alg_id == ACVP_TDES_KW) ||
-            (alg_id == ACVP_AES_KWP)) {
-            kwcipher_str = json_object_get_string(groupobj, "kwCipher");
-            if (!kwcipher_str) {
-                ACVP_LOG_ERR("Server JSON missing 'kwCipher'");
+            iv_gen_str = json_object_get_string(groupobj, "ivGen");
+            if (!iv_gen_str) {
+                ACVP_LOG_ERR("Server JSON missing 'ivGen'");
                 rv = ACVP_MISSING_ARG;
                 goto err;
             }
-
-            kwcipher = read_kw_mode(kwcipher_str);
-            if (!kwcipher) {
-                ACVP_LOG_ERR("Server JSON invalid 'kwCipher'");
+            iv_gen = read_ivgen_source(iv_gen_str);
+            if (!iv_gen) {
+                ACVP_LOG_ERR("Server JSON invalid 'ivGen'");
                 rv = ACVP_INVALID_ARG;
                 goto err;
             }
-        }
-
-        keylen = (unsigned int)json_object_get_number(groupobj, "keyLen");
-        if (keylen != 128 && keylen != 192 && keylen != 256) {
-            ACVP_LOG_ERR("Server JSON invalid 'keyLen', (%u)", keylen);
-            rv = ACVP_INVALID_ARG;
-            goto err;
-        }
-
-        if ((alg_id != ACVP_AES_ECB) && (alg_id != ACVP_AES_KW) &&
-            (alg_id != ACVP_AES_KWP)) {
-            ivlen = 128;
-        }
-        if (alg_id == ACVP_AES_GCM || alg_id == ACVP_AES_CCM) {
-            ivlen = (unsigned int)json_object_get_number(groupobj, "ivLen");
-            if (!ivlen) {
-                ACVP_LOG_ERR("Server JSON missing 'ivlen'");
-                rv = ACVP_MISSING_ARG;
-                goto err;
-            }
-
-            if (alg_id == ACVP_AES_GCM) {
-                if (!(ivlen >= ACVP_AES_GCM_IV_BIT_MIN &&
-                      ivlen <= ACVP_AES_GCM_IV_BIT_MAX)) {
-                    ACVP_LOG_ERR("Server JSON invalid 'ivlen', (%u)", ivlen);
-                    rv = ACVP_INVALID_ARG;
-                    goto err;
-                }
 
-                iv_gen_str = json_object_get_string(groupobj, "ivGen");
-                if (!iv_gen_str) {
-                    ACVP_LOG_ERR("Server JSON missing 'ivGen'");
+            if (iv_gen == ACVP_SYM_CIPH_IVGEN_SRC_INT) {
+                iv_gen_mode_str = json_object_get_string(groupobj, "ivGenMode");
+                if (!iv_gen_mode_str) {
+                    ACVP_LOG_ERR("Server JSON missing 'ivGenMode'");
                     rv = ACVP_MISSING_ARG;
                     goto err;
                 }
-                iv_gen = read_ivgen_source(iv_gen_str);
-                if (!iv_gen) {
-                    ACVP_LOG_ERR("Server JSON invalid 'ivGen'");
+                iv_gen_mode = read_ivgen_mode(iv_gen_mode_str);
+                if (!iv_gen_mode) {
+                    ACVP_LOG_ERR("Server JSON invalid 'ivGenMode'");
                     rv = ACVP_INVALID_ARG;
                     goto err;
                 }
-
-                if (iv_gen == ACVP_SYM_CIPH_IVGEN_SRC_INT) {
-                    iv_gen_mode_str = json_object_get_string(groupobj, "ivGenMode");
-                    if (!iv_gen_mode_str) {
-                        ACVP_LOG_ERR("Server JSON missing 'ivGenMode'");
-                        rv = ACVP_MISSING_ARG;
-                        goto err;
-                    }
-                    iv_gen_mode = read_ivgen_mode(iv_gen_mode_str);
-                    if (!iv_gen_mode) {
-                        ACVP_LOG_ERR("Server JSON invalid 'ivGenMode'");
-                        rv = ACVP_INVALID_ARG;
-                        goto err;
-                    }
-                }
-            } else {
-                if (ivlen >= ACVP_AES_CCM_IV_BIT_MIN &&
-                    ivlen <= ACVP_AES_CCM_IV_BIT_MAX) {
-                    if (ivlen % 8 != 0) {
-                        // Only increments of 8 allowed
-                        ACVP_LOG_ERR("Server JSON 'ivlen' (%u) mod 8 != 0", ivlen);
-                        rv = ACVP_INVALID_ARG;
-                        goto err;
-                    }
-                } else {
-                    ACVP_LOG_ERR("Server JSON invalid 'ivlen', (%u)", ivlen);
+            }
+        } else {
+            if (ivlen >= ACVP_AES_CCM_IV_BIT_MIN &&
+                ivlen <= ACVP_AES_CCM_IV_BIT_MAX) {
+                if (ivlen % 8 != 0) {
+                    // Only increments of 8 allowed
+                    ACVP_LOG_ERR("Server JSON 'ivlen' (%u) mod 8 != 0", ivlen);
                     rv = ACVP_INVALID_ARG;
                     goto err;
                 }
-            }
-
-            aadlen = (unsigned int)json_object_get_number(groupobj, "aadLen");
-            if (aadlen > ACVP_SYM_AAD_BIT_MAX) {
-                ACVP_LOG_ERR("'aadLen' too large (%u), max allowed=(%d)",
-                             aadlen, ACVP_SYM_AAD_BIT_MAX);
+            } else {
+                ACVP_LOG_ERR("Server JSON invalid 'ivlen', (%u)", ivlen);
                 rv = ACVP_INVALID_ARG;
                 goto err;
             }
+        }
 
-            taglen = (unsigned int)json_object_get_number(groupobj, "tagLen");
-            if (!(taglen >= ACVP_SYM_TAG_BIT_MIN &&
-                  taglen <= ACVP_SYM_TAG_BIT_MAX)) {
-                ACVP_LOG_ERR("Server JSON invalid 'taglen', (%u)", taglen);
-                rv = ACVP_INVALID_ARG;
-                goto err;
-            }
+        aadlen = (unsigned int)json_object_get_number(groupobj, "aadLen");
+        if (aadlen > ACVP_SYM_AAD_BIT_MAX) {
+            ACVP_LOG_ERR("'aadLen' too large (%u), max allowed=(%d)",
+                         aadlen, ACVP_SYM_AAD_BIT_MAX);
+            rv = ACVP_INVALID_ARG;
+            goto err;
         }
 
-        ptlen = (unsigned int)json_object_get_number(groupobj, "payloadLen");
-        if (ptlen > ACVP_SYM_PT_BIT_MAX) {
-            ACVP_LOG_ERR("'ptLen' too large (%u), max allowed=(%d)",
-                         ptlen, ACVP_SYM_PT_BIT_MAX);
+        taglen = (unsigned int)json_object_get_number(groupobj, "tagLen");
+        if (!(taglen >= ACVP_SYM_TAG_BIT_MIN &&
+              taglen <= ACVP_SYM_TAG_BIT_MAX)) {
+            ACVP_LOG_ERR("Server JSON invalid 'taglen', (%u)", taglen);
+            rv = ACVP_INVALID_ARG;
+            goto err;
+        }
+    }
+
+    ptlen = (unsigned int)json_object_get_number(groupobj, "payloadLen");
+    if (ptlen > ACVP_SYM_PT_BIT_MAX) {
+        ACVP_LOG_ERR("'ptLen' too large (%u), max allowed=(%d)",
+                     ptlen, ACVP_SYM_PT_BIT_MAX);
+        rv = ACVP_INVALID_ARG;
+        goto err;
+    }
+
+    ACVP_LOG_INFO("    Test group: %d", idx);
+    ACVP_LOG_INFO("           dir: %s", dir_str);
+    ACVP_LOG_INFO("            kw: %s", kwcipher_str);
+    ACVP_LOG_INFO("        keylen: %d", keylen);
+    ACVP_LOG_INFO("         ivlen: %d", ivlen);
+    ACVP_LOG_INFO("         ptlen: %d", ptlen);
+    ACVP_LOG_INFO("        aadlen: %d", aadlen);
+    ACVP_LOG_INFO("        taglen: %d", taglen);
+    ACVP_LOG_INFO("      testtype: %s", test_type_str);
+    ACVP_LOG_INFO("      incr_ctr: %d", incr_ctr);
+    ACVP_LOG_INFO("    ovrflw_ctr: %d", ovrflw_ctr);
+
+    tests = json_object_get_array(groupobj, "tests");
+    t_cnt = json_array_get_count(tests);
+
+    for (j = 0; j < t_cnt; j++) {
+        const char *pt = NULL, *ct = NULL, *iv = NULL,
+                   *key = NULL, *tag = NULL, *aad = NULL;
+        unsigned int tc_id = 0;
+
+        ACVP_LOG_INFO("Found new AES test vector...");
+        testval = json_array_get_value(tests, j);
+        testobj = json_value_get_object(testval);
+
+        tc_id = (unsigned int)json_object_get_number(testobj, "tcId");
+
+        key = json_object_get_string(testobj, "key");
+        if (!key) {
+            ACVP_LOG_ERR("Server JSON missing 'key'");
+            rv = ACVP_MISSING_ARG;
+            goto err;
+        }
+        if (strnlen_s(key, ACVP_SYM_KEY_MAX_STR + 1) > ACVP_SYM_KEY_MAX_STR) {
+            ACVP_LOG_ERR("'key' length exceeds max aes key string length (%d)", ACVP_SYM_KEY_MAX_STR);
             rv = ACVP_INVALID_ARG;
             goto err;
         }
 
-        ACVP_LOG_INFO("    Test group: %d", i);
-        ACVP_LOG_INFO("           dir: %s", dir_str);
-        ACVP_LOG_INFO("            kw: %s", kwcipher_str);
-        ACVP_LOG_INFO("        keylen: %d", keylen);
-        ACVP_LOG_INFO("         ivlen: %d", ivlen);
-        ACVP_LOG_INFO("         ptlen: %d", ptlen);
-        ACVP_LOG_INFO("        aadlen: %d", aadlen);
-        ACVP_LOG_INFO("        taglen: %d", taglen);
-        ACVP_LOG_INFO("      testtype: %s", test_type_str);
-        ACVP_LOG_INFO("      incr_ctr: %d", incr_ctr);
-        ACVP_LOG_INFO("    ovrflw_ctr: %d", ovrflw_ctr);
-
-        tests = json_object_get_array(groupobj, "tests");
-        t_cnt = json_array_get_count(tests);
-
-        for (j = 0; j < t_cnt; j++) {
-            const char *pt = NULL, *ct = NULL, *iv = NULL,
-                       *key = NULL, *tag = NULL, *aad = NULL;
-            unsigned int tc_id = 0;
-
-            ACVP_LOG_INFO("Found new AES test vector...");
-            testval = json_array_get_value(tests, j);
-            testobj = json_value_get_object(testval);
-
-            tc_id = (unsigned int)json_object_get_number(testobj, "tcId");
-
-            key = json_object_get_string(testobj, "key");
-            if (!key) {
-                ACVP_LOG_ERR("Server JSON missing 'key'");
+        if (alg_id == ACVP_AES_CFB1) {
+            datalen = (unsigned int)json_object_get_number(testobj, "payloadLen");
+            if (datalen > ACVP_SYM_PT_BIT_MAX) {
+                ACVP_LOG_ERR("'dataLen' too large (%u), max allowed=(%d)",
+                             datalen, ACVP_SYM_PT_BIT_MAX);
+                rv = ACVP_INVALID_ARG;
+                goto err;
+            }
+        }
+
+        if (dir == ACVP_SYM_CIPH_DIR_ENCRYPT) {
+            unsigned int tmp_pt_len = 0;
+            pt = json_object_get_string(testobj, "pt");
+            if (!pt) {
+                ACVP_LOG_ERR("Server JSON missing 'pt'");
                 rv = ACVP_MISSING_ARG;
                 goto err;
             }
-            if (strnlen_s(key, ACVP_SYM_KEY_MAX_STR + 1) > ACVP_SYM_KEY_MAX_STR) {
-                ACVP_LOG_ERR("'key' length exceeds max aes key string length (%d)", ACVP_SYM_KEY_MAX_STR);
+            tmp_pt_len = strnlen_s(pt, ACVP_SYM_PT_MAX + 1);
+            if (tmp_pt_len > ACVP_SYM_PT_MAX) {
+                ACVP_LOG_ERR("'pt' too long, max allowed=(%d)",
+                             ACVP_SYM_PT_MAX);
                 rv = ACVP_INVALID_ARG;
                 goto err;
             }
+        } else {
+            unsigned int tmp_ct_len = 0;
 
-            if (alg_id == ACVP_AES_CFB1) {
-                datalen = (unsigned int)json_object_get_number(testobj, "payloadLen");
-                if (datalen > ACVP_SYM_PT_BIT_MAX) {
-                    ACVP_LOG_ERR("'dataLen' too large (%u), max allowed=(%d)",
-                                 datalen, ACVP_SYM_PT_BIT_MAX);
-                    rv = ACVP_INVALID_ARG;
-                    goto err;
-                }
+            ct = json_object_get_string(testobj, "ct");
+            if (!ct) {
+                ACVP_LOG_ERR("Server JSON missing 'ct'");
+                rv = ACVP_MISSING_ARG;
+                goto err;
+            }
+            tmp_ct_len = strnlen_s(ct, ACVP_SYM_CT_MAX + 1);
+            if (tmp_ct_len > ACVP_SYM_CT_MAX) {
+                ACVP_LOG_ERR("'ct' too long, max allowed=(%d)",
+                             ACVP_SYM_CT_MAX);
+                rv = ACVP_INVALID_ARG;
+                goto err;
             }
 
-            if (dir == ACVP_SYM_CIPH_DIR_ENCRYPT) {
-                unsigned int tmp_pt_len = 0;
-                pt = json_object_get_string(testobj, "pt");
-                if (!pt) {
-                    ACVP_LOG_ERR("Server JSON missing 'pt'");
+            if (alg_id == ACVP_AES_GCM) {
+                tag = json_object_get_string(testobj, "tag");
+                if (!tag) {
+                    ACVP_LOG_ERR("Server JSON missing 'tag'");
                     rv = ACVP_MISSING_ARG;
                     goto err;
                 }
-                tmp_pt_len = strnlen_s(pt, ACVP_SYM_PT_MAX + 1);
-                if (tmp_pt_len > ACVP_SYM_PT_MAX) {
-                    ACVP_LOG_ERR("'pt' too long, max allowed=(%d)",
-                                 ACVP_SYM_PT_MAX);
+                if (strnlen_s(tag, ACVP_SYM_TAG_MAX + 1) > ACVP_SYM_TAG_MAX) {
+                    ACVP_LOG_ERR("'tag' too long, max allowed=(%d)",
+                                 ACVP_SYM_TAG_MAX);
                     rv = ACVP_INVALID_ARG;
                     goto err;
                 }
-            } else {
-                unsigned int tmp_ct_len = 0;
+            }
+        }
 
-                ct = json_object_get_string(testobj, "ct");
-                if (!ct) {
-                    ACVP_LOG_ERR("Server JSON missing 'ct'");
+        /*
+         * If GCM, direction is encrypt, and the generation is internal
+         * then iv is not provided.
+         */
+        if (ivlen && !(alg_id == ACVP_AES_GCM && dir == ACVP_SYM_CIPH_DIR_ENCRYPT &&
+                       iv_gen == ACVP_SYM_CIPH_IVGEN_SRC_INT)) {
+            if (alg_id == ACVP_AES_XTS) {
+                /* XTS may call it tweak value, but we treat it as an IV */
+                iv = json_object_get_string(testobj, "tweakValue");
+                if (!iv) {
+                    ACVP_LOG_ERR("Server JSON missing 'tweakValue'");
                     rv = ACVP_MISSING_ARG;
                     goto err;
                 }
-                tmp_ct_len = strnlen_s(ct, ACVP_SYM_CT_MAX + 1);
-                if (tmp_ct_len > ACVP_SYM_CT_MAX) {
-                    ACVP_LOG_ERR("'ct' too long, max allowed=(%d)",
-                                 ACVP_SYM_CT_MAX);
+                if (strnlen_s(iv, ACVP_SYM_IV_MAX + 1) > ACVP_SYM_IV_MAX) {
+                    ACVP_LOG_ERR("'i' too long, max allowed=(%d)",
+                                 ACVP_SYM_IV_MAX);
                     rv = ACVP_INVALID_ARG;
                     goto err;
                 }
-
-                if (alg_id == ACVP_AES_GCM) {
-                    tag = json_object_get_string(testobj, "tag");
-                    if (!tag) {
-                        ACVP_LOG_ERR("Server JSON missing 'tag'");
-                        rv = ACVP_MISSING_ARG;
-                        goto err;
-                    }
-                    if (strnlen_s(tag, ACVP_SYM_TAG_MAX + 1) > ACVP_SYM_TAG_MAX) {
-                        ACVP_LOG_ERR("'tag' too long, max allowed=(%d)",
-                                     ACVP_SYM_TAG_MAX);
-                        rv = ACVP_INVALID_ARG;
-                        goto err;
-                    }
-                }
-            }
-
-            /*
-             * If GCM, direction is encrypt, and the generation is internal
-             * then iv is not provided.
-             */
-            if (ivlen && !(alg_id == ACVP_AES_GCM && dir == ACVP_SYM_CIPH_DIR_ENCRYPT &&
-                           iv_gen == ACVP_SYM_CIPH_IVGEN_SRC_INT)) {
-                if (alg_id == ACVP_AES_XTS) {
-                    /* XTS may call it tweak value, but we treat it as an IV */
-                    iv = json_object_get_string(testobj, "tweakValue");
-                    if (!iv) {
-                        ACVP_LOG_ERR("Server JSON missing 'tweakValue'");
-                        rv = ACVP_MISSING_ARG;
-                        goto err;
-                    }
-                    if (strnlen_s(iv, ACVP_SYM_IV_MAX + 1) > ACVP_SYM_IV_MAX) {
-                        ACVP_LOG_ERR("'i' too long, max allowed=(%d)",
-                                     ACVP_SYM_IV_MAX);
-                        rv = ACVP_INVALID_ARG;
-                        goto err;
-                    }
-                } else {
-                    iv = json_object_get_string(testobj, "iv");
-                    if (!iv) {
-                        ACVP_LOG_ERR("Server JSON missing 'iv'");
-                        rv = ACVP_MISSING_ARG;
-                        goto err;
-                    }
-                    if (strnlen_s(iv, ACVP_SYM_IV_MAX + 1) > ACVP_SYM_IV_MAX) {
-                        ACVP_LOG_ERR("'iv' too long, max allowed=(%d)",
-                                     ACVP_SYM_IV_MAX);
-                        rv = ACVP_INVALID_ARG;
-                        goto err;
-                    }
-                }
-            }
-
-            if (alg_id == ACVP_AES_GCM || alg_id == ACVP_AES_CCM) {
-                aad = json_object_get_string(testobj, "aad");
-                if (!aad) {
-                    ACVP_LOG_ERR("Server JSON missing 'aad'");
+            } else {
+                iv = json_object_get_string(testobj, "iv");
+                if (!iv) {
+                    ACVP_LOG_ERR("Server JSON missing 'iv'");
                     rv = ACVP_MISSING_ARG;
                     goto err;
                 }
-                if (strnlen_s(aad, ACVP_SYM_AAD_MAX + 1) > ACVP_SYM_AAD_MAX) {
-                    ACVP_LOG_ERR("'aad' too long, max allowed=(%d)",
-                                 ACVP_SYM_AAD_MAX);
+                if (strnlen_s(iv, ACVP_SYM_IV_MAX + 1) > ACVP_SYM_IV_MAX) {
+                    ACVP_LOG_ERR("'iv' too long, max allowed=(%d)",
+                                 ACVP_SYM_IV_MAX);
                     rv = ACVP_INVALID_ARG;
                     goto err;
                 }
             }
+        }
 
-            ACVP_LOG_INFO("        Test case: %d", j);
-            ACVP_LOG_INFO("            tcId: %d", tc_id);
-            ACVP_LOG_INFO("              key: %s", key);
-            ACVP_LOG_INFO("               pt: %s", pt);
-            ACVP_LOG_INFO("          dataLen: %d", datalen);
-            ACVP_LOG_INFO("               ct: %s", ct);
-            ACVP_LOG_INFO("               iv: %s", iv);
-            ACVP_LOG_INFO("              tag: %s", tag);
-            ACVP_LOG_INFO("              aad: %s", aad);
+        if (alg_id == ACVP_AES_GCM || alg_id == ACVP_AES_CCM) {
+            aad = json_object_get_string(testobj, "aad");
+            if (!aad) {
+                ACVP_LOG_ERR("Server JSON missing 'aad'");
+                rv = ACVP_MISSING_ARG;
+                goto err;
+            }
+            if (strnlen_s(aad, ACVP_SYM_AAD_MAX + 1) > ACVP_SYM_AAD_MAX) {
+                ACVP_LOG_ERR("'aad' too long, max allowed=(%d)",
+                             ACVP_SYM_AAD_MAX);
+                rv = ACVP_INVALID_ARG;
+                goto err;
+            }
+        }
 
-            /*
-             * Create a new test case in the response
-             */
-            r_tval = json_value_init_object();
-            r_tobj = json_value_get_object(r_tval);
+        ACVP_LOG_INFO("        Test case: %d", j);
+        ACVP_LOG_INFO("            tcId: %d", tc_id);
+        ACVP_LOG_INFO("              key: %s", key);
+        ACVP_LOG_INFO("               pt: %s", pt);
+        ACVP_LOG_INFO("          dataLen: %d", datalen);
+        ACVP_LOG_INFO("               ct: %s", ct);
+        ACVP_LOG_INFO("               iv: %s", iv);
+        ACVP_LOG_INFO("              tag: %s", tag);
+        ACVP_LOG_INFO("              aad: %s", aad);
 
-            json_object_set_number(r_tobj, "tcId", tc_id);
+        /*
+         * Create a new test case in the response
+         */
+        r_tval = json_value_init_object();
+        r_tobj = json_value_get_object(r_tval);
 
-            /*
-             * Setup the test case data that will be passed down to
-             * the crypto module.
-             */
-            rv = acvp_aes_init_tc(ctx, &stc, tc_id, test_type, key, pt, ct, iv, tag, 
-                                  aad, kwcipher, keylen, ivlen, datalen, ptlen,
-                                  taglen, alg_id, dir, iv_gen, iv_gen_mode, aadlen,
-                                  incr_ctr, ovrflw_ctr);
+        json_object_set_number(r_tobj, "tcId", tc_id);
+
+        /*
+         * Setup the test case data that will be passed down to
+         * the crypto module.
+         */
+        rv = acvp_aes_init_tc(ctx, &stc, tc_id, test_type, key, pt, ct, iv, tag, 
+                              aad, kwcipher, keylen, ivlen, datalen, ptlen,
+                              taglen, alg_id, dir, iv_gen, iv_gen_mode, aadlen,
+                              incr_ctr, ovrflw_ctr);
+        if (rv != ACVP_SUCCESS) {
+            ACVP_LOG_ERR("Init for stc (test case) failed");
+            acvp_aes_release_tc(&stc);
+            goto err;
+        }
+
+        /* If Monte Carlo start that here */
+        if (stc.test_type == ACVP_SYM_TEST_TYPE_MCT) {
+            json_object_set_value(r_tobj, "resultsArray", json_value_init_array());
+            res_tarr = json_object_get_array(r_tobj, "resultsArray");
+            rv = acvp_aes_mct_tc(ctx, cap, &tc, &stc, res_tarr);
             if (rv != ACVP_SUCCESS) {
-                ACVP_LOG_ERR("Init for stc (test case) failed");
+                ACVP_LOG_ERR("crypto module failed the MCT operation");
+                json_value_free(r_tval);
                 acvp_aes_release_tc(&stc);
                 goto err;
             }
-
-            /* If Monte Carlo start that here */
-            if (stc.test_type == ACVP_SYM_TEST_TYPE_MCT) {
-                json_object_set_value(r_tobj, "resultsArray", json_value_init_array());
-                res_tarr = json_object_get_array(r_tobj, "resultsArray");
-                rv = acvp_aes_mct_tc(ctx, cap, &tc, &stc, res_tarr);
-                if (rv != ACVP_SUCCESS) {
-                    ACVP_LOG_ERR("crypto module failed the MCT operation");
-                    json_value_free(r_tval);
+        } else {
+            /* Process the current AES KAT test vector... */
+            int t_rv = (cap->crypto_handler)(&tc);
+            if (t_rv) {
+                if (alg_id != ACVP_AES_KW && alg_id != ACVP_AES_GCM &&
+                    alg_id != ACVP_AES_CCM && alg_id != ACVP_AES_KWP) {
+                    ACVP_LOG_ERR("ERROR: crypto module failed the operation");
                     acvp_aes_release_tc(&stc);
-                    goto err;
-                }
-            } else {
-                /* Process the current AES KAT test vector... */
-                int t_rv = (cap->crypto_handler)(&tc);
-                if (t_rv) {
-                    if (alg_id != ACVP_AES_KW && alg_id != ACVP_AES_GCM &&
-                        alg_id != ACVP_AES_CCM && alg_id != ACVP_AES_KWP) {
-                        ACVP_LOG_ERR("ERROR: crypto module failed the operation");
-                        acvp_aes_release_tc(&stc);
-                        json_value_free(r_tval);
-                        rv = ACVP_CRYPTO_MODULE_FAIL;
-                        goto err;
-                    }
-                }
-
-                /*
-                 * Output the test case results using JSON
-                 */
-                rv = acvp_aes_output_tc(ctx, &stc, r_tobj, t_rv);
-                if (rv != ACVP_SUCCESS) {
-                    ACVP_LOG_ERR("JSON output failure in AES module");
                     json_value_free(r_tval);
-                    acvp_aes_release_tc(&stc);
+                    rv = ACVP_CRYPTO_MODULE_FAIL;
                     goto err;
                 }
             }
 
             /*
-             * Release all the memory associated with the test case
+             * Output the test case results using JSON
              */
-            acvp_aes_release_tc(&stc);
-
-            /* Append the test response value to array */
-            json_array_append_value(r_tarr, r_tval);
+            rv = acvp_aes_output_tc(ctx, &stc, r_tobj, t_rv);
+            if (rv != ACVP_SUCCESS) {
+                ACVP_LOG_ERR("JSON output failure in AES module");
+                json_value_free(r_tval);
+                acvp_aes_release_tc(&stc);
+                goto err;
+            }
         }
-        json_array_append_value(r_garr, r_gval);
+
+        /*
+         * Release all the memory associated with the test case
+         */
+        acvp_aes_release_tc(&stc);
+
+        /* Append the test response value to array */
+        json_array_append_value(r_tarr, r_tval);
+    }
+
+    return ACVP_SUCCESS;
+
+err:
+    return rv;
+}
+
+/*
+ * This is the handler for AES KAT values.  This will parse
+ * a JSON encoded vector set for AES.  Each test case is
+ * parsed, processed, and a response is generated to be sent
+ * back to the ACV server by the transport layer.
+ */
+ACVP_RESULT acvp_aes_kat_handler(ACVP_CTX *ctx, ACVP_VS_WORK *work, JSON_Object *obj) {
+    JSON_Array *groups;
+
+    JSON_Value *reg_arry_val = NULL;
+    JSON_Object *reg_obj = NULL;
+    JSON_Array *reg_arry = NULL;
+
+    JSON_Value *r_vs_val = NULL;
+    JSON_Object *r_vs = NULL;
+    JSON_Array *r_garr = NULL;  /* Response grouparray */
+    ACVP_CAPS_LIST *cap;
+    ACVP_RESULT rv;
+    char *json_result = NULL;
+    const char *alg_str = NULL;
+    ACVP_CIPHER alg_id = 0;
+
+    if (!ctx) {
+        ACVP_LOG_ERR("No ctx for handler operation");
+        return ACVP_NO_CTX;
+    }
+
+    alg_str = json_object_get_string(obj, "algorithm");
+    if (!alg_str) {
+        ACVP_LOG_ERR("unable to parse 'algorithm' from JSON");
+        return ACVP_MALFORMED_JSON;
+    }
+
+    /*
+     * Get the crypto module handler for AES mode
+     */
+    alg_id = acvp_lookup_cipher_index(alg_str);
+    if (alg_id < ACVP_CIPHER_START) {
+        ACVP_LOG_ERR("unsupported algorithm (%s)", alg_str);
+        return ACVP_UNSUPPORTED_OP;
+    }
+    cap = acvp_locate_cap_entry(ctx, alg_id);
+    if (!cap) {
+        ACVP_LOG_ERR("ACVP server requesting unsupported capability");
+        return ACVP_UNSUPPORTED_OP;
+    }
+
+    /*
+     * Create ACVP array for response
+     */
+    rv = acvp_create_array(&reg_obj, &reg_arry_val, &reg_arry);
+    if (rv != ACVP_SUCCESS) {
+        ACVP_LOG_ERR("Failed to create JSON response struct. ");
+        return rv;
+    }
+
+    /*
+     * Start to build the JSON response
+     */
+    rv = acvp_setup_json_rsp_group(work, &reg_arry_val, &r_vs_val, &r_vs, alg_str, &r_garr);
+    if (rv != ACVP_SUCCESS) {
+        ACVP_LOG_ERR("Failed to setup json response");
+        return rv;
+    }
+
+    groups = json_object_get_array(obj, "testGroups");
+    rv = acvp_process_test_groups(ctx, cap, groups, r_garr, acvp_aes_tg_handler);
+    if (rv != ACVP_SUCCESS) {
+        goto err;
     }
     json_array_append_value(reg_arry, r_vs_val);
-    rv = ACVP_SUCCESS;
 
-    json_result = json_serialize_to_string_pretty(ctx->kat_resp, NULL);
+    json_result = json_serialize_to_string_pretty(work->kat_resp, NULL);
     if (ctx->debug == ACVP_LOG_LVL_VERBOSE) {
         printf("\n\n%s\n\n", json_result);
     } else {
@@ -1071,7 +1112,7 @@ ACVP_RESULT acvp_aes_kat_handler(ACVP_CTX *ctx, JSON_Object *obj) {
 
 err:
     if (rv != ACVP_SUCCESS) {
-        acvp_release_json(r_vs_val, r_gval);
+        acvp_release_json(r_vs_val, NULL);
     }
     return rv;
 }
@@ -165,9 +165,14 @@ static ACVP_RESULT acvp_cap_list_append(ACVP_CTX *ctx,
                                         ACVP_CAP_TYPE type,
                                         ACVP_CIPHER cipher,
                                         int (*crypto_handler)(ACVP_TEST_CASE *test_case)) {
-    ACVP_CAPS_LIST *cap_entry, *cap_e2;
+    ACVP_CAPS_LIST *cap_entry;
     ACVP_RESULT rv = ACVP_SUCCESS;
 
+    if (cipher <= ACVP_CIPHER_START || cipher >= ACVP_CIPHER_END) {
+        ACVP_LOG_ERR("Invalid parameter 'cipher'");
+        return ACVP_INVALID_ARG;
+    }
+
     /*
      * Check for duplicate entry
      */
@@ -478,16 +483,14 @@ static ACVP_RESULT acvp_cap_list_append(ACVP_CTX *ctx,
     cap_entry->crypto_handler = crypto_handler;
     cap_entry->cap_type = type;
 
-    // Append to list
+    // Append to list, and index it by cipher for acvp_locate_cap_entry()
     if (!ctx->caps_list) {
         ctx->caps_list = cap_entry;
     } else {
-        cap_e2 = ctx->caps_list;
-        while (cap_e2->next) {
-            cap_e2 = cap_e2->next;
-        }
-        cap_e2->next = cap_entry;
+        ctx->caps_tail->next = cap_entry;
     }
+    ctx->caps_tail = cap_entry;
+    ctx->caps_tbl[cipher] = cap_entry;
 
     return ACVP_SUCCESS;
 
@@ -62,9 +62,16 @@ static ACVP_RESULT acvp_des_release_tc(ACVP_SYM_CIPHER_TC *stc);
 #define OLD_IV_LEN 8
 #define TEXT_COL_LEN 10001
 #define TEXT_ROW_LEN 8
-static unsigned char old_iv[OLD_IV_LEN];
-static unsigned char ptext[TEXT_COL_LEN][TEXT_ROW_LEN];
-static unsigned char ctext[TEXT_COL_LEN][TEXT_ROW_LEN];
+
+/*
+ * Scratch space for one Monte Carlo test case.  This is allocated
+ * per test case so TDES vector sets can be processed concurrently.
+ */
+typedef struct acvp_des_mct_buf_t {
+    unsigned char old_iv[OLD_IV_LEN];
+    unsigned char ptext[TEXT_COL_LEN][TEXT_ROW_LEN];
+    unsigned char ctext[TEXT_COL_LEN][TEXT_ROW_LEN];
+} ACVP_DES_MCT_BUF;
 
 static void shiftin(unsigned char *dst, int dst_max, unsigned char *src, int nbits) {
     int n = 0, move_bytes = 0, copy_bytes = 0;
@@ -97,34 +104,35 @@ static void shiftin(unsigned char *dst, int dst_max, unsigned char *src, int nbi
  */
 static ACVP_RESULT acvp_des_mct_iterate_tc(ACVP_CTX *ctx,
                                            ACVP_SYM_CIPHER_TC *stc,
+                                           ACVP_DES_MCT_BUF *mct,
                                            int i,
                                            JSON_Object *r_tobj) {
     int j = stc->mct_index;
     int n;
 
-    memcpy_s(ctext[j], TEXT_ROW_LEN,  stc->ct, stc->ct_len);
-    memcpy_s(ptext[j], TEXT_ROW_LEN, stc->pt, stc->pt_len);
+    memcpy_s(mct->ctext[j], TEXT_ROW_LEN,  stc->ct, stc->ct_len);
+    memcpy_s(mct->ptext[j], TEXT_ROW_LEN, stc->pt, stc->pt_len);
 
     switch (stc->cipher) {
     case ACVP_TDES_CBC:
         if (stc->direction == ACVP_SYM_CIPH_DIR_ENCRYPT) {
             if (j == 0) {
-                memcpy_s(stc->pt, ACVP_SYM_PT_BYTE_MAX, old_iv, 8);
+                memcpy_s(stc->pt, ACVP_SYM_PT_BYTE_MAX, mct->old_iv, 8);
             } else {
                 for (n = 0; n < 8; ++n) {
-                    stc->pt[n] = ctext[j - 1][n];
+                    stc->pt[n] = mct->ctext[j - 1][n];
                 }
             }
             for (n = 0; n < 8; ++n) {
-                stc->iv[n] = ctext[j][n];
+                stc->iv[n] = mct->ctext[j][n];
             }
         } else {
             for (n = 0; n < 8; ++n) {
-                stc->ct[n] = ptext[j][n];
+                stc->ct[n] = mct->ptext[j][n];
             }
             if (j != 0) {
                 for (n = 0; n < 8; ++n) {
-                    stc->iv[n] = ptext[j - 1][n];
+                    stc->iv[n] = mct->ptext[j - 1][n];
                 }
             }
         }
@@ -132,14 +140,14 @@ static ACVP_RESULT acvp_des_mct_iterate_tc(ACVP_CTX *ctx,
     case ACVP_TDES_CFB64:
         if (stc->direction == ACVP_SYM_CIPH_DIR_ENCRYPT) {
             if (j == 0) {
-                memcpy_s(stc->pt, ACVP_SYM_PT_BYTE_MAX, old_iv, 8);
+                memcpy_s(stc->pt, ACVP_SYM_PT_BYTE_MAX, mct->old_iv, 8);
             } else {
                 for (n = 0; n < 8; ++n) {
-                    stc->pt[n] = ctext[j - 1][n];
+                    stc->pt[n] = mct->ctext[j - 1][n];
                 }
             }
             for (n = 0; n < 8; ++n) {
-                stc->iv[n] = ctext[j][n];
+                stc->iv[n] = mct->ctext[j][n];
             }
         } else {
             for (n = 0; n < 8; ++n) {
@@ -154,7 +162,7 @@ static ACVP_RESULT acvp_des_mct_iterate_tc(ACVP_CTX *ctx,
     case ACVP_TDES_OFB:
         if (stc->direction == ACVP_SYM_CIPH_DIR_ENCRYPT) {
             if (j == 0) {
-                memcpy_s(stc->pt, ACVP_SYM_PT_BYTE_MAX, old_iv, 8);
+                memcpy_s(stc->pt, ACVP_SYM_PT_BYTE_MAX, mct->old_iv, 8);
             } else {
                 for (n = 0; n < 8; ++n) {
                     stc->pt[n] = stc->iv_ret[n];
@@ -162,7 +170,7 @@ static ACVP_RESULT acvp_des_mct_iterate_tc(ACVP_CTX *ctx,
             }
         } else {
             if (j == 0) {
-                memcpy_s(stc->ct, ACVP_SYM_CT_BYTE_MAX, old_iv, 8);
+                memcpy_s(stc->ct, ACVP_SYM_CT_BYTE_MAX, mct->old_iv, 8);
             } else {
                 for (n = 0; n < 8; ++n) {
                     stc->ct[n] = stc->iv_ret[n];
@@ -174,7 +182,7 @@ static ACVP_RESULT acvp_des_mct_iterate_tc(ACVP_CTX *ctx,
     case ACVP_TDES_CFB8:
         if (stc->direction == ACVP_SYM_CIPH_DIR_ENCRYPT) {
             if (j == 0) {
-                memcpy_s(stc->pt, ACVP_SYM_PT_BYTE_MAX, old_iv, 8);
+                memcpy_s(stc->pt, ACVP_SYM_PT_BYTE_MAX, mct->old_iv, 8);
             } else {
                 for (n = 0; n < 8; ++n) {
                     stc->pt[n] = stc->iv_ret[n];
@@ -385,11 +393,12 @@ void acvp_des_set_odd_parity(unsigned char *key) {
  * parsed, processed, and a response is generated to be sent
  * back to the ACV server by the transport layer.
  */
-static ACVP_RESULT acvp_des_mct_tc(ACVP_CTX *ctx,
-                                   ACVP_CAPS_LIST *cap,
-                                   ACVP_TEST_CASE *tc,
-                                   ACVP_SYM_CIPHER_TC *stc,
-                                   JSON_Array *res_array) {
+static ACVP_RESULT acvp_des_mct_run(ACVP_CTX *ctx,
+                                    ACVP_CAPS_LIST *cap,
+                                    ACVP_TEST_CASE *tc,
+                                    ACVP_SYM_CIPHER_TC *stc,
+                                    ACVP_DES_MCT_BUF *mct,
+                                    JSON_Array *res_array) {
     int i, j, n, bit_len;
     ACVP_RESULT rv;
     JSON_Value *r_tval = NULL;  /* Response testval */
@@ -400,7 +409,7 @@ static ACVP_RESULT acvp_des_mct_tc(ACVP_CTX *ctx,
 
     tmp = calloc(1, ACVP_SYM_CT_MAX + 1);
     if (!tmp) {
-        ACVP_LOG_ERR("Unable to malloc in acvp_des_mct_tc");
+        ACVP_LOG_ERR("Unable to malloc in acvp_des_mct_run");
         return ACVP_MALLOC_FAIL;
     }
 
@@ -444,7 +453,7 @@ static ACVP_RESULT acvp_des_mct_tc(ACVP_CTX *ctx,
 
         for (j = 0; j < ACVP_DES_MCT_INNER; ++j) {
             if (j == 0) {
-                memcpy_s(old_iv, OLD_IV_LEN, stc->iv, stc->iv_len);
+                memcpy_s(mct->old_iv, OLD_IV_LEN, stc->iv, stc->iv_len);
             }
             stc->mct_index = j;    /* indicates init vs. update */
             /* Process the current DES encrypt test vector... */
@@ -462,7 +471,7 @@ static ACVP_RESULT acvp_des_mct_tc(ACVP_CTX *ctx,
             } else {
                 shiftin(nk, NK_LEN, stc->pt, bit_len);
             }
-            rv = acvp_des_mct_iterate_tc(ctx, stc, i, r_tobj);
+            rv = acvp_des_mct_iterate_tc(ctx, stc, mct, i, r_tobj);
             if (rv != ACVP_SUCCESS) {
                 ACVP_LOG_ERR("Failed the MCT iteration changes");
                 free(tmp);
@@ -494,11 +503,11 @@ static ACVP_RESULT acvp_des_mct_tc(ACVP_CTX *ctx,
         if (stc->cipher == ACVP_TDES_OFB) {
             if (stc->direction == ACVP_SYM_CIPH_DIR_ENCRYPT) {
                 for (n = 0; n < 8; ++n) {
-                    stc->pt[n] = ptext[0][n] ^ stc->iv_ret[n];
+                    stc->pt[n] = mct->ptext[0][n] ^ stc->iv_ret[n];
                 }
             } else {
                 for (n = 0; n < 8; ++n) {
-                    stc->ct[n] = ctext[0][n] ^ stc->iv_ret[n];
+                    stc->ct[n] = mct->ctext[0][n] ^ stc->iv_ret[n];
                 }
             }
         }
@@ -555,6 +564,24 @@ static ACVP_RESULT acvp_des_mct_tc(ACVP_CTX *ctx,
     return ACVP_SUCCESS;
 }
 
+static ACVP_RESULT acvp_des_mct_tc(ACVP_CTX *ctx,
+                                   ACVP_CAPS_LIST *cap,
+                                   ACVP_TEST_CASE *tc,
+                                   ACVP_SYM_CIPHER_TC *stc,
+                                   JSON_Array *res_array) {
+    ACVP_DES_MCT_BUF *mct = NULL;
+    ACVP_RESULT rv;
+
+    mct = calloc(1, sizeof(ACVP_DES_MCT_BUF));
+    if (!mct) {
+        ACVP_LOG_ERR("Unable to malloc in acvp_des_mct_tc");
+        return ACVP_MALLOC_FAIL;
+    }
+    rv = acvp_des_mct_run(ctx, cap, tc, stc, mct, res_array);
+    free(mct);
+    return rv;
+}
+
 /**
  * @brief Read the \p str reprenting the test type and
  *        convert to enum.
@@ -613,7 +640,7 @@ static ACVP_SYM_CIPH_DIR read_direction(const char *str) {
  * parsed, processed, and a response is generated to be sent
  * back to the ACV server by the transport layer.
  */
-ACVP_RESULT acvp_des_kat_handler(ACVP_CTX *ctx, JSON_Object *obj) {
+ACVP_RESULT acvp_des_kat_handler(ACVP_CTX *ctx, ACVP_VS_WORK *work, JSON_Object *obj) {
     JSON_Value *groupval;
     JSON_Object *groupobj = NULL;
     JSON_Value *testval;
@@ -689,7 +716,7 @@ ACVP_RESULT acvp_des_kat_handler(ACVP_CTX *ctx, JSON_Object *obj) {
     /*
      * Start to build the JSON response
      */
-    rv = acvp_setup_json_rsp_group(&ctx, &reg_arry_val, &r_vs_val, &r_vs, alg_str, &r_garr);
+    rv = acvp_setup_json_rsp_group(work, &reg_arry_val, &r_vs_val, &r_vs, alg_str, &r_garr);
     if (rv != ACVP_SUCCESS) {
         ACVP_LOG_ERR("Failed to setup json response");
         return rv;
@@ -1001,7 +1028,7 @@ ACVP_RESULT acvp_des_kat_handler(ACVP_CTX *ctx, JSON_Object *obj) {
     json_array_append_value(reg_arry, r_vs_val);
     rv = ACVP_SUCCESS;
 
-    json_result = json_serialize_to_string_pretty(ctx->kat_resp, NULL);
+    json_result = json_serialize_to_string_pretty(work->kat_resp, NULL);
     if (ctx->debug == ACVP_LOG_LVL_VERBOSE) {
         printf("\n\n%s\n\n", json_result);
     } else {
@@ -60,7 +60,7 @@ static ACVP_RESULT acvp_drbg_init_tc(ACVP_CTX *ctx,
 
 static ACVP_RESULT acvp_drbg_release_tc(ACVP_DRBG_TC *stc);
 
-ACVP_RESULT acvp_drbg_kat_handler(ACVP_CTX *ctx, JSON_Object *obj) {
+ACVP_RESULT acvp_drbg_kat_handler(ACVP_CTX *ctx, ACVP_VS_WORK *work, JSON_Object *obj) {
     char *json_result = NULL;
 
     JSON_Value *reg_arry_val = NULL;
@@ -134,7 +134,7 @@ ACVP_RESULT acvp_drbg_kat_handler(ACVP_CTX *ctx, JSON_Object *obj) {
     /*
      * Start to build the JSON response
      */
-    rv = acvp_setup_json_rsp_group(&ctx, &reg_arry_val, &r_vs_val, &r_vs, alg_str, &r_garr);
+    rv = acvp_setup_json_rsp_group(work, &reg_arry_val, &r_vs_val, &r_vs, alg_str, &r_garr);
     if (rv != ACVP_SUCCESS) {
         ACVP_LOG_ERR("Failed to setup json response");
         return rv;
@@ -480,7 +480,7 @@ ACVP_RESULT acvp_drbg_kat_handler(ACVP_CTX *ctx, JSON_Object *obj) {
     }
     json_array_append_value(reg_arry, r_vs_val);
 
-    json_result = json_serialize_to_string_pretty(ctx->kat_resp, NULL);
+    json_result = json_serialize_to_string_pretty(work->kat_resp, NULL);
     if (ctx->debug == ACVP_LOG_LVL_VERBOSE) {
         printf("\n\n%s\n\n", json_result);
     } else {
@@ -1433,7 +1433,7 @@ ACVP_RESULT acvp_dsa_sigver_handler(ACVP_CTX *ctx,
     return rv;
 }
 
-ACVP_RESULT acvp_dsa_pqgver_kat_handler(ACVP_CTX *ctx, JSON_Object *obj) {
+ACVP_RESULT acvp_dsa_pqgver_kat_handler(ACVP_CTX *ctx, ACVP_VS_WORK *work, JSON_Object *obj) {
     JSON_Value *groupval;
     JSON_Object *groupobj = NULL;
     JSON_Value *r_vs_val = NULL;
@@ -1485,7 +1485,7 @@ ACVP_RESULT acvp_dsa_pqgver_kat_handler(ACVP_CTX *ctx, JSON_Object *obj) {
     /*
      * Start to build the JSON response
      */
-    rv = acvp_setup_json_rsp_group(&ctx, &reg_arry_val, &r_vs_val, &r_vs, alg_str, &r_garr);
+    rv = acvp_setup_json_rsp_group(work, &reg_arry_val, &r_vs_val, &r_vs, alg_str, &r_garr);
     if (rv != ACVP_SUCCESS) {
         ACVP_LOG_ERR("Failed to setup json response");
         return rv;
@@ -1535,7 +1535,7 @@ ACVP_RESULT acvp_dsa_pqgver_kat_handler(ACVP_CTX *ctx, JSON_Object *obj) {
     }
     memzero_s(&stc, sizeof(ACVP_DSA_TC));
     json_array_append_value(reg_arry, r_vs_val);
-    json_result = json_serialize_to_string_pretty(ctx->kat_resp, NULL);
+    json_result = json_serialize_to_string_pretty(work->kat_resp, NULL);
     if (!json_result) {
         ACVP_LOG_ERR("JSON unable to be serialized");
         rv = ACVP_JSON_ERR;
@@ -1558,7 +1558,7 @@ err:
     return rv;
 }
 
-ACVP_RESULT acvp_dsa_pqggen_kat_handler(ACVP_CTX *ctx, JSON_Object *obj) {
+ACVP_RESULT acvp_dsa_pqggen_kat_handler(ACVP_CTX *ctx, ACVP_VS_WORK *work, JSON_Object *obj) {
     JSON_Value *groupval;
     JSON_Object *groupobj = NULL;
     JSON_Value *r_vs_val = NULL;
@@ -1610,7 +1610,7 @@ ACVP_RESULT acvp_dsa_pqggen_kat_handler(ACVP_CTX *ctx, JSON_Object *obj) {
     /*
      * Start to build the JSON response
      */
-    rv = acvp_setup_json_rsp_group(&ctx, &reg_arry_val, &r_vs_val, &r_vs, alg_str, &r_garr);
+    rv = acvp_setup_json_rsp_group(work, &reg_arry_val, &r_vs_val, &r_vs, alg_str, &r_garr);
     if (rv != ACVP_SUCCESS) {
         ACVP_LOG_ERR("Failed to setup json response");
         return rv;
@@ -1660,7 +1660,7 @@ ACVP_RESULT acvp_dsa_pqggen_kat_handler(ACVP_CTX *ctx, JSON_Object *obj) {
 
     memzero_s(&stc, sizeof(ACVP_DSA_TC));
     json_array_append_value(reg_arry, r_vs_val);
-    json_result = json_serialize_to_string_pretty(ctx->kat_resp, NULL);
+    json_result = json_serialize_to_string_pretty(work->kat_resp, NULL);
     if (ctx->debug == ACVP_LOG_LVL_VERBOSE) {
         printf("\n\n%s\n\n", json_result);
     } else {
@@ -1677,7 +1677,7 @@ err:
     return rv;
 }
 
-ACVP_RESULT acvp_dsa_siggen_kat_handler(ACVP_CTX *ctx, JSON_Object *obj) {
+ACVP_RESULT acvp_dsa_siggen_kat_handler(ACVP_CTX *ctx, ACVP_VS_WORK *work, JSON_Object *obj) {
     JSON_Value *groupval;
     JSON_Object *groupobj = NULL;
     JSON_Value *r_vs_val = NULL;
@@ -1729,7 +1729,7 @@ ACVP_RESULT acvp_dsa_siggen_kat_handler(ACVP_CTX *ctx, JSON_Object *obj) {
     /*
      * Start to build the JSON response
      */
-    rv = acvp_setup_json_rsp_group(&ctx, &reg_arry_val, &r_vs_val, &r_vs, alg_str, &r_garr);
+    rv = acvp_setup_json_rsp_group(work, &reg_arry_val, &r_vs_val, &r_vs, alg_str, &r_garr);
     if (rv != ACVP_SUCCESS) {
         ACVP_LOG_ERR("Failed to setup json response");
         return rv;
@@ -1780,7 +1780,7 @@ ACVP_RESULT acvp_dsa_siggen_kat_handler(ACVP_CTX *ctx, JSON_Object *obj) {
 
     memzero_s(&stc, sizeof(ACVP_DSA_TC));
     json_array_append_value(reg_arry, r_vs_val);
-    json_result = json_serialize_to_string_pretty(ctx->kat_resp, NULL);
+    json_result = json_serialize_to_string_pretty(work->kat_resp, NULL);
 
     if (ctx->debug == ACVP_LOG_LVL_VERBOSE) {
         printf("\n\n%s\n\n", json_result);
@@ -1798,7 +1798,7 @@ err:
     return rv;
 }
 
-ACVP_RESULT acvp_dsa_keygen_kat_handler(ACVP_CTX *ctx, JSON_Object *obj) {
+ACVP_RESULT acvp_dsa_keygen_kat_handler(ACVP_CTX *ctx, ACVP_VS_WORK *work, JSON_Object *obj) {
     JSON_Value *groupval;
     JSON_Object *groupobj = NULL;
     JSON_Value *r_vs_val = NULL;
@@ -1850,7 +1850,7 @@ ACVP_RESULT acvp_dsa_keygen_kat_handler(ACVP_CTX *ctx, JSON_Object *obj) {
     /*
      * Start to build the JSON response
      */
-    rv = acvp_setup_json_rsp_group(&ctx, &reg_arry_val, &r_vs_val, &r_vs, alg_str, &r_garr);
+    rv = acvp_setup_json_rsp_group(work, &reg_arry_val, &r_vs_val, &r_vs, alg_str, &r_garr);
     if (rv != ACVP_SUCCESS) {
         ACVP_LOG_ERR("Failed to setup json response");
         return rv;
@@ -1900,7 +1900,7 @@ ACVP_RESULT acvp_dsa_keygen_kat_handler(ACVP_CTX *ctx, JSON_Object *obj) {
 
     memzero_s(&stc, sizeof(ACVP_DSA_TC));
     json_array_append_value(reg_arry, r_vs_val);
-    json_result = json_serialize_to_string_pretty(ctx->kat_resp, NULL);
+    json_result = json_serialize_to_string_pretty(work->kat_resp, NULL);
 
     if (ctx->debug == ACVP_LOG_LVL_VERBOSE) {
         printf("\n\n%s\n\n", json_result);
@@ -1918,7 +1918,7 @@ err:
     return rv;
 }
 
-ACVP_RESULT acvp_dsa_sigver_kat_handler(ACVP_CTX *ctx, JSON_Object *obj) {
+ACVP_RESULT acvp_dsa_sigver_kat_handler(ACVP_CTX *ctx, ACVP_VS_WORK *work, JSON_Object *obj) {
     JSON_Value *groupval;
     JSON_Object *groupobj = NULL;
     JSON_Value *r_vs_val = NULL;
@@ -1970,7 +1970,7 @@ ACVP_RESULT acvp_dsa_sigver_kat_handler(ACVP_CTX *ctx, JSON_Object *obj) {
     /*
      * Start to build the JSON response
      */
-    rv = acvp_setup_json_rsp_group(&ctx, &reg_arry_val, &r_vs_val, &r_vs, alg_str, &r_garr);
+    rv = acvp_setup_json_rsp_group(work, &reg_arry_val, &r_vs_val, &r_vs, alg_str, &r_garr);
     if (rv != ACVP_SUCCESS) {
         ACVP_LOG_ERR("Failed to setup json response");
         return rv;
@@ -2020,7 +2020,7 @@ ACVP_RESULT acvp_dsa_sigver_kat_handler(ACVP_CTX *ctx, JSON_Object *obj) {
 
     memzero_s(&stc, sizeof(ACVP_DSA_TC));
     json_array_append_value(reg_arry, r_vs_val);
-    json_result = json_serialize_to_string_pretty(ctx->kat_resp, NULL);
+    json_result = json_serialize_to_string_pretty(work->kat_resp, NULL);
     if (!json_result) {
         ACVP_LOG_ERR("JSON unable to be serialized");
         rv = ACVP_JSON_ERR;
@@ -2045,7 +2045,7 @@ err:
 
 #define DSA_MODE_STR_MAX 6
 
-ACVP_RESULT acvp_dsa_kat_handler(ACVP_CTX *ctx, JSON_Object *obj) {
+ACVP_RESULT acvp_dsa_kat_handler(ACVP_CTX *ctx, ACVP_VS_WORK *work, JSON_Object *obj) {
     const char *mode = json_object_get_string(obj, "mode");
     int diff = 0;
 
@@ -2065,19 +2065,19 @@ ACVP_RESULT acvp_dsa_kat_handler(ACVP_CTX *ctx, JSON_Object *obj) {
     }
 
     strcmp_s(ACVP_ALG_DSA_PQGGEN, DSA_MODE_STR_MAX, mode, &diff);
-    if (!diff) return acvp_dsa_pqggen_kat_handler(ctx, obj);
+    if (!diff) return acvp_dsa_pqggen_kat_handler(ctx, work, obj);
 
     strcmp_s(ACVP_ALG_DSA_PQGVER, DSA_MODE_STR_MAX, mode, &diff);
-    if (!diff) return acvp_dsa_pqgver_kat_handler(ctx, obj);
+    if (!diff) return acvp_dsa_pqgver_kat_handler(ctx, work, obj);
 
     strcmp_s(ACVP_ALG_DSA_SIGGEN, DSA_MODE_STR_MAX, mode, &diff);
-    if (!diff) return acvp_dsa_siggen_kat_handler(ctx, obj);
+    if (!diff) return acvp_dsa_siggen_kat_handler(ctx, work, obj);
 
     strcmp_s(ACVP_ALG_DSA_SIGVER, DSA_MODE_STR_MAX, mode, &diff);
-    if (!diff) return acvp_dsa_sigver_kat_handler(ctx, obj);
+    if (!diff) return acvp_dsa_sigver_kat_handler(ctx, work, obj);
 
     strcmp_s(ACVP_ALG_DSA_KEYGEN, DSA_MODE_STR_MAX, mode, &diff);
-    if (!diff) return acvp_dsa_keygen_kat_handler(ctx, obj);
+    if (!diff) return acvp_dsa_keygen_kat_handler(ctx, work, obj);
 
     return ACVP_INVALID_ARG;
 }
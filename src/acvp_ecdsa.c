@@ -33,7 +33,7 @@
 #include "parson.h"
 #include "safe_lib.h"
 
-static ACVP_RESULT acvp_ecdsa_kat_handler_internal(ACVP_CTX *ctx, JSON_Object *obj, ACVP_CIPHER cipher);
+static ACVP_RESULT acvp_ecdsa_kat_handler_internal(ACVP_CTX *ctx, ACVP_VS_WORK *work, JSON_Object *obj, ACVP_CIPHER cipher);
 
 
 /*
@@ -206,20 +206,20 @@ err:
     return ACVP_MALLOC_FAIL;
 }
 
-ACVP_RESULT acvp_ecdsa_keygen_kat_handler(ACVP_CTX *ctx, JSON_Object *obj) {
-    return acvp_ecdsa_kat_handler_internal(ctx, obj, ACVP_ECDSA_KEYGEN);
+ACVP_RESULT acvp_ecdsa_keygen_kat_handler(ACVP_CTX *ctx, ACVP_VS_WORK *work, JSON_Object *obj) {
+    return acvp_ecdsa_kat_handler_internal(ctx, work, obj, ACVP_ECDSA_KEYGEN);
 }
 
-ACVP_RESULT acvp_ecdsa_keyver_kat_handler(ACVP_CTX *ctx, JSON_Object *obj) {
-    return acvp_ecdsa_kat_handler_internal(ctx, obj, ACVP_ECDSA_KEYVER);
+ACVP_RESULT acvp_ecdsa_keyver_kat_handler(ACVP_CTX *ctx, ACVP_VS_WORK *work, JSON_Object *obj) {
+    return acvp_ecdsa_kat_handler_internal(ctx, work, obj, ACVP_ECDSA_KEYVER);
 }
 
-ACVP_RESULT acvp_ecdsa_siggen_kat_handler(ACVP_CTX *ctx, JSON_Object *obj) {
-    return acvp_ecdsa_kat_handler_internal(ctx, obj, ACVP_ECDSA_SIGGEN);
+ACVP_RESULT acvp_ecdsa_siggen_kat_handler(ACVP_CTX *ctx, ACVP_VS_WORK *work, JSON_Object *obj) {
+    return acvp_ecdsa_kat_handler_internal(ctx, work, obj, ACVP_ECDSA_SIGGEN);
 }
 
-ACVP_RESULT acvp_ecdsa_sigver_kat_handler(ACVP_CTX *ctx, JSON_Object *obj) {
-    return acvp_ecdsa_kat_handler_internal(ctx, obj, ACVP_ECDSA_SIGVER);
+ACVP_RESULT acvp_ecdsa_sigver_kat_handler(ACVP_CTX *ctx, ACVP_VS_WORK *work, JSON_Object *obj) {
+    return acvp_ecdsa_kat_handler_internal(ctx, work, obj, ACVP_ECDSA_SIGVER);
 }
 
 static ACVP_ECDSA_SECRET_GEN_MODE read_secret_gen_mode(const char *str) {
@@ -238,35 +238,256 @@ static ACVP_ECDSA_SECRET_GEN_MODE read_secret_gen_mode(const char *str) {
     return 0;
 }
 
-static ACVP_RESULT acvp_ecdsa_kat_handler_internal(ACVP_CTX *ctx, JSON_Object *obj, ACVP_CIPHER cipher) {
+/*
+ * Process a single test group of an ECDSA vector set, see
+ * acvp_process_test_groups().
+ */
+static ACVP_RESULT acvp_ecdsa_tg_handler(ACVP_CTX *ctx,
+                                         ACVP_CAPS_LIST *cap,
+                                         JSON_Object *groupobj,
+                                         int idx,
+                                         JSON_Value **r_gval) {
+    int tgId = 0;
+    ACVP_HASH_ALG hash_alg = 0;
+    ACVP_EC_CURVE curve = 0;
+    ACVP_ECDSA_SECRET_GEN_MODE secret_gen_mode = 0;
+    const char *hash_alg_str = NULL, *curve_str = NULL,
+               *secret_gen_mode_str = NULL;
+    char *qx = NULL, *qy = NULL, *r = NULL, *s = NULL, *message = NULL;
+    ACVP_CIPHER alg_id = cap->cipher;
     unsigned int tc_id;
-    JSON_Value *groupval;
-    JSON_Object *groupobj = NULL;
     JSON_Value *testval;
     JSON_Object *testobj = NULL;
-    JSON_Array *groups;
     JSON_Array *tests;
+    int j, t_cnt;
+    JSON_Array *r_tarr = NULL;                  /* Response testarray */
+    JSON_Value *r_tval = NULL;                  /* Response testval */
+    JSON_Object *r_tobj = NULL, *r_gobj = NULL; /* Response testobj, groupobj */
+    ACVP_ECDSA_TC stc;
+    ACVP_TEST_CASE tc;
+    ACVP_RESULT rv;
+
+    memzero_s(&stc, sizeof(ACVP_ECDSA_TC));
+    tc.tc.ecdsa = &stc;
+
+    /*
+     * Create a new group in the response with the tgid
+     * and an array of tests
+     */
+    *r_gval = json_value_init_object();
+    r_gobj = json_value_get_object(*r_gval);
+    tgId = json_object_get_number(groupobj, "tgId");
+    if (!tgId) {
+        ACVP_LOG_ERR("Missing tgid from server JSON groub obj");
+        rv = ACVP_MISSING_ARG;
+        goto err;
+    }
+    json_object_set_number(r_gobj, "tgId", tgId);
+    json_object_set_value(r_gobj, "tests", json_value_init_array());
+    r_tarr = json_object_get_array(r_gobj, "tests");
+
+    /*
+     * Get a reference to the abstracted test case
+     */
+    curve_str = json_object_get_string(groupobj, "curve");
+    if (!curve_str) {
+        ACVP_LOG_ERR("Server JSON missing 'curve'");
+        rv = ACVP_MISSING_ARG;
+        goto err;
+    }
+
+    curve = acvp_lookup_ec_curve(alg_id, curve_str);
+    if (!curve) {
+        ACVP_LOG_ERR("Server JSON includes unrecognized curve");
+        rv = ACVP_INVALID_ARG;
+        goto err;
+    }
+
+    if (alg_id == ACVP_ECDSA_KEYGEN) {
+        secret_gen_mode_str = json_object_get_string(groupobj, "secretGenerationMode");
+        if (!secret_gen_mode_str) {
+            ACVP_LOG_ERR("Server JSON missing 'secretGenerationMode'");
+            rv = ACVP_MISSING_ARG;
+            goto err;
+        }
+
+        secret_gen_mode = read_secret_gen_mode(secret_gen_mode_str);
+        if (!secret_gen_mode) {
+            ACVP_LOG_ERR("Server JSON invalid 'secretGenerationMode'");
+            rv = ACVP_INVALID_ARG;
+            goto err;
+        }
+    } else if (alg_id == ACVP_ECDSA_SIGGEN || alg_id == ACVP_ECDSA_SIGVER) {
+        hash_alg_str = json_object_get_string(groupobj, "hashAlg");
+        if (!hash_alg_str) {
+            ACVP_LOG_ERR("Server JSON missing 'hashAlg'");
+            rv = ACVP_MISSING_ARG;
+            goto err;
+        }
+
+        hash_alg = acvp_lookup_hash_alg(hash_alg_str);
+        if (!hash_alg || (alg_id == ACVP_ECDSA_SIGGEN && hash_alg == ACVP_SHA1)) {
+            ACVP_LOG_ERR("Server JSON invalid 'hashAlg'");
+            rv = ACVP_INVALID_ARG;
+            goto err;
+        }
+    }
+
+    ACVP_LOG_INFO("           Test group: %d", idx);
+    ACVP_LOG_INFO("                curve: %s", curve_str);
+    ACVP_LOG_INFO(" secretGenerationMode: %s", secret_gen_mode_str);
+    ACVP_LOG_INFO("              hashAlg: %s", hash_alg_str);
+
+    tests = json_object_get_array(groupobj, "tests");
+    t_cnt = json_array_get_count(tests);
+    if (!t_cnt) {
+        ACVP_LOG_ERR("Test array count is zero");
+        rv = ACVP_MISSING_ARG;
+        goto err;
+    }
+
+    for (j = 0; j < t_cnt; j++) {
+        ACVP_LOG_INFO("Found new ECDSA test vector...");
+        testval = json_array_get_value(tests, j);
+        testobj = json_value_get_object(testval);
+        tc_id = (unsigned int)json_object_get_number(testobj, "tcId");
+
+        if (alg_id == ACVP_ECDSA_KEYVER || alg_id == ACVP_ECDSA_SIGVER) {
+            qx = (char *)json_object_get_string(testobj, "qx");
+            qy = (char *)json_object_get_string(testobj, "qy");
+            if (!qx || !qy) {
+                ACVP_LOG_ERR("Server JSON missing 'qx' or 'qy'");
+                rv = ACVP_MISSING_ARG;
+                goto err;
+            }
+            if (strnlen_s(qx, ACVP_ECDSA_EXP_LEN_MAX + 1) > ACVP_ECDSA_EXP_LEN_MAX ||
+                strnlen_s(qy, ACVP_ECDSA_EXP_LEN_MAX + 1) > ACVP_ECDSA_EXP_LEN_MAX) {
+                ACVP_LOG_ERR("'qx' or 'qy' too long");
+                rv = ACVP_INVALID_ARG;
+                goto err;
+            }
+        }
+        if (alg_id == ACVP_ECDSA_SIGGEN || alg_id == ACVP_ECDSA_SIGVER) {
+            message = (char *)json_object_get_string(testobj, "message");
+            if (!message) {
+                ACVP_LOG_ERR("Server JSON missing 'message'");
+                rv = ACVP_MISSING_ARG;
+                goto err;
+            }
+            if (strnlen_s(message, ACVP_ECDSA_MSGLEN_MAX + 1) > ACVP_ECDSA_MSGLEN_MAX) {
+                ACVP_LOG_ERR("message string too long");
+                rv = ACVP_INVALID_ARG;
+                goto err;
+            }
+        }
+        if (alg_id == ACVP_ECDSA_SIGVER) {
+            r = (char *)json_object_get_string(testobj, "r");
+            s = (char *)json_object_get_string(testobj, "s");
+            if (!r || !s) {
+                ACVP_LOG_ERR("Server JSON missing 'r' or 's'");
+                rv = ACVP_MISSING_ARG;
+                goto err;
+            }
+            if (strnlen_s(r, ACVP_ECDSA_EXP_LEN_MAX + 1) > ACVP_ECDSA_EXP_LEN_MAX ||
+                strnlen_s(s, ACVP_ECDSA_EXP_LEN_MAX + 1) > ACVP_ECDSA_EXP_LEN_MAX) {
+                ACVP_LOG_ERR("'r' or 's' too long");
+                rv = ACVP_INVALID_ARG;
+                goto err;
+            }
+        }
+
+        ACVP_LOG_INFO("        Test case: %d", j);
+        ACVP_LOG_INFO("             tcId: %d", tc_id);
+
+        /*
+         * Create a new test case in the response
+         */
+        r_tval = json_value_init_object();
+        r_tobj = json_value_get_object(r_tval);
+
+        json_object_set_number(r_tobj, "tcId", tc_id);
+
+        rv = acvp_ecdsa_init_tc(ctx, alg_id, &stc, tgId, tc_id, curve, secret_gen_mode, hash_alg, qx, qy, message, r, s);
+
+        /* Process the current test vector... */
+        if (rv == ACVP_SUCCESS) {
+            if ((cap->crypto_handler)(&tc)) {
+                ACVP_LOG_ERR("ERROR: crypto module failed the operation");
+                rv = ACVP_CRYPTO_MODULE_FAIL;
+                json_value_free(r_tval);
+                goto err;
+            }
+        } else {
+            ACVP_LOG_ERR("Failed to initialize ECDSA test case");
+            json_value_free(r_tval);
+            goto err;
+        }
+
+        /*
+         * Output the test case results using JSON
+         */
+        if (alg_id == ACVP_ECDSA_SIGGEN) {
+            char *tmp = calloc(ACVP_ECDSA_EXP_LEN_MAX + 1, sizeof(char));
+            rv = acvp_bin_to_hexstr(stc.qy, stc.qy_len, tmp, ACVP_ECDSA_EXP_LEN_MAX);
+            if (rv != ACVP_SUCCESS) {
+                ACVP_LOG_ERR("hex conversion failure (qy)");
+                free(tmp);
+                json_value_free(r_tval);
+                goto err;
+            }
+            json_object_set_string(r_gobj, "qy", (const char *)tmp);
+            memzero_s(tmp, ACVP_ECDSA_EXP_LEN_MAX);
+
+            rv = acvp_bin_to_hexstr(stc.qx, stc.qx_len, tmp, ACVP_ECDSA_EXP_LEN_MAX);
+            if (rv != ACVP_SUCCESS) {
+                ACVP_LOG_ERR("hex conversion failure (qx)");
+                free(tmp);
+                json_value_free(r_tval);
+                goto err;
+            }
+            json_object_set_string(r_gobj, "qx", (const char *)tmp);
+            memzero_s(tmp, ACVP_ECDSA_EXP_LEN_MAX);
+            free(tmp);
+        }
+        rv = acvp_ecdsa_output_tc(ctx, alg_id, &stc, r_tobj);
+        if (rv != ACVP_SUCCESS) {
+            ACVP_LOG_ERR("ERROR: JSON output failure in hash module");
+            json_value_free(r_tval);
+            goto err;
+        }
+
+        /* Append the test response value to array */
+        json_array_append_value(r_tarr, r_tval);
+
+        /*
+         * Release all the memory associated with the test case
+         */
+        acvp_ecdsa_release_tc(&stc);
+    }
+
+    return ACVP_SUCCESS;
+
+err:
+    acvp_ecdsa_release_tc(&stc);
+    return rv;
+}
+
+static ACVP_RESULT acvp_ecdsa_kat_handler_internal(ACVP_CTX *ctx, ACVP_VS_WORK *work, JSON_Object *obj, ACVP_CIPHER cipher) {
+    JSON_Array *groups;
 
     JSON_Value *reg_arry_val = NULL;
     JSON_Object *reg_obj = NULL;
     JSON_Array *reg_arry = NULL;
 
-    int i, g_cnt;
-    int j, t_cnt;
-
     JSON_Value *r_vs_val = NULL;
     JSON_Object *r_vs = NULL;
-    JSON_Array *r_tarr = NULL, *r_garr = NULL;  /* Response testarray, grouparray */
-    JSON_Value *r_tval = NULL, *r_gval = NULL;  /* Response testval, groupval */
-    JSON_Object *r_tobj = NULL, *r_gobj = NULL; /* Response testobj, groupobj */
+    JSON_Array *r_garr = NULL;  /* Response grouparray */
     ACVP_CAPS_LIST *cap;
-    ACVP_ECDSA_TC stc;
-    ACVP_TEST_CASE tc;
     ACVP_RESULT rv;
 
     ACVP_CIPHER alg_id;
     char *json_result = NULL;
-    char *alg_str, *mode_str, *qx = NULL, *qy = NULL, *r = NULL, *s = NULL, *message = NULL;
+    char *alg_str, *mode_str;
 
     if (!ctx) {
         ACVP_LOG_ERR("No ctx for handler operation");
@@ -279,8 +500,6 @@ static ACVP_RESULT acvp_ecdsa_kat_handler_internal(ACVP_CTX *ctx, JSON_Object *o
         return ACVP_MALFORMED_JSON;
     }
 
-    memzero_s(&stc, sizeof(ACVP_ECDSA_TC));
-    tc.tc.ecdsa = &stc;
     mode_str = (char *)json_object_get_string(obj, "mode");
     if (!mode_str) {
         ACVP_LOG_ERR("Server JSON missing 'mode_str'");
@@ -312,7 +531,7 @@ static ACVP_RESULT acvp_ecdsa_kat_handler_internal(ACVP_CTX *ctx, JSON_Object *o
     /*
      * Start to build the JSON response
      */
-    rv = acvp_setup_json_rsp_group(&ctx, &reg_arry_val, &r_vs_val, &r_vs, alg_str, &r_garr);
+    rv = acvp_setup_json_rsp_group(work, &reg_arry_val, &r_vs_val, &r_vs, alg_str, &r_garr);
     if (rv != ACVP_SUCCESS) {
         ACVP_LOG_ERR("Failed to setup json response");
         return rv;
@@ -325,219 +544,14 @@ static ACVP_RESULT acvp_ecdsa_kat_handler_internal(ACVP_CTX *ctx, JSON_Object *o
         rv = ACVP_MALFORMED_JSON;
         goto err;
     }
-    g_cnt = json_array_get_count(groups);
-
-    for (i = 0; i < g_cnt; i++) {
-        int tgId = 0;
-        ACVP_HASH_ALG hash_alg = 0;
-        ACVP_EC_CURVE curve = 0;
-        ACVP_ECDSA_SECRET_GEN_MODE secret_gen_mode = 0;
-        const char *hash_alg_str = NULL, *curve_str = NULL,
-                   *secret_gen_mode_str = NULL;
-
-        groupval = json_array_get_value(groups, i);
-        groupobj = json_value_get_object(groupval);
-
-        /*
-         * Create a new group in the response with the tgid
-         * and an array of tests
-         */
-        r_gval = json_value_init_object();
-        r_gobj = json_value_get_object(r_gval);
-        tgId = json_object_get_number(groupobj, "tgId");
-        if (!tgId) {
-            ACVP_LOG_ERR("Missing tgid from server JSON groub obj");
-            rv = ACVP_MISSING_ARG;
-            goto err;
-        }
-        json_object_set_number(r_gobj, "tgId", tgId);
-        json_object_set_value(r_gobj, "tests", json_value_init_array());
-        r_tarr = json_object_get_array(r_gobj, "tests");
-
-        /*
-         * Get a reference to the abstracted test case
-         */
-        curve_str = json_object_get_string(groupobj, "curve");
-        if (!curve_str) {
-            ACVP_LOG_ERR("Server JSON missing 'curve'");
-            rv = ACVP_MISSING_ARG;
-            goto err;
-        }
-
-        curve = acvp_lookup_ec_curve(alg_id, curve_str);
-        if (!curve) {
-            ACVP_LOG_ERR("Server JSON includes unrecognized curve");
-            rv = ACVP_INVALID_ARG;
-            goto err;
-        }
-
-        if (alg_id == ACVP_ECDSA_KEYGEN) {
-            secret_gen_mode_str = json_object_get_string(groupobj, "secretGenerationMode");
-            if (!secret_gen_mode_str) {
-                ACVP_LOG_ERR("Server JSON missing 'secretGenerationMode'");
-                rv = ACVP_MISSING_ARG;
-                goto err;
-            }
-
-            secret_gen_mode = read_secret_gen_mode(secret_gen_mode_str);
-            if (!secret_gen_mode) {
-                ACVP_LOG_ERR("Server JSON invalid 'secretGenerationMode'");
-                rv = ACVP_INVALID_ARG;
-                goto err;
-            }
-        } else if (alg_id == ACVP_ECDSA_SIGGEN || alg_id == ACVP_ECDSA_SIGVER) {
-            hash_alg_str = json_object_get_string(groupobj, "hashAlg");
-            if (!hash_alg_str) {
-                ACVP_LOG_ERR("Server JSON missing 'hashAlg'");
-                rv = ACVP_MISSING_ARG;
-                goto err;
-            }
-
-            hash_alg = acvp_lookup_hash_alg(hash_alg_str);
-            if (!hash_alg || (alg_id == ACVP_ECDSA_SIGGEN && hash_alg == ACVP_SHA1)) {
-                ACVP_LOG_ERR("Server JSON invalid 'hashAlg'");
-                rv = ACVP_INVALID_ARG;
-                goto err;
-            }
-        }
-
-        ACVP_LOG_INFO("           Test group: %d", i);
-        ACVP_LOG_INFO("                curve: %s", curve_str);
-        ACVP_LOG_INFO(" secretGenerationMode: %s", secret_gen_mode_str);
-        ACVP_LOG_INFO("              hashAlg: %s", hash_alg_str);
-
-        tests = json_object_get_array(groupobj, "tests");
-        t_cnt = json_array_get_count(tests);
-        if (!t_cnt) {
-            ACVP_LOG_ERR("Test array count is zero");
-            rv = ACVP_MISSING_ARG;
-            goto err;
-        }
-
-        for (j = 0; j < t_cnt; j++) {
-            ACVP_LOG_INFO("Found new ECDSA test vector...");
-            testval = json_array_get_value(tests, j);
-            testobj = json_value_get_object(testval);
-            tc_id = (unsigned int)json_object_get_number(testobj, "tcId");
-
-            if (alg_id == ACVP_ECDSA_KEYVER || alg_id == ACVP_ECDSA_SIGVER) {
-                qx = (char *)json_object_get_string(testobj, "qx");
-                qy = (char *)json_object_get_string(testobj, "qy");
-                if (!qx || !qy) {
-                    ACVP_LOG_ERR("Server JSON missing 'qx' or 'qy'");
-                    rv = ACVP_MISSING_ARG;
-                    goto err;
-                }
-                if (strnlen_s(qx, ACVP_ECDSA_EXP_LEN_MAX + 1) > ACVP_ECDSA_EXP_LEN_MAX ||
-                    strnlen_s(qy, ACVP_ECDSA_EXP_LEN_MAX + 1) > ACVP_ECDSA_EXP_LEN_MAX) {
-                    ACVP_LOG_ERR("'qx' or 'qy' too long");
-                    rv = ACVP_INVALID_ARG;
-                    goto err;
-                }
-            }
-            if (alg_id == ACVP_ECDSA_SIGGEN || alg_id == ACVP_ECDSA_SIGVER) {
-                message = (char *)json_object_get_string(testobj, "message");
-                if (!message) {
-                    ACVP_LOG_ERR("Server JSON missing 'message'");
-                    rv = ACVP_MISSING_ARG;
-                    goto err;
-                }
-                if (strnlen_s(message, ACVP_ECDSA_MSGLEN_MAX + 1) > ACVP_ECDSA_MSGLEN_MAX) {
-                    ACVP_LOG_ERR("message string too long");
-                    rv = ACVP_INVALID_ARG;
-                    goto err;
-                }
-            }
-            if (alg_id == ACVP_ECDSA_SIGVER) {
-                r = (char *)json_object_get_string(testobj, "r");
-                s = (char *)json_object_get_string(testobj, "s");
-                if (!r || !s) {
-                    ACVP_LOG_ERR("Server JSON missing 'r' or 's'");
-                    rv = ACVP_MISSING_ARG;
-                    goto err;
-                }
-                if (strnlen_s(r, ACVP_ECDSA_EXP_LEN_MAX + 1) > ACVP_ECDSA_EXP_LEN_MAX ||
-                    strnlen_s(s, ACVP_ECDSA_EXP_LEN_MAX + 1) > ACVP_ECDSA_EXP_LEN_MAX) {
-                    ACVP_LOG_ERR("'r' or 's' too long");
-                    rv = ACVP_INVALID_ARG;
-                    goto err;
-                }
-            }
-
-            ACVP_LOG_INFO("        Test case: %d", j);
-            ACVP_LOG_INFO("             tcId: %d", tc_id);
-
-            /*
-             * Create a new test case in the response
-             */
-            r_tval = json_value_init_object();
-            r_tobj = json_value_get_object(r_tval);
-
-            json_object_set_number(r_tobj, "tcId", tc_id);
-
-            rv = acvp_ecdsa_init_tc(ctx, alg_id, &stc, tgId, tc_id, curve, secret_gen_mode, hash_alg, qx, qy, message, r, s);
-
-            /* Process the current test vector... */
-            if (rv == ACVP_SUCCESS) {
-                if ((cap->crypto_handler)(&tc)) {
-                    ACVP_LOG_ERR("ERROR: crypto module failed the operation");
-                    rv = ACVP_CRYPTO_MODULE_FAIL;
-                    json_value_free(r_tval);
-                    goto err;
-                }
-            } else {
-                ACVP_LOG_ERR("Failed to initialize ECDSA test case");
-                json_value_free(r_tval);
-                goto err;
-            }
-
-            /*
-             * Output the test case results using JSON
-             */
-            if (cipher == ACVP_ECDSA_SIGGEN) {
-                char *tmp = calloc(ACVP_ECDSA_EXP_LEN_MAX + 1, sizeof(char));
-                rv = acvp_bin_to_hexstr(stc.qy, stc.qy_len, tmp, ACVP_ECDSA_EXP_LEN_MAX);
-                if (rv != ACVP_SUCCESS) {
-                    ACVP_LOG_ERR("hex conversion failure (qy)");
-                    free(tmp);
-                    json_value_free(r_tval);
-                    goto err;
-                }
-                json_object_set_string(r_gobj, "qy", (const char *)tmp);
-                memzero_s(tmp, ACVP_ECDSA_EXP_LEN_MAX);
-
-                rv = acvp_bin_to_hexstr(stc.qx, stc.qx_len, tmp, ACVP_ECDSA_EXP_LEN_MAX);
-                if (rv != ACVP_SUCCESS) {
-                    ACVP_LOG_ERR("hex conversion failure (qx)");
-                    free(tmp);
-                    json_value_free(r_tval);
-                    goto err;
-                }
-                json_object_set_string(r_gobj, "qx", (const char *)tmp);
-                memzero_s(tmp, ACVP_ECDSA_EXP_LEN_MAX);
-                free(tmp);
-            }
-            rv = acvp_ecdsa_output_tc(ctx, alg_id, &stc, r_tobj);
-            if (rv != ACVP_SUCCESS) {
-                ACVP_LOG_ERR("ERROR: JSON output failure in hash module");
-                json_value_free(r_tval);
-                goto err;
-            }
-
-            /* Append the test response value to array */
-            json_array_append_value(r_tarr, r_tval);
-
-            /*
-             * Release all the memory associated with the test case
-             */
-            acvp_ecdsa_release_tc(&stc);
-        }
-        json_array_append_value(r_garr, r_gval);
+    rv = acvp_process_test_groups(ctx, cap, groups, r_garr, acvp_ecdsa_tg_handler);
+    if (rv != ACVP_SUCCESS) {
+        goto err;
     }
 
     json_array_append_value(reg_arry, r_vs_val);
 
-    json_result = json_serialize_to_string_pretty(ctx->kat_resp, NULL);
+    json_result = json_serialize_to_string_pretty(work->kat_resp, NULL);
     if (ctx->debug == ACVP_LOG_LVL_VERBOSE) {
         printf("\n\n%s\n\n", json_result);
     } else {
@@ -548,8 +562,7 @@ static ACVP_RESULT acvp_ecdsa_kat_handler_internal(ACVP_CTX *ctx, JSON_Object *o
 
 err:
     if (rv != ACVP_SUCCESS) {
-        acvp_ecdsa_release_tc(&stc);
-        acvp_release_json(r_vs_val, r_gval);
+        acvp_release_json(r_vs_val, NULL);
     }
     return rv;
 }
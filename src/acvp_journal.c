@@ -0,0 +1,661 @@
+/*****************************************************************************
+* Copyright (c) 2016-2017, Cisco Systems, Inc.
+* All rights reserved.
+
+* Redistribution and use in source and binary forms, with or without modification,
+* are permitted provided that the following conditions are met:
+*
+* 1. Redistributions of source code must retain the above copyright notice,
+*    this list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright notice,
+*    this list of conditions and the following disclaimer in the documentation
+*    and/or other materials provided with the distribution.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+* SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+* CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+* USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+/*
+ * The session journal records enough about a test session for it to
+ * be picked up again by acvp_resume_session() if the process dies
+ * before the session is finished.  The journal is a JSON file holding
+ * the test session URL, the current JWT and the list of vector sets,
+ * each with how far it got:
+ *
+ *  - pending:  nothing done yet, the vector set is processed again
+ *  - computed: the responses were built and spooled to a file next
+ *              to the journal, they only need to be uploaded
+ *  - uploaded: the server acknowledged the responses
+ *
+ * The journal is rewritten every time a vector set changes state.  It
+ * is written to a temporary file first, flushed to disk and renamed
+ * over the previous one, so a crash never leaves a partially written
+ * journal behind.  The journal holds the JWT, so it and the spool
+ * files are only readable by their owner.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+#include "acvp.h"
+#include "acvp_lcl.h"
+#include "parson.h"
+#include "safe_lib.h"
+
+#define ACVP_JOURNAL_SPOOL_EXT_MAX  16
+#define ACVP_JOURNAL_SPOOL_BUF      (1024 * 16)
+
+static const char *acvp_journal_state_name[] = { "pending", "computed", "uploaded" };
+
+static void acvp_journal_spool_name(ACVP_JOURNAL *journal, int idx, char *name, int name_len) {
+    snprintf(name, name_len, "%s.%d", journal->path, idx);
+}
+
+static ACVP_JOURNAL_VS *acvp_journal_find(ACVP_JOURNAL *journal, const char *vsid_url, int *idx) {
+    int i, diff;
+
+    for (i = 0; i < journal->vs_cnt; i++) {
+        diff = 1;
+        strcmp_s(journal->vs[i].vsid_url, ACVP_ATTR_URL_MAX, vsid_url, &diff);
+        if (!diff) {
+            if (idx) *idx = i;
+            return &journal->vs[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Create a file only the owner can read and write, replacing any
+ * file left at path.  Returns NULL on failure.
+ */
+static FILE *acvp_journal_create(const char *path) {
+#ifndef WIN32
+    FILE *fp;
+    int fd;
+
+    /* O_EXCL makes sure the file is ours, not a link planted there */
+    remove(path);
+    fd = open(path, O_WRONLY | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+    if (fd < 0) {
+        return NULL;
+    }
+    fp = fdopen(fd, "wb");
+    if (!fp) {
+        close(fd);
+        remove(path);
+    }
+    return fp;
+#else
+    return fopen(path, "wb");
+#endif
+}
+
+/*
+ * Flush a file written with acvp_journal_create() to disk and close
+ * it.  Returns 0 on success.
+ */
+static int acvp_journal_close(FILE *fp) {
+    int err = fflush(fp);
+
+#ifndef WIN32
+    if (!err) {
+        err = fsync(fileno(fp));
+    }
+#endif
+    if (fclose(fp)) {
+        err = -1;
+    }
+    return err;
+}
+
+/*
+ * Flush the directory holding the journal to disk, so a rename or a
+ * new spool file in it survives a crash.
+ */
+static void acvp_journal_sync_dir(ACVP_JOURNAL *journal) {
+#ifndef WIN32
+    char *dir, *slash;
+    int fd;
+
+    dir = strndup(journal->path, ACVP_JOURNAL_PATH_MAX);
+    if (!dir) {
+        return;
+    }
+    slash = strrchr(dir, '/');
+    if (!slash) {
+        strcpy_s(dir, strnlen_s(journal->path, ACVP_JOURNAL_PATH_MAX) + 1, ".");
+    } else if (slash == dir) {
+        slash[1] = 0;
+    } else {
+        *slash = 0;
+    }
+    fd = open(dir, O_RDONLY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+    free(dir);
+#endif
+}
+
+/*
+ * Write the journal out, called with the journal lock held.
+ */
+static ACVP_RESULT acvp_journal_write(ACVP_CTX *ctx) {
+    ACVP_JOURNAL *journal = ctx->journal;
+    JSON_Value *val = NULL, *vs_val = NULL;
+    JSON_Object *obj = NULL, *vs_obj = NULL;
+    JSON_Array *vs_arr = NULL;
+    char *tmp_path = NULL, *data = NULL;
+    FILE *fp = NULL;
+    int i, len;
+    ACVP_RESULT rv = ACVP_SUCCESS;
+
+    val = json_value_init_object();
+    obj = json_value_get_object(val);
+    json_object_set_string(obj, "sessionUrl", journal->session_url);
+    if (journal->jwt_token) {
+        json_object_set_string(obj, "accessToken", journal->jwt_token);
+    }
+    json_object_set_value(obj, "vectorSets", json_value_init_array());
+    vs_arr = json_object_get_array(obj, "vectorSets");
+    for (i = 0; i < journal->vs_cnt; i++) {
+        vs_val = json_value_init_object();
+        vs_obj = json_value_get_object(vs_val);
+        json_object_set_string(vs_obj, "vectorSetUrl", journal->vs[i].vsid_url);
+        json_object_set_number(vs_obj, "vsId", journal->vs[i].vs_id);
+        json_object_set_string(vs_obj, "status", acvp_journal_state_name[journal->vs[i].state]);
+        json_array_append_value(vs_arr, vs_val);
+    }
+
+    len = strnlen_s(journal->path, ACVP_JOURNAL_PATH_MAX) + 5;
+    tmp_path = calloc(len, sizeof(char));
+    if (!tmp_path) {
+        rv = ACVP_MALLOC_FAIL;
+        goto end;
+    }
+    snprintf(tmp_path, len, "%s.tmp", journal->path);
+    data = json_serialize_to_string_pretty(val, &len);
+    if (!data) {
+        rv = ACVP_MALLOC_FAIL;
+        goto end;
+    }
+    fp = acvp_journal_create(tmp_path);
+    if (!fp) {
+        ACVP_LOG_ERR("Unable to create session journal %s", tmp_path);
+        rv = ACVP_JOURNAL_FAIL;
+        goto end;
+    }
+    /* len counts the terminating NUL */
+    if (fwrite(data, 1, len - 1, fp) != (size_t)(len - 1)) {
+        fclose(fp);
+        ACVP_LOG_ERR("Unable to write session journal %s", tmp_path);
+        rv = ACVP_JOURNAL_FAIL;
+        goto end;
+    }
+    if (acvp_journal_close(fp)) {
+        ACVP_LOG_ERR("Unable to write session journal %s", tmp_path);
+        rv = ACVP_JOURNAL_FAIL;
+        goto end;
+    }
+#ifdef WIN32
+    remove(journal->path);
+#endif
+    if (rename(tmp_path, journal->path)) {
+        ACVP_LOG_ERR("Unable to replace session journal %s", journal->path);
+        rv = ACVP_JOURNAL_FAIL;
+        goto end;
+    }
+    acvp_journal_sync_dir(journal);
+
+end:
+    if (data) json_free_serialized_string(data);
+    free(tmp_path);
+    json_value_free(val);
+    return rv;
+}
+
+static ACVP_JOURNAL *acvp_journal_new(const char *path) {
+    ACVP_JOURNAL *journal;
+
+    journal = calloc(1, sizeof(ACVP_JOURNAL));
+    if (!journal) {
+        return NULL;
+    }
+    journal->path = strndup(path, ACVP_JOURNAL_PATH_MAX);
+    if (!journal->path || acvp_mutex_init(&journal->lock)) {
+        free(journal->path);
+        free(journal);
+        return NULL;
+    }
+    return journal;
+}
+
+static void acvp_journal_destroy(ACVP_JOURNAL *journal) {
+    int i;
+
+    if (!journal) {
+        return;
+    }
+    if (journal->vs) {
+        for (i = 0; i < journal->vs_cnt; i++) {
+            free(journal->vs[i].vsid_url);
+        }
+        free(journal->vs);
+    }
+    free(journal->session_url);
+    free(journal->jwt_token);
+    free(journal->path);
+    acvp_mutex_destroy(&journal->lock);
+    free(journal);
+}
+
+/*
+ * Set up the journal, it is written once the test session has
+ * been registered.
+ */
+ACVP_RESULT acvp_journal_open(ACVP_CTX *ctx, const char *path) {
+    acvp_journal_free(ctx);
+    ctx->journal = acvp_journal_new(path);
+    if (!ctx->journal) {
+        return ACVP_MALLOC_FAIL;
+    }
+    return ACVP_SUCCESS;
+}
+
+/*
+ * Write the first journal for a test session the server just
+ * registered, with all the vector sets pending.
+ */
+ACVP_RESULT acvp_journal_start(ACVP_CTX *ctx) {
+    ACVP_JOURNAL *journal = ctx->journal;
+    ACVP_STRING_LIST *vs_entry;
+    ACVP_RESULT rv;
+    int i;
+
+    if (!journal) {
+        return ACVP_SUCCESS;
+    }
+
+    acvp_mutex_lock(&journal->lock);
+    journal->vs_cnt = 0;
+    for (vs_entry = ctx->vsid_url_list; vs_entry; vs_entry = vs_entry->next) {
+        journal->vs_cnt++;
+    }
+    journal->vs = calloc(journal->vs_cnt, sizeof(ACVP_JOURNAL_VS));
+    journal->session_url = strndup(ctx->session_url, ACVP_ATTR_URL_MAX);
+    if (!journal->vs || !journal->session_url) {
+        rv = ACVP_MALLOC_FAIL;
+        goto end;
+    }
+    vs_entry = ctx->vsid_url_list;
+    for (i = 0; i < journal->vs_cnt; i++) {
+        journal->vs[i].vsid_url = strndup(vs_entry->string, ACVP_ATTR_URL_MAX);
+        if (!journal->vs[i].vsid_url) {
+            rv = ACVP_MALLOC_FAIL;
+            goto end;
+        }
+        vs_entry = vs_entry->next;
+    }
+    rv = acvp_journal_write(ctx);
+    if (rv == ACVP_SUCCESS) {
+        ACVP_LOG_STATUS("Journaling test session to %s", journal->path);
+    }
+
+end:
+    acvp_mutex_unlock(&journal->lock);
+    return rv;
+}
+
+/*
+ * Record a new JWT so a resumed session can refresh it.  This is
+ * called with the JWT lock held.
+ */
+void acvp_journal_set_token(ACVP_CTX *ctx, const char *jwt_token) {
+    ACVP_JOURNAL *journal = ctx->journal;
+
+    if (!journal) {
+        return;
+    }
+
+    acvp_mutex_lock(&journal->lock);
+    if (journal->jwt_token) free(journal->jwt_token);
+    journal->jwt_token = strndup(jwt_token, ACVP_JWT_TOKEN_MAX);
+    if (journal->vs) {
+        acvp_journal_write(ctx);
+    }
+    acvp_mutex_unlock(&journal->lock);
+}
+
+/*
+ * Returns the journaled state of a vector set, and its vsId once known.
+ */
+ACVP_JOURNAL_STATE acvp_journal_vs_state(ACVP_CTX *ctx, const char *vsid_url, int *vs_id) {
+    ACVP_JOURNAL *journal = ctx->journal;
+    ACVP_JOURNAL_VS *vs;
+    ACVP_JOURNAL_STATE state = ACVP_JOURNAL_PENDING;
+
+    if (!journal) {
+        return state;
+    }
+
+    acvp_mutex_lock(&journal->lock);
+    vs = acvp_journal_find(journal, vsid_url, NULL);
+    if (vs) {
+        state = vs->state;
+        if (vs_id) *vs_id = vs->vs_id;
+    }
+    acvp_mutex_unlock(&journal->lock);
+    return state;
+}
+
+/*
+ * Write the responses of a vector set to its spool file.  Unless they
+ * were already serialized, they are written straight from the JSON
+ * tree, the same way they are streamed to the server.
+ */
+static int acvp_journal_spool_write(ACVP_VS_WORK *work, FILE *fp) {
+    ACVP_JSON_WRITER *writer;
+    char buf[ACVP_JOURNAL_SPOOL_BUF];
+    size_t len = 0;
+    int ok = 1;
+
+    if (work->resp_buf) {
+        return fwrite(work->resp_buf, 1, work->resp_len, fp) == (size_t)work->resp_len;
+    }
+    if (!work->kat_resp) {
+        return 0;
+    }
+    writer = acvp_json_writer_new(work->kat_resp);
+    if (!writer) {
+        return 0;
+    }
+    do {
+        if (!acvp_json_writer_read(writer, buf, sizeof(buf), &len) ||
+            fwrite(buf, 1, len, fp) != len) {
+            ok = 0;
+            break;
+        }
+    } while (len);
+    acvp_json_writer_free(writer);
+    return ok;
+}
+
+/*
+ * Spool the responses for a vector set next to the journal and
+ * record that the vector set was computed.
+ */
+ACVP_RESULT acvp_journal_computed(ACVP_CTX *ctx, ACVP_VS_WORK *work) {
+    ACVP_JOURNAL *journal = ctx->journal;
+    ACVP_JOURNAL_VS *vs;
+    char *name = NULL;
+    int idx = 0, name_len;
+    FILE *fp = NULL;
+    ACVP_RESULT rv = ACVP_SUCCESS;
+
+    if (!journal) {
+        return ACVP_SUCCESS;
+    }
+
+    acvp_mutex_lock(&journal->lock);
+    vs = acvp_journal_find(journal, work->vsid_url, &idx);
+    if (!vs) {
+        goto end;
+    }
+
+    name_len = strnlen_s(journal->path, ACVP_JOURNAL_PATH_MAX) + ACVP_JOURNAL_SPOOL_EXT_MAX;
+    name = calloc(name_len, sizeof(char));
+    if (!name) {
+        rv = ACVP_MALLOC_FAIL;
+        goto end;
+    }
+    acvp_journal_spool_name(journal, idx, name, name_len);
+    fp = acvp_journal_create(name);
+    if (!fp) {
+        ACVP_LOG_ERR("Unable to open %s to spool the vector set responses", name);
+        rv = ACVP_JOURNAL_FAIL;
+        goto end;
+    }
+    if (!acvp_journal_spool_write(work, fp)) {
+        ACVP_LOG_ERR("Unable to spool the vector set responses to %s", name);
+        rv = ACVP_JOURNAL_FAIL;
+        goto end;
+    }
+    /*
+     * The spool file must be on disk before the journal says the
+     * vector set was computed, the journal write syncs the directory.
+     */
+    if (acvp_journal_close(fp)) {
+        fp = NULL;
+        ACVP_LOG_ERR("Unable to spool the vector set responses to %s", name);
+        rv = ACVP_JOURNAL_FAIL;
+        goto end;
+    }
+    fp = NULL;
+
+    vs->vs_id = work->vs_id;
+    vs->state = ACVP_JOURNAL_COMPUTED;
+    rv = acvp_journal_write(ctx);
+
+end:
+    if (fp) fclose(fp);
+    free(name);
+    acvp_mutex_unlock(&journal->lock);
+    return rv;
+}
+
+/*
+ * Record that the server acknowledged the responses for a vector set.
+ * The spooled responses are no longer needed.
+ */
+ACVP_RESULT acvp_journal_uploaded(ACVP_CTX *ctx, ACVP_VS_WORK *work) {
+    ACVP_JOURNAL *journal = ctx->journal;
+    ACVP_JOURNAL_VS *vs;
+    char *name = NULL;
+    int idx = 0, name_len;
+    ACVP_RESULT rv = ACVP_SUCCESS;
+
+    if (!journal) {
+        return ACVP_SUCCESS;
+    }
+
+    acvp_mutex_lock(&journal->lock);
+    vs = acvp_journal_find(journal, work->vsid_url, &idx);
+    if (!vs) {
+        goto end;
+    }
+    vs->vs_id = work->vs_id;
+    vs->state = ACVP_JOURNAL_UPLOADED;
+    rv = acvp_journal_write(ctx);
+    if (rv != ACVP_SUCCESS) {
+        goto end;
+    }
+
+    name_len = strnlen_s(journal->path, ACVP_JOURNAL_PATH_MAX) + ACVP_JOURNAL_SPOOL_EXT_MAX;
+    name = calloc(name_len, sizeof(char));
+    if (!name) {
+        goto end;
+    }
+    acvp_journal_spool_name(journal, idx, name, name_len);
+    remove(name);
+
+end:
+    free(name);
+    acvp_mutex_unlock(&journal->lock);
+    return rv;
+}
+
+/*
+ * Read back the spooled responses of a vector set that was computed
+ * before the session was interrupted, ready to be uploaded.
+ */
+ACVP_RESULT acvp_journal_load_responses(ACVP_CTX *ctx, ACVP_VS_WORK *work) {
+    ACVP_JOURNAL *journal = ctx->journal;
+    ACVP_JOURNAL_VS *vs;
+    char *name = NULL;
+    int idx = 0, name_len;
+    long len;
+    FILE *fp = NULL;
+    ACVP_RESULT rv = ACVP_SUCCESS;
+
+    if (!journal) {
+        return ACVP_NO_DATA;
+    }
+
+    acvp_mutex_lock(&journal->lock);
+    vs = acvp_journal_find(journal, work->vsid_url, &idx);
+    if (!vs) {
+        rv = ACVP_NO_DATA;
+        goto end;
+    }
+    name_len = strnlen_s(journal->path, ACVP_JOURNAL_PATH_MAX) + ACVP_JOURNAL_SPOOL_EXT_MAX;
+    name = calloc(name_len, sizeof(char));
+    if (!name) {
+        rv = ACVP_MALLOC_FAIL;
+        goto end;
+    }
+    acvp_journal_spool_name(journal, idx, name, name_len);
+
+    fp = fopen(name, "rb");
+    if (!fp) {
+        ACVP_LOG_ERR("Unable to open spooled vector set responses %s", name);
+        rv = ACVP_JOURNAL_FAIL;
+        goto end;
+    }
+    if (fseek(fp, 0, SEEK_END) || (len = ftell(fp)) <= 0 || fseek(fp, 0, SEEK_SET)) {
+        ACVP_LOG_ERR("Unable to read spooled vector set responses %s", name);
+        rv = ACVP_JOURNAL_FAIL;
+        goto end;
+    }
+    work->resp_buf = calloc(len + 1, sizeof(char));
+    if (!work->resp_buf) {
+        rv = ACVP_MALLOC_FAIL;
+        goto end;
+    }
+    if (fread(work->resp_buf, 1, len, fp) != (size_t)len) {
+        ACVP_LOG_ERR("Unable to read spooled vector set responses %s", name);
+        free(work->resp_buf);
+        work->resp_buf = NULL;
+        rv = ACVP_JOURNAL_FAIL;
+        goto end;
+    }
+    work->resp_len = (int)len;
+    work->vs_id = vs->vs_id;
+
+end:
+    if (fp) fclose(fp);
+    free(name);
+    acvp_mutex_unlock(&journal->lock);
+    return rv;
+}
+
+/*
+ * Read a journal written by an earlier run of a test session.
+ */
+ACVP_RESULT acvp_journal_load(ACVP_CTX *ctx, const char *path) {
+    ACVP_JOURNAL *journal = NULL;
+    JSON_Value *val = NULL;
+    JSON_Object *obj = NULL, *vs_obj = NULL;
+    JSON_Array *vs_arr = NULL;
+    const char *str = NULL;
+    int i, j, diff = 1;
+    ACVP_RESULT rv = ACVP_SUCCESS;
+
+    val = json_parse_file(path);
+    if (!val) {
+        ACVP_LOG_ERR("Unable to read session journal %s", path);
+        return ACVP_JOURNAL_FAIL;
+    }
+    obj = json_value_get_object(val);
+
+    journal = acvp_journal_new(path);
+    if (!journal) {
+        rv = ACVP_MALLOC_FAIL;
+        goto err;
+    }
+
+    str = json_object_get_string(obj, "sessionUrl");
+    if (!str) {
+        ACVP_LOG_ERR("Session journal %s has no sessionUrl", path);
+        rv = ACVP_MALFORMED_JSON;
+        goto err;
+    }
+    journal->session_url = strndup(str, ACVP_ATTR_URL_MAX);
+    if (!journal->session_url) {
+        rv = ACVP_MALLOC_FAIL;
+        goto err;
+    }
+    str = json_object_get_string(obj, "accessToken");
+    if (str) {
+        journal->jwt_token = strndup(str, ACVP_JWT_TOKEN_MAX);
+        if (!journal->jwt_token) {
+            rv = ACVP_MALLOC_FAIL;
+            goto err;
+        }
+    }
+
+    vs_arr = json_object_get_array(obj, "vectorSets");
+    journal->vs_cnt = json_array_get_count(vs_arr);
+    if (!journal->vs_cnt) {
+        ACVP_LOG_ERR("Session journal %s has no vector sets", path);
+        rv = ACVP_MALFORMED_JSON;
+        goto err;
+    }
+    journal->vs = calloc(journal->vs_cnt, sizeof(ACVP_JOURNAL_VS));
+    if (!journal->vs) {
+        rv = ACVP_MALLOC_FAIL;
+        goto err;
+    }
+    for (i = 0; i < journal->vs_cnt; i++) {
+        vs_obj = json_array_get_object(vs_arr, i);
+        str = json_object_get_string(vs_obj, "vectorSetUrl");
+        if (!str) {
+            ACVP_LOG_ERR("Session journal %s has a vector set with no url", path);
+            rv = ACVP_MALFORMED_JSON;
+            goto err;
+        }
+        journal->vs[i].vsid_url = strndup(str, ACVP_ATTR_URL_MAX);
+        if (!journal->vs[i].vsid_url) {
+            rv = ACVP_MALLOC_FAIL;
+            goto err;
+        }
+        journal->vs[i].vs_id = json_object_get_number(vs_obj, "vsId");
+        str = json_object_get_string(vs_obj, "status");
+        for (j = 0; str && j <= ACVP_JOURNAL_UPLOADED; j++) {
+            diff = 1;
+            strcmp_s(acvp_journal_state_name[j], strlen(acvp_journal_state_name[j]), str, &diff);
+            if (!diff) {
+                journal->vs[i].state = j;
+                break;
+            }
+        }
+    }
+
+    acvp_journal_free(ctx);
+    ctx->journal = journal;
+    json_value_free(val);
+    return ACVP_SUCCESS;
+
+err:
+    acvp_journal_destroy(journal);
+    json_value_free(val);
+    return rv;
+}
+
+void acvp_journal_free(ACVP_CTX *ctx) {
+    acvp_journal_destroy(ctx->journal);
+    ctx->journal = NULL;
+}
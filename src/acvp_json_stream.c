@@ -0,0 +1,884 @@
+/*****************************************************************************
+* Copyright (c) 2016-2017, Cisco Systems, Inc.
+* All rights reserved.
+
+* Redistribution and use in source and binary forms, with or without modification,
+* are permitted provided that the following conditions are met:
+*
+* 1. Redistributions of source code must retain the above copyright notice,
+*    this list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright notice,
+*    this list of conditions and the following disclaimer in the documentation
+*    and/or other materials provided with the distribution.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+* SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+* CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+* USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+/*
+ * Streaming JSON for the transport.
+ *
+ * The parser builds the same parson tree as json_parse_string(), but
+ * is fed the document a piece at a time as it arrives from the
+ * server.  The vector set is then parsed while it is still
+ * downloading, and the tree is ready as soon as the last byte is
+ * received.  The parser keeps the containers being filled on a stack,
+ * and the token being read (a string, number or literal) in a buffer,
+ * so a token may be split across any number of pieces.
+ *
+ * The writer does the reverse for the responses: it walks a parson
+ * tree and hands out the compact serialization a piece at a time, so
+ * the responses are sent without first being serialized in full.
+ * The pieces may also be gzip compressed on the way out.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <zlib.h>
+#include "acvp.h"
+#include "acvp_lcl.h"
+#include "parson.h"
+#include "safe_lib.h"
+
+#define ACVP_JSON_STREAM_NESTING_MAX 2048   /* same as parson */
+#define ACVP_JSON_STREAM_TOK_MIN     64
+#define ACVP_JSON_NUM_BUF_SIZE       64     /* same format as parson */
+#define ACVP_JSON_NUM_FORMAT         "%1.17g"
+#define ACVP_JSON_GZIP_CHUNK         (1024*16)
+
+/* What the parser expects next */
+typedef enum acvp_json_expect {
+    ACVP_JSON_EXPECT_VALUE = 0,
+    ACVP_JSON_EXPECT_VALUE_OR_END,  /* just after '[' */
+    ACVP_JSON_EXPECT_KEY_OR_END,    /* just after '{' */
+    ACVP_JSON_EXPECT_KEY,
+    ACVP_JSON_EXPECT_COLON,
+    ACVP_JSON_EXPECT_COMMA_OR_END,
+    ACVP_JSON_EXPECT_NOTHING        /* the document is complete */
+} ACVP_JSON_EXPECT;
+
+/* The token being read, if any */
+typedef enum acvp_json_tok {
+    ACVP_JSON_TOK_NONE = 0,
+    ACVP_JSON_TOK_STRING,
+    ACVP_JSON_TOK_STRING_ESC,       /* after a backslash */
+    ACVP_JSON_TOK_STRING_HEX,       /* reading the 4 digits of \uXXXX */
+    ACVP_JSON_TOK_NUMBER,
+    ACVP_JSON_TOK_LITERAL           /* true, false or null */
+} ACVP_JSON_TOK;
+
+typedef struct acvp_json_frame_t {
+    JSON_Value *val;        /* the object or array being filled */
+    char *key;              /* key of the member being read */
+} ACVP_JSON_FRAME;
+
+struct acvp_json_stream_t {
+    ACVP_JSON_EXPECT expect;
+    ACVP_JSON_TOK tok;
+    int is_key;             /* the string being read is an object key */
+    int failed;
+    char *buf;              /* the token being read */
+    size_t buf_len;
+    size_t buf_size;
+    unsigned int hex;       /* \uXXXX being read */
+    int hex_cnt;
+    unsigned int high;      /* pending high surrogate, 0 if none */
+    ACVP_JSON_FRAME *stack;
+    int depth;
+    int stack_size;
+    JSON_Value *root;
+};
+
+ACVP_JSON_STREAM *acvp_json_stream_new(void) {
+    ACVP_JSON_STREAM *js;
+
+    js = calloc(1, sizeof(ACVP_JSON_STREAM));
+    if (!js) {
+        return NULL;
+    }
+    js->buf = malloc(ACVP_JSON_STREAM_TOK_MIN);
+    if (!js->buf) {
+        free(js);
+        return NULL;
+    }
+    js->buf_size = ACVP_JSON_STREAM_TOK_MIN;
+    return js;
+}
+
+/*
+ * Forget the document fed so far, to parse a new one.
+ */
+void acvp_json_stream_reset(ACVP_JSON_STREAM *js) {
+    int i;
+
+    for (i = 0; i < js->depth; i++) {
+        if (js->stack[i].key) free(js->stack[i].key);
+    }
+    /* The containers on the stack all belong to the root */
+    if (js->root) json_value_free(js->root);
+    js->root = NULL;
+    js->depth = 0;
+    js->expect = ACVP_JSON_EXPECT_VALUE;
+    js->tok = ACVP_JSON_TOK_NONE;
+    js->is_key = 0;
+    js->failed = 0;
+    js->buf_len = 0;
+    js->high = 0;
+}
+
+void acvp_json_stream_free(ACVP_JSON_STREAM *js) {
+    if (!js) {
+        return;
+    }
+    acvp_json_stream_reset(js);
+    free(js->stack);
+    free(js->buf);
+    free(js);
+}
+
+static int acvp_json_buf_put(ACVP_JSON_STREAM *js, char c) {
+    size_t new_size;
+    char *new_buf;
+
+    if (js->buf_len + 1 >= js->buf_size) {
+        new_size = js->buf_size * 2;
+        new_buf = realloc(js->buf, new_size);
+        if (!new_buf) {
+            return 0;
+        }
+        js->buf = new_buf;
+        js->buf_size = new_size;
+    }
+    js->buf[js->buf_len++] = c;
+    return 1;
+}
+
+/*
+ * Append a code point from a \u escape to the string being read
+ */
+static int acvp_json_buf_put_utf8(ACVP_JSON_STREAM *js, unsigned int cp) {
+    if (cp < 0x80) {
+        return acvp_json_buf_put(js, (char)cp);
+    } else if (cp < 0x800) {
+        return acvp_json_buf_put(js, (char)(0xC0 | (cp >> 6))) &&
+               acvp_json_buf_put(js, (char)(0x80 | (cp & 0x3F)));
+    } else if (cp < 0x10000) {
+        return acvp_json_buf_put(js, (char)(0xE0 | (cp >> 12))) &&
+               acvp_json_buf_put(js, (char)(0x80 | ((cp >> 6) & 0x3F))) &&
+               acvp_json_buf_put(js, (char)(0x80 | (cp & 0x3F)));
+    }
+    return acvp_json_buf_put(js, (char)(0xF0 | (cp >> 18))) &&
+           acvp_json_buf_put(js, (char)(0x80 | ((cp >> 12) & 0x3F))) &&
+           acvp_json_buf_put(js, (char)(0x80 | ((cp >> 6) & 0x3F))) &&
+           acvp_json_buf_put(js, (char)(0x80 | (cp & 0x3F)));
+}
+
+/*
+ * Add a value that was read to the container on top of the stack,
+ * or make it the root.  The value belongs to the tree afterwards,
+ * or is freed on failure.
+ */
+static int acvp_json_add_value(ACVP_JSON_STREAM *js, JSON_Value *val) {
+    ACVP_JSON_FRAME *top;
+    JSON_Object *obj;
+    int rv;
+
+    if (!val) {
+        return 0;
+    }
+    if (!js->depth) {
+        js->root = val;
+        js->expect = ACVP_JSON_EXPECT_NOTHING;
+        return 1;
+    }
+    top = &js->stack[js->depth - 1];
+    if (json_value_get_type(top->val) == JSONObject) {
+        obj = json_value_get_object(top->val);
+        /* parson doesn't accept duplicate keys either */
+        rv = !json_object_has_value(obj, top->key) &&
+             json_object_set_value(obj, top->key, val) == JSONSuccess;
+        free(top->key);
+        top->key = NULL;
+    } else {
+        rv = json_array_append_value(json_value_get_array(top->val), val) == JSONSuccess;
+    }
+    if (!rv) {
+        json_value_free(val);
+        return 0;
+    }
+    js->expect = ACVP_JSON_EXPECT_COMMA_OR_END;
+    return 1;
+}
+
+/*
+ * Start filling a new object or array
+ */
+static int acvp_json_push(ACVP_JSON_STREAM *js, JSON_Value *val) {
+    ACVP_JSON_FRAME *new_stack;
+    int new_size;
+
+    if (!val) {
+        return 0;
+    }
+    if (js->depth >= ACVP_JSON_STREAM_NESTING_MAX) {
+        json_value_free(val);
+        return 0;
+    }
+    if (js->depth == js->stack_size) {
+        new_size = js->stack_size ? js->stack_size * 2 : 16;
+        new_stack = realloc(js->stack, new_size * sizeof(ACVP_JSON_FRAME));
+        if (!new_stack) {
+            json_value_free(val);
+            return 0;
+        }
+        js->stack = new_stack;
+        js->stack_size = new_size;
+    }
+    if (!acvp_json_add_value(js, val)) {
+        return 0;
+    }
+    js->stack[js->depth].val = val;
+    js->stack[js->depth].key = NULL;
+    js->depth++;
+    return 1;
+}
+
+/*
+ * The object or array on top of the stack is complete
+ */
+static int acvp_json_pop(ACVP_JSON_STREAM *js, JSON_Value_Type type) {
+    if (!js->depth || json_value_get_type(js->stack[js->depth - 1].val) != type) {
+        return 0;
+    }
+    js->depth--;
+    js->expect = js->depth ? ACVP_JSON_EXPECT_COMMA_OR_END : ACVP_JSON_EXPECT_NOTHING;
+    return 1;
+}
+
+/*
+ * Checks the number follows the JSON grammar, which is stricter
+ * than strtod()
+ */
+static int acvp_json_is_number(const char *s) {
+    if (*s == '-') s++;
+    if (*s == '0') {
+        s++;
+    } else if (*s >= '1' && *s <= '9') {
+        while (*s >= '0' && *s <= '9') s++;
+    } else {
+        return 0;
+    }
+    if (*s == '.') {
+        s++;
+        if (*s < '0' || *s > '9') return 0;
+        while (*s >= '0' && *s <= '9') s++;
+    }
+    if (*s == 'e' || *s == 'E') {
+        s++;
+        if (*s == '+' || *s == '-') s++;
+        if (*s < '0' || *s > '9') return 0;
+        while (*s >= '0' && *s <= '9') s++;
+    }
+    return *s == 0;
+}
+
+/*
+ * A number or literal ended, turn it into a value
+ */
+static int acvp_json_end_scalar(ACVP_JSON_STREAM *js) {
+    double number;
+
+    js->buf[js->buf_len] = 0;
+    if (js->tok == ACVP_JSON_TOK_NUMBER) {
+        js->tok = ACVP_JSON_TOK_NONE;
+        if (!acvp_json_is_number(js->buf)) {
+            return 0;
+        }
+        errno = 0;
+        number = strtod(js->buf, NULL);
+        if (errno) {
+            return 0;
+        }
+        return acvp_json_add_value(js, json_value_init_number(number));
+    }
+    js->tok = ACVP_JSON_TOK_NONE;
+    if (!strcmp(js->buf, "true")) {
+        return acvp_json_add_value(js, json_value_init_boolean(1));
+    } else if (!strcmp(js->buf, "false")) {
+        return acvp_json_add_value(js, json_value_init_boolean(0));
+    } else if (!strcmp(js->buf, "null")) {
+        return acvp_json_add_value(js, json_value_init_null());
+    }
+    return 0;
+}
+
+/*
+ * A string ended, it is either an object key or a value
+ */
+static int acvp_json_end_string(ACVP_JSON_STREAM *js) {
+    char *key;
+
+    js->tok = ACVP_JSON_TOK_NONE;
+    if (js->high) {
+        /* Unpaired high surrogate */
+        return 0;
+    }
+    js->buf[js->buf_len] = 0;
+    if (strlen(js->buf) != js->buf_len) {
+        /* \u0000, which a C string can't hold */
+        return 0;
+    }
+    if (js->is_key) {
+        key = malloc(js->buf_len + 1);
+        if (!key) {
+            return 0;
+        }
+        memcpy_s(key, js->buf_len + 1, js->buf, js->buf_len + 1);
+        js->stack[js->depth - 1].key = key;
+        js->expect = ACVP_JSON_EXPECT_COLON;
+        return 1;
+    }
+    /* This checks the string is valid UTF-8 */
+    return acvp_json_add_value(js, json_value_init_string(js->buf));
+}
+
+static int acvp_json_hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/*
+ * Feed one character inside a string
+ */
+static int acvp_json_string_char(ACVP_JSON_STREAM *js, char c) {
+    int digit;
+
+    switch (js->tok) {
+    case ACVP_JSON_TOK_STRING:
+        if (c == '"') {
+            return acvp_json_end_string(js);
+        } else if (c == '\\') {
+            js->tok = ACVP_JSON_TOK_STRING_ESC;
+            return 1;
+        } else if ((unsigned char)c < 0x20 || js->high) {
+            return 0;
+        }
+        return acvp_json_buf_put(js, c);
+    case ACVP_JSON_TOK_STRING_ESC:
+        js->tok = ACVP_JSON_TOK_STRING;
+        if (c == 'u') {
+            js->tok = ACVP_JSON_TOK_STRING_HEX;
+            js->hex = 0;
+            js->hex_cnt = 0;
+            return 1;
+        }
+        if (js->high) {
+            return 0;
+        }
+        switch (c) {
+        case '"': case '\\': case '/':
+            return acvp_json_buf_put(js, c);
+        case 'b': return acvp_json_buf_put(js, '\b');
+        case 'f': return acvp_json_buf_put(js, '\f');
+        case 'n': return acvp_json_buf_put(js, '\n');
+        case 'r': return acvp_json_buf_put(js, '\r');
+        case 't': return acvp_json_buf_put(js, '\t');
+        default: return 0;
+        }
+    case ACVP_JSON_TOK_STRING_HEX:
+        digit = acvp_json_hex_digit(c);
+        if (digit < 0) {
+            return 0;
+        }
+        js->hex = (js->hex << 4) | digit;
+        if (++js->hex_cnt < 4) {
+            return 1;
+        }
+        js->tok = ACVP_JSON_TOK_STRING;
+        if (js->hex >= 0xD800 && js->hex <= 0xDBFF) {
+            if (js->high) {
+                return 0;
+            }
+            js->high = js->hex;
+            return 1;
+        }
+        if (js->hex >= 0xDC00 && js->hex <= 0xDFFF) {
+            if (!js->high) {
+                return 0;
+            }
+            js->hex = 0x10000 + ((js->high - 0xD800) << 10) + (js->hex - 0xDC00);
+            js->high = 0;
+        } else if (js->high) {
+            return 0;
+        }
+        return acvp_json_buf_put_utf8(js, js->hex);
+    default:
+        return 0;
+    }
+}
+
+/*
+ * Feed one character outside of a string
+ */
+static int acvp_json_char(ACVP_JSON_STREAM *js, char c) {
+    if (js->tok == ACVP_JSON_TOK_NUMBER || js->tok == ACVP_JSON_TOK_LITERAL) {
+        if ((js->tok == ACVP_JSON_TOK_NUMBER && ((c >= '0' && c <= '9') ||
+             c == '.' || c == 'e' || c == 'E' || c == '+' || c == '-')) ||
+            (js->tok == ACVP_JSON_TOK_LITERAL && c >= 'a' && c <= 'z')) {
+            return acvp_json_buf_put(js, c);
+        }
+        /* The token ended, c is looked at below */
+        if (!acvp_json_end_scalar(js)) {
+            return 0;
+        }
+    }
+
+    if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+        return 1;
+    }
+
+    switch (js->expect) {
+    case ACVP_JSON_EXPECT_VALUE_OR_END:
+        if (c == ']') {
+            return acvp_json_pop(js, JSONArray);
+        }
+        /* fall through */
+    case ACVP_JSON_EXPECT_VALUE:
+        js->buf_len = 0;
+        switch (c) {
+        case '{':
+            if (!acvp_json_push(js, json_value_init_object())) {
+                return 0;
+            }
+            js->expect = ACVP_JSON_EXPECT_KEY_OR_END;
+            return 1;
+        case '[':
+            if (!acvp_json_push(js, json_value_init_array())) {
+                return 0;
+            }
+            js->expect = ACVP_JSON_EXPECT_VALUE_OR_END;
+            return 1;
+        case '"':
+            js->tok = ACVP_JSON_TOK_STRING;
+            js->is_key = 0;
+            return 1;
+        case 't': case 'f': case 'n':
+            js->tok = ACVP_JSON_TOK_LITERAL;
+            return acvp_json_buf_put(js, c);
+        default:
+            if (c == '-' || (c >= '0' && c <= '9')) {
+                js->tok = ACVP_JSON_TOK_NUMBER;
+                return acvp_json_buf_put(js, c);
+            }
+            return 0;
+        }
+    case ACVP_JSON_EXPECT_KEY_OR_END:
+        if (c == '}') {
+            return acvp_json_pop(js, JSONObject);
+        }
+        /* fall through */
+    case ACVP_JSON_EXPECT_KEY:
+        if (c != '"') {
+            return 0;
+        }
+        js->buf_len = 0;
+        js->tok = ACVP_JSON_TOK_STRING;
+        js->is_key = 1;
+        return 1;
+    case ACVP_JSON_EXPECT_COLON:
+        if (c != ':') {
+            return 0;
+        }
+        js->expect = ACVP_JSON_EXPECT_VALUE;
+        return 1;
+    case ACVP_JSON_EXPECT_COMMA_OR_END:
+        if (c == ',') {
+            js->expect = json_value_get_type(js->stack[js->depth - 1].val) == JSONObject ?
+                         ACVP_JSON_EXPECT_KEY : ACVP_JSON_EXPECT_VALUE;
+            return 1;
+        } else if (c == '}') {
+            return acvp_json_pop(js, JSONObject);
+        } else if (c == ']') {
+            return acvp_json_pop(js, JSONArray);
+        }
+        return 0;
+    case ACVP_JSON_EXPECT_NOTHING:
+    default:
+        return 0;
+    }
+}
+
+/*
+ * Feed the next piece of the document.  Returns 0 once the document
+ * is found to be invalid, after which the rest of it is ignored.
+ */
+int acvp_json_stream_feed(ACVP_JSON_STREAM *js, const char *data, size_t len) {
+    size_t i;
+    char c;
+
+    if (js->failed) {
+        return 0;
+    }
+    for (i = 0; i < len; i++) {
+        c = data[i];
+        if (js->tok >= ACVP_JSON_TOK_STRING && js->tok <= ACVP_JSON_TOK_STRING_HEX) {
+            if (!acvp_json_string_char(js, c)) {
+                break;
+            }
+        } else if (!acvp_json_char(js, c)) {
+            break;
+        }
+    }
+    if (i < len) {
+        js->failed = 1;
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * The whole document was fed.  Returns the tree, which then belongs
+ * to the caller, or NULL if the document was invalid or incomplete.
+ */
+JSON_Value *acvp_json_stream_finish(ACVP_JSON_STREAM *js) {
+    JSON_Value *root;
+
+    if (js->failed) {
+        return NULL;
+    }
+    /* A number at the very end of the document isn't finished yet */
+    if (js->tok == ACVP_JSON_TOK_NUMBER || js->tok == ACVP_JSON_TOK_LITERAL) {
+        if (!acvp_json_end_scalar(js)) {
+            js->failed = 1;
+            return NULL;
+        }
+    }
+    if (js->expect != ACVP_JSON_EXPECT_NOTHING) {
+        return NULL;
+    }
+    root = js->root;
+    js->root = NULL;
+    return root;
+}
+
+typedef struct acvp_json_wframe_t {
+    const JSON_Value *val;  /* the object or array being written */
+    size_t idx;             /* next member or element to write */
+} ACVP_JSON_WFRAME;
+
+struct acvp_json_writer_t {
+    const JSON_Value *root;
+    int started;
+    int done;
+    ACVP_JSON_WFRAME *stack;
+    int depth;
+    int stack_size;
+    char *buf;              /* the piece being handed out */
+    size_t buf_len;
+    size_t buf_off;
+    size_t buf_size;
+    z_stream *gz;           /* compresses the document when not NULL */
+    char *gz_in;            /* the document waiting to be compressed */
+    int gz_eof;             /* all of the document was given to zlib */
+    int gz_done;            /* zlib has handed out all of its output */
+};
+
+/*
+ * Create a writer for the tree, which must not change or be freed
+ * while the writer is in use.
+ */
+ACVP_JSON_WRITER *acvp_json_writer_new(const JSON_Value *root) {
+    ACVP_JSON_WRITER *w;
+
+    w = calloc(1, sizeof(ACVP_JSON_WRITER));
+    if (!w) {
+        return NULL;
+    }
+    w->root = root;
+    return w;
+}
+
+/*
+ * Have the document handed out gzip compressed.  Returns 0 on failure.
+ */
+int acvp_json_writer_set_gzip(ACVP_JSON_WRITER *w) {
+    if (w->gz) {
+        return 1;
+    }
+    w->gz = calloc(1, sizeof(z_stream));
+    w->gz_in = malloc(ACVP_JSON_GZIP_CHUNK);
+    if (!w->gz || !w->gz_in) {
+        goto err;
+    }
+    /* 16 more window bits asks for a gzip header and trailer */
+    if (deflateInit2(w->gz, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+        goto err;
+    }
+    return 1;
+
+err:
+    free(w->gz);
+    free(w->gz_in);
+    w->gz = NULL;
+    w->gz_in = NULL;
+    return 0;
+}
+
+/*
+ * Start over from the beginning of the document, as when a request
+ * is sent again.
+ */
+void acvp_json_writer_rewind(ACVP_JSON_WRITER *w) {
+    w->started = 0;
+    w->done = 0;
+    w->depth = 0;
+    w->buf_len = 0;
+    w->buf_off = 0;
+    if (w->gz) {
+        deflateReset(w->gz);
+        w->gz->avail_in = 0;
+        w->gz_eof = 0;
+        w->gz_done = 0;
+    }
+}
+
+void acvp_json_writer_free(ACVP_JSON_WRITER *w) {
+    if (!w) {
+        return;
+    }
+    if (w->gz) {
+        deflateEnd(w->gz);
+        free(w->gz);
+    }
+    free(w->gz_in);
+    free(w->stack);
+    free(w->buf);
+    free(w);
+}
+
+static int acvp_json_writer_put(ACVP_JSON_WRITER *w, const char *str, size_t len) {
+    size_t new_size;
+    char *new_buf;
+
+    if (!len) {
+        return 1;
+    }
+    if (w->buf_len + len > w->buf_size) {
+        new_size = w->buf_size ? w->buf_size : ACVP_JSON_STREAM_TOK_MIN;
+        while (new_size < w->buf_len + len) {
+            new_size *= 2;
+        }
+        new_buf = realloc(w->buf, new_size);
+        if (!new_buf) {
+            return 0;
+        }
+        w->buf = new_buf;
+        w->buf_size = new_size;
+    }
+    memcpy_s(w->buf + w->buf_len, w->buf_size - w->buf_len, str, len);
+    w->buf_len += len;
+    return 1;
+}
+
+/*
+ * Write a string with the same escaping as parson
+ */
+static int acvp_json_writer_put_string(ACVP_JSON_WRITER *w, const char *str) {
+    char esc[8];
+    const char *run = str;
+    unsigned char c;
+
+    if (!str || !acvp_json_writer_put(w, "\"", 1)) {
+        return 0;
+    }
+    for (; *str; str++) {
+        c = (unsigned char)*str;
+        if (c >= 0x20 && c != '"' && c != '\\' && c != '/') {
+            continue;
+        }
+        if (!acvp_json_writer_put(w, run, str - run)) {
+            return 0;
+        }
+        run = str + 1;
+        switch (c) {
+        case '"': strcpy_s(esc, sizeof(esc), "\\\""); break;
+        case '\\': strcpy_s(esc, sizeof(esc), "\\\\"); break;
+        case '/': strcpy_s(esc, sizeof(esc), "\\/"); break;
+        case '\b': strcpy_s(esc, sizeof(esc), "\\b"); break;
+        case '\f': strcpy_s(esc, sizeof(esc), "\\f"); break;
+        case '\n': strcpy_s(esc, sizeof(esc), "\\n"); break;
+        case '\r': strcpy_s(esc, sizeof(esc), "\\r"); break;
+        case '\t': strcpy_s(esc, sizeof(esc), "\\t"); break;
+        default: snprintf(esc, sizeof(esc), "\\u%04x", c); break;
+        }
+        if (!acvp_json_writer_put(w, esc, strnlen_s(esc, sizeof(esc)))) {
+            return 0;
+        }
+    }
+    return acvp_json_writer_put(w, run, str - run) && acvp_json_writer_put(w, "\"", 1);
+}
+
+/*
+ * Write a value, or just the opening of an object or array, whose
+ * contents are written by the next calls to acvp_json_writer_next()
+ */
+static int acvp_json_writer_value(ACVP_JSON_WRITER *w, const JSON_Value *val) {
+    ACVP_JSON_WFRAME *new_stack;
+    char num[ACVP_JSON_NUM_BUF_SIZE];
+    int new_size, len;
+
+    switch (json_value_get_type(val)) {
+    case JSONObject:
+    case JSONArray:
+        if (w->depth == w->stack_size) {
+            new_size = w->stack_size ? w->stack_size * 2 : 16;
+            new_stack = realloc(w->stack, new_size * sizeof(ACVP_JSON_WFRAME));
+            if (!new_stack) {
+                return 0;
+            }
+            w->stack = new_stack;
+            w->stack_size = new_size;
+        }
+        w->stack[w->depth].val = val;
+        w->stack[w->depth].idx = 0;
+        w->depth++;
+        return acvp_json_writer_put(w, json_value_get_type(val) == JSONObject ? "{" : "[", 1);
+    case JSONString:
+        return acvp_json_writer_put_string(w, json_value_get_string(val));
+    case JSONNumber:
+        len = snprintf(num, sizeof(num), ACVP_JSON_NUM_FORMAT, json_value_get_number(val));
+        if (len < 0 || len >= (int)sizeof(num)) {
+            return 0;
+        }
+        return acvp_json_writer_put(w, num, len);
+    case JSONBoolean:
+        return json_value_get_boolean(val) ? acvp_json_writer_put(w, "true", 4) :
+                                             acvp_json_writer_put(w, "false", 5);
+    case JSONNull:
+        return acvp_json_writer_put(w, "null", 4);
+    default:
+        return 0;
+    }
+}
+
+/*
+ * Write the next piece of the document: a member of an object, an
+ * element of an array, or the end of either.
+ */
+static int acvp_json_writer_next(ACVP_JSON_WRITER *w) {
+    ACVP_JSON_WFRAME *top;
+    const JSON_Object *obj;
+    const JSON_Array *arr;
+
+    w->buf_len = 0;
+    w->buf_off = 0;
+    if (!w->started) {
+        w->started = 1;
+        return acvp_json_writer_value(w, w->root);
+    }
+    if (!w->depth) {
+        w->done = 1;
+        return 1;
+    }
+    top = &w->stack[w->depth - 1];
+    if (json_value_get_type(top->val) == JSONObject) {
+        obj = json_value_get_object(top->val);
+        if (top->idx == json_object_get_count(obj)) {
+            w->depth--;
+            return acvp_json_writer_put(w, "}", 1);
+        }
+        if (top->idx && !acvp_json_writer_put(w, ",", 1)) {
+            return 0;
+        }
+        if (!acvp_json_writer_put_string(w, json_object_get_name(obj, top->idx)) ||
+            !acvp_json_writer_put(w, ":", 1)) {
+            return 0;
+        }
+        return acvp_json_writer_value(w, json_object_get_value_at(obj, top->idx++));
+    }
+    arr = json_value_get_array(top->val);
+    if (top->idx == json_array_get_count(arr)) {
+        w->depth--;
+        return acvp_json_writer_put(w, "]", 1);
+    }
+    if (top->idx && !acvp_json_writer_put(w, ",", 1)) {
+        return 0;
+    }
+    return acvp_json_writer_value(w, json_array_get_value(arr, top->idx++));
+}
+
+static int acvp_json_writer_read_text(ACVP_JSON_WRITER *w, char *out, size_t len, size_t *out_len) {
+    size_t n = 0, cnt;
+
+    while (n < len) {
+        if (w->buf_off == w->buf_len) {
+            if (w->done) {
+                break;
+            }
+            if (!acvp_json_writer_next(w)) {
+                return 0;
+            }
+            continue;
+        }
+        cnt = w->buf_len - w->buf_off;
+        if (cnt > len - n) {
+            cnt = len - n;
+        }
+        memcpy_s(out + n, len - n, w->buf + w->buf_off, cnt);
+        w->buf_off += cnt;
+        n += cnt;
+    }
+    *out_len = n;
+    return 1;
+}
+
+static int acvp_json_writer_read_gzip(ACVP_JSON_WRITER *w, char *out, size_t len, size_t *out_len) {
+    z_stream *gz = w->gz;
+    size_t in_len;
+    int rv;
+
+    gz->next_out = (Bytef *)out;
+    gz->avail_out = (uInt)len;
+    while (gz->avail_out && !w->gz_done) {
+        if (!gz->avail_in && !w->gz_eof) {
+            if (!acvp_json_writer_read_text(w, w->gz_in, ACVP_JSON_GZIP_CHUNK, &in_len)) {
+                return 0;
+            }
+            gz->next_in = (Bytef *)w->gz_in;
+            gz->avail_in = (uInt)in_len;
+            w->gz_eof = !in_len;
+        }
+        rv = deflate(gz, w->gz_eof ? Z_FINISH : Z_NO_FLUSH);
+        if (rv == Z_STREAM_END) {
+            w->gz_done = 1;
+        } else if (rv != Z_OK && rv != Z_BUF_ERROR) {
+            return 0;
+        }
+    }
+    *out_len = len - gz->avail_out;
+    return 1;
+}
+
+/*
+ * Copy up to len bytes of the document, compressed if so set, to out.
+ * *out_len is set to the number of bytes copied, which is only 0 at
+ * the end of the document.  Returns 0 on failure.
+ */
+int acvp_json_writer_read(ACVP_JSON_WRITER *w, char *out, size_t len, size_t *out_len) {
+    if (w->gz) {
+        return acvp_json_writer_read_gzip(w, out, len, out_len);
+    }
+    return acvp_json_writer_read_text(w, out, len, out_len);
+}
@@ -26,7 +26,11 @@
 #ifndef acvp_lcl_h
 #define acvp_lcl_h
 
+#include <time.h>
 #include "parson.h"
+#ifndef WIN32
+#include <pthread.h>
+#endif
 
 #define ACVP_VERSION    "0.5"
 #define ACVP_LIBRARY_VERSION    "libacvp-1.0.0"
@@ -559,12 +563,20 @@
  * END RSA
  */
 
-#define ACVP_KAT_BUF_MAX        1024 * 1024 * 4
-#define ACVP_ANS_BUF_MAX        1024 * 1024 * 4
-#define ACVP_REG_BUF_MAX        1024 * 128
+#define ACVP_HTTP_BUF_MIN       (1024 * 16)          /* first size of a receive buffer */
+#define ACVP_HTTP_BUF_MAX       (1024 * 1024 * 256)  /* largest HTTP body accepted */
+#define ACVP_RETRY_TIME_MIN     1  /* seconds */
 #define ACVP_RETRY_TIME_MAX     60 /* seconds */
 #define ACVP_JWT_TOKEN_MAX      1024
 #define ACVP_ATTR_URL_MAX       2083 /* MS IE's limit - arbitrary */
+#define ACVP_JOURNAL_PATH_MAX   4096
+#define ACVP_OFFLINE_PATH_MAX   4096
+#define ACVP_OFFLINE_VS_EXT     ".json"     /* vector set files */
+#define ACVP_OFFLINE_RSP_EXT    ".rsp.json" /* their responses */
+#define ACVP_WORKER_COUNT_MAX   32   /* vector sets processed concurrently */
+#define ACVP_PREFETCH_DEPTH_MAX 8    /* vector sets downloaded ahead of processing */
+#define ACVP_PREFETCH_DEPTH_DEFAULT 0
+#define ACVP_HTTP_STATS_INIT    64   /* first size of the request timing array */
 
 #define ACVP_SESSION_PARAMS_STR_LEN_MAX 256
 #define ACVP_PATH_SEGMENT_DEFAULT ""
@@ -572,12 +584,162 @@
 
 #define ACVP_CFB1_BIT_MASK      0x80
 
+/*
+ * Locking used to protect the few values on the ACVP_CTX that may
+ * change while vector sets are processed from several threads.
+ * Worker threads are only available when pthreads is, so the lock
+ * is a no-op on the other platforms.  The lock is recursive, see
+ * acvp_mutex_init().
+ */
+#ifndef WIN32
+typedef pthread_mutex_t ACVP_MUTEX;
+#define acvp_mutex_lock(m)      pthread_mutex_lock(m)
+#define acvp_mutex_unlock(m)    pthread_mutex_unlock(m)
+#define acvp_mutex_destroy(m)   pthread_mutex_destroy(m)
+#else
+typedef int ACVP_MUTEX;
+#define acvp_mutex_lock(m)      do { } while (0)
+#define acvp_mutex_unlock(m)    do { } while (0)
+#define acvp_mutex_destroy(m)   do { } while (0)
+#endif
+
+typedef struct acvp_json_stream_t ACVP_JSON_STREAM;
+
+typedef struct acvp_json_writer_t ACVP_JSON_WRITER;
+
+/*
+ * This struct holds the transitory state for one vector set while
+ * it is downloaded, processed and the responses are uploaded.  It
+ * is also used for the other requests made after registration, such
+ * as fetching the test session results.  Keeping this state off the
+ * ACVP_CTX allows several vector sets to be in flight at once.
+ */
+typedef struct acvp_vs_work_t {
+    int vs_id;            /* vs_id currently being processed */
+    char *vsid_url;       /* vs currently being processed */
+    char *kat_buf;        /* holds the current set of vectors being processed */
+    ACVP_JSON_STREAM *kat_stream;   /* parses kat_buf while it is downloaded */
+    JSON_Value *kat_val;  /* the parsed vector set, once it has been downloaded */
+    JSON_Value *kat_resp; /* holds the current set of vector responses */
+    char *resp_buf;       /* the vector responses, when serialized rather than streamed */
+    int resp_len;
+    int resp_serialized;  /* resp_buf is from the JSON serializer rather than malloc */
+    ACVP_JSON_WRITER *resp_writer;  /* streams kat_resp to the server */
+    int resp_gzip;        /* resp_buf, or what resp_writer hands out, is gzip encoded */
+    char *upld_buf;       /* holds the HTTP response from server when uploading */
+    char *test_sess_buf;  /* holds the test session or vector set results */
+    char *sample_buf;     /* holds the expected results for a sample session */
+    size_t kat_buf_size;  /* allocated sizes of the receive buffers above */
+    size_t upld_buf_size;
+    size_t test_sess_buf_size;
+    size_t sample_buf_size;
+    size_t read_ctr;      /* used during curl processing */
+    size_t content_len;   /* Content-Length of the response being received, 0 if unknown */
+} ACVP_VS_WORK;
+
+/*
+ * How far a vector set got, as recorded in the session journal
+ */
+typedef enum acvp_journal_state {
+    ACVP_JOURNAL_PENDING = 0,
+    ACVP_JOURNAL_COMPUTED,
+    ACVP_JOURNAL_UPLOADED
+} ACVP_JOURNAL_STATE;
+
+typedef struct acvp_journal_vs_t {
+    char *vsid_url;
+    int vs_id;
+    ACVP_JOURNAL_STATE state;
+} ACVP_JOURNAL_VS;
+
+/*
+ * The session journal, see acvp_journal.c
+ */
+typedef struct acvp_journal_t {
+    char *path;
+    ACVP_MUTEX lock;
+    char *session_url;
+    char *jwt_token;
+    int vs_cnt;
+    ACVP_JOURNAL_VS *vs;
+} ACVP_JOURNAL;
+
+/*
+ * Where a vector set, or a request for test results, is in a session
+ * driven with acvp_poll(), or by acvp_process_tests() and
+ * acvp_check_test_results()
+ */
+#define ACVP_ASYNC_PENDING   0  /* to be requested from the server once due */
+#define ACVP_ASYNC_FETCHING  1  /* being downloaded */
+#define ACVP_ASYNC_READY     2  /* downloaded, to be processed */
+#define ACVP_ASYNC_RUNNING   3  /* being processed by a worker */
+#define ACVP_ASYNC_COMPUTED  4  /* responses to be uploaded, unless processing failed */
+#define ACVP_ASYNC_UPLOADING 5  /* responses being uploaded */
+#define ACVP_ASYNC_DONE      6  /* uploaded, or failed */
+#define ACVP_ASYNC_RESULTS   7  /* test results being downloaded */
+#define ACVP_ASYNC_EXPECTED  8  /* expected results of a sample session being downloaded */
+
+/* Longest acvp_poll() asks to wait while requests are in flight, unless acvp_get_fds() was called */
+#define ACVP_ASYNC_POLL_MS 100
+
+typedef struct acvp_net_multi_t ACVP_NET_MULTI;
+
+typedef struct acvp_async_vs_t {
+    ACVP_VS_WORK work;
+    int state;
+    time_t due;             /* when to ask again for a vector set the server isn't done with */
+    unsigned int backoff;   /* used when the server doesn't send a retry period */
+    ACVP_RESULT rv;
+} ACVP_ASYNC_VS;
+
+/*
+ * State of a test session started with acvp_process_tests_start(),
+ * or run by acvp_process_tests() or acvp_check_test_results().  The
+ * thread driving the session keeps the downloads and uploads going,
+ * and the vector sets are run through the crypto handlers by the
+ * worker threads.  Without workers they are run by the thread driving
+ * the session.  Once the vector sets are done, the results of the test
+ * session are asked for until the server has graded every vector set.
+ */
+typedef struct acvp_async_t {
+    ACVP_CTX *ctx;
+    int vs_cnt;
+    int done;               /* number of vector sets in the DONE state */
+    ACVP_ASYNC_VS *vs;
+    ACVP_NET_MULTI *net;    /* the downloads and uploads in flight */
+    int pipe_fd[2];         /* readable while there is work that is due */
+    int signaled;           /* set while a byte is waiting in the pipe */
+    int wait_sockets;       /* set when the driver also waits on the sockets of the requests */
+    ACVP_MUTEX lock;        /* protects the states of the vector sets and the pipe */
+#ifndef WIN32
+    pthread_cond_t cond;    /* signaled when a vector set is READY, or the workers must stop */
+    pthread_t workers[ACVP_WORKER_COUNT_MAX];
+#endif
+    int worker_cnt;
+    int running;            /* number of vector sets in the RUNNING state */
+    int stopping;           /* set when the workers must exit */
+    int want_results;       /* set when the results of the test session are fetched */
+    ACVP_ASYNC_VS results;  /* the results of the test session, work.vsid_url is the session URL */
+    JSON_Value *results_val;    /* the graded results, which the URLs of the details point into */
+    ACVP_ASYNC_VS *details; /* details of the vector sets that failed, fetched for the log */
+    int details_cnt;
+    int details_done;       /* number of details in the DONE state */
+    void (*vs_done_cb)(ACVP_CTX *ctx, int vs_id, ACVP_RESULT rv);
+    void (*done_cb)(ACVP_CTX *ctx, ACVP_RESULT rv);
+} ACVP_ASYNC;
+
+typedef struct acvp_http_hnd_t ACVP_HTTP_HND;
+
+typedef struct acvp_tg_pool_t ACVP_TG_POOL;
+
+typedef struct acvp_http_share_t ACVP_HTTP_SHARE;
+
 typedef struct acvp_alg_handler_t ACVP_ALG_HANDLER;
 
 struct acvp_alg_handler_t {
     ACVP_CIPHER cipher;
 
-    ACVP_RESULT (*handler) (ACVP_CTX *ctx, JSON_Object *obj);
+    ACVP_RESULT (*handler) (ACVP_CTX *ctx, ACVP_VS_WORK *work, JSON_Object *obj);
 
     char *name;
     char *mode; /** < Should be NULL unless using an asymmetric alg */
@@ -1028,6 +1190,10 @@ struct acvp_ctx_t {
     int verify_peer;        /* enables TLS peer verification via Curl */
     char *tls_cert;         /* Location of PEM encoded X509 cert to use for TLS client auth */
     char *tls_key;          /* Location of PEM encoded priv key to use for TLS client auth */
+    int worker_count;       /* number of vector sets processed concurrently */
+    int prefetch_depth;     /* number of vector sets downloaded ahead */
+    int group_workers;      /* number of test groups of a vector set processed concurrently */
+    ACVP_COMPRESSION compression;   /* HTTP messages sent or received compressed */
     char *vendor_name;
     char *vendor_website;
     char *contact_name;
@@ -1053,9 +1219,29 @@ struct acvp_ctx_t {
     /* test session data */
     ACVP_VS_LIST *vs_list;
     char *jwt_token; /* access_token provided by server for authenticating REST calls */
-
-    /* crypto module capabilities list */
+    ACVP_MUTEX jwt_lock; /* serializes use and refresh of the jwt_token */
+    int jwt_gen;         /* incremented each time the jwt_token changes */
+    ACVP_JOURNAL *journal;  /* records the progress of the session, if enabled */
+    ACVP_ASYNC *async;      /* set while a session started with acvp_process_tests_start() runs */
+    ACVP_MUTEX hnd_lock;    /* protects idle_hnds and http_share */
+    ACVP_HTTP_HND *idle_hnds;   /* HTTP handles kept between requests, see acvp_transport.c */
+    ACVP_HTTP_SHARE *http_share;    /* caches shared by the HTTP handles */
+    ACVP_MUTEX stats_lock;  /* protects http_stats */
+    ACVP_HTTP_STATS *http_stats;    /* timing of each request sent, see acvp_get_http_stats() */
+    int http_stats_cnt;
+    int http_stats_size;
+    char *http_stats_report;    /* written when the session is freed, if set */
+    ACVP_TRANSPORT *transport;  /* sends the requests instead of curl, if set */
+    ACVP_MUTEX tg_lock;     /* protects tg_pool and the groups handed to it */
+    ACVP_TG_POOL *tg_pool;  /* threads of acvp_process_test_groups(), see acvp_util.c */
+
+    /*
+     * crypto module capabilities list, in the order the capabilities
+     * were enabled, and the same entries indexed by ACVP_CIPHER
+     */
     ACVP_CAPS_LIST *caps_list;
+    ACVP_CAPS_LIST *caps_tail;
+    ACVP_CAPS_LIST *caps_tbl[ACVP_CIPHER_END];
 
     /* application callbacks */
     ACVP_RESULT (*test_progress_cb) (char *msg);
@@ -1063,18 +1249,13 @@ struct acvp_ctx_t {
     /* Two-factor authentication callback */
     ACVP_RESULT (*totp_cb) (char **token, int token_max);
 
-    /* Transitory values */
+    /*
+     * Transitory values used during login and registration.  The state
+     * used while processing a vector set lives on ACVP_VS_WORK.
+     */
     char *login_buf;      /* holds the 2-FA authentication response */
     char *reg_buf;        /* holds the JSON registration response */
-    char *kat_buf;        /* holds the current set of vectors being processed */
-    char *upld_buf;       /* holds the HTTP response from server when uploading results */
-    JSON_Value *kat_resp; /* holds the current set of vector responses */
-    int read_ctr;         /* used during curl processing */
-    char *test_sess_buf;
-    char *sample_buf;
-    int vs_id;      /* vs_id currently being processed */
-    char *vsid_url; /* vs currently being processed */
-    char *ans_buf;  /* holds the queried answers on a sample registration */
+    char *ans_buf;        /* holds the queried answers on a sample registration */
 };
 
 ACVP_RESULT acvp_send_test_session_registration(ACVP_CTX *ctx, char *reg, int len);
@@ -1092,15 +1273,101 @@ ACVP_RESULT acvp_send_dep_registration(ACVP_CTX *ctx, char *reg);
 
 ACVP_RESULT acvp_send_login(ACVP_CTX *ctx, char *login, int len);
 
-ACVP_RESULT acvp_retrieve_vector_set(ACVP_CTX *ctx, char *vsid_url);
+ACVP_RESULT acvp_transport_init(ACVP_CTX *ctx);
+
+void acvp_transport_free(ACVP_CTX *ctx);
+
+void acvp_transport_release(ACVP_CTX *ctx);
+
+ACVP_RESULT acvp_http_stats_write_report(ACVP_CTX *ctx, const char *path);
+
+ACVP_RESULT acvp_serialize_vector_responses(ACVP_CTX *ctx, ACVP_VS_WORK *work);
+
+ACVP_RESULT acvp_run_vector_set(ACVP_CTX *ctx, ACVP_VS_WORK *work);
+
+/*
+ * Requests kept in flight without blocking, see acvp_transport.c
+ */
+ACVP_RESULT acvp_net_multi_new(ACVP_CTX *ctx,
+                               void (*done_cb)(ACVP_CTX *ctx, ACVP_VS_WORK *work, ACVP_RESULT rv, void *arg),
+                               ACVP_NET_MULTI **multi);
+
+void acvp_net_multi_free(ACVP_NET_MULTI *m);
+
+ACVP_RESULT acvp_net_multi_get_vector_set(ACVP_NET_MULTI *m, ACVP_VS_WORK *work, void *arg);
+
+ACVP_RESULT acvp_net_multi_submit_responses(ACVP_NET_MULTI *m, ACVP_VS_WORK *work, void *arg);
+
+ACVP_RESULT acvp_net_multi_get_result(ACVP_NET_MULTI *m, ACVP_VS_WORK *work, const char *api_url, void *arg);
+
+ACVP_RESULT acvp_net_multi_get_expected(ACVP_NET_MULTI *m, ACVP_VS_WORK *work, const char *api_url, void *arg);
+
+ACVP_RESULT acvp_net_multi_perform(ACVP_NET_MULTI *m);
+
+long acvp_net_multi_timeout(ACVP_NET_MULTI *m);
+
+ACVP_RESULT acvp_net_multi_wait(ACVP_NET_MULTI *m, int timeout_ms, int fd);
+
+int acvp_net_multi_fds(ACVP_NET_MULTI *m, ACVP_POLLFD *fds, int max);
+
+int acvp_net_multi_count(ACVP_NET_MULTI *m);
+
+/*
+ * Vector set files, see acvp_offline.c
+ */
+ACVP_RESULT acvp_offline_list_files(ACVP_CTX *ctx, const char *in_dir, char ***names, int *cnt);
+
+void acvp_offline_free_names(char **names, int cnt);
+
+void acvp_offline_rsp_path(char *path, int path_len, const char *dir, const char *name);
+
+void acvp_vs_work_release(ACVP_VS_WORK *work);
+
+int acvp_mutex_init(ACVP_MUTEX *mutex);
+
+/*
+ * Streaming JSON parser and writer, see acvp_json_stream.c
+ */
+ACVP_JSON_STREAM *acvp_json_stream_new(void);
+
+void acvp_json_stream_reset(ACVP_JSON_STREAM *js);
+
+void acvp_json_stream_free(ACVP_JSON_STREAM *js);
+
+int acvp_json_stream_feed(ACVP_JSON_STREAM *js, const char *data, size_t len);
+
+JSON_Value *acvp_json_stream_finish(ACVP_JSON_STREAM *js);
+
+ACVP_JSON_WRITER *acvp_json_writer_new(const JSON_Value *root);
+
+int acvp_json_writer_set_gzip(ACVP_JSON_WRITER *w);
 
-ACVP_RESULT acvp_retrieve_vector_set_result(ACVP_CTX *ctx, char *vsid_url);
+void acvp_json_writer_rewind(ACVP_JSON_WRITER *w);
+
+void acvp_json_writer_free(ACVP_JSON_WRITER *w);
+
+int acvp_json_writer_read(ACVP_JSON_WRITER *w, char *out, size_t len, size_t *out_len);
+
+/*
+ * Session journal functions used internally
+ */
+ACVP_RESULT acvp_journal_open(ACVP_CTX *ctx, const char *path);
 
-ACVP_RESULT acvp_retrieve_result(ACVP_CTX *ctx, char *api_url);
+ACVP_RESULT acvp_journal_start(ACVP_CTX *ctx);
 
-ACVP_RESULT acvp_retrieve_expected_result(ACVP_CTX *ctx, char *api_url);
+ACVP_RESULT acvp_journal_load(ACVP_CTX *ctx, const char *path);
 
-ACVP_RESULT acvp_submit_vector_responses(ACVP_CTX *ctx);
+void acvp_journal_set_token(ACVP_CTX *ctx, const char *jwt_token);
+
+ACVP_JOURNAL_STATE acvp_journal_vs_state(ACVP_CTX *ctx, const char *vsid_url, int *vs_id);
+
+ACVP_RESULT acvp_journal_computed(ACVP_CTX *ctx, ACVP_VS_WORK *work);
+
+ACVP_RESULT acvp_journal_uploaded(ACVP_CTX *ctx, ACVP_VS_WORK *work);
+
+ACVP_RESULT acvp_journal_load_responses(ACVP_CTX *ctx, ACVP_VS_WORK *work);
+
+void acvp_journal_free(ACVP_CTX *ctx);
 
 void acvp_log_msg(ACVP_CTX *ctx, ACVP_LOG_LVL level, const char *format, ...);
 
@@ -1113,57 +1380,57 @@ ACVP_RESULT acvp_bit_to_bin(const unsigned char *in, int len, unsigned char *out
 /*
  * These are the handler routines for each KAT operation
  */
-ACVP_RESULT acvp_aes_kat_handler(ACVP_CTX *ctx, JSON_Object *obj);
+ACVP_RESULT acvp_aes_kat_handler(ACVP_CTX *ctx, ACVP_VS_WORK *work, JSON_Object *obj);
 
-ACVP_RESULT acvp_des_kat_handler(ACVP_CTX *ctx, JSON_Object *obj);
+ACVP_RESULT acvp_des_kat_handler(ACVP_CTX *ctx, ACVP_VS_WORK *work, JSON_Object *obj);
 
-ACVP_RESULT acvp_entropy_handler(ACVP_CTX *ctx, JSON_Object *obj);
+ACVP_RESULT acvp_entropy_handler(ACVP_CTX *ctx, ACVP_VS_WORK *work, JSON_Object *obj);
 
-ACVP_RESULT acvp_hash_kat_handler(ACVP_CTX *ctx, JSON_Object *obj);
+ACVP_RESULT acvp_hash_kat_handler(ACVP_CTX *ctx, ACVP_VS_WORK *work, JSON_Object *obj);
 
-ACVP_RESULT acvp_drbg_kat_handler(ACVP_CTX *ctx, JSON_Object *obj);
+ACVP_RESULT acvp_drbg_kat_handler(ACVP_CTX *ctx, ACVP_VS_WORK *work, JSON_Object *obj);
 
-ACVP_RESULT acvp_hmac_kat_handler(ACVP_CTX *ctx, JSON_Object *obj);
+ACVP_RESULT acvp_hmac_kat_handler(ACVP_CTX *ctx, ACVP_VS_WORK *work, JSON_Object *obj);
 
-ACVP_RESULT acvp_cmac_kat_handler(ACVP_CTX *ctx, JSON_Object *obj);
+ACVP_RESULT acvp_cmac_kat_handler(ACVP_CTX *ctx, ACVP_VS_WORK *work, JSON_Object *obj);
 
-ACVP_RESULT acvp_rsa_keygen_kat_handler(ACVP_CTX *ctx, JSON_Object *obj);
+ACVP_RESULT acvp_rsa_keygen_kat_handler(ACVP_CTX *ctx, ACVP_VS_WORK *work, JSON_Object *obj);
 
-ACVP_RESULT acvp_rsa_siggen_kat_handler(ACVP_CTX *ctx, JSON_Object *obj);
+ACVP_RESULT acvp_rsa_siggen_kat_handler(ACVP_CTX *ctx, ACVP_VS_WORK *work, JSON_Object *obj);
 
-ACVP_RESULT acvp_rsa_sigver_kat_handler(ACVP_CTX *ctx, JSON_Object *obj);
+ACVP_RESULT acvp_rsa_sigver_kat_handler(ACVP_CTX *ctx, ACVP_VS_WORK *work, JSON_Object *obj);
 
-ACVP_RESULT acvp_ecdsa_keygen_kat_handler(ACVP_CTX *ctx, JSON_Object *obj);
+ACVP_RESULT acvp_ecdsa_keygen_kat_handler(ACVP_CTX *ctx, ACVP_VS_WORK *work, JSON_Object *obj);
 
-ACVP_RESULT acvp_ecdsa_keyver_kat_handler(ACVP_CTX *ctx, JSON_Object *obj);
+ACVP_RESULT acvp_ecdsa_keyver_kat_handler(ACVP_CTX *ctx, ACVP_VS_WORK *work, JSON_Object *obj);
 
-ACVP_RESULT acvp_ecdsa_siggen_kat_handler(ACVP_CTX *ctx, JSON_Object *obj);
+ACVP_RESULT acvp_ecdsa_siggen_kat_handler(ACVP_CTX *ctx, ACVP_VS_WORK *work, JSON_Object *obj);
 
-ACVP_RESULT acvp_ecdsa_sigver_kat_handler(ACVP_CTX *ctx, JSON_Object *obj);
+ACVP_RESULT acvp_ecdsa_sigver_kat_handler(ACVP_CTX *ctx, ACVP_VS_WORK *work, JSON_Object *obj);
 
-ACVP_RESULT acvp_kdf135_tls_kat_handler(ACVP_CTX *ctx, JSON_Object *obj);
+ACVP_RESULT acvp_kdf135_tls_kat_handler(ACVP_CTX *ctx, ACVP_VS_WORK *work, JSON_Object *obj);
 
-ACVP_RESULT acvp_kdf135_snmp_kat_handler(ACVP_CTX *ctx, JSON_Object *obj);
+ACVP_RESULT acvp_kdf135_snmp_kat_handler(ACVP_CTX *ctx, ACVP_VS_WORK *work, JSON_Object *obj);
 
-ACVP_RESULT acvp_kdf135_ssh_kat_handler(ACVP_CTX *ctx, JSON_Object *obj);
+ACVP_RESULT acvp_kdf135_ssh_kat_handler(ACVP_CTX *ctx, ACVP_VS_WORK *work, JSON_Object *obj);
 
-ACVP_RESULT acvp_kdf135_srtp_kat_handler(ACVP_CTX *ctx, JSON_Object *obj);
+ACVP_RESULT acvp_kdf135_srtp_kat_handler(ACVP_CTX *ctx, ACVP_VS_WORK *work, JSON_Object *obj);
 
-ACVP_RESULT acvp_kdf135_ikev2_kat_handler(ACVP_CTX *ctx, JSON_Object *obj);
+ACVP_RESULT acvp_kdf135_ikev2_kat_handler(ACVP_CTX *ctx, ACVP_VS_WORK *work, JSON_Object *obj);
 
-ACVP_RESULT acvp_kdf135_ikev1_kat_handler(ACVP_CTX *ctx, JSON_Object *obj);
+ACVP_RESULT acvp_kdf135_ikev1_kat_handler(ACVP_CTX *ctx, ACVP_VS_WORK *work, JSON_Object *obj);
 
-ACVP_RESULT acvp_kdf135_x963_kat_handler(ACVP_CTX *ctx, JSON_Object *obj);
+ACVP_RESULT acvp_kdf135_x963_kat_handler(ACVP_CTX *ctx, ACVP_VS_WORK *work, JSON_Object *obj);
 
-ACVP_RESULT acvp_kdf108_kat_handler(ACVP_CTX *ctx, JSON_Object *obj);
+ACVP_RESULT acvp_kdf108_kat_handler(ACVP_CTX *ctx, ACVP_VS_WORK *work, JSON_Object *obj);
 
-ACVP_RESULT acvp_dsa_kat_handler(ACVP_CTX *ctx, JSON_Object *obj);
+ACVP_RESULT acvp_dsa_kat_handler(ACVP_CTX *ctx, ACVP_VS_WORK *work, JSON_Object *obj);
 
-ACVP_RESULT acvp_dsa_kat_handler(ACVP_CTX *ctx, JSON_Object *obj);
+ACVP_RESULT acvp_dsa_kat_handler(ACVP_CTX *ctx, ACVP_VS_WORK *work, JSON_Object *obj);
 
-ACVP_RESULT acvp_kas_ecc_kat_handler(ACVP_CTX *ctx, JSON_Object *obj);
+ACVP_RESULT acvp_kas_ecc_kat_handler(ACVP_CTX *ctx, ACVP_VS_WORK *work, JSON_Object *obj);
 
-ACVP_RESULT acvp_kas_ffc_kat_handler(ACVP_CTX *ctx, JSON_Object *obj);
+ACVP_RESULT acvp_kas_ffc_kat_handler(ACVP_CTX *ctx, ACVP_VS_WORK *work, JSON_Object *obj);
 
 /*
  * ACVP build registration functions used internally
@@ -1189,6 +1456,8 @@ ACVP_RESULT acvp_build_dependency(ACVP_DEPENDENCY_LIST *dep, char **reg);
  */
 ACVP_CAPS_LIST *acvp_locate_cap_entry(ACVP_CTX *ctx, ACVP_CIPHER cipher);
 
+ACVP_ALG_HANDLER *acvp_lookup_alg_handler(const char *algorithm, const char *mode);
+
 char *acvp_lookup_cipher_name(ACVP_CIPHER alg);
 
 ACVP_CIPHER acvp_lookup_cipher_index(const char *algorithm);
@@ -1222,8 +1491,10 @@ char *acvp_lookup_ec_curve_name(ACVP_CIPHER cipher, ACVP_EC_CURVE id);
 void ctr64_inc(unsigned char *counter);
 void ctr128_inc(unsigned char *counter);
 ACVP_RESULT acvp_refresh(ACVP_CTX *ctx);
+ACVP_RESULT acvp_build_login(ACVP_CTX *ctx, char **login, int *login_len, int refresh);
+ACVP_RESULT acvp_parse_login(ACVP_CTX *ctx, char *json_buf);
 
-ACVP_RESULT acvp_setup_json_rsp_group(ACVP_CTX **ctx,
+ACVP_RESULT acvp_setup_json_rsp_group(ACVP_VS_WORK *work,
                                       JSON_Value **outer_arr_val,
                                       JSON_Value **r_vs_val,
                                       JSON_Object **r_vs,
@@ -1232,4 +1503,25 @@ ACVP_RESULT acvp_setup_json_rsp_group(ACVP_CTX **ctx,
 
 void acvp_release_json(JSON_Value *r_vs_val,
                        JSON_Value *r_gval);
+
+/*
+ * Handler for a single test group of a vector set, see
+ * acvp_process_test_groups().  The response group is returned in
+ * *r_gval as soon as it is created, the caller frees it on failure.
+ */
+typedef ACVP_RESULT (*ACVP_TG_HANDLER)(ACVP_CTX *ctx,
+                                       ACVP_CAPS_LIST *cap,
+                                       JSON_Object *groupobj,
+                                       int idx,
+                                       JSON_Value **r_gval);
+
+ACVP_RESULT acvp_process_test_groups(ACVP_CTX *ctx,
+                                     ACVP_CAPS_LIST *cap,
+                                     JSON_Array *groups,
+                                     JSON_Array *r_garr,
+                                     ACVP_TG_HANDLER handler);
+
+#ifndef WIN32
+void acvp_tg_pool_free(ACVP_CTX *ctx);
+#endif
 #endif
@@ -0,0 +1,422 @@
+/*****************************************************************************
+* Copyright (c) 2016-2017, Cisco Systems, Inc.
+* All rights reserved.
+
+* Redistribution and use in source and binary forms, with or without modification,
+* are permitted provided that the following conditions are met:
+*
+* 1. Redistributions of source code must retain the above copyright notice,
+*    this list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright notice,
+*    this list of conditions and the following disclaimer in the documentation
+*    and/or other materials provided with the distribution.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+* SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+* CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+* USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+/*
+ * A transport that answers the requests of a test session itself
+ * instead of sending them to a server.  The vector sets are the
+ * *.json files of a directory, laid out as for offline processing,
+ * and the responses are written to *.rsp.json files.  Vector set N of
+ * the session is the Nth file in name order.
+ *
+ * Only the requests libacvp sends are understood: the login, the
+ * test session registration, the vector sets, their responses and
+ * results, and the results of the session.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "acvp.h"
+#include "acvp_lcl.h"
+#include "parson.h"
+#include "safe_lib.h"
+
+#define HTTP_OK         200
+#define HTTP_NOT_FOUND  404
+
+#define ACVP_LOOPBACK_SESSION   "testSessions/1"
+#define ACVP_LOOPBACK_TOKEN     "loopback"
+
+/*
+ * Disposition of a vector set
+ */
+#define ACVP_LOOPBACK_UNRECEIVED    0
+#define ACVP_LOOPBACK_PASSED        1
+#define ACVP_LOOPBACK_FAILED        2
+
+typedef struct acvp_loopback_t {
+    ACVP_CTX *ctx;
+    char *in_dir;
+    char *out_dir;
+    char **names;           /* vector set file names, sorted */
+    int *status;            /* disposition of each vector set */
+    int cnt;
+    ACVP_MUTEX lock;        /* protects status */
+} ACVP_LOOPBACK;
+
+static void acvp_loopback_free(void *data) {
+    ACVP_LOOPBACK *lb = (ACVP_LOOPBACK *)data;
+
+    if (!lb) {
+        return;
+    }
+    acvp_offline_free_names(lb->names, lb->cnt);
+    free(lb->status);
+    free(lb->in_dir);
+    free(lb->out_dir);
+    acvp_mutex_destroy(&lb->lock);
+    free(lb);
+}
+
+static int acvp_loopback_ends_with(const char *str, const char *suffix) {
+    int len = strnlen_s(str, ACVP_ATTR_URL_MAX);
+    int suffix_len = strnlen_s(suffix, ACVP_ATTR_URL_MAX);
+    int diff = 1;
+
+    if (len < suffix_len) {
+        return 0;
+    }
+    strcmp_s(str + len - suffix_len, suffix_len, suffix, &diff);
+    return !diff;
+}
+
+/*
+ * Find the vector set a URL is about and return its index, or -1 if
+ * the URL isn't about a vector set.  rest is set to what follows the
+ * vector set in the URL.
+ */
+static int acvp_loopback_vs_index(ACVP_LOOPBACK *lb, const char *url, const char **rest) {
+    const char *p;
+    char *end;
+    long n;
+
+    p = strstr(url, "/vectorSets/");
+    if (!p) {
+        return -1;
+    }
+    n = strtol(p + strlen("/vectorSets/"), &end, 10);
+    if (n < 1 || n > lb->cnt) {
+        return -1;
+    }
+    *rest = end;
+    return (int)n - 1;
+}
+
+/*
+ * Pass a JSON value to the caller the way a server would send it,
+ * preceded by the protocol version.
+ */
+static long acvp_loopback_send_json(JSON_Value *val, ACVP_TRANSPORT_WRITE_FN write_fn, void *write_arg) {
+    JSON_Value *arry_val = NULL;
+    JSON_Object *obj = NULL;
+    JSON_Array *arry = NULL;
+    char *buf;
+    size_t len;
+    long http_code = 0;
+
+    acvp_create_array(&obj, &arry_val, &arry);
+    json_array_append_value(arry, val);
+    buf = json_serialize_to_string(arry_val);
+    if (buf) {
+        len = strnlen_s(buf, ACVP_HTTP_BUF_MAX);
+        if ((write_fn)(buf, 1, len, write_arg) == len) {
+            http_code = HTTP_OK;
+        }
+        json_free_serialized_string(buf);
+    }
+    json_value_free(arry_val);
+    return http_code;
+}
+
+static long acvp_loopback_send_file(ACVP_LOOPBACK *lb, const char *path,
+                                    ACVP_TRANSPORT_WRITE_FN write_fn, void *write_arg) {
+    ACVP_CTX *ctx = lb->ctx;
+    char buf[1024 * 16];
+    size_t len;
+    long http_code = HTTP_OK;
+    FILE *fp;
+
+    fp = fopen(path, "rb");
+    if (!fp) {
+        ACVP_LOG_ERR("Unable to open %s", path);
+        return HTTP_NOT_FOUND;
+    }
+    while ((len = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        if ((write_fn)(buf, 1, len, write_arg) != len) {
+            http_code = 0;
+            break;
+        }
+    }
+    if (ferror(fp)) {
+        ACVP_LOG_ERR("Unable to read %s", path);
+        http_code = 0;
+    }
+    fclose(fp);
+    return http_code;
+}
+
+static const char *acvp_loopback_status_str(int status) {
+    switch (status) {
+    case ACVP_LOOPBACK_PASSED:
+        return "passed";
+    case ACVP_LOOPBACK_FAILED:
+        return "fail";
+    default:
+        return "unreceived";
+    }
+}
+
+/*
+ * The results of the session: passed once every vector set passed.
+ */
+static long acvp_loopback_session_results(ACVP_LOOPBACK *lb, ACVP_TRANSPORT_WRITE_FN write_fn, void *write_arg) {
+    ACVP_CTX *ctx = lb->ctx;
+    JSON_Value *val, *res_val;
+    JSON_Object *obj, *res_obj;
+    JSON_Array *results;
+    char url[ACVP_ATTR_URL_MAX];
+    int i, passed = 1;
+
+    val = json_value_init_object();
+    obj = json_value_get_object(val);
+    json_object_set_value(obj, "results", json_value_init_array());
+    results = json_object_get_array(obj, "results");
+
+    acvp_mutex_lock(&lb->lock);
+    for (i = 0; i < lb->cnt; i++) {
+        snprintf(url, sizeof(url), "/%s" ACVP_LOOPBACK_SESSION "/vectorSets/%d", ctx->path_segment, i + 1);
+        res_val = json_value_init_object();
+        res_obj = json_value_get_object(res_val);
+        json_object_set_string(res_obj, "vectorSetUrl", url);
+        json_object_set_string(res_obj, "status", acvp_loopback_status_str(lb->status[i]));
+        json_array_append_value(results, res_val);
+        if (lb->status[i] != ACVP_LOOPBACK_PASSED) {
+            passed = 0;
+        }
+    }
+    acvp_mutex_unlock(&lb->lock);
+    json_object_set_boolean(obj, "passed", passed);
+
+    return acvp_loopback_send_json(val, write_fn, write_arg);
+}
+
+static long acvp_loopback_get(void *data, const char *url, const char *token,
+                              ACVP_TRANSPORT_WRITE_FN write_fn, void *write_arg) {
+    ACVP_LOOPBACK *lb = (ACVP_LOOPBACK *)data;
+    char path[ACVP_OFFLINE_PATH_MAX];
+    JSON_Value *val;
+    const char *rest;
+    int vs, diff = 1;
+
+    vs = acvp_loopback_vs_index(lb, url, &rest);
+    if (vs < 0) {
+        if (acvp_loopback_ends_with(url, ACVP_LOOPBACK_SESSION "/results")) {
+            return acvp_loopback_session_results(lb, write_fn, write_arg);
+        }
+        return HTTP_NOT_FOUND;
+    }
+
+    if (!*rest) {
+        snprintf(path, sizeof(path), "%s/%s", lb->in_dir, lb->names[vs]);
+        return acvp_loopback_send_file(lb, path, write_fn, write_arg);
+    }
+    strcmp_s("/expected", strlen("/expected"), rest, &diff);
+    if (!diff) {
+        acvp_offline_rsp_path(path, sizeof(path), lb->in_dir, lb->names[vs]);
+        return acvp_loopback_send_file(lb, path, write_fn, write_arg);
+    }
+    strcmp_s("/results", strlen("/results"), rest, &diff);
+    if (!diff) {
+        val = json_value_init_object();
+        acvp_mutex_lock(&lb->lock);
+        json_object_set_string(json_value_get_object(val), "disposition",
+                               acvp_loopback_status_str(lb->status[vs]));
+        acvp_mutex_unlock(&lb->lock);
+        return acvp_loopback_send_json(val, write_fn, write_arg);
+    }
+    return HTTP_NOT_FOUND;
+}
+
+/*
+ * The responses to a vector set.  They are compared with the ones
+ * in the input directory, if there are any, before being written out
+ * since the response file may be the same one.
+ */
+static long acvp_loopback_post_responses(ACVP_LOOPBACK *lb, int vs, const char *body, int body_len) {
+    ACVP_CTX *ctx = lb->ctx;
+    JSON_Value *val = NULL, *expected = NULL;
+    char path[ACVP_OFFLINE_PATH_MAX];
+    char *buf;
+    int status = ACVP_LOOPBACK_PASSED;
+
+    buf = strndup(body, body_len);
+    if (!buf) {
+        return 0;
+    }
+    val = json_parse_string(buf);
+    free(buf);
+    if (!val) {
+        ACVP_LOG_ERR("%s: unable to parse the responses", lb->names[vs]);
+        return 0;
+    }
+
+    acvp_offline_rsp_path(path, sizeof(path), lb->in_dir, lb->names[vs]);
+    expected = json_parse_file(path);
+    if (expected && !json_value_equals(val, expected)) {
+        ACVP_LOG_ERR("%s: responses don't match %s", lb->names[vs], path);
+        status = ACVP_LOOPBACK_FAILED;
+    }
+
+    acvp_offline_rsp_path(path, sizeof(path), lb->out_dir, lb->names[vs]);
+    if (json_serialize_to_file_pretty(val, path) != JSONSuccess) {
+        ACVP_LOG_ERR("Unable to write response file %s", path);
+        status = ACVP_LOOPBACK_FAILED;
+    }
+
+    acvp_mutex_lock(&lb->lock);
+    lb->status[vs] = status;
+    acvp_mutex_unlock(&lb->lock);
+
+    json_value_free(val);
+    if (expected) {
+        json_value_free(expected);
+    }
+    return HTTP_OK;
+}
+
+/*
+ * The test session registration.  Every vector set file is part of
+ * the session, whatever capabilities were registered.
+ */
+static long acvp_loopback_register(ACVP_LOOPBACK *lb, ACVP_TRANSPORT_WRITE_FN write_fn, void *write_arg) {
+    ACVP_CTX *ctx = lb->ctx;
+    JSON_Value *val;
+    JSON_Object *obj;
+    JSON_Array *urls;
+    char url[ACVP_ATTR_URL_MAX];
+    int i;
+
+    val = json_value_init_object();
+    obj = json_value_get_object(val);
+    snprintf(url, sizeof(url), "/%s" ACVP_LOOPBACK_SESSION, ctx->path_segment);
+    json_object_set_string(obj, "url", url);
+    json_object_set_value(obj, "vectorSetUrls", json_value_init_array());
+    urls = json_object_get_array(obj, "vectorSetUrls");
+
+    acvp_mutex_lock(&lb->lock);
+    for (i = 0; i < lb->cnt; i++) {
+        snprintf(url, sizeof(url), "/%s" ACVP_LOOPBACK_SESSION "/vectorSets/%d", ctx->path_segment, i + 1);
+        json_array_append_string(urls, url);
+        lb->status[i] = ACVP_LOOPBACK_UNRECEIVED;
+    }
+    acvp_mutex_unlock(&lb->lock);
+
+    return acvp_loopback_send_json(val, write_fn, write_arg);
+}
+
+static long acvp_loopback_post(void *data, const char *url, const char *token, const char *body, int body_len,
+                               ACVP_TRANSPORT_WRITE_FN write_fn, void *write_arg) {
+    ACVP_LOOPBACK *lb = (ACVP_LOOPBACK *)data;
+    JSON_Value *val;
+    const char *rest;
+    int vs, diff = 1;
+
+    if (acvp_loopback_ends_with(url, "/login")) {
+        val = json_value_init_object();
+        json_object_set_string(json_value_get_object(val), "accessToken", ACVP_LOOPBACK_TOKEN);
+        return acvp_loopback_send_json(val, write_fn, write_arg);
+    }
+    if (acvp_loopback_ends_with(url, "/testSessions")) {
+        return acvp_loopback_register(lb, write_fn, write_arg);
+    }
+
+    vs = acvp_loopback_vs_index(lb, url, &rest);
+    if (vs < 0) {
+        return HTTP_NOT_FOUND;
+    }
+    strcmp_s("/results", strlen("/results"), rest, &diff);
+    if (diff) {
+        return HTTP_NOT_FOUND;
+    }
+    if (acvp_loopback_post_responses(lb, vs, body, body_len) != HTTP_OK) {
+        return 0;
+    }
+    val = json_value_init_object();
+    return acvp_loopback_send_json(val, write_fn, write_arg);
+}
+
+/*
+ * This function is used by the application to run test sessions
+ * against the vector sets saved in a directory, with no server.
+ */
+ACVP_RESULT acvp_set_loopback_transport(ACVP_CTX *ctx, const char *in_dir, const char *out_dir) {
+    ACVP_TRANSPORT transport;
+    ACVP_LOOPBACK *lb;
+    ACVP_RESULT rv;
+
+    if (!ctx) {
+        return ACVP_NO_CTX;
+    }
+    if (!in_dir) {
+        return ACVP_MISSING_ARG;
+    }
+    if (ctx->async) {
+        ACVP_LOG_ERR("The transport can't be changed while a test session is in progress");
+        return ACVP_INVALID_ARG;
+    }
+    if (!out_dir) {
+        out_dir = in_dir;
+    }
+
+    lb = calloc(1, sizeof(ACVP_LOOPBACK));
+    if (!lb) {
+        return ACVP_MALLOC_FAIL;
+    }
+    if (acvp_mutex_init(&lb->lock)) {
+        free(lb);
+        return ACVP_MALLOC_FAIL;
+    }
+    lb->ctx = ctx;
+    lb->in_dir = strndup(in_dir, ACVP_OFFLINE_PATH_MAX);
+    lb->out_dir = strndup(out_dir, ACVP_OFFLINE_PATH_MAX);
+    if (!lb->in_dir || !lb->out_dir) {
+        rv = ACVP_MALLOC_FAIL;
+        goto err;
+    }
+    rv = acvp_offline_list_files(ctx, in_dir, &lb->names, &lb->cnt);
+    if (rv != ACVP_SUCCESS) {
+        goto err;
+    }
+    lb->status = calloc(lb->cnt, sizeof(int));
+    if (!lb->status) {
+        rv = ACVP_MALLOC_FAIL;
+        goto err;
+    }
+
+    memzero_s(&transport, sizeof(ACVP_TRANSPORT));
+    transport.get = &acvp_loopback_get;
+    transport.post = &acvp_loopback_post;
+    transport.free = &acvp_loopback_free;
+    transport.data = lb;
+    rv = acvp_set_transport(ctx, &transport);
+    if (rv != ACVP_SUCCESS) {
+        goto err;
+    }
+    ACVP_LOG_STATUS("Serving %d vector sets from %s", lb->cnt, in_dir);
+    return ACVP_SUCCESS;
+
+err:
+    acvp_loopback_free(lb);
+    return rv;
+}
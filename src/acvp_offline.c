@@ -0,0 +1,347 @@
+/*****************************************************************************
+* Copyright (c) 2016-2017, Cisco Systems, Inc.
+* All rights reserved.
+
+* Redistribution and use in source and binary forms, with or without modification,
+* are permitted provided that the following conditions are met:
+*
+* 1. Redistributions of source code must retain the above copyright notice,
+*    this list of conditions and the following disclaimer.
+*
+* 2. Redistributions in binary form must reproduce the above copyright notice,
+*    this list of conditions and the following disclaimer in the documentation
+*    and/or other materials provided with the distribution.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+* AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+* IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+* SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+* CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+* USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*****************************************************************************/
+/*
+ * Offline processing of vector sets saved to disk.  Each file in the
+ * input directory named *.json holds one vector set, in the form the
+ * server sends it.  The vector sets are run through the same handlers
+ * as in a test session and the responses are written to *.rsp.json
+ * files, one per vector set, without talking to a server.
+ *
+ * The files are processed by ctx->worker_count threads.  They are
+ * handed out in name order and the result reported is the one of the
+ * first file, in name order, that failed, so a run is reproducible
+ * no matter how the work was spread over the threads.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <time.h>
+#endif
+#include "acvp.h"
+#include "acvp_lcl.h"
+#include "parson.h"
+#include "safe_lib.h"
+
+typedef struct acvp_offline_t {
+    ACVP_CTX *ctx;
+    const char *in_dir;
+    const char *out_dir;
+    char **names;           /* vector set file names, sorted */
+    ACVP_RESULT *rv;        /* result of each file */
+    int cnt;
+    int next;               /* next file to hand to a worker */
+#ifndef WIN32
+    pthread_mutex_t lock;
+#endif
+} ACVP_OFFLINE;
+
+static int acvp_offline_has_ext(const char *name, const char *ext) {
+    int len = strnlen_s(name, ACVP_OFFLINE_PATH_MAX);
+    int ext_len = strnlen_s(ext, ACVP_OFFLINE_PATH_MAX);
+    int diff = 1;
+
+    if (len <= ext_len) {
+        return 0;
+    }
+    strcmp_s(name + len - ext_len, ext_len, ext, &diff);
+    return !diff;
+}
+
+/*
+ * Vector set files are the *.json files, other than the responses
+ * written by a previous run.
+ */
+static int acvp_offline_is_vs_file(const char *name) {
+    return acvp_offline_has_ext(name, ACVP_OFFLINE_VS_EXT) &&
+           !acvp_offline_has_ext(name, ACVP_OFFLINE_RSP_EXT);
+}
+
+static int acvp_offline_name_cmp(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static ACVP_RESULT acvp_offline_add_name(char ***names, int *cnt, int *max, const char *name) {
+    char **tmp;
+
+    if (*cnt == *max) {
+        *max = *max ? *max * 2 : 16;
+        tmp = realloc(*names, *max * sizeof(char *));
+        if (!tmp) {
+            return ACVP_MALLOC_FAIL;
+        }
+        *names = tmp;
+    }
+    (*names)[*cnt] = strndup(name, strnlen_s(name, ACVP_OFFLINE_PATH_MAX));
+    if (!(*names)[*cnt]) {
+        return ACVP_MALLOC_FAIL;
+    }
+    (*cnt)++;
+    return ACVP_SUCCESS;
+}
+
+/*
+ * Build the sorted list of the vector set files in a directory.  The
+ * list is released with acvp_offline_free_names(), even on failure.
+ */
+ACVP_RESULT acvp_offline_list_files(ACVP_CTX *ctx, const char *in_dir, char ***names, int *cnt) {
+    ACVP_RESULT rv = ACVP_SUCCESS;
+    int max = 0;
+#ifdef WIN32
+    WIN32_FIND_DATAA fd;
+    HANDLE h;
+    char pattern[ACVP_OFFLINE_PATH_MAX];
+
+    snprintf(pattern, sizeof(pattern), "%s\\*" ACVP_OFFLINE_VS_EXT, in_dir);
+    h = FindFirstFileA(pattern, &fd);
+    if (h == INVALID_HANDLE_VALUE) {
+        ACVP_LOG_ERR("No vector set files found in %s", in_dir);
+        return ACVP_INVALID_ARG;
+    }
+    do {
+        if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY ||
+            !acvp_offline_is_vs_file(fd.cFileName)) {
+            continue;
+        }
+        rv = acvp_offline_add_name(names, cnt, &max, fd.cFileName);
+    } while (rv == ACVP_SUCCESS && FindNextFileA(h, &fd));
+    FindClose(h);
+#else
+    DIR *dir;
+    struct dirent *ent;
+
+    dir = opendir(in_dir);
+    if (!dir) {
+        ACVP_LOG_ERR("Unable to open vector set directory %s", in_dir);
+        return ACVP_INVALID_ARG;
+    }
+    while (rv == ACVP_SUCCESS && (ent = readdir(dir)) != NULL) {
+        if (!acvp_offline_is_vs_file(ent->d_name)) {
+            continue;
+        }
+        rv = acvp_offline_add_name(names, cnt, &max, ent->d_name);
+    }
+    closedir(dir);
+#endif
+    if (rv != ACVP_SUCCESS) {
+        return rv;
+    }
+    if (!*cnt) {
+        ACVP_LOG_ERR("No vector set files found in %s", in_dir);
+        return ACVP_NO_DATA;
+    }
+    qsort(*names, *cnt, sizeof(char *), acvp_offline_name_cmp);
+    return ACVP_SUCCESS;
+}
+
+void acvp_offline_free_names(char **names, int cnt) {
+    int i;
+
+    for (i = 0; i < cnt; i++) {
+        free(names[i]);
+    }
+    free(names);
+}
+
+/*
+ * Build the path of the response file of a vector set file.
+ */
+void acvp_offline_rsp_path(char *path, int path_len, const char *dir, const char *name) {
+    int base_len;
+
+    base_len = strnlen_s(name, ACVP_OFFLINE_PATH_MAX) - strnlen_s(ACVP_OFFLINE_VS_EXT, ACVP_OFFLINE_PATH_MAX);
+    snprintf(path, path_len, "%s/%.*s" ACVP_OFFLINE_RSP_EXT, dir, base_len, name);
+}
+
+/*
+ * Process one vector set file and write out its responses.
+ */
+static ACVP_RESULT acvp_offline_process_file(ACVP_OFFLINE *off, const char *name) {
+    ACVP_CTX *ctx = off->ctx;
+    ACVP_VS_WORK work;
+    char path[ACVP_OFFLINE_PATH_MAX];
+    FILE *fp = NULL;
+    ACVP_RESULT rv;
+
+    memzero_s(&work, sizeof(ACVP_VS_WORK));
+
+    snprintf(path, sizeof(path), "%s/%s", off->in_dir, name);
+    work.kat_val = json_parse_file(path);
+    if (!work.kat_val) {
+        ACVP_LOG_ERR("Unable to parse vector set file %s", path);
+        return ACVP_JSON_ERR;
+    }
+
+    rv = acvp_run_vector_set(ctx, &work);
+    if (rv != ACVP_SUCCESS) {
+        ACVP_LOG_ERR("%s: %s", name, acvp_lookup_error_string(rv));
+        goto end;
+    }
+    /* The response files are meant to be read, so indent them */
+    work.resp_buf = json_serialize_to_string_pretty(work.kat_resp, &work.resp_len);
+    if (!work.resp_buf) {
+        ACVP_LOG_ERR("%s: unable to serialize the responses", name);
+        rv = ACVP_JSON_ERR;
+        goto end;
+    }
+    work.resp_serialized = 1;
+
+    acvp_offline_rsp_path(path, sizeof(path), off->out_dir, name);
+    fp = fopen(path, "w");
+    if (!fp) {
+        ACVP_LOG_ERR("Unable to create response file %s", path);
+        rv = ACVP_INVALID_ARG;
+        goto end;
+    }
+    if (fputs(work.resp_buf, fp) == EOF) {
+        rv = ACVP_INVALID_ARG;
+    }
+    if (fclose(fp) == EOF) {
+        rv = ACVP_INVALID_ARG;
+    }
+    if (rv != ACVP_SUCCESS) {
+        ACVP_LOG_ERR("Unable to write response file %s", path);
+        goto end;
+    }
+    ACVP_LOG_STATUS("vsId %d: responses written to %s", work.vs_id, path);
+
+end:
+    acvp_vs_work_release(&work);
+    return rv;
+}
+
+static void *acvp_offline_main(void *arg) {
+    ACVP_OFFLINE *off = (ACVP_OFFLINE *)arg;
+    int i;
+
+    while (1) {
+#ifndef WIN32
+        pthread_mutex_lock(&off->lock);
+#endif
+        i = off->next < off->cnt ? off->next++ : -1;
+#ifndef WIN32
+        pthread_mutex_unlock(&off->lock);
+#endif
+        if (i < 0) {
+            break;
+        }
+        off->rv[i] = acvp_offline_process_file(off, off->names[i]);
+    }
+
+    return NULL;
+}
+
+/*
+ * This function is used by the application to process vector sets
+ * that were saved to files, with no ACVP server involved.  The
+ * crypto capabilities must have been enabled as for a test session,
+ * but there is no need to call acvp_register().
+ */
+ACVP_RESULT acvp_process_vector_files(ACVP_CTX *ctx, const char *in_dir, const char *out_dir) {
+    ACVP_OFFLINE off;
+    ACVP_RESULT rv;
+    int i, done = 0, workers = 1;
+#ifndef WIN32
+    pthread_t threads[ACVP_WORKER_COUNT_MAX];
+    struct timespec start, end;
+    double elapsed;
+    int started = 0;
+#endif
+
+    if (!ctx) {
+        return ACVP_NO_CTX;
+    }
+    if (!in_dir) {
+        return ACVP_MISSING_ARG;
+    }
+
+    memzero_s(&off, sizeof(ACVP_OFFLINE));
+    off.ctx = ctx;
+    off.in_dir = in_dir;
+    off.out_dir = out_dir ? out_dir : in_dir;
+
+    rv = acvp_offline_list_files(ctx, in_dir, &off.names, &off.cnt);
+    if (rv != ACVP_SUCCESS) {
+        goto end;
+    }
+    off.rv = calloc(off.cnt, sizeof(ACVP_RESULT));
+    if (!off.rv) {
+        rv = ACVP_MALLOC_FAIL;
+        goto end;
+    }
+
+#ifndef WIN32
+    workers = ctx->worker_count < off.cnt ? ctx->worker_count : off.cnt;
+    if (pthread_mutex_init(&off.lock, NULL)) {
+        rv = ACVP_MALLOC_FAIL;
+        goto end;
+    }
+#endif
+    ACVP_LOG_STATUS("Processing %d vector set files from %s with %d workers",
+                    off.cnt, in_dir, workers);
+
+#ifndef WIN32
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 1; i < workers; i++) {
+        if (pthread_create(&threads[started], NULL, acvp_offline_main, &off)) {
+            ACVP_LOG_WARN("Unable to start worker thread %d", i);
+            continue;
+        }
+        started++;
+    }
+#endif
+    acvp_offline_main(&off);
+#ifndef WIN32
+    for (i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    pthread_mutex_destroy(&off.lock);
+#endif
+
+    rv = ACVP_SUCCESS;
+    for (i = 0; i < off.cnt; i++) {
+        if (off.rv[i] == ACVP_SUCCESS) {
+            done++;
+        } else if (rv == ACVP_SUCCESS) {
+            rv = off.rv[i];
+        }
+    }
+    ACVP_LOG_STATUS("Wrote responses for %d of %d vector sets", done, off.cnt);
+#ifndef WIN32
+    elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    ACVP_LOG_STATUS("Processed %d vector sets in %.3f seconds (%.1f per second)",
+                    off.cnt, elapsed, elapsed > 0 ? off.cnt / elapsed : 0.0);
+#endif
+
+end:
+    acvp_offline_free_names(off.names, off.cnt);
+    free(off.rv);
+    return rv;
+}
@@ -33,7 +33,7 @@
 #include "parson.h"
 #include "safe_lib.h"
 
-static ACVP_RESULT acvp_rsa_sig_kat_handler_internal(ACVP_CTX *ctx, JSON_Object *obj, ACVP_CIPHER cipher);
+static ACVP_RESULT acvp_rsa_sig_kat_handler_internal(ACVP_CTX *ctx, ACVP_VS_WORK *work, JSON_Object *obj, ACVP_CIPHER cipher);
 
 /*
  * After the test case has been processed by the DUT, the results
@@ -160,12 +160,12 @@ err:
     return ACVP_MALLOC_FAIL;
 }
 
-ACVP_RESULT acvp_rsa_siggen_kat_handler(ACVP_CTX *ctx, JSON_Object *obj) {
-    return acvp_rsa_sig_kat_handler_internal(ctx, obj, ACVP_RSA_SIGGEN);
+ACVP_RESULT acvp_rsa_siggen_kat_handler(ACVP_CTX *ctx, ACVP_VS_WORK *work, JSON_Object *obj) {
+    return acvp_rsa_sig_kat_handler_internal(ctx, work, obj, ACVP_RSA_SIGGEN);
 }
 
-ACVP_RESULT acvp_rsa_sigver_kat_handler(ACVP_CTX *ctx, JSON_Object *obj) {
-    return acvp_rsa_sig_kat_handler_internal(ctx, obj, ACVP_RSA_SIGVER);
+ACVP_RESULT acvp_rsa_sigver_kat_handler(ACVP_CTX *ctx, ACVP_VS_WORK *work, JSON_Object *obj) {
+    return acvp_rsa_sig_kat_handler_internal(ctx, work, obj, ACVP_RSA_SIGVER);
 }
 
 static ACVP_RSA_SIG_TYPE read_sig_type(const char *str) {
@@ -192,7 +192,7 @@ static ACVP_RSA_SIG_TYPE read_sig_type(const char *str) {
     return 0;
 }
 
-static ACVP_RESULT acvp_rsa_sig_kat_handler_internal(ACVP_CTX *ctx, JSON_Object *obj, ACVP_CIPHER cipher) {
+static ACVP_RESULT acvp_rsa_sig_kat_handler_internal(ACVP_CTX *ctx, ACVP_VS_WORK *work, JSON_Object *obj, ACVP_CIPHER cipher) {
     unsigned int tc_id;
     JSON_Value *groupval;
     JSON_Object *groupobj = NULL;
@@ -273,7 +273,7 @@ static ACVP_RESULT acvp_rsa_sig_kat_handler_internal(ACVP_CTX *ctx, JSON_Object
     /*
      * Start to build the JSON response
      */
-    rv = acvp_setup_json_rsp_group(&ctx, &reg_arry_val, &r_vs_val, &r_vs, alg_str, &r_garr);
+    rv = acvp_setup_json_rsp_group(work, &reg_arry_val, &r_vs_val, &r_vs, alg_str, &r_garr);
     if (rv != ACVP_SUCCESS) {
         ACVP_LOG_ERR("Failed to setup json response");
         return rv;
@@ -500,7 +500,7 @@ static ACVP_RESULT acvp_rsa_sig_kat_handler_internal(ACVP_CTX *ctx, JSON_Object
 
     json_array_append_value(reg_arry, r_vs_val);
 
-    json_result = json_serialize_to_string_pretty(ctx->kat_resp, NULL);
+    json_result = json_serialize_to_string_pretty(work->kat_resp, NULL);
     if (ctx->debug == ACVP_LOG_LVL_VERBOSE) {
         printf("\n\n%s\n\n", json_result);
     } else {
@@ -32,6 +32,15 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <ctype.h>
+#include <errno.h>
+#ifdef WIN32
+#include <winsock2.h>
+#define poll WSAPoll
+#else
+#include <poll.h>
+#include <time.h>
+#endif
 #include "acvp.h"
 #include "acvp_lcl.h"
 #include "safe_lib.h"
@@ -41,24 +50,23 @@
 
 #define ACVP_AUTH_BEARER_TITLE_LEN 23
 
-typedef enum acvp_net_action {
-    ACVP_NET_ACTION_GET_RESULT = 1,
-    ACVP_NET_ACTION_GET_VECTOR_SET,
-    ACVP_NET_ACTION_GET_SAMPLE,
-    ACVP_NET_ACTION_POST_VECTOR_RESP
-} ACVP_NET_ACTION;
+/* Growth of the buffer the vector set responses are compressed to */
+#define ACVP_GZIP_CHUNK (1024 * 16)
 
 static struct curl_slist *acvp_add_auth_hdr(ACVP_CTX *ctx, struct curl_slist *slist) {
     int bearer_size;
     char *bearer;
 
     /*
-     * Create the Authorzation header if needed
+     * Create the Authorzation header if needed.  The JWT may be
+     * refreshed by another thread, so hold the lock while copying it.
      */
+    acvp_mutex_lock(&ctx->jwt_lock);
     if (ctx->jwt_token) {
         bearer_size = strnlen_s(ctx->jwt_token, ACVP_JWT_TOKEN_MAX) + ACVP_AUTH_BEARER_TITLE_LEN;
         bearer = calloc(1, bearer_size);
         if (!bearer) {
+            acvp_mutex_unlock(&ctx->jwt_lock);
             ACVP_LOG_ERR("unable to allocate memory.");
             return slist;
         }
@@ -66,6 +74,7 @@ static struct curl_slist *acvp_add_auth_hdr(ACVP_CTX *ctx, struct curl_slist *sl
         slist = curl_slist_append(slist, bearer);
         free(bearer);
     }
+    acvp_mutex_unlock(&ctx->jwt_lock);
     return slist;
 }
 
@@ -98,376 +107,874 @@ static void acvp_curl_log_peer_cert(ACVP_CTX *ctx, CURL *hnd) {
 }
 
 /*
- * This function uses libcurl to send a simple HTTP GET
- * request with no Content-Type header.
- * TLS peer verification is enabled, but not HTTP authentication.
- * The parameters are:
- *
- * ctx: Ptr to ACVP_CTX, which contains the server name
- * url: URL to use for the GET request
- * writefunc: Function pointer to handle writing the data
- *            from the HTTP body received from the server.
- *
- * Return value is the HTTP status value from the server
- *	    (e.g. 200 for HTTP OK)
+ * An HTTP handle kept on the ctx between requests.  Reusing the
+ * handle lets libcurl keep the connection to the server, and the TLS
+ * session, alive from one request to the next.  The request headers
+ * only change when the JWT does, so they are kept with the handle
+ * along with the JWT generation they were built for.
  */
-static long acvp_curl_http_get(ACVP_CTX *ctx, char *url, void *writefunc) {
-    long http_code = 0;
-    CURL *hnd;
-    struct curl_slist *slist;
-
-    slist = NULL;
-    /*
-     * Create the Authorzation header if needed
-     */
-    slist = acvp_add_auth_hdr(ctx, slist);
+struct acvp_http_hnd_t {
+    CURL *curl;
+    struct curl_slist *get_hdrs;
+    struct curl_slist *post_hdrs;
+    struct curl_slist *post_gzip_hdrs;
+    struct curl_slist *stream_hdrs; /* for a POST with a streamed body */
+    struct curl_slist *stream_gzip_hdrs;
+    int jwt_gen;        /* ctx->jwt_gen the headers were built for, -1 if none */
+    struct acvp_http_hnd_t *next;
+};
+
+static void acvp_http_hnd_free(ACVP_HTTP_HND *hnd) {
+    if (hnd->curl) curl_easy_cleanup(hnd->curl);
+    if (hnd->get_hdrs) curl_slist_free_all(hnd->get_hdrs);
+    if (hnd->post_hdrs) curl_slist_free_all(hnd->post_hdrs);
+    if (hnd->post_gzip_hdrs) curl_slist_free_all(hnd->post_gzip_hdrs);
+    if (hnd->stream_hdrs) curl_slist_free_all(hnd->stream_hdrs);
+    if (hnd->stream_gzip_hdrs) curl_slist_free_all(hnd->stream_gzip_hdrs);
+    free(hnd);
+}
 
-    ctx->read_ctr = 0;
+/*
+ * Make room on the ACVP_VS_WORK for len more bytes of the HTTP body
+ * plus the terminating NUL.  The buffer starts at the Content-Length
+ * sent by the server, if any, and grows geometrically from there.  It
+ * is kept on the ACVP_VS_WORK for the next request, so it is only
+ * reallocated when a larger response comes along.
+ */
+static int acvp_http_buf_reserve(ACVP_VS_WORK *work, char **buf, size_t *buf_size, size_t len) {
+    size_t need = work->read_ctr + len + 1;
+    size_t new_size;
+    char *new_buf;
 
-    /*
-     * Setup Curl
-     */
-    hnd = curl_easy_init();
-    curl_easy_setopt(hnd, CURLOPT_URL, url);
-    curl_easy_setopt(hnd, CURLOPT_NOPROGRESS, 1L);
-    curl_easy_setopt(hnd, CURLOPT_USERAGENT, "curl/7.27.0");
-    curl_easy_setopt(hnd, CURLOPT_SSLVERSION, CURL_SSLVERSION_TLSv1_2);
-    if (slist) {
-        curl_easy_setopt(hnd, CURLOPT_HTTPHEADER, slist);
+    if (need <= *buf_size) {
+        return 1;
     }
-    if (ctx->verify_peer && ctx->cacerts_file) {
-        curl_easy_setopt(hnd, CURLOPT_CAINFO, ctx->cacerts_file);
-        curl_easy_setopt(hnd, CURLOPT_SSL_VERIFYPEER, 1L);
-        curl_easy_setopt(hnd, CURLOPT_CERTINFO, 1L);
-    } else {
-        curl_easy_setopt(hnd, CURLOPT_SSL_VERIFYPEER, 0L);
-        ACVP_LOG_WARN("TLS peer verification has not been enabled.\n");
+    if (need > ACVP_HTTP_BUF_MAX) {
+        return 0;
     }
-    curl_easy_setopt(hnd, CURLOPT_TCP_KEEPALIVE, 1L);
-    if (ctx->tls_cert && ctx->tls_key) {
-        curl_easy_setopt(hnd, CURLOPT_SSLCERTTYPE, "PEM");
-        curl_easy_setopt(hnd, CURLOPT_SSLCERT, ctx->tls_cert);
-        curl_easy_setopt(hnd, CURLOPT_SSLKEYTYPE, "PEM");
-        curl_easy_setopt(hnd, CURLOPT_SSLKEY, ctx->tls_key);
+    new_size = *buf_size ? *buf_size : ACVP_HTTP_BUF_MIN;
+    if (work->content_len >= new_size) {
+        new_size = work->content_len + 1;
     }
-    /*
-     * If the caller wants the HTTP data from the server
-     * set the callback function
-     */
-    if (writefunc) {
-        curl_easy_setopt(hnd, CURLOPT_WRITEDATA, ctx);
-        curl_easy_setopt(hnd, CURLOPT_WRITEFUNCTION, writefunc);
+    while (new_size < need) {
+        new_size *= 2;
+    }
+    if (new_size > ACVP_HTTP_BUF_MAX) {
+        new_size = ACVP_HTTP_BUF_MAX;
     }
+    new_buf = realloc(*buf, new_size);
+    if (!new_buf) {
+        return 0;
+    }
+    *buf = new_buf;
+    *buf_size = new_size;
+    return 1;
+}
 
-    /*
-     * Send the HTTP GET request
-     */
-    curl_easy_perform(hnd);
+/*
+ * Append the HTTP body received from the server to one of the
+ * transitory buffers on the ACVP_VS_WORK.
+ */
+static size_t acvp_http_buf_append(ACVP_VS_WORK *work, char **buf, size_t *buf_size,
+                                   void *ptr, size_t size, size_t nmemb, const char *what) {
+    if (size != 1) {
+        fprintf(stderr, "\ncurl size not 1\n");
+        return 0;
+    }
 
-    /*
-     * Get the cert info from the TLS peer
-     */
-    if (ctx->verify_peer) {
-        acvp_curl_log_peer_cert(ctx, hnd);
+    if (!acvp_http_buf_reserve(work, buf, buf_size, nmemb)) {
+        fprintf(stderr, "\n%s is too large\n", what);
+        return 0;
     }
 
-    /*
-     * Get the HTTP reponse status code from the server
-     */
-    curl_easy_getinfo(hnd, CURLINFO_RESPONSE_CODE, &http_code);
+    memcpy_s(&(*buf)[work->read_ctr], (*buf_size - work->read_ctr), ptr, nmemb);
+    (*buf)[work->read_ctr + nmemb] = 0;
+    work->read_ctr += nmemb;
 
-    if (http_code != HTTP_OK) {
-        ACVP_LOG_ERR("HTTP response: %d\n", (int)http_code);
-    }
+    return nmemb;
+}
 
-    curl_easy_cleanup(hnd);
-    hnd = NULL;
-    if (slist) {
-        curl_slist_free_all(slist);
-        slist = NULL;
-    }
+/*
+ * Empty the transitory buffers on the ACVP_VS_WORK before a request,
+ * so one that receives no HTTP body doesn't leave the previous body
+ * behind.  Only the first byte is cleared, not the whole buffer.
+ */
+static void acvp_http_buf_reset(ACVP_VS_WORK *work) {
+    work->read_ctr = 0;
+    work->content_len = 0;
+    if (work->kat_buf) work->kat_buf[0] = 0;
+    if (work->kat_stream) acvp_json_stream_reset(work->kat_stream);
+    if (work->upld_buf) work->upld_buf[0] = 0;
+    if (work->test_sess_buf) work->test_sess_buf[0] = 0;
+    if (work->sample_buf) work->sample_buf[0] = 0;
+}
 
-    return http_code;
+/*
+ * This is a callback used by curl to send the HTTP headers to
+ * the application (us).  The Content-Length, when the server
+ * sends one, is used to size the receive buffer up front.
+ */
+static size_t acvp_curl_header_func(char *ptr, size_t size, size_t nmemb, void *userdata) {
+    static const char content_length[] = "content-length:";
+    ACVP_VS_WORK *work = (ACVP_VS_WORK *)userdata;
+    size_t len = size * nmemb;
+    size_t i, value = 0;
+
+    if (len < sizeof(content_length)) {
+        return len;
+    }
+    for (i = 0; i < sizeof(content_length) - 1; i++) {
+        if (tolower((unsigned char)ptr[i]) != content_length[i]) {
+            return len;
+        }
+    }
+    while (i < len && (ptr[i] == ' ' || ptr[i] == '\t')) {
+        i++;
+    }
+    while (i < len && ptr[i] >= '0' && ptr[i] <= '9') {
+        value = value * 10 + (ptr[i++] - '0');
+        if (value > ACVP_HTTP_BUF_MAX) {
+            /* Let the write callback fail it */
+            return len;
+        }
+    }
+    work->content_len = value;
+    return len;
 }
 
 /*
- * This function uses libcurl to send a simple HTTP POST
- * request with no Content-Type header.
- * TLS peer verification is enabled, but not HTTP authentication.
- * The parameters are:
- *
- * ctx: Ptr to ACVP_CTX, which contains the server name
- * url: URL to use for the GET request
- * data: data to POST to the server
- * writefunc: Function pointer to handle writing the data
- *            from the HTTP body received from the server.
- *
- * Return value is the HTTP status value from the server
- *	    (e.g. 200 for HTTP OK)
+ * The DNS cache, TLS sessions and connections shared by every HTTP
+ * handle of a ctx, so that only the first request of a session pays
+ * for the name lookup and the full TLS handshake.  The handles may be
+ * used from several threads at once, so each kind of shared data has
+ * its own lock.  Murl has no share interface.
  */
-static long acvp_curl_http_post(ACVP_CTX *ctx, char *url, char *data, int data_len, void *writefunc) {
-    long http_code = 0;
-    CURL *hnd;
-    CURLcode crv;
-    struct curl_slist *slist;
+struct acvp_http_share_t {
+#ifndef USE_MURL
+    CURLSH *curlsh;
+    ACVP_MUTEX locks[CURL_LOCK_DATA_LAST];
+#else
+    int unused;
+#endif
+};
 
-    /*
-     * Set the Content-Type header in the HTTP request
-     */
-    slist = NULL;
-    slist = curl_slist_append(slist, "Content-Type:application/json");
+#ifndef USE_MURL
+static void acvp_curl_share_lock(CURL *curl, curl_lock_data data, curl_lock_access access, void *userptr) {
+    ACVP_HTTP_SHARE *share = (ACVP_HTTP_SHARE *)userptr;
 
-    /*
-     * Create the Authorzation header if needed
-     */
-    slist = acvp_add_auth_hdr(ctx, slist);
+    if (data < CURL_LOCK_DATA_LAST) {
+        acvp_mutex_lock(&share->locks[data]);
+    }
+}
 
-    ctx->read_ctr = 0;
+static void acvp_curl_share_unlock(CURL *curl, curl_lock_data data, void *userptr) {
+    ACVP_HTTP_SHARE *share = (ACVP_HTTP_SHARE *)userptr;
 
-    /*
-     * Setup Curl
-     */
-    hnd = curl_easy_init();
-    curl_easy_setopt(hnd, CURLOPT_URL, url);
-    curl_easy_setopt(hnd, CURLOPT_NOPROGRESS, 1L);
-    curl_easy_setopt(hnd, CURLOPT_USERAGENT, "libacvp");
-    curl_easy_setopt(hnd, CURLOPT_HTTPHEADER, slist);
-    curl_easy_setopt(hnd, CURLOPT_CUSTOMREQUEST, "POST");
-    curl_easy_setopt(hnd, CURLOPT_POST, 1L);
-    curl_easy_setopt(hnd, CURLOPT_POSTFIELDS, data);
-    curl_easy_setopt(hnd, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)data_len);
-    curl_easy_setopt(hnd, CURLOPT_SSLVERSION, CURL_SSLVERSION_TLSv1_2);
+    if (data < CURL_LOCK_DATA_LAST) {
+        acvp_mutex_unlock(&share->locks[data]);
+    }
+}
+
+static void acvp_http_share_free(ACVP_HTTP_SHARE *share) {
+    int i;
+
+    if (share->curlsh) curl_share_cleanup(share->curlsh);
+    for (i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+        acvp_mutex_destroy(&share->locks[i]);
+    }
+    free(share);
+}
+
+static ACVP_HTTP_SHARE *acvp_http_share_new(ACVP_CTX *ctx) {
+    ACVP_HTTP_SHARE *share;
+    int i;
+
+    share = calloc(1, sizeof(ACVP_HTTP_SHARE));
+    if (!share) {
+        ACVP_LOG_ERR("unable to allocate memory.");
+        return NULL;
+    }
+    for (i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+        if (acvp_mutex_init(&share->locks[i])) {
+            ACVP_LOG_ERR("Unable to create HTTP share lock");
+            while (--i >= 0) {
+                acvp_mutex_destroy(&share->locks[i]);
+            }
+            free(share);
+            return NULL;
+        }
+    }
+    share->curlsh = curl_share_init();
+    if (!share->curlsh) {
+        ACVP_LOG_ERR("Unable to create HTTP share handle");
+        acvp_http_share_free(share);
+        return NULL;
+    }
+    curl_share_setopt(share->curlsh, CURLSHOPT_LOCKFUNC, acvp_curl_share_lock);
+    curl_share_setopt(share->curlsh, CURLSHOPT_UNLOCKFUNC, acvp_curl_share_unlock);
+    curl_share_setopt(share->curlsh, CURLSHOPT_USERDATA, share);
+    curl_share_setopt(share->curlsh, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share->curlsh, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    curl_share_setopt(share->curlsh, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+    return share;
+}
+#endif
+
+/*
+ * Take an idle HTTP handle from the ctx, or create a new one with
+ * the options that are the same for every request.  Each thread
+ * making requests uses its own handle.
+ */
+static ACVP_HTTP_HND *acvp_http_hnd_get(ACVP_CTX *ctx) {
+    ACVP_HTTP_HND *hnd;
+
+    acvp_mutex_lock(&ctx->hnd_lock);
+    hnd = ctx->idle_hnds;
+    if (hnd) {
+        ctx->idle_hnds = hnd->next;
+        hnd->next = NULL;
+    }
+#ifndef USE_MURL
+    if (!hnd && !ctx->http_share) {
+        /* Without the share every handle just has its own caches */
+        ctx->http_share = acvp_http_share_new(ctx);
+    }
+#endif
+    acvp_mutex_unlock(&ctx->hnd_lock);
+    if (hnd) {
+        return hnd;
+    }
+
+    hnd = calloc(1, sizeof(ACVP_HTTP_HND));
+    if (!hnd) {
+        ACVP_LOG_ERR("unable to allocate memory.");
+        return NULL;
+    }
+    hnd->jwt_gen = -1;
+    hnd->curl = curl_easy_init();
+    if (!hnd->curl) {
+        ACVP_LOG_ERR("Unable to create HTTP handle");
+        free(hnd);
+        return NULL;
+    }
+    curl_easy_setopt(hnd->curl, CURLOPT_NOPROGRESS, 1L);
+    curl_easy_setopt(hnd->curl, CURLOPT_SSLVERSION, CURL_SSLVERSION_TLSv1_2);
     //FIXME: we should always to TLS peer auth
     if (ctx->verify_peer && ctx->cacerts_file) {
-        curl_easy_setopt(hnd, CURLOPT_CAINFO, ctx->cacerts_file);
-        curl_easy_setopt(hnd, CURLOPT_SSL_VERIFYPEER, 1L);
-        curl_easy_setopt(hnd, CURLOPT_CERTINFO, 1L);
+        curl_easy_setopt(hnd->curl, CURLOPT_CAINFO, ctx->cacerts_file);
+        curl_easy_setopt(hnd->curl, CURLOPT_SSL_VERIFYPEER, 1L);
+        curl_easy_setopt(hnd->curl, CURLOPT_CERTINFO, 1L);
     } else {
-        curl_easy_setopt(hnd, CURLOPT_SSL_VERIFYPEER, 0L);
+        curl_easy_setopt(hnd->curl, CURLOPT_SSL_VERIFYPEER, 0L);
         ACVP_LOG_WARN("TLS peer verification has not been enabled.");
     }
-    curl_easy_setopt(hnd, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(hnd->curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(hnd->curl, CURLOPT_HEADERFUNCTION, &acvp_curl_header_func);
+#ifndef USE_MURL
+    if (ctx->http_share) {
+        curl_easy_setopt(hnd->curl, CURLOPT_SHARE, ctx->http_share->curlsh);
+    }
+#endif
     if (ctx->tls_cert && ctx->tls_key) {
-        curl_easy_setopt(hnd, CURLOPT_SSLCERTTYPE, "PEM");
-        curl_easy_setopt(hnd, CURLOPT_SSLCERT, ctx->tls_cert);
-        curl_easy_setopt(hnd, CURLOPT_SSLKEYTYPE, "PEM");
-        curl_easy_setopt(hnd, CURLOPT_SSLKEY, ctx->tls_key);
+        curl_easy_setopt(hnd->curl, CURLOPT_SSLCERTTYPE, "PEM");
+        curl_easy_setopt(hnd->curl, CURLOPT_SSLCERT, ctx->tls_cert);
+        curl_easy_setopt(hnd->curl, CURLOPT_SSLKEYTYPE, "PEM");
+        curl_easy_setopt(hnd->curl, CURLOPT_SSLKEY, ctx->tls_key);
     }
+    return hnd;
+}
 
-    /*
-     * If the caller wants the HTTP data from the server
-     * set the callback function
-     */
-    if (writefunc) {
-        curl_easy_setopt(hnd, CURLOPT_WRITEDATA, ctx);
-        curl_easy_setopt(hnd, CURLOPT_WRITEFUNCTION, writefunc);
-    }
+/*
+ * Return an HTTP handle to the ctx for the next request.
+ */
+static void acvp_http_hnd_put(ACVP_CTX *ctx, ACVP_HTTP_HND *hnd) {
+    acvp_mutex_lock(&ctx->hnd_lock);
+    hnd->next = ctx->idle_hnds;
+    ctx->idle_hnds = hnd;
+    acvp_mutex_unlock(&ctx->hnd_lock);
+}
 
-    /*
-     * Send the HTTP POST request
-     */
-    crv = curl_easy_perform(hnd);
-    if (crv != CURLE_OK) {
-        ACVP_LOG_ERR("Curl failed with code %d (%s)\n", crv, curl_easy_strerror(crv));
-    }
+/*
+ * Build the headers of an HTTP POST request of JSON data, streamed
+ * when stream is set, and gzip encoded when gzip is set.
+ */
+static struct curl_slist *acvp_post_hdrs(ACVP_CTX *ctx, int stream, int gzip) {
+    struct curl_slist *slist;
 
     /*
-     * Get the cert info from the TLS peer
+     * Set the Content-Type header in the HTTP POST request
      */
-    if (ctx->verify_peer) {
-        acvp_curl_log_peer_cert(ctx, hnd);
+    slist = curl_slist_append(NULL, "Content-Type:application/json");
+    if (stream) {
+        /*
+         * The length of a streamed body isn't known up front.  Don't
+         * wait for a 100 Continue from the server before sending it.
+         */
+        slist = curl_slist_append(slist, "Transfer-Encoding: chunked");
+        slist = curl_slist_append(slist, "Expect:");
     }
-
-    /*
-     * Get the HTTP reponse status code from the server
-     */
-    curl_easy_getinfo(hnd, CURLINFO_RESPONSE_CODE, &http_code);
-
-    if (http_code != HTTP_OK) {
-        ACVP_LOG_ERR("HTTP response: %d\n", (int)http_code);
+    if (gzip) {
+        slist = curl_slist_append(slist, "Content-Encoding: gzip");
     }
-
-    curl_easy_cleanup(hnd);
-    hnd = NULL;
-    curl_slist_free_all(slist);
-    slist = NULL;
-
-    return http_code;
+    return acvp_add_auth_hdr(ctx, slist);
 }
 
 /*
- * This is a callback used by curl to send the HTTP body
- * to the application (us).  We will store the HTTP body
- * on the ACVP_CTX in one of the transitory fields.
+ * Rebuild the request headers of the handle if the JWT changed
+ * since they were built.  Whether a body is sent compressed is up to
+ * how it was encoded, see acvp_curl_setup_post(), so there is a set
+ * of headers for each.
  */
-static size_t acvp_curl_write_upld_func(void *ptr, size_t size, size_t nmemb, void *userdata) {
-    ACVP_CTX *ctx = (ACVP_CTX *)userdata;
-    char *http_buf;
-
-    if (size != 1) {
-        fprintf(stderr, "\ncurl size not 1\n");
-        return 0;
+static void acvp_http_hnd_headers(ACVP_CTX *ctx, ACVP_HTTP_HND *hnd) {
+    acvp_mutex_lock(&ctx->jwt_lock);
+    if (hnd->jwt_gen != ctx->jwt_gen) {
+        if (hnd->get_hdrs) curl_slist_free_all(hnd->get_hdrs);
+        if (hnd->post_hdrs) curl_slist_free_all(hnd->post_hdrs);
+        if (hnd->post_gzip_hdrs) curl_slist_free_all(hnd->post_gzip_hdrs);
+        if (hnd->stream_hdrs) curl_slist_free_all(hnd->stream_hdrs);
+        if (hnd->stream_gzip_hdrs) curl_slist_free_all(hnd->stream_gzip_hdrs);
+        hnd->get_hdrs = acvp_add_auth_hdr(ctx, NULL);
+        hnd->post_hdrs = acvp_post_hdrs(ctx, 0, 0);
+        hnd->post_gzip_hdrs = acvp_post_hdrs(ctx, 0, 1);
+        hnd->stream_hdrs = acvp_post_hdrs(ctx, 1, 0);
+        hnd->stream_gzip_hdrs = acvp_post_hdrs(ctx, 1, 1);
+        hnd->jwt_gen = ctx->jwt_gen;
     }
+    acvp_mutex_unlock(&ctx->jwt_lock);
+}
 
-    if (!ctx->upld_buf) {
-        ctx->upld_buf = calloc(1, ACVP_KAT_BUF_MAX);
-        if (!ctx->upld_buf) {
-            fprintf(stderr, "\nmalloc failed in curl write upld func\n");
-            return 0;
-        }
+/*
+ * Release the transport set with acvp_set_transport()
+ */
+void acvp_transport_release(ACVP_CTX *ctx) {
+    if (!ctx->transport) {
+        return;
     }
-    http_buf = ctx->upld_buf;
-
-    if ((ctx->read_ctr + nmemb) > ACVP_KAT_BUF_MAX) {
-        fprintf(stderr, "\nKAT is too large\n");
-        return 0;
+    if (ctx->transport->free) {
+        (ctx->transport->free)(ctx->transport->data);
     }
-
-    memcpy_s(&http_buf[ctx->read_ctr], (ACVP_KAT_BUF_MAX - ctx->read_ctr), ptr, nmemb);
-    http_buf[ctx->read_ctr + nmemb] = 0;
-    ctx->read_ctr += nmemb;
-
-    return nmemb;
+    free(ctx->transport);
+    ctx->transport = NULL;
 }
 
 /*
- * This is a callback used by curl to send the HTTP body
- * to the application (us).  We will store the HTTP body
- * on the ACVP_CTX in one of the transitory fields.
+ * Release the HTTP handles kept on the ctx, and then the caches
+ * they shared, along with the timing of the requests sent on them
+ * and the transport if one was set.
  */
-static size_t acvp_curl_write_vs_func(void *ptr, size_t size, size_t nmemb, void *userdata) {
-    ACVP_CTX *ctx = (ACVP_CTX *)userdata;
-    char *json_buf;
+void acvp_transport_free(ACVP_CTX *ctx) {
+    ACVP_HTTP_HND *hnd;
 
-    if (size != 1) {
-        fprintf(stderr, "\ncurl size not 1\n");
-        return 0;
+    while (ctx->idle_hnds) {
+        hnd = ctx->idle_hnds;
+        ctx->idle_hnds = hnd->next;
+        acvp_http_hnd_free(hnd);
     }
-
-    if (!ctx->test_sess_buf) {
-        ctx->test_sess_buf = calloc(1, ACVP_ANS_BUF_MAX);
-        if (!ctx->test_sess_buf) {
-            fprintf(stderr, "\nmalloc failed in curl write ans func\n");
-            return 0;
-        }
+#ifndef USE_MURL
+    if (ctx->http_share) {
+        acvp_http_share_free(ctx->http_share);
+        ctx->http_share = NULL;
     }
-    json_buf = ctx->test_sess_buf;
-
-    if ((ctx->read_ctr + nmemb) > ACVP_ANS_BUF_MAX) {
-        fprintf(stderr, "\nAnswer response is too large\n");
-        return 0;
+#endif
+    if (ctx->http_stats) {
+        free(ctx->http_stats);
+        ctx->http_stats = NULL;
     }
+    ctx->http_stats_cnt = 0;
+    ctx->http_stats_size = 0;
+    acvp_transport_release(ctx);
+}
 
-    memcpy_s(&json_buf[ctx->read_ctr], (ACVP_ANS_BUF_MAX - ctx->read_ctr), ptr, nmemb);
-    json_buf[ctx->read_ctr + nmemb] = 0;
-    ctx->read_ctr += nmemb;
+static const char *acvp_net_action_name(ACVP_NET_ACTION action) {
+    switch(action) {
+    case ACVP_NET_ACTION_GET_RESULT:
+        return "getResult";
+    case ACVP_NET_ACTION_GET_VECTOR_SET:
+        return "getVectorSet";
+    case ACVP_NET_ACTION_GET_SAMPLE:
+        return "getSample";
+    case ACVP_NET_ACTION_POST_VECTOR_RESP:
+        return "postVectorResponses";
+    case ACVP_NET_ACTION_LOGIN:
+        return "login";
+    case ACVP_NET_ACTION_REGISTER:
+        return "register";
+    default:
+        return "unknown";
+    }
+}
 
-    return nmemb;
+/*
+ * The time from the request being sent to the first byte of the
+ * response, which is mostly the time the server took.  When a request
+ * has a body, curl may take the first byte sent as the start of the
+ * transfer, so the whole exchange is counted instead.
+ */
+static long acvp_http_stats_wait_us(ACVP_HTTP_STATS *stats) {
+    if (stats->bytes_sent) {
+        return stats->total_us - stats->pretransfer_us;
+    }
+    return stats->first_byte_us - stats->pretransfer_us;
 }
 
 /*
- * This is a callback used by curl to send the HTTP body
- * to the application (us).  We will store the HTTP body
- * on the ACVP_CTX in one of the transitory fields.
+ * Write the timing of the requests sent so far to a JSON file, each
+ * request followed by totals for each kind of request.
  */
-static size_t acvp_curl_write_sample_func(void *ptr, size_t size, size_t nmemb, void *userdata) {
-    ACVP_CTX *ctx = (ACVP_CTX *)userdata;
-    char *json_buf;
+ACVP_RESULT acvp_http_stats_write_report(ACVP_CTX *ctx, const char *path) {
+    JSON_Value *val = NULL, *req_val;
+    JSON_Object *obj, *req_obj, *totals, *tot_obj;
+    JSON_Array *reqs;
+    ACVP_HTTP_STATS *stats;
+    ACVP_RESULT rv = ACVP_SUCCESS;
+    const char *name;
+    int i;
 
-    if (size != 1) {
-        fprintf(stderr, "\ncurl size not 1\n");
-        return 0;
+    val = json_value_init_object();
+    obj = json_value_get_object(val);
+    json_object_set_value(obj, "requests", json_value_init_array());
+    json_object_set_value(obj, "totals", json_value_init_object());
+    reqs = json_object_get_array(obj, "requests");
+    totals = json_object_get_object(obj, "totals");
+    if (!reqs || !totals) {
+        json_value_free(val);
+        return ACVP_MALLOC_FAIL;
     }
 
-    if (!ctx->sample_buf) {
-        ctx->sample_buf = calloc(1, ACVP_ANS_BUF_MAX);
-        if (!ctx->sample_buf) {
-            fprintf(stderr, "\nmalloc failed in curl write ans func\n");
-            return 0;
+    acvp_mutex_lock(&ctx->stats_lock);
+    for (i = 0; i < ctx->http_stats_cnt; i++) {
+        stats = &ctx->http_stats[i];
+        name = acvp_net_action_name(stats->action);
+
+        req_val = json_value_init_object();
+        req_obj = json_value_get_object(req_val);
+        json_object_set_string(req_obj, "action", name);
+        if (stats->vs_id) {
+            json_object_set_number(req_obj, "vsId", stats->vs_id);
+        }
+        json_object_set_number(req_obj, "httpCode", stats->http_code);
+        json_object_set_number(req_obj, "time", (double)stats->time);
+        json_object_set_number(req_obj, "dnsUs", stats->dns_us);
+        json_object_set_number(req_obj, "connectUs", stats->connect_us);
+        json_object_set_number(req_obj, "tlsUs", stats->tls_us);
+        json_object_set_number(req_obj, "pretransferUs", stats->pretransfer_us);
+        json_object_set_number(req_obj, "firstByteUs", stats->first_byte_us);
+        json_object_set_number(req_obj, "totalUs", stats->total_us);
+        json_object_set_number(req_obj, "bytesSent", stats->bytes_sent);
+        json_object_set_number(req_obj, "bytesReceived", stats->bytes_received);
+        json_array_append_value(reqs, req_val);
+
+        tot_obj = json_object_get_object(totals, name);
+        if (!tot_obj) {
+            json_object_set_value(totals, name, json_value_init_object());
+            tot_obj = json_object_get_object(totals, name);
+            if (!tot_obj) {
+                rv = ACVP_MALLOC_FAIL;
+                break;
+            }
         }
+        json_object_set_number(tot_obj, "count", json_object_get_number(tot_obj, "count") + 1);
+        json_object_set_number(tot_obj, "failures", json_object_get_number(tot_obj, "failures") +
+                               (stats->http_code == HTTP_OK ? 0 : 1));
+        json_object_set_number(tot_obj, "totalUs", json_object_get_number(tot_obj, "totalUs") +
+                               stats->total_us);
+        json_object_set_number(tot_obj, "waitUs", json_object_get_number(tot_obj, "waitUs") +
+                               acvp_http_stats_wait_us(stats));
+        json_object_set_number(tot_obj, "bytesSent", json_object_get_number(tot_obj, "bytesSent") +
+                               stats->bytes_sent);
+        json_object_set_number(tot_obj, "bytesReceived", json_object_get_number(tot_obj, "bytesReceived") +
+                               stats->bytes_received);
     }
-    json_buf = ctx->sample_buf;
+    acvp_mutex_unlock(&ctx->stats_lock);
 
-    if ((ctx->read_ctr + nmemb) > ACVP_ANS_BUF_MAX) {
-        fprintf(stderr, "\nAnswer response is too large\n");
-        return 0;
+    if (rv == ACVP_SUCCESS && json_serialize_to_file_pretty(val, path) != JSONSuccess) {
+        ACVP_LOG_ERR("Unable to write the HTTP stats report to %s", path);
+        rv = ACVP_JSON_ERR;
     }
+    json_value_free(val);
+    return rv;
+}
+
+/*
+ * Used when the caller doesn't want the HTTP body from the server.
+ */
+static size_t acvp_curl_discard_func(void *ptr, size_t size, size_t nmemb, void *userdata) {
+    return size * nmemb;
+}
 
-    memcpy_s(&json_buf[ctx->read_ctr], (ACVP_ANS_BUF_MAX - ctx->read_ctr), ptr, nmemb);
-    json_buf[ctx->read_ctr + nmemb] = 0;
-    ctx->read_ctr += nmemb;
+/*
+ * Curl reports its timers in seconds, murl doesn't report them at all
+ * and leaves the value alone.
+ */
+static long acvp_curl_getinfo_us(CURL *curl, CURLINFO info) {
+    double secs = 0;
 
-    return nmemb;
+    curl_easy_getinfo(curl, info, &secs);
+    return (long)(secs * 1000000);
 }
 
 /*
- * This is a callback used by curl to send the HTTP body
- * to the application (us).  We will store the HTTP body
- * on the ACVP_CTX in one of the transitory fields.
+ * Find the vsId a request was for.  The vsId isn't known until a
+ * vector set has been downloaded, so take it from the URL until then.
  */
-static size_t acvp_curl_write_kat_func(void *ptr, size_t size, size_t nmemb, void *userdata) {
-    ACVP_CTX *ctx = (ACVP_CTX *)userdata;
-    char *json_buf;
+static int acvp_http_stats_vs_id(ACVP_VS_WORK *work, ACVP_NET_ACTION action) {
+    char *id;
 
-    if (size != 1) {
-        fprintf(stderr, "\ncurl size not 1\n");
+    if (!work) {
         return 0;
     }
+    if (work->vs_id || action != ACVP_NET_ACTION_GET_VECTOR_SET) {
+        return work->vs_id;
+    }
+    id = strrchr(work->vsid_url, '/');
+    return id ? atoi(id + 1) : 0;
+}
 
-    if (!ctx->kat_buf) {
-        ctx->kat_buf = calloc(1, ACVP_KAT_BUF_MAX);
-        if (!ctx->kat_buf) {
-            fprintf(stderr, "\nmalloc failed in curl write kat func\n");
-            return 0;
+/*
+ * Record the timing of a request sent on the handle, see
+ * acvp_get_http_stats().  There is no handle when the request went
+ * through a transport set with acvp_set_transport(), and only the
+ * size of the request body is known then.  Requests are sent from
+ * the worker threads too, hence the lock.
+ */
+static void acvp_http_stats_record(ACVP_CTX *ctx, ACVP_HTTP_HND *hnd, ACVP_NET_ACTION action,
+                                   ACVP_VS_WORK *work, long http_code, int data_len) {
+    ACVP_HTTP_STATS *stats;
+
+    acvp_mutex_lock(&ctx->stats_lock);
+    if (ctx->http_stats_cnt == ctx->http_stats_size) {
+        int size = ctx->http_stats_size ? ctx->http_stats_size * 2 : ACVP_HTTP_STATS_INIT;
+
+        stats = realloc(ctx->http_stats, size * sizeof(ACVP_HTTP_STATS));
+        if (!stats) {
+            acvp_mutex_unlock(&ctx->stats_lock);
+            return;
         }
+        ctx->http_stats = stats;
+        ctx->http_stats_size = size;
     }
-    json_buf = ctx->kat_buf;
-
-    if ((ctx->read_ctr + nmemb) > ACVP_KAT_BUF_MAX) {
-        fprintf(stderr, "\nKAT is too large\n");
-        return 0;
+    stats = &ctx->http_stats[ctx->http_stats_cnt++];
+    memzero_s(stats, sizeof(ACVP_HTTP_STATS));
+    stats->action = action;
+    stats->vs_id = acvp_http_stats_vs_id(work, action);
+    stats->http_code = http_code;
+    stats->time = time(NULL);
+    if (!hnd) {
+        stats->bytes_sent = data_len;
+        acvp_mutex_unlock(&ctx->stats_lock);
+        return;
     }
-
-    memcpy_s(&json_buf[ctx->read_ctr], (ACVP_KAT_BUF_MAX - ctx->read_ctr), ptr, nmemb);
-    json_buf[ctx->read_ctr + nmemb] = 0;
-    ctx->read_ctr += nmemb;
-
-    return nmemb;
+    stats->dns_us = acvp_curl_getinfo_us(hnd->curl, CURLINFO_NAMELOOKUP_TIME);
+    stats->connect_us = acvp_curl_getinfo_us(hnd->curl, CURLINFO_CONNECT_TIME);
+    stats->tls_us = acvp_curl_getinfo_us(hnd->curl, CURLINFO_APPCONNECT_TIME);
+    stats->pretransfer_us = acvp_curl_getinfo_us(hnd->curl, CURLINFO_PRETRANSFER_TIME);
+    stats->first_byte_us = acvp_curl_getinfo_us(hnd->curl, CURLINFO_STARTTRANSFER_TIME);
+    stats->total_us = acvp_curl_getinfo_us(hnd->curl, CURLINFO_TOTAL_TIME);
+#if defined(LIBCURL_VERSION_NUM) && LIBCURL_VERSION_NUM >= 0x073700
+    {
+        curl_off_t sent = 0, received = 0;
+
+        curl_easy_getinfo(hnd->curl, CURLINFO_SIZE_UPLOAD_T, &sent);
+        curl_easy_getinfo(hnd->curl, CURLINFO_SIZE_DOWNLOAD_T, &received);
+        stats->bytes_sent = (long)sent;
+        stats->bytes_received = (long)received;
+    }
+#endif
+    acvp_mutex_unlock(&ctx->stats_lock);
 }
 
 /*
- * This is a callback used by curl to send the HTTP body
- * to the application (us).  We will store the HTTP body
- * on the ACVP_CTX in one of the transitory fields.
+ * Look at how a request sent on the handle went and return the HTTP
+ * status from the server, or zero if the request failed.
  */
-static size_t acvp_curl_write_register_func(void *ptr, size_t size, size_t nmemb, void *userdata) {
-    ACVP_CTX *ctx = (ACVP_CTX *)userdata;
-    char *json_buf;
+static long acvp_curl_finish(ACVP_CTX *ctx, ACVP_HTTP_HND *hnd, CURLcode crv,
+                             ACVP_NET_ACTION action, ACVP_VS_WORK *work) {
+    long http_code = 0;
 
-    if (size != 1) {
-        fprintf(stderr, "\ncurl size not 1\n");
+    if (crv != CURLE_OK) {
+        ACVP_LOG_ERR("Curl failed with code %d (%s)\n", crv, curl_easy_strerror(crv));
+        acvp_http_stats_record(ctx, hnd, action, work, 0, 0);
         return 0;
     }
 
-    if (!ctx->reg_buf) {
-        ctx->reg_buf = calloc(1, ACVP_REG_BUF_MAX);
-        if (!ctx->reg_buf) {
-            fprintf(stderr, "\nmalloc failed in curl write reg func\n");
-            return 0;
-        }
+    /*
+     * Get the cert info from the TLS peer
+     */
+    if (ctx->verify_peer) {
+        acvp_curl_log_peer_cert(ctx, hnd->curl);
     }
-    json_buf = ctx->reg_buf;
 
-    if ((ctx->read_ctr + nmemb) > ACVP_REG_BUF_MAX) {
-        fprintf(stderr, "\nRegister response is too large\n");
-        return 0;
-    }
+    /*
+     * Get the HTTP reponse status code from the server
+     */
+    curl_easy_getinfo(hnd->curl, CURLINFO_RESPONSE_CODE, &http_code);
+    acvp_http_stats_record(ctx, hnd, action, work, http_code, 0);
 
-    memcpy_s(&json_buf[ctx->read_ctr], (ACVP_REG_BUF_MAX - ctx->read_ctr), ptr, nmemb);
-    json_buf[ctx->read_ctr + nmemb] = 0;
-    ctx->read_ctr += nmemb;
+    if (http_code != HTTP_OK) {
+        ACVP_LOG_ERR("HTTP response: %d\n", (int)http_code);
+    }
+    return http_code;
+}
 
-    return nmemb;
+/*
+ * Send the request set up on the handle and return the HTTP status
+ * from the server, or zero if the request failed.
+ */
+static long acvp_curl_perform(ACVP_CTX *ctx, ACVP_HTTP_HND *hnd, ACVP_NET_ACTION action, ACVP_VS_WORK *work) {
+    return acvp_curl_finish(ctx, hnd, curl_easy_perform(hnd->curl), action, work);
+}
+
+/*
+ * Ask for compressed responses if enabled.  An empty string asks for
+ * every encoding curl can decode, and has it decode them for us.
+ */
+static void acvp_curl_setup_encoding(ACVP_CTX *ctx, ACVP_HTTP_HND *hnd) {
+    if (ctx->compression & ACVP_COMPRESSION_DOWNLOADS) {
+        curl_easy_setopt(hnd->curl, CURLOPT_ACCEPT_ENCODING, "");
+    } else {
+        curl_easy_setopt(hnd->curl, CURLOPT_ACCEPT_ENCODING, NULL);
+    }
+}
+
+/*
+ * Set up the handle for an HTTP GET request with no Content-Type
+ * header.  Only the options that differ from one request to the next
+ * are set here, the others were set when the handle was created.
+ */
+static void acvp_curl_setup_get(ACVP_CTX *ctx, ACVP_HTTP_HND *hnd, ACVP_VS_WORK *work, char *url, void *writefunc) {
+    /*
+     * Create the Authorzation header if needed
+     */
+    acvp_http_hnd_headers(ctx, hnd);
+
+    acvp_http_buf_reset(work);
+
+    curl_easy_setopt(hnd->curl, CURLOPT_URL, url);
+    curl_easy_setopt(hnd->curl, CURLOPT_HTTPGET, 1L);
+    curl_easy_setopt(hnd->curl, CURLOPT_CUSTOMREQUEST, NULL);
+    curl_easy_setopt(hnd->curl, CURLOPT_USERAGENT, "curl/7.27.0");
+    curl_easy_setopt(hnd->curl, CURLOPT_HTTPHEADER, hnd->get_hdrs);
+    acvp_curl_setup_encoding(ctx, hnd);
+    /*
+     * If the caller wants the HTTP data from the server
+     * set the callback function
+     */
+    curl_easy_setopt(hnd->curl, CURLOPT_WRITEDATA, work);
+    curl_easy_setopt(hnd->curl, CURLOPT_WRITEFUNCTION, writefunc ? writefunc : &acvp_curl_discard_func);
+    curl_easy_setopt(hnd->curl, CURLOPT_HEADERDATA, work);
+}
+
+#ifndef USE_MURL
+/*
+ * This is a callback used by curl to get the body of a POST request
+ * from the application (us).  The vector set responses are serialized
+ * into curl's buffer a piece at a time, straight from the JSON tree.
+ */
+static size_t acvp_curl_read_resp_func(char *buffer, size_t size, size_t nitems, void *userdata) {
+    ACVP_VS_WORK *work = (ACVP_VS_WORK *)userdata;
+    size_t len = 0;
+
+    if (!acvp_json_writer_read(work->resp_writer, buffer, size * nitems, &len)) {
+        fprintf(stderr, "\nUnable to serialize vector set responses\n");
+        return CURL_READFUNC_ABORT;
+    }
+    return len;
+}
+#endif
+
+/*
+ * Set up the handle for an HTTP POST request of JSON data.  When data
+ * is NULL, the body is streamed from work->resp_writer.  The body is
+ * sent as gzip encoded when work->resp_gzip is set.
+ */
+static void acvp_curl_setup_post(ACVP_CTX *ctx, ACVP_HTTP_HND *hnd, ACVP_VS_WORK *work, char *url,
+                                 char *data, int data_len, void *writefunc) {
+    /*
+     * Create the Content-Type and Authorzation headers if needed
+     */
+    acvp_http_hnd_headers(ctx, hnd);
+
+    acvp_http_buf_reset(work);
+
+    curl_easy_setopt(hnd->curl, CURLOPT_URL, url);
+    curl_easy_setopt(hnd->curl, CURLOPT_USERAGENT, "libacvp");
+    curl_easy_setopt(hnd->curl, CURLOPT_CUSTOMREQUEST, "POST");
+    curl_easy_setopt(hnd->curl, CURLOPT_POST, 1L);
+#ifndef USE_MURL
+    if (!data) {
+        acvp_json_writer_rewind(work->resp_writer);
+        curl_easy_setopt(hnd->curl, CURLOPT_HTTPHEADER,
+                         work->resp_gzip ? hnd->stream_gzip_hdrs : hnd->stream_hdrs);
+        curl_easy_setopt(hnd->curl, CURLOPT_POSTFIELDS, NULL);
+        curl_easy_setopt(hnd->curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)-1);
+        curl_easy_setopt(hnd->curl, CURLOPT_READFUNCTION, &acvp_curl_read_resp_func);
+        curl_easy_setopt(hnd->curl, CURLOPT_READDATA, work);
+    } else
+#endif
+    {
+        curl_easy_setopt(hnd->curl, CURLOPT_HTTPHEADER,
+                         work->resp_gzip ? hnd->post_gzip_hdrs : hnd->post_hdrs);
+        curl_easy_setopt(hnd->curl, CURLOPT_POSTFIELDS, data);
+        curl_easy_setopt(hnd->curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)data_len);
+    }
+    acvp_curl_setup_encoding(ctx, hnd);
+    /*
+     * If the caller wants the HTTP data from the server
+     * set the callback function
+     */
+    curl_easy_setopt(hnd->curl, CURLOPT_WRITEDATA, work);
+    curl_easy_setopt(hnd->curl, CURLOPT_WRITEFUNCTION, writefunc ? writefunc : &acvp_curl_discard_func);
+    curl_easy_setopt(hnd->curl, CURLOPT_HEADERDATA, work);
+}
+
+/*
+ * This function uses libcurl to send a simple HTTP POST
+ * request with no Content-Type header.
+ * TLS peer verification is enabled, but not HTTP authentication.
+ * The parameters are:
+ *
+ * ctx: Ptr to ACVP_CTX, which contains the server name
+ * action: What the request is for, used for the timing stats
+ * work: Ptr to ACVP_VS_WORK, which receives the HTTP body
+ * url: URL to use for the GET request
+ * data: data to POST to the server
+ * writefunc: Function pointer to handle writing the data
+ *            from the HTTP body received from the server.
+ *
+ * Return value is the HTTP status value from the server
+ *	    (e.g. 200 for HTTP OK)
+ */
+static long acvp_curl_http_post(ACVP_CTX *ctx, ACVP_NET_ACTION action, ACVP_VS_WORK *work, char *url,
+                                char *data, int data_len, void *writefunc) {
+    long http_code = 0;
+    ACVP_HTTP_HND *hnd;
+
+    hnd = acvp_http_hnd_get(ctx);
+    if (!hnd) {
+        return 0;
+    }
+    acvp_curl_setup_post(ctx, hnd, work, url, data, data_len, writefunc);
+
+    /*
+     * Send the HTTP POST request
+     */
+    http_code = acvp_curl_perform(ctx, hnd, action, work);
+
+    acvp_http_hnd_put(ctx, hnd);
+    return http_code;
+}
+
+/*
+ * Send a request through the transport set with acvp_set_transport()
+ * and return the HTTP status, or zero if the request failed.  The
+ * request is a POST of data when data is set, a GET otherwise.
+ */
+static long acvp_transport_send(ACVP_CTX *ctx, ACVP_NET_ACTION action, ACVP_VS_WORK *work, char *url,
+                                char *data, int data_len, void *writefunc) {
+    ACVP_TRANSPORT *tp = ctx->transport;
+    ACVP_TRANSPORT_WRITE_FN write_fn;
+    char token[ACVP_JWT_TOKEN_MAX + 1] = {0};
+    long http_code;
+
+    acvp_mutex_lock(&ctx->jwt_lock);
+    if (ctx->jwt_token) {
+        strcpy_s(token, sizeof(token), ctx->jwt_token);
+    }
+    acvp_mutex_unlock(&ctx->jwt_lock);
+
+    acvp_http_buf_reset(work);
+    write_fn = writefunc ? (ACVP_TRANSPORT_WRITE_FN)writefunc : &acvp_curl_discard_func;
+    if (data) {
+        http_code = (tp->post)(tp->data, url, token[0] ? token : NULL, data, data_len, write_fn, work);
+    } else {
+        http_code = (tp->get)(tp->data, url, token[0] ? token : NULL, write_fn, work);
+    }
+    acvp_http_stats_record(ctx, NULL, action, work, http_code, data ? data_len : 0);
+
+    if (!http_code) {
+        ACVP_LOG_ERR("Transport failed to send %s", url);
+    } else if (http_code != HTTP_OK) {
+        ACVP_LOG_ERR("HTTP response: %d\n", (int)http_code);
+    }
+    return http_code;
+}
+
+/*
+ * Send an HTTP POST request, with curl unless another transport
+ * was set with acvp_set_transport().
+ */
+static long acvp_http_post(ACVP_CTX *ctx, ACVP_NET_ACTION action, ACVP_VS_WORK *work, char *url,
+                           char *data, int data_len, void *writefunc) {
+    if (ctx->transport) {
+        return acvp_transport_send(ctx, action, work, url, data, data_len, writefunc);
+    }
+    return acvp_curl_http_post(ctx, action, work, url, data, data_len, writefunc);
+}
+
+/*
+ * This is a callback used by curl to send the HTTP body
+ * to the application (us).  We will store the HTTP body
+ * on the ACVP_VS_WORK in one of the transitory fields.
+ */
+static size_t acvp_curl_write_upld_func(void *ptr, size_t size, size_t nmemb, void *userdata) {
+    ACVP_VS_WORK *work = (ACVP_VS_WORK *)userdata;
+
+    return acvp_http_buf_append(work, &work->upld_buf, &work->upld_buf_size, ptr, size, nmemb, "KAT");
+}
+
+/*
+ * This is a callback used by curl to send the HTTP body
+ * to the application (us).  We will store the HTTP body
+ * on the ACVP_VS_WORK in one of the transitory fields.
+ */
+static size_t acvp_curl_write_vs_func(void *ptr, size_t size, size_t nmemb, void *userdata) {
+    ACVP_VS_WORK *work = (ACVP_VS_WORK *)userdata;
+
+    return acvp_http_buf_append(work, &work->test_sess_buf, &work->test_sess_buf_size, ptr, size, nmemb, "Answer response");
+}
+
+/*
+ * This is a callback used by curl to send the HTTP body
+ * to the application (us).  We will store the HTTP body
+ * on the ACVP_VS_WORK in one of the transitory fields.
+ */
+static size_t acvp_curl_write_sample_func(void *ptr, size_t size, size_t nmemb, void *userdata) {
+    ACVP_VS_WORK *work = (ACVP_VS_WORK *)userdata;
+
+    return acvp_http_buf_append(work, &work->sample_buf, &work->sample_buf_size, ptr, size, nmemb, "Answer response");
+}
+
+/*
+ * This is a callback used by curl to send the HTTP body
+ * to the application (us).  We will store the HTTP body
+ * on the ACVP_VS_WORK in one of the transitory fields.
+ */
+static size_t acvp_curl_write_kat_func(void *ptr, size_t size, size_t nmemb, void *userdata) {
+    ACVP_VS_WORK *work = (ACVP_VS_WORK *)userdata;
+
+    /*
+     * Parse the vector set as it arrives.  If the parser can't be
+     * created, the vector set is parsed once it has been received.
+     */
+    if (!work->kat_stream && !work->read_ctr) {
+        work->kat_stream = acvp_json_stream_new();
+    }
+    if (work->kat_stream) {
+        acvp_json_stream_feed(work->kat_stream, ptr, size * nmemb);
+    }
+
+    return acvp_http_buf_append(work, &work->kat_buf, &work->kat_buf_size, ptr, size, nmemb, "KAT");
+}
+
+/*
+ * This is a callback used by curl to send the HTTP body
+ * to the application (us).  We will store the HTTP body
+ * on the ACVP_VS_WORK in one of the transitory fields.
+ */
+static size_t acvp_curl_write_register_func(void *ptr, size_t size, size_t nmemb, void *userdata) {
+    ACVP_VS_WORK *work = (ACVP_VS_WORK *)userdata;
+
+    return acvp_http_buf_append(work, &work->upld_buf, &work->upld_buf_size, ptr, size, nmemb, "Register response");
 }
 
 /*
@@ -479,6 +986,7 @@ static ACVP_RESULT acvp_send_internal(ACVP_CTX *ctx, char *data, int data_len, c
     int rv;
     int diff = 1;
     char url[ACVP_ATTR_URL_MAX] = {0};
+    ACVP_VS_WORK work;
 
     if (!ctx) {
         ACVP_LOG_ERR("No CTX to send");
@@ -518,13 +1026,27 @@ static ACVP_RESULT acvp_send_internal(ACVP_CTX *ctx, char *data, int data_len, c
      */
     strcmp_s("login", 5, uri, &diff);
     if (!diff) {
+        acvp_mutex_lock(&ctx->jwt_lock);
         if (ctx->jwt_token) {
             free(ctx->jwt_token);
         }
         ctx->jwt_token = NULL;
+        ctx->jwt_gen++;
+        acvp_mutex_unlock(&ctx->jwt_lock);
     }
 
-    rv = acvp_curl_http_post(ctx, url, data, data_len, &acvp_curl_write_register_func);
+    /*
+     * The response is kept on the ctx for the registration
+     * parsing routines.
+     */
+    memzero_s(&work, sizeof(ACVP_VS_WORK));
+    rv = acvp_http_post(ctx, diff ? ACVP_NET_ACTION_REGISTER : ACVP_NET_ACTION_LOGIN,
+                        &work, url, data, data_len, &acvp_curl_write_register_func);
+    if (ctx->reg_buf) {
+        free(ctx->reg_buf);
+    }
+    ctx->reg_buf = work.upld_buf;
+    work.upld_buf = NULL;
     if (rv != HTTP_OK) {
         ACVP_LOG_ERR("Unable to register |%s| with ACVP server. curl rv=%d\n", url, rv);
         printf("%s", ctx->reg_buf);
@@ -613,11 +1135,37 @@ ACVP_RESULT acvp_send_login(ACVP_CTX *ctx, char *login, int len) {
     return acvp_send_internal(ctx, login, len, ACVP_LOGIN_URI);
 }
 
+/*
+ * This performs the global initialization of the HTTP library.
+ * It must be called before any handles are created from more
+ * than one thread, since the implicit initialization done by
+ * curl_easy_init() is not thread-safe.
+ */
+ACVP_RESULT acvp_transport_init(ACVP_CTX *ctx) {
+#ifdef USE_MURL
+    CURL *hnd;
+
+    /* Murl initializes itself when the first handle is created */
+    hnd = curl_easy_init();
+    if (!hnd) {
+        ACVP_LOG_ERR("Unable to initialize HTTP transport");
+        return ACVP_TRANSPORT_FAIL;
+    }
+    curl_easy_cleanup(hnd);
+#else
+    if (curl_global_init(CURL_GLOBAL_ALL) != CURLE_OK) {
+        ACVP_LOG_ERR("Unable to initialize HTTP transport");
+        return ACVP_TRANSPORT_FAIL;
+    }
+#endif
+    return ACVP_SUCCESS;
+}
+
 #define JWT_EXPIRED_STR "JWT expired"
 #define JWT_EXPIRED_STR_LEN 11
 #define JWT_INVALID_STR "JWT signature does not match"
 #define JWT_INVALID_STR_LEN 28
-static ACVP_RESULT inspect_http_code(ACVP_CTX *ctx, int code) {
+static ACVP_RESULT inspect_http_code(ACVP_CTX *ctx, int code, char *body) {
     ACVP_RESULT result = ACVP_TRANSPORT_FAIL; /* Generic failure */
     JSON_Value *root_value = NULL;
     const JSON_Object *obj = NULL;
@@ -631,10 +1179,8 @@ static ACVP_RESULT inspect_http_code(ACVP_CTX *ctx, int code) {
     if (code == HTTP_UNAUTH) {
         int diff = 1;
 
-        if (ctx->sample_buf) {
-            root_value = json_parse_string(ctx->sample_buf);
-        } else if (ctx->kat_buf) {
-            root_value = json_parse_string(ctx->kat_buf);
+        if (body) {
+            root_value = json_parse_string(body);
         }
 
         obj = json_value_get_object(root_value);
@@ -668,284 +1214,987 @@ end:
     return result;
 }
 
-static ACVP_RESULT execute_network_action(ACVP_CTX *ctx,
-                                          ACVP_NET_ACTION action,
-                                          char *url,
-                                          void *curl_callback) {
-    ACVP_RESULT result = ACVP_TRANSPORT_FAIL;
-    char *resp = NULL;
-    int resp_len = 0;
-    int rc = 0;
-
+/*
+ * Returns the buffer on the ACVP_VS_WORK that receives the
+ * HTTP body for the given network action.
+ */
+static char *acvp_net_action_buf(ACVP_VS_WORK *work, ACVP_NET_ACTION action) {
     switch(action) {
     case ACVP_NET_ACTION_GET_RESULT:
+        return work->test_sess_buf;
     case ACVP_NET_ACTION_GET_VECTOR_SET:
+        return work->kat_buf;
     case ACVP_NET_ACTION_GET_SAMPLE:
-        rc = acvp_curl_http_get(ctx, url, curl_callback);
-        break;
+        return work->sample_buf;
     case ACVP_NET_ACTION_POST_VECTOR_RESP:
-        resp = json_serialize_to_string_pretty(ctx->kat_resp, &resp_len);
-
-        rc = acvp_curl_http_post(ctx, url, resp, resp_len, curl_callback);
-        json_value_free(ctx->kat_resp);
-        ctx->kat_resp = NULL;
-        break;
+        return work->upld_buf;
     default:
-        ACVP_LOG_ERR("Unknown ACVP_NET_ACTION");
-        return ACVP_INVALID_ARG;
+        return NULL;
     }
+}
 
-    /* Peek at the HTTP code */
-    result = inspect_http_code(ctx, rc);
+/*
+ * Refresh the JWT after the server said it expired.  Another thread
+ * may have refreshed the JWT while the request was in flight, in which
+ * case the request is just sent again with the new one.  jwt_gen is
+ * the generation of the JWT the request was sent with.  *refreshed is
+ * set when the JWT was refreshed here rather than by another request.
+ */
+static ACVP_RESULT acvp_refresh_stale_jwt(ACVP_CTX *ctx, int jwt_gen, int *refreshed) {
+    ACVP_RESULT result;
 
-    if (result != ACVP_SUCCESS) {
-        if (result == ACVP_JWT_EXPIRED) {
-            /*
-             * Expired JWT
-              * We are going to refresh the session
-              * and try to obtain a new JWT!
-              */
-            ACVP_LOG_ERR("JWT authorization has timed out, curl rc=%d.\n"
-                         "Refreshing session...", rc);
+    acvp_mutex_lock(&ctx->jwt_lock);
+    if (jwt_gen == ctx->jwt_gen) {
+        result = acvp_refresh(ctx);
+        *refreshed = 1;
+    } else {
+        result = ACVP_SUCCESS;
+    }
+    acvp_mutex_unlock(&ctx->jwt_lock);
+    return result;
+}
 
-            result = acvp_refresh(ctx);
-            if (result != ACVP_SUCCESS) {
-                ACVP_LOG_ERR("JWT refresh failed.");
-                goto end;
-            }
+static void acvp_net_action_log_err(ACVP_CTX *ctx, ACVP_VS_WORK *work, ACVP_NET_ACTION action, int rc) {
+    switch(action) {
+    case ACVP_NET_ACTION_GET_RESULT:
+        ACVP_LOG_ERR("Unable to get vector result from server. curl rc=%d\n", rc);
+        ACVP_LOG_ERR("%s\n", work->test_sess_buf);
+        break;
+    case ACVP_NET_ACTION_GET_VECTOR_SET:
+        ACVP_LOG_ERR("Unable to get vector set from ACVP server. curl rc=%d\n", rc);
+        ACVP_LOG_ERR("%s\n", work->kat_buf);
+        break;
+    case ACVP_NET_ACTION_GET_SAMPLE:
+        ACVP_LOG_ERR("Unable to get vector result samples from server. curl rc=%d\n", rc);
+        ACVP_LOG_ERR("%s\n", work->sample_buf);
+        break;
+    case ACVP_NET_ACTION_POST_VECTOR_RESP:
+        ACVP_LOG_ERR("Unable to submit vector set responses. curl rc=%d\n", rc);
+        ACVP_LOG_ERR("%s\n", work->upld_buf);
+        break;
+    default:
+        break;
+    }
+}
 
-            /* Try action again after the refresh */
-            switch(action) {
-            case ACVP_NET_ACTION_GET_RESULT:
-            case ACVP_NET_ACTION_GET_VECTOR_SET:
-            case ACVP_NET_ACTION_GET_SAMPLE:
-                rc = acvp_curl_http_get(ctx, url, curl_callback);
-                break;
-            case ACVP_NET_ACTION_POST_VECTOR_RESP:
-                rc = acvp_curl_http_post(ctx, url, resp, resp_len, curl_callback);
-                break;
-            }
+/*
+ * Get the vector set responses ready to be uploaded.  Responses that
+ * were already serialized, as when loaded from the session journal,
+ * are sent as they are.  Otherwise they are streamed to the server
+ * straight from the JSON tree, gzip compressed if enabled, so the
+ * full serialized copy is never made.  Murl can't stream a request
+ * body, and a transport set with acvp_set_transport() takes the body
+ * in one piece, so with them the responses are serialized first,
+ * compressed the same way with murl.
+ */
+static ACVP_RESULT acvp_prepare_vector_responses(ACVP_CTX *ctx, ACVP_VS_WORK *work) {
+    if (work->resp_buf || work->resp_writer) {
+        return ACVP_SUCCESS;
+    }
+#ifdef USE_MURL
+    return acvp_serialize_vector_responses(ctx, work);
+#else
+    if (ctx->transport) {
+        return acvp_serialize_vector_responses(ctx, work);
+    }
+    if (!work->kat_resp) {
+        ACVP_LOG_ERR("Missing vector set responses to upload");
+        return ACVP_MISSING_ARG;
+    }
+    work->resp_writer = acvp_json_writer_new(work->kat_resp);
+    if (!work->resp_writer) {
+        return ACVP_MALLOC_FAIL;
+    }
+    if (ctx->compression & ACVP_COMPRESSION_UPLOADS) {
+        if (!acvp_json_writer_set_gzip(work->resp_writer)) {
+            ACVP_LOG_ERR("Unable to set up compression of vector set responses");
+            return ACVP_MALLOC_FAIL;
+        }
+        work->resp_gzip = 1;
+    }
+    return ACVP_SUCCESS;
+#endif
+}
 
-            result = inspect_http_code(ctx, rc);
-            if (result != ACVP_SUCCESS) {
-                ACVP_LOG_ERR("Refreshed + retried, HTTP transport fails. curl rc=%d\n", rc);
+/*
+ * Serialize the vector set responses into work->resp_buf gzip
+ * compressed, a piece at a time the same way they are streamed.
+ */
+static ACVP_RESULT acvp_gzip_vector_responses(ACVP_CTX *ctx, ACVP_VS_WORK *work) {
+    ACVP_JSON_WRITER *writer;
+    ACVP_RESULT rv = ACVP_SUCCESS;
+    char *buf = NULL, *new_buf;
+    size_t len = 0, size = 0, n = 0;
+
+    writer = acvp_json_writer_new(work->kat_resp);
+    if (!writer || !acvp_json_writer_set_gzip(writer)) {
+        ACVP_LOG_ERR("Unable to set up compression of vector set responses");
+        rv = ACVP_MALLOC_FAIL;
+        goto end;
+    }
+    do {
+        if (size - len < ACVP_GZIP_CHUNK) {
+            new_buf = realloc(buf, size + ACVP_GZIP_CHUNK);
+            if (!new_buf) {
+                rv = ACVP_MALLOC_FAIL;
                 goto end;
             }
-        } else if (result == ACVP_JWT_INVALID) {
-            /*
-             * Invalid JWT
-             */
-            ACVP_LOG_ERR("JWT invalid. curl rc=%d.\n", rc);
+            buf = new_buf;
+            size += ACVP_GZIP_CHUNK;
+        }
+        if (!acvp_json_writer_read(writer, buf + len, size - len, &n)) {
+            ACVP_LOG_ERR("Unable to compress vector set responses");
+            rv = ACVP_JSON_ERR;
             goto end;
         }
-
-        /* Generic error */
+        len += n;
+    } while (n);
+    if (len > ACVP_HTTP_BUF_MAX) {
+        ACVP_LOG_ERR("Compressed vector set responses too large");
+        rv = ACVP_JSON_ERR;
         goto end;
     }
-
-    result = ACVP_SUCCESS;
+    work->resp_buf = buf;
+    work->resp_len = (int)len;
+    work->resp_gzip = 1;
+    buf = NULL;
 
 end:
-    /* Log any errors */
-    switch(action) {
-    case ACVP_NET_ACTION_GET_RESULT:
-        if (result != ACVP_SUCCESS) {
-            ACVP_LOG_ERR("Unable to get vector result from server. curl rc=%d\n", rc);
-            ACVP_LOG_ERR("%s\n", ctx->kat_buf);
+    free(buf);
+    acvp_json_writer_free(writer);
+    return rv;
+}
+
+/*
+ * This function serializes the vector set responses built by the
+ * handler into work->resp_buf, compactly since it is only read by
+ * the server, and gzip compressed if enabled.  The JSON tree is
+ * released since it is much larger than its serialized form.  A
+ * transport set with acvp_set_transport() is never handed compressed
+ * responses, see acvp_set_compression().
+ */
+ACVP_RESULT acvp_serialize_vector_responses(ACVP_CTX *ctx, ACVP_VS_WORK *work) {
+    ACVP_RESULT rv;
+
+    if (!work->kat_resp) {
+        ACVP_LOG_ERR("Missing vector set responses to serialize");
+        return ACVP_MISSING_ARG;
+    }
+
+    if ((ctx->compression & ACVP_COMPRESSION_UPLOADS) && !ctx->transport) {
+        rv = acvp_gzip_vector_responses(ctx, work);
+        if (rv != ACVP_SUCCESS) {
+            return rv;
         }
-        break;
-    case ACVP_NET_ACTION_GET_VECTOR_SET:
-        if (result != ACVP_SUCCESS) {
-            ACVP_LOG_ERR("Unable to get vector set from ACVP server. curl rc=%d\n", rc);
-            ACVP_LOG_ERR("%s\n", ctx->kat_buf);
+    } else {
+        work->resp_buf = json_serialize_to_string(work->kat_resp);
+        if (!work->resp_buf) {
+            ACVP_LOG_ERR("Unable to serialize vector set responses");
+            return ACVP_JSON_ERR;
         }
-        break;
-    case ACVP_NET_ACTION_GET_SAMPLE:
-        if (result != ACVP_SUCCESS) {
-            ACVP_LOG_ERR("Unable to get vector result samples from server. curl rc=%d\n", rc);
-            ACVP_LOG_ERR("%s\n", ctx->sample_buf);
+        work->resp_len = strnlen_s(work->resp_buf, ACVP_HTTP_BUF_MAX);
+        work->resp_serialized = 1;
+    }
+    json_value_free(work->kat_resp);
+    work->kat_resp = NULL;
+
+    return ACVP_SUCCESS;
+}
+
+/*
+ * A request kept in flight on an ACVP_NET_MULTI.  The body received
+ * from the server goes to the buffers on the ACVP_VS_WORK, the same
+ * as for the login and registration requests above.  There is no
+ * handle when the request goes through a transport set with
+ * acvp_set_transport().
+ */
+typedef struct acvp_net_xfer_t {
+    ACVP_HTTP_HND *hnd;
+    ACVP_VS_WORK *work;
+    ACVP_NET_ACTION action;
+    char url[ACVP_ATTR_URL_MAX];
+    void *writefunc;
+    int refreshed;          /* set once the JWT was refreshed for this request */
+    int jwt_gen;            /* generation of the JWT the request was sent with */
+    int parked;             /* set while the request waits for the JWT to be refreshed */
+    long rc;                /* HTTP status when the request was sent when it was added */
+    void *arg;
+    struct acvp_net_xfer_t *next;
+} ACVP_NET_XFER;
+
+/*
+ * A socket of the requests in flight, as reported by curl
+ */
+typedef struct acvp_net_sock_t {
+    curl_socket_t fd;
+    int what;               /* CURL_POLL_IN, CURL_POLL_OUT or both */
+} ACVP_NET_SOCK;
+
+/*
+ * Requests to the server that are kept in flight concurrently and
+ * driven by acvp_net_multi_perform() without blocking.  Each request
+ * has its own HTTP handle, and the multi handle shares the
+ * connections between them.  The multi handle tells which sockets it
+ * waits on, and when it must be called back, through the socket and
+ * timer callbacks, so the caller only wakes up when there is work to
+ * do.  When the JWT expires, it is refreshed with a login request of
+ * its own while the requests the server turned away wait for it.  A
+ * transport set with acvp_set_transport() blocks, so with it a
+ * request is sent when it is added and completes on the next
+ * acvp_net_multi_perform().
+ */
+struct acvp_net_multi_t {
+    ACVP_CTX *ctx;
+    CURLM *multi;
+    ACVP_NET_XFER *xfers;
+    int in_flight;
+    ACVP_NET_SOCK *socks;   /* the sockets curl waits on */
+    int sock_cnt;
+    int sock_max;
+    long long timer;        /* when curl must be called back, see acvp_net_now(), or -1 */
+    ACVP_NET_XFER *login;   /* the login refreshing the JWT, while in flight */
+    ACVP_VS_WORK login_work;
+    char *login_body;
+    int login_len;
+    struct curl_slist *login_hdrs;
+    void (*done_cb)(ACVP_CTX *ctx, ACVP_VS_WORK *work, ACVP_RESULT rv, void *arg);
+};
+
+/*
+ * Milliseconds on a clock that doesn't jump when the time of day is set
+ */
+static long long acvp_net_now(void) {
+#ifdef WIN32
+    return (long long)GetTickCount64();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#endif
+}
+
+/*
+ * Called by curl when it starts or stops waiting on a socket, or
+ * waits for something else on it.
+ */
+static int acvp_net_socket_cb(CURL *easy, curl_socket_t s, int what, void *userp, void *socketp) {
+    ACVP_NET_MULTI *m = (ACVP_NET_MULTI *)userp;
+    ACVP_NET_SOCK *socks;
+    int i;
+
+    for (i = 0; i < m->sock_cnt; i++) {
+        if (m->socks[i].fd == s) {
+            break;
         }
-        break;
-    case ACVP_NET_ACTION_POST_VECTOR_RESP:
-        if (result != ACVP_SUCCESS) {
-            ACVP_LOG_ERR("Unable to submit vector set responses. curl rc=%d\n", rc);
-            ACVP_LOG_ERR("%s\n", ctx->kat_buf);
+    }
+    if (what == CURL_POLL_REMOVE) {
+        if (i < m->sock_cnt) {
+            m->socks[i] = m->socks[--m->sock_cnt];
         }
-        break;
+        return 0;
     }
+    if (i == m->sock_cnt) {
+        if (m->sock_cnt == m->sock_max) {
+            socks = realloc(m->socks, (m->sock_max + 8) * sizeof(ACVP_NET_SOCK));
+            if (!socks) {
+                return -1;
+            }
+            m->socks = socks;
+            m->sock_max += 8;
+        }
+        m->socks[m->sock_cnt++].fd = s;
+    }
+    m->socks[i].what = what;
+    return 0;
+}
 
-    if (resp) json_free_serialized_string(resp);
+/*
+ * Called by curl when the time it must be called back changes
+ */
+static int acvp_net_timer_cb(CURLM *multi, long timeout_ms, void *userp) {
+    ACVP_NET_MULTI *m = (ACVP_NET_MULTI *)userp;
 
-    return result;
+    m->timer = timeout_ms < 0 ? -1 : acvp_net_now() + timeout_ms;
+    return 0;
+}
+
+ACVP_RESULT acvp_net_multi_new(ACVP_CTX *ctx,
+                               void (*done_cb)(ACVP_CTX *ctx, ACVP_VS_WORK *work, ACVP_RESULT rv, void *arg),
+                               ACVP_NET_MULTI **multi) {
+    ACVP_NET_MULTI *m;
+
+    if (!ctx) {
+        return ACVP_NO_CTX;
+    }
+    if (!multi || !done_cb) {
+        return ACVP_INVALID_ARG;
+    }
+    m = calloc(1, sizeof(ACVP_NET_MULTI));
+    if (!m) {
+        return ACVP_MALLOC_FAIL;
+    }
+    m->multi = curl_multi_init();
+    if (!m->multi) {
+        ACVP_LOG_ERR("Unable to create HTTP multi handle");
+        free(m);
+        return ACVP_TRANSPORT_FAIL;
+    }
+    m->timer = -1;
+    curl_multi_setopt(m->multi, CURLMOPT_SOCKETFUNCTION, &acvp_net_socket_cb);
+    curl_multi_setopt(m->multi, CURLMOPT_SOCKETDATA, m);
+    curl_multi_setopt(m->multi, CURLMOPT_TIMERFUNCTION, &acvp_net_timer_cb);
+    curl_multi_setopt(m->multi, CURLMOPT_TIMERDATA, m);
+    /*
+     * The login is sent without the JWT it replaces
+     */
+    m->login_hdrs = curl_slist_append(NULL, "Content-Type:application/json");
+    m->ctx = ctx;
+    m->done_cb = done_cb;
+    *multi = m;
+    return ACVP_SUCCESS;
+}
+
+/*
+ * Release the engine.  Requests still in flight are abandoned without
+ * calling the done callback, and their handles are not reused since
+ * their connections are in an unknown state.
+ */
+void acvp_net_multi_free(ACVP_NET_MULTI *m) {
+    ACVP_NET_XFER *x;
+
+    if (!m) {
+        return;
+    }
+    while (m->xfers) {
+        x = m->xfers;
+        m->xfers = x->next;
+        if (x->hnd) {
+            curl_multi_remove_handle(m->multi, x->hnd->curl);
+            acvp_http_hnd_free(x->hnd);
+        }
+        free(x);
+    }
+    curl_multi_cleanup(m->multi);
+    if (m->login_hdrs) curl_slist_free_all(m->login_hdrs);
+    free(m->login_body);
+    free(m->login_work.upld_buf);
+    free(m->socks);
+    free(m);
+}
+
+/*
+ * Set up the handle of the request and hand it to the multi handle.
+ */
+static ACVP_RESULT acvp_net_multi_start(ACVP_NET_MULTI *m, ACVP_NET_XFER *x) {
+    ACVP_CTX *ctx = m->ctx;
+
+    if (!x->hnd) {
+        acvp_mutex_lock(&ctx->jwt_lock);
+        x->jwt_gen = ctx->jwt_gen;
+        acvp_mutex_unlock(&ctx->jwt_lock);
+        if (x->action == ACVP_NET_ACTION_POST_VECTOR_RESP) {
+            x->rc = acvp_transport_send(ctx, x->action, x->work, x->url, x->work->resp_buf,
+                                        x->work->resp_len, x->writefunc);
+        } else {
+            x->rc = acvp_transport_send(ctx, x->action, x->work, x->url, NULL, 0, x->writefunc);
+        }
+        return ACVP_SUCCESS;
+    }
+    if (x->action == ACVP_NET_ACTION_LOGIN) {
+        acvp_curl_setup_post(ctx, x->hnd, x->work, x->url, m->login_body, m->login_len, x->writefunc);
+        curl_easy_setopt(x->hnd->curl, CURLOPT_HTTPHEADER, m->login_hdrs);
+    } else if (x->action == ACVP_NET_ACTION_POST_VECTOR_RESP) {
+        acvp_curl_setup_post(ctx, x->hnd, x->work, x->url, x->work->resp_buf,
+                             x->work->resp_len, x->writefunc);
+    } else {
+        acvp_curl_setup_get(ctx, x->hnd, x->work, x->url, x->writefunc);
+    }
+    x->jwt_gen = x->hnd->jwt_gen;
+    curl_easy_setopt(x->hnd->curl, CURLOPT_PRIVATE, x);
+    if (curl_multi_add_handle(m->multi, x->hnd->curl) != CURLM_OK) {
+        ACVP_LOG_ERR("Unable to add the request to the HTTP multi handle");
+        return ACVP_TRANSPORT_FAIL;
+    }
+    return ACVP_SUCCESS;
+}
+
+static ACVP_RESULT acvp_net_multi_add(ACVP_NET_MULTI *m, ACVP_VS_WORK *work, ACVP_NET_ACTION action,
+                                      char *url, void *writefunc, void *arg) {
+    ACVP_CTX *ctx = m->ctx;
+    ACVP_NET_XFER *x;
+    ACVP_RESULT rv;
+
+    x = calloc(1, sizeof(ACVP_NET_XFER));
+    if (!x) {
+        return ACVP_MALLOC_FAIL;
+    }
+    if (!ctx->transport) {
+        x->hnd = acvp_http_hnd_get(ctx);
+        if (!x->hnd) {
+            free(x);
+            return ACVP_TRANSPORT_FAIL;
+        }
+    }
+    x->work = work;
+    x->action = action;
+    strcpy_s(x->url, ACVP_ATTR_URL_MAX, url);
+    x->writefunc = writefunc;
+    x->arg = arg;
+
+    rv = acvp_net_multi_start(m, x);
+    if (rv != ACVP_SUCCESS) {
+        if (x->hnd) {
+            acvp_http_hnd_put(ctx, x->hnd);
+        }
+        free(x);
+        return rv;
+    }
+    x->next = m->xfers;
+    m->xfers = x;
+    m->in_flight++;
+    return ACVP_SUCCESS;
 }
 
 /*
- * This is the top level function used within libacvp to retrieve
- * a KAT vector set from the ACVP server.
+ * Start downloading a KAT vector set.  The done callback is called
+ * from acvp_net_multi_perform() once work->kat_buf holds the response.
  */
-ACVP_RESULT acvp_retrieve_vector_set(ACVP_CTX *ctx, char *vsid_url) {
+ACVP_RESULT acvp_net_multi_get_vector_set(ACVP_NET_MULTI *m, ACVP_VS_WORK *work, void *arg) {
     char url[ACVP_ATTR_URL_MAX] = {0};
-    ACVP_RESULT result = ACVP_SUCCESS;
+    ACVP_CTX *ctx;
 
-    if (!ctx) {
+    if (!m) {
         return ACVP_NO_CTX;
     }
-
+    ctx = m->ctx;
     if (!ctx->server_name || !ctx->server_port) {
         ACVP_LOG_ERR("Missing server/port details; call acvp_set_server first");
         return ACVP_MISSING_ARG;
     }
-
-    if (!vsid_url) {
+    if (!work->vsid_url) {
         ACVP_LOG_ERR("Missing vsid_url from retrieve vector set");
         return ACVP_MISSING_ARG;
     }
 
     snprintf(url, ACVP_ATTR_URL_MAX - 1, "https://%s:%d/%s%s", ctx->server_name, ctx->server_port,
-             ctx->api_context, vsid_url);
+             ctx->api_context, work->vsid_url);
 
     ACVP_LOG_STATUS("GET %s", url);
 
-    if (ctx->kat_buf) {
-        memzero_s(ctx->kat_buf, ACVP_KAT_BUF_MAX);
-    }
-
-    result = execute_network_action(ctx, ACVP_NET_ACTION_GET_VECTOR_SET,
-                                    url, &acvp_curl_write_kat_func);
-    if (result != ACVP_SUCCESS) {
-        /* Failed to transport */
-        ACVP_LOG_ERR("Transport failure.");
-        return result;
-    }
-
-    ACVP_LOG_STATUS("KAT vector set response received");
-
-    return ACVP_SUCCESS;
+    return acvp_net_multi_add(m, work, ACVP_NET_ACTION_GET_VECTOR_SET, url,
+                              &acvp_curl_write_kat_func, arg);
 }
 
 /*
- * This function is used to submit a vector set response
- * to the ACV server.
+ * Start uploading the responses of a vector set.  The done callback is
+ * called from acvp_net_multi_perform() once the server answered.
  */
-ACVP_RESULT acvp_submit_vector_responses(ACVP_CTX *ctx) {
+ACVP_RESULT acvp_net_multi_submit_responses(ACVP_NET_MULTI *m, ACVP_VS_WORK *work, void *arg) {
     char url[ACVP_ATTR_URL_MAX] = {0};
-    ACVP_RESULT result = ACVP_SUCCESS;
+    ACVP_CTX *ctx;
+    ACVP_RESULT rv;
 
-    if (!ctx) {
+    if (!m) {
         return ACVP_NO_CTX;
     }
-
+    ctx = m->ctx;
     if (!ctx->server_name || !ctx->server_port) {
         ACVP_LOG_ERR("Missing server/port details; call acvp_set_server first");
         return ACVP_MISSING_ARG;
     }
-
-    if (!ctx->vs_id) {
+    if (!work->vs_id) {
         ACVP_LOG_ERR("Missing vs_id when trying to submit responses");
         return ACVP_MISSING_ARG;
     }
+    rv = acvp_prepare_vector_responses(ctx, work);
+    if (rv != ACVP_SUCCESS) {
+        return rv;
+    }
 
     snprintf(url, ACVP_ATTR_URL_MAX - 1, "https://%s:%d/%s%s/results", ctx->server_name, ctx->server_port,
-             ctx->api_context, ctx->vsid_url);
+             ctx->api_context, work->vsid_url);
 
     ACVP_LOG_STATUS("Submitting vector responses to %s", url);
 
-    result = execute_network_action(ctx, ACVP_NET_ACTION_POST_VECTOR_RESP,
-                                    url, &acvp_curl_write_upld_func);
-    if (result != ACVP_SUCCESS) {
-        /* Failed to transport */
-        ACVP_LOG_ERR("Transport failure.");
-        return result;
-    }
-
-    ACVP_LOG_STATUS("Finished POSTing KAT vector responses");
-    return ACVP_SUCCESS;
+    return acvp_net_multi_add(m, work, ACVP_NET_ACTION_POST_VECTOR_RESP, url,
+                              &acvp_curl_write_upld_func, arg);
 }
 
 /*
- * This is the top level function used within libacvp to retrieve
- * the test result for a given KAT vector set from the ACVP server.
- * It can be used to get the results for an entire session, or
- * more specifically for a vectorSet
+ * Start downloading the results of a test session, or of one of its
+ * vector sets when api_url is the URL of the vector set.  The done
+ * callback is called from acvp_net_multi_perform() once
+ * work->test_sess_buf holds the response.
  */
-ACVP_RESULT acvp_retrieve_result(ACVP_CTX *ctx, char *api_url) {
+ACVP_RESULT acvp_net_multi_get_result(ACVP_NET_MULTI *m, ACVP_VS_WORK *work, const char *api_url, void *arg) {
     char url[ACVP_ATTR_URL_MAX] = {0};
-    ACVP_RESULT result = ACVP_SUCCESS;
+    ACVP_CTX *ctx;
 
-    if (!ctx) {
+    if (!m) {
         return ACVP_NO_CTX;
     }
-
+    ctx = m->ctx;
     if (!ctx->server_name || !ctx->server_port) {
         ACVP_LOG_ERR("Missing server/port details; call acvp_set_server first");
         return ACVP_MISSING_ARG;
     }
-
     if (!api_url) {
-        ACVP_LOG_ERR("Missing vs_id from retrieve vector set");
+        ACVP_LOG_ERR("Missing URL to retrieve the results from");
         return ACVP_MISSING_ARG;
     }
 
     snprintf(url, ACVP_ATTR_URL_MAX - 1, "https://%s:%d/%s%s/results", ctx->server_name, ctx->server_port,
              ctx->api_context, api_url);
 
-    if (ctx->kat_buf) {
-        memzero_s(ctx->kat_buf, ACVP_KAT_BUF_MAX);
-    }
-
-    result = execute_network_action(ctx, ACVP_NET_ACTION_GET_RESULT,
-                                    url, &acvp_curl_write_vs_func);
-    if (result != ACVP_SUCCESS) {
-        /* Failed to transport */
-        ACVP_LOG_ERR("Transport failure.");
-        return result;
-    }
-
-    ACVP_LOG_STATUS("Successfully retrieved KAT vector set response");
+    ACVP_LOG_STATUS("GET %s", url);
 
-    return ACVP_SUCCESS;
+    return acvp_net_multi_add(m, work, ACVP_NET_ACTION_GET_RESULT, url,
+                              &acvp_curl_write_vs_func, arg);
 }
 
 /*
- * This is the top level function used within libacvp to retrieve
- * the test result for a given KAT vector set from the ACVP server.
- * It can be used to get the results for an entire session, or
- * more specifically for a vectorSet
+ * Start downloading the expected results of a vector set of a sample
+ * test session.  The done callback is called from
+ * acvp_net_multi_perform() once work->sample_buf holds the response.
  */
-ACVP_RESULT acvp_retrieve_expected_result(ACVP_CTX *ctx, char *api_url) {
+ACVP_RESULT acvp_net_multi_get_expected(ACVP_NET_MULTI *m, ACVP_VS_WORK *work, const char *api_url, void *arg) {
     char url[ACVP_ATTR_URL_MAX] = {0};
-    ACVP_RESULT result = ACVP_SUCCESS;
+    ACVP_CTX *ctx;
 
-    if (!ctx) {
+    if (!m) {
         return ACVP_NO_CTX;
     }
-
+    ctx = m->ctx;
     if (!ctx->server_name || !ctx->server_port) {
         ACVP_LOG_ERR("Missing server/port details; call acvp_set_server first");
         return ACVP_MISSING_ARG;
     }
-
     if (!api_url) {
-        ACVP_LOG_ERR("Missing vs_id from retrieve vector set");
+        ACVP_LOG_ERR("Missing URL to retrieve the expected results from");
         return ACVP_MISSING_ARG;
     }
 
     snprintf(url, ACVP_ATTR_URL_MAX - 1, "https://%s:%d/%s%s/expected", ctx->server_name, ctx->server_port,
              ctx->api_context, api_url);
 
-    if (ctx->sample_buf) {
-        memzero_s(ctx->sample_buf, ACVP_KAT_BUF_MAX);
+    ACVP_LOG_STATUS("GET %s", url);
+
+    return acvp_net_multi_add(m, work, ACVP_NET_ACTION_GET_SAMPLE, url,
+                              &acvp_curl_write_sample_func, arg);
+}
+
+/*
+ * Take a request off the list of the engine
+ */
+static void acvp_net_multi_unlink(ACVP_NET_MULTI *m, ACVP_NET_XFER *x) {
+    ACVP_NET_XFER **pp;
+
+    for (pp = &m->xfers; *pp; pp = &(*pp)->next) {
+        if (*pp == x) {
+            *pp = x->next;
+            break;
+        }
     }
+    m->in_flight--;
+}
+
+/*
+ * A request is done with.  The handle goes back to the ctx and the
+ * done callback is called.
+ */
+static void acvp_net_multi_finish(ACVP_NET_MULTI *m, ACVP_NET_XFER *x, ACVP_RESULT rv) {
+    ACVP_CTX *ctx = m->ctx;
 
-    result = execute_network_action(ctx, ACVP_NET_ACTION_GET_SAMPLE,
-                                    url, &acvp_curl_write_sample_func);
-    if (result != ACVP_SUCCESS) {
-        /* Failed to transport */
-        ACVP_LOG_ERR("Transport failure.");
-        return result;
+    acvp_net_multi_unlink(m, x);
+    if (x->hnd) {
+        acvp_http_hnd_put(ctx, x->hnd);
     }
+    (m->done_cb)(ctx, x->work, rv, x->arg);
+    free(x);
+}
 
-    ACVP_LOG_STATUS("Successfully retrieved sample results");
+/*
+ * Log in again to refresh the JWT the server said expired.  The
+ * requests it turned away wait until acvp_net_multi_login_done().
+ */
+static ACVP_RESULT acvp_net_multi_login(ACVP_NET_MULTI *m) {
+    ACVP_CTX *ctx = m->ctx;
+    char url[ACVP_ATTR_URL_MAX] = {0};
+    ACVP_RESULT rv;
+
+    free(m->login_body);
+    m->login_body = NULL;
+    acvp_mutex_lock(&ctx->jwt_lock);
+    rv = acvp_build_login(ctx, &m->login_body, &m->login_len, 1);
+    acvp_mutex_unlock(&ctx->jwt_lock);
+    if (rv != ACVP_SUCCESS) {
+        ACVP_LOG_ERR("Unable to build login message");
+        return rv;
+    }
 
+    snprintf(url, ACVP_ATTR_URL_MAX - 1, "https://%s:%d/%s%s%s", ctx->server_name, ctx->server_port,
+             ctx->api_context, ctx->path_segment, ACVP_LOGIN_URI);
+
+    ACVP_LOG_INFO("POST %s", m->login_body);
+
+    rv = acvp_net_multi_add(m, &m->login_work, ACVP_NET_ACTION_LOGIN, url,
+                            &acvp_curl_write_register_func, NULL);
+    if (rv == ACVP_SUCCESS) {
+        /* Added at the head of the list */
+        m->login = m->xfers;
+    }
+    return rv;
+}
+
+/*
+ * The login refreshing the JWT finished.  The requests that waited for
+ * it are sent again with the new JWT, or fail when there is none.
+ */
+static void acvp_net_multi_login_done(ACVP_NET_MULTI *m, long rc) {
+    ACVP_CTX *ctx = m->ctx;
+    ACVP_NET_XFER *x = m->login;
+    ACVP_RESULT rv;
+
+    rv = inspect_http_code(ctx, rc, m->login_work.upld_buf);
+    if (rv == ACVP_SUCCESS) {
+        ACVP_LOG_STATUS("200 OK %s", m->login_work.upld_buf);
+        rv = acvp_parse_login(ctx, m->login_work.upld_buf);
+    }
+    if (rv != ACVP_SUCCESS) {
+        ACVP_LOG_ERR("JWT refresh failed.");
+    }
+    acvp_net_multi_unlink(m, x);
+    if (x->hnd) {
+        acvp_http_hnd_put(ctx, x->hnd);
+    }
+    free(x);
+    m->login = NULL;
+
+    /*
+     * The done callback may add requests to the list, so look for the
+     * next one that waited from the head of the list each time.
+     */
+    while (1) {
+        for (x = m->xfers; x && !x->parked; x = x->next);
+        if (!x) {
+            break;
+        }
+        x->parked = 0;
+        if (rv != ACVP_SUCCESS) {
+            acvp_net_action_log_err(ctx, x->work, x->action, HTTP_UNAUTH);
+            acvp_net_multi_finish(m, x, rv);
+        } else if (acvp_net_multi_start(m, x) != ACVP_SUCCESS) {
+            acvp_net_multi_finish(m, x, ACVP_TRANSPORT_FAIL);
+        }
+    }
+}
+
+/*
+ * Get a request the server turned away because the JWT expired sent
+ * again once there is a new JWT.  When another request already
+ * replaced the JWT it was sent with, it is sent again right away.
+ * Otherwise it waits for the login that refreshes the JWT, which is
+ * started unless another request already did.  Only the request that
+ * started the login counts it against its one retry, so a request that
+ * already used it still waits for, or takes, a JWT another request got.
+ * It fails with ACVP_JWT_EXPIRED when the JWT it got itself expired.
+ */
+static ACVP_RESULT acvp_net_multi_refresh(ACVP_NET_MULTI *m, ACVP_NET_XFER *x) {
+    ACVP_CTX *ctx = m->ctx;
+    ACVP_RESULT rv;
+    int stale;
+
+    acvp_mutex_lock(&ctx->jwt_lock);
+    stale = x->jwt_gen != ctx->jwt_gen;
+    acvp_mutex_unlock(&ctx->jwt_lock);
+    if (stale) {
+        return acvp_net_multi_start(m, x);
+    }
+    if (!m->login && x->refreshed) {
+        return ACVP_JWT_EXPIRED;
+    }
+    if (!m->login) {
+        if (!ctx->totp_cb) {
+            /* There is nothing to log in with, just try again */
+            x->refreshed = 1;
+            return acvp_net_multi_start(m, x);
+        }
+        rv = acvp_net_multi_login(m);
+        if (rv != ACVP_SUCCESS) {
+            return rv;
+        }
+        x->refreshed = 1;
+    }
+    x->parked = 1;
     return ACVP_SUCCESS;
 }
+
+/*
+ * A request finished.  When the JWT expired while it was in flight,
+ * the request is sent again with a new one, see
+ * acvp_net_multi_refresh().  A transport set with acvp_set_transport()
+ * blocks anyway, so with it the JWT is refreshed right here.
+ * Otherwise the handle goes back to the ctx and the done callback is
+ * called.
+ */
+static void acvp_net_multi_complete(ACVP_NET_MULTI *m, ACVP_NET_XFER *x, long rc) {
+    ACVP_CTX *ctx = m->ctx;
+    ACVP_VS_WORK *work = x->work;
+    ACVP_RESULT rv;
+
+    if (x == m->login) {
+        acvp_net_multi_login_done(m, rc);
+        return;
+    }
+    rv = inspect_http_code(ctx, rc, acvp_net_action_buf(work, x->action));
+    if (rv == ACVP_JWT_EXPIRED && !x->refreshed) {
+        ACVP_LOG_ERR("JWT authorization has timed out, curl rc=%d.\n"
+                     "Refreshing session...", (int)rc);
+    }
+    if (rv == ACVP_JWT_EXPIRED && !ctx->transport) {
+        rv = acvp_net_multi_refresh(m, x);
+        if (rv == ACVP_SUCCESS) {
+            /* Still in flight, or waiting for the new JWT */
+            return;
+        }
+    } else if (rv == ACVP_JWT_EXPIRED && !x->refreshed) {
+        rv = acvp_refresh_stale_jwt(ctx, x->jwt_gen, &x->refreshed);
+        if (rv == ACVP_SUCCESS) {
+            rv = acvp_net_multi_start(m, x);
+        } else {
+            ACVP_LOG_ERR("JWT refresh failed.");
+        }
+        if (rv == ACVP_SUCCESS) {
+            /* Still in flight */
+            return;
+        }
+    }
+    if (rv == ACVP_JWT_EXPIRED) {
+        ACVP_LOG_ERR("Refreshed + retried, HTTP transport fails. curl rc=%d\n", (int)rc);
+    } else if (rv == ACVP_JWT_INVALID) {
+        ACVP_LOG_ERR("JWT invalid. curl rc=%d.\n", (int)rc);
+    }
+    if (rv != ACVP_SUCCESS) {
+        acvp_net_action_log_err(ctx, work, x->action, (int)rc);
+    }
+    acvp_net_multi_finish(m, x, rv);
+}
+
+/*
+ * Fill pfds with the sockets curl waits on, and return how many
+ * there are.
+ */
+static int acvp_net_multi_pollfds(ACVP_NET_MULTI *m, struct pollfd *pfds) {
+    int i;
+
+    for (i = 0; i < m->sock_cnt; i++) {
+        pfds[i].fd = m->socks[i].fd;
+        pfds[i].events = 0;
+        pfds[i].revents = 0;
+        if (m->socks[i].what & CURL_POLL_IN) {
+            pfds[i].events |= POLLIN;
+        }
+        if (m->socks[i].what & CURL_POLL_OUT) {
+            pfds[i].events |= POLLOUT;
+        }
+    }
+    return m->sock_cnt;
+}
+
+/*
+ * Have curl move the requests on the multi handle along.  Curl is
+ * only called for the sockets that are ready, and once the time it
+ * asked to be called back at is up.
+ */
+static ACVP_RESULT acvp_net_multi_perform_curl(ACVP_NET_MULTI *m) {
+    ACVP_CTX *ctx = m->ctx;
+    ACVP_NET_XFER *x;
+    struct pollfd *pfds = NULL;
+    CURLMcode mrv = CURLM_OK;
+    CURLMsg *msg;
+    char *priv;
+    int i, n, ev, running, left;
+
+    /*
+     * The sockets may change while curl handles one of them, so
+     * look at a copy
+     */
+    if (m->sock_cnt) {
+        pfds = calloc(m->sock_cnt, sizeof(struct pollfd));
+        if (!pfds) {
+            return ACVP_MALLOC_FAIL;
+        }
+        n = acvp_net_multi_pollfds(m, pfds);
+        if (poll(pfds, n, 0) > 0) {
+            for (i = 0; i < n && mrv == CURLM_OK; i++) {
+                ev = 0;
+                if (pfds[i].revents & (POLLIN | POLLHUP)) {
+                    ev |= CURL_CSELECT_IN;
+                }
+                if (pfds[i].revents & POLLOUT) {
+                    ev |= CURL_CSELECT_OUT;
+                }
+                if (pfds[i].revents & (POLLERR | POLLNVAL)) {
+                    ev |= CURL_CSELECT_ERR;
+                }
+                if (ev) {
+                    mrv = curl_multi_socket_action(m->multi, pfds[i].fd, ev, &running);
+                }
+            }
+        }
+        free(pfds);
+    }
+    if (mrv == CURLM_OK && m->timer >= 0 && m->timer <= acvp_net_now()) {
+        m->timer = -1;
+        mrv = curl_multi_socket_action(m->multi, CURL_SOCKET_TIMEOUT, 0, &running);
+    }
+    if (mrv != CURLM_OK) {
+        ACVP_LOG_ERR("HTTP multi handle failed with code %d (%s)", mrv, curl_multi_strerror(mrv));
+        return ACVP_TRANSPORT_FAIL;
+    }
+    while ((msg = curl_multi_info_read(m->multi, &left))) {
+        if (msg->msg != CURLMSG_DONE) {
+            continue;
+        }
+        priv = NULL;
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &priv);
+        x = (ACVP_NET_XFER *)priv;
+        curl_multi_remove_handle(m->multi, x->hnd->curl);
+        acvp_net_multi_complete(m, x, acvp_curl_finish(ctx, x->hnd, msg->data.result, x->action, x->work));
+    }
+    return ACVP_SUCCESS;
+}
+
+/*
+ * Move the requests in flight along as far as they can go without
+ * blocking, and call the done callback for the ones that finished.
+ */
+ACVP_RESULT acvp_net_multi_perform(ACVP_NET_MULTI *m) {
+    ACVP_NET_XFER *x, *next;
+
+    if (!m) {
+        return ACVP_NO_CTX;
+    }
+    if (!m->ctx->transport) {
+        return acvp_net_multi_perform_curl(m);
+    }
+    /*
+     * Every request was sent when it was added.  Requests sent again
+     * after a JWT refresh complete on the next call.
+     */
+    x = m->xfers;
+    while (x) {
+        next = x->next;
+        acvp_net_multi_complete(m, x, x->rc);
+        x = next;
+    }
+    return ACVP_SUCCESS;
+}
+
+/*
+ * How long in milliseconds until acvp_net_multi_perform() must be
+ * called again, or -1 when there is no deadline.  Requests in flight
+ * may still be waiting on their sockets when there is no deadline.
+ */
+long acvp_net_multi_timeout(ACVP_NET_MULTI *m) {
+    long long timeout;
+
+    if (!m || !m->in_flight) {
+        return -1;
+    }
+    if (!m->ctx->transport) {
+        if (m->timer < 0) {
+            return -1;
+        }
+        timeout = m->timer - acvp_net_now();
+        return timeout > 0 ? (long)timeout : 0;
+    }
+    /* The requests were sent when they were added */
+    return 0;
+}
+
+/*
+ * Fill fds with up to max of the sockets of the requests in flight and
+ * what they wait for, and return how many sockets there are, which
+ * may be more than max.
+ */
+int acvp_net_multi_fds(ACVP_NET_MULTI *m, ACVP_POLLFD *fds, int max) {
+    int i;
+
+    if (!m) {
+        return 0;
+    }
+    for (i = 0; i < m->sock_cnt && i < max; i++) {
+        fds[i].fd = (int)m->socks[i].fd;
+        fds[i].events = 0;
+        if (m->socks[i].what & CURL_POLL_IN) {
+            fds[i].events |= ACVP_POLL_IN;
+        }
+        if (m->socks[i].what & CURL_POLL_OUT) {
+            fds[i].events |= ACVP_POLL_OUT;
+        }
+    }
+    return m->sock_cnt;
+}
+
+/*
+ * Wait up to timeout_ms, or without limit when it is -1, for one of
+ * the requests in flight to make progress, or for fd to become
+ * readable when it is not -1.  This returns early when
+ * acvp_net_multi_perform() needs to be called sooner.
+ */
+ACVP_RESULT acvp_net_multi_wait(ACVP_NET_MULTI *m, int timeout_ms, int fd) {
+    ACVP_CTX *ctx;
+    struct pollfd *pfds;
+    long net_timeout;
+    int n;
+
+    if (!m) {
+        return ACVP_NO_CTX;
+    }
+    ctx = m->ctx;
+    net_timeout = acvp_net_multi_timeout(m);
+    if (net_timeout >= 0 && (timeout_ms < 0 || net_timeout < timeout_ms)) {
+        timeout_ms = (int)net_timeout;
+    }
+    if (!timeout_ms) {
+        return ACVP_SUCCESS;
+    }
+    if (timeout_ms < 0) {
+        /* Nothing is due, wake up now and then all the same */
+        timeout_ms = ACVP_RETRY_TIME_MAX * 1000;
+    }
+    pfds = calloc(m->sock_cnt + 1, sizeof(struct pollfd));
+    if (!pfds) {
+        return ACVP_MALLOC_FAIL;
+    }
+    n = acvp_net_multi_pollfds(m, pfds);
+    if (fd >= 0) {
+        pfds[n].fd = fd;
+        pfds[n].events = POLLIN;
+        n++;
+    }
+#ifdef WIN32
+    if (!n) {
+        /* WSAPoll() doesn't take an empty set */
+        Sleep(timeout_ms);
+        free(pfds);
+        return ACVP_SUCCESS;
+    }
+#endif
+    if (poll(pfds, n, timeout_ms) < 0 && errno != EINTR) {
+        ACVP_LOG_ERR("Unable to wait on the sockets of the requests in flight, errno %d", errno);
+        free(pfds);
+        return ACVP_TRANSPORT_FAIL;
+    }
+    free(pfds);
+    return ACVP_SUCCESS;
+}
+
+/*
+ * The number of requests in flight
+ */
+int acvp_net_multi_count(ACVP_NET_MULTI *m) {
+    return m ? m->in_flight : 0;
+}
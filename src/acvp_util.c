@@ -97,29 +97,140 @@ ACVP_RESULT acvp_cleanup(ACVP_CTX *ctx) {
 
 /*
  * This function is used to locate the callback function that's needed
- * when a particular crypto operation is needed by libacvp.
+ * when a particular crypto operation is needed by libacvp.  The
+ * capabilities are indexed by cipher on the ctx as they are enabled.
  */
 ACVP_CAPS_LIST *acvp_locate_cap_entry(ACVP_CTX *ctx, ACVP_CIPHER cipher) {
-    ACVP_CAPS_LIST *cap;
-
-    if (!ctx || !ctx->caps_list) {
+    if (!ctx || cipher <= ACVP_CIPHER_START || cipher >= ACVP_CIPHER_END) {
         return NULL;
     }
+    return ctx->caps_tbl[cipher];
+}
+
+/*
+ * Index of alg_tbl[] by algorithm name.  The entries sharing a name,
+ * which differ by mode, are next to each other in alg_tbl[], so each
+ * name maps to the first of its entries and the number of them.  The
+ * index is an open addressed hash table built the first time it is
+ * needed, which makes the lookups independent of the number of
+ * algorithms in alg_tbl[].
+ */
+#define ACVP_ALG_NAME_BUCKETS 128 /* power of 2, over twice the names in alg_tbl[] */
+
+typedef struct acvp_alg_name_idx_t {
+    const char *name;
+    int first;  /* index in alg_tbl[] */
+    int count;
+} ACVP_ALG_NAME_IDX;
+
+static ACVP_ALG_NAME_IDX alg_name_idx[ACVP_ALG_NAME_BUCKETS];
+
+#ifndef WIN32
+static pthread_once_t alg_name_idx_once = PTHREAD_ONCE_INIT;
+#else
+static int alg_name_idx_built = 0;
+#endif
 
-    cap = ctx->caps_list;
-    while (cap) {
-        if (cap->cipher == cipher) {
-            return cap;
+/* FNV-1a */
+static unsigned int acvp_alg_name_hash(const char *name) {
+    unsigned int h = 2166136261u;
+
+    while (*name) {
+        h ^= (unsigned char)*name++;
+        h *= 16777619u;
+    }
+    return h & (ACVP_ALG_NAME_BUCKETS - 1);
+}
+
+static void acvp_alg_name_idx_build(void) {
+    unsigned int b;
+    int i;
+
+    for (i = 0; i < ACVP_ALG_MAX; i++) {
+        if (i > 0 && !strncmp(alg_tbl[i].name, alg_tbl[i - 1].name, ACVP_ALG_NAME_MAX)) {
+            /* Another mode of the previous entry */
+            continue;
+        }
+        b = acvp_alg_name_hash(alg_tbl[i].name);
+        while (alg_name_idx[b].name) {
+            b = (b + 1) & (ACVP_ALG_NAME_BUCKETS - 1);
+        }
+        alg_name_idx[b].name = alg_tbl[i].name;
+        alg_name_idx[b].first = i;
+        alg_name_idx[b].count = 1;
+        while (i + alg_name_idx[b].count < ACVP_ALG_MAX &&
+               !strncmp(alg_tbl[i + alg_name_idx[b].count].name, alg_tbl[i].name, ACVP_ALG_NAME_MAX)) {
+            alg_name_idx[b].count++;
+        }
+    }
+}
+
+static ACVP_ALG_NAME_IDX *acvp_alg_name_idx_find(const char *name) {
+    ACVP_ALG_NAME_IDX *e;
+    unsigned int b;
+    int diff = 1;
+
+#ifndef WIN32
+    pthread_once(&alg_name_idx_once, acvp_alg_name_idx_build);
+#else
+    if (!alg_name_idx_built) {
+        acvp_alg_name_idx_build();
+        alg_name_idx_built = 1;
+    }
+#endif
+    b = acvp_alg_name_hash(name);
+    while (alg_name_idx[b].name) {
+        e = &alg_name_idx[b];
+        strcmp_s(e->name, strnlen_s(e->name, ACVP_ALG_NAME_MAX), name, &diff);
+        if (!diff) {
+            return e;
+        }
+        b = (b + 1) & (ACVP_ALG_NAME_BUCKETS - 1);
+    }
+    return NULL;
+}
+
+/*
+ * This function returns the alg_tbl[] entry matching the
+ * algorithm and mode strings of a vector set.  When \p mode
+ * is NULL, the first entry with the algorithm name is returned.
+ * Returns NULL if none match.
+ */
+ACVP_ALG_HANDLER *acvp_lookup_alg_handler(const char *algorithm, const char *mode) {
+    ACVP_ALG_NAME_IDX *e;
+    int i, diff = 1;
+
+    if (!algorithm) {
+        return NULL;
+    }
+    e = acvp_alg_name_idx_find(algorithm);
+    if (!e) {
+        return NULL;
+    }
+    if (!mode) {
+        return &alg_tbl[e->first];
+    }
+    for (i = e->first; i < e->first + e->count; i++) {
+        if (alg_tbl[i].mode == NULL) continue;
+        if (!*alg_tbl[i].mode) {
+            /* An empty mode, such as ACVP_ALG_KAS_ECC_NOCOMP, matches any mode */
+            return &alg_tbl[i];
+        }
+        strcmp_s(alg_tbl[i].mode,
+                 strnlen_s(alg_tbl[i].mode, ACVP_ALG_MODE_MAX),
+                 mode, &diff);
+        if (!diff) {
+            return &alg_tbl[i];
         }
-        cap = cap->next;
     }
     return NULL;
 }
 
 /*
  * This function returns the name of an algorithm given
- * a ACVP_CIPHER value.  It looks for the cipher in
- * the master algorithm table, returns NULL if none match.
+ * a ACVP_CIPHER value.  alg_tbl[] is ordered by ACVP_CIPHER,
+ * so the cipher indexes the table directly.  Returns NULL
+ * if the cipher is out of range.
  *
  * IMPORTANT: If using an asymmetric cipher with a mode,
  * note that this API only returns the alg string
@@ -127,6 +238,13 @@ ACVP_CAPS_LIST *acvp_locate_cap_entry(ACVP_CTX *ctx, ACVP_CIPHER cipher) {
 char *acvp_lookup_cipher_name(ACVP_CIPHER alg) {
     int i;
 
+    if (alg <= ACVP_CIPHER_START || alg > ACVP_ALG_MAX) {
+        return NULL;
+    }
+    if (alg_tbl[alg - 1].cipher == alg) {
+        return alg_tbl[alg - 1].name;
+    }
+    /* alg_tbl[] is out of order, don't rely on it */
     for (i = 0; i < ACVP_ALG_MAX; i++) {
         if (alg_tbl[i].cipher == alg) {
             return alg_tbl[i].name;
@@ -136,9 +254,8 @@ char *acvp_lookup_cipher_name(ACVP_CIPHER alg) {
 }
 
 /**
- * @brief Loop through all entries in alg_tbl, trying to match
- *        \p algorithm to each name field. If successful, will
- *        return the ACVP_CIPHER id field.
+ * @brief Look up \p algorithm in alg_tbl, returning the ACVP_CIPHER
+ *        id field of the first entry with that name.
  *
  * IMPORTANT: This only works accurately for algorithms that have
  * a 1:1 name to id entry. I.e. does not work for algorithms that
@@ -149,31 +266,14 @@ char *acvp_lookup_cipher_name(ACVP_CIPHER alg) {
  * @return 0 if no-match
  */
 ACVP_CIPHER acvp_lookup_cipher_index(const char *algorithm) {
-    int i = 0;
-
-    if (!algorithm) {
-        return 0;
-    }
+    ACVP_ALG_HANDLER *entry = acvp_lookup_alg_handler(algorithm, NULL);
 
-    for (i = 0; i < ACVP_ALG_MAX; i++) {
-        int diff = 1;
-
-        strcmp_s(alg_tbl[i].name,
-                 strnlen_s(alg_tbl[i].name, ACVP_ALG_NAME_MAX),
-                 algorithm, &diff);
-
-        if (!diff) {
-            return alg_tbl[i].cipher;
-        }
-    }
-
-    return 0;
+    return entry ? entry->cipher : 0;
 }
 
 /**
- * @brief Loop through all entries in alg_tbl, trying to match
- *        both \p algorithm and \p mode to their respective fields.
- *        If successful, will return the ACVP_CIPHER id field.
+ * @brief Look up the alg_tbl entry matching both \p algorithm and
+ *        \p mode, returning its ACVP_CIPHER id field.
  *
  * Useful for algorithms that have multiple modes (i.e. asymmetric).
  *
@@ -182,33 +282,13 @@ ACVP_CIPHER acvp_lookup_cipher_index(const char *algorithm) {
  */
 ACVP_CIPHER acvp_lookup_cipher_w_mode_index(const char *algorithm,
                                             const char *mode) {
-    int i = 0;
+    ACVP_ALG_HANDLER *entry;
 
     if (!algorithm || !mode) {
         return 0;
     }
-
-    for (i = 0; i < ACVP_ALG_MAX; i++) {
-        int diff = 0;
-
-        if (alg_tbl[i].mode == NULL) continue;
-
-        /* Compare the algorithm string */
-        strcmp_s(alg_tbl[i].name,
-                 strnlen_s(alg_tbl[i].name, ACVP_ALG_NAME_MAX),
-                 algorithm, &diff);
-
-        if (!diff) {
-            /* Compare the mode string */
-            strcmp_s(alg_tbl[i].mode,
-                     strnlen_s(alg_tbl[i].mode, ACVP_ALG_MODE_MAX),
-                     mode, &diff);
-
-            if (!diff) return alg_tbl[i].cipher;
-        }
-    }
-
-    return 0;
+    entry = acvp_lookup_alg_handler(algorithm, mode);
+    return entry ? entry->cipher : 0;
 }
 
 /*
@@ -726,7 +806,8 @@ char *acvp_lookup_error_string(ACVP_RESULT rv) {
         { ACVP_DUP_CIPHER,         "Duplicate cipher, may have already registered"    },
         { ACVP_TOTP_DECODE_FAIL,   "Failed to base64 decode TOTP seed"                },
         { ACVP_TOTP_MISSING_SEED,  "Missing TOTP seed"                                },
-        { ACVP_DUPLICATE_CTX,      "ctx already initialized"                          }
+        { ACVP_DUPLICATE_CTX,      "ctx already initialized"                          },
+        { ACVP_JOURNAL_FAIL,       "Error reading or writing the session journal"     }
     };
 
     for (i = 0; i < ACVP_RESULT_MAX - 1; i++) {
@@ -776,20 +857,20 @@ void acvp_free_kv_list(ACVP_KV_LIST *kv_list) {
     }
 }
 
-ACVP_RESULT acvp_setup_json_rsp_group(ACVP_CTX **ctx,
+ACVP_RESULT acvp_setup_json_rsp_group(ACVP_VS_WORK *work,
                                       JSON_Value **outer_arr_val,
                                       JSON_Value **r_vs_val,
                                       JSON_Object **r_vs,
                                       const char *alg_str,
                                       JSON_Array **groups_arr) {
-    if ((*ctx)->kat_resp) {
-        json_value_free((*ctx)->kat_resp);
+    if (work->kat_resp) {
+        json_value_free(work->kat_resp);
     }
-    (*ctx)->kat_resp = *outer_arr_val;
+    work->kat_resp = *outer_arr_val;
     *r_vs_val = json_value_init_object();
     *r_vs = json_value_get_object(*r_vs_val);
 
-    json_object_set_number(*r_vs, "vsId", (*ctx)->vs_id);
+    json_object_set_number(*r_vs, "vsId", work->vs_id);
     json_object_set_string(*r_vs, "algorithm", alg_str);
     /*
      * create an array of response test groups
@@ -807,3 +888,327 @@ void acvp_release_json(JSON_Value *r_vs_val,
     if (r_vs_val) json_value_free(r_vs_val);
 }
 
+#ifndef WIN32
+/*
+ * The test groups of one vector set handed to the pool, see
+ * acvp_process_test_groups_pool().
+ */
+typedef struct acvp_tg_batch_t {
+    ACVP_CTX *ctx;
+    ACVP_CAPS_LIST *cap;
+    JSON_Array *groups;
+    ACVP_TG_HANDLER handler;
+    JSON_Value **r_gvals;   /* response of each group */
+    ACVP_RESULT *rvs;       /* result of each group */
+    int g_cnt;
+    int next;               /* next group to hand out */
+    int active;             /* number of threads processing a group */
+    int max_active;         /* number of threads that may, ctx->group_workers */
+    int failed;             /* set once a group failed */
+    struct acvp_tg_batch_t *next_batch;
+} ACVP_TG_BATCH;
+
+/*
+ * The threads processing test groups of the vector sets.  They are
+ * started the first time they are needed and kept until the ctx is
+ * freed, so the threads aren't started again for every vector set.
+ * Everything is protected by ctx->tg_lock.
+ */
+struct acvp_tg_pool_t {
+    pthread_cond_t work_cond;   /* signaled when a batch is added, or the threads must stop */
+    pthread_cond_t done_cond;   /* signaled when a group is done */
+    pthread_t *threads;
+    int thread_cnt;
+    int thread_max;
+    int stopping;           /* set when the threads must exit */
+    ACVP_TG_BATCH *batches; /* in the order they were added */
+};
+
+/*
+ * Whether a thread may take the next group of the batch.
+ */
+static int acvp_tg_batch_open(ACVP_TG_BATCH *b) {
+    return !b->failed && b->next < b->g_cnt && b->active < b->max_active;
+}
+
+/*
+ * Process the next group of the batch.  Called with ctx->tg_lock held,
+ * which is released while the handler runs.
+ */
+static void acvp_tg_batch_run(ACVP_CTX *ctx, ACVP_TG_BATCH *b) {
+    JSON_Object *groupobj;
+    ACVP_RESULT rv;
+    int i;
+
+    i = b->next++;
+    b->active++;
+    acvp_mutex_unlock(&ctx->tg_lock);
+
+    groupobj = json_value_get_object(json_array_get_value(b->groups, i));
+    rv = (b->handler)(b->ctx, b->cap, groupobj, i, &b->r_gvals[i]);
+
+    acvp_mutex_lock(&ctx->tg_lock);
+    b->rvs[i] = rv;
+    if (rv != ACVP_SUCCESS) {
+        /* No point starting the remaining groups */
+        b->failed = 1;
+    }
+    b->active--;
+    pthread_cond_broadcast(&ctx->tg_pool->done_cond);
+}
+
+static void *acvp_tg_worker_main(void *arg) {
+    ACVP_CTX *ctx = (ACVP_CTX *)arg;
+    ACVP_TG_POOL *pool = ctx->tg_pool;
+    ACVP_TG_BATCH *b;
+
+    acvp_mutex_lock(&ctx->tg_lock);
+    while (!pool->stopping) {
+        for (b = pool->batches; b && !acvp_tg_batch_open(b); b = b->next_batch);
+        if (b) {
+            acvp_tg_batch_run(ctx, b);
+        } else {
+            pthread_cond_wait(&pool->work_cond, &ctx->tg_lock);
+        }
+    }
+    acvp_mutex_unlock(&ctx->tg_lock);
+
+    return NULL;
+}
+
+/*
+ * Make sure the pool has at least cnt threads.  Called with
+ * ctx->tg_lock held.  Running with fewer threads is only slower, so
+ * failing to start one is not an error.
+ */
+static ACVP_RESULT acvp_tg_pool_grow(ACVP_CTX *ctx, int cnt) {
+    ACVP_TG_POOL *pool = ctx->tg_pool;
+    pthread_t *threads;
+
+    if (!pool) {
+        pool = calloc(1, sizeof(ACVP_TG_POOL));
+        if (!pool) {
+            return ACVP_MALLOC_FAIL;
+        }
+        if (pthread_cond_init(&pool->work_cond, NULL)) {
+            free(pool);
+            return ACVP_MALLOC_FAIL;
+        }
+        if (pthread_cond_init(&pool->done_cond, NULL)) {
+            pthread_cond_destroy(&pool->work_cond);
+            free(pool);
+            return ACVP_MALLOC_FAIL;
+        }
+        ctx->tg_pool = pool;
+    }
+    if (cnt > pool->thread_max) {
+        threads = realloc(pool->threads, cnt * sizeof(pthread_t));
+        if (threads) {
+            pool->threads = threads;
+            pool->thread_max = cnt;
+        } else {
+            cnt = pool->thread_max;
+        }
+    }
+    while (pool->thread_cnt < cnt) {
+        if (pthread_create(&pool->threads[pool->thread_cnt], NULL, acvp_tg_worker_main, ctx)) {
+            ACVP_LOG_WARN("Unable to start test group thread %d", pool->thread_cnt + 1);
+            break;
+        }
+        pool->thread_cnt++;
+    }
+    return ACVP_SUCCESS;
+}
+
+/*
+ * Stop the threads of the test group pool, called when the ctx is
+ * freed.  The threads exit once they are done with the group they are
+ * processing, if any.
+ */
+void acvp_tg_pool_free(ACVP_CTX *ctx) {
+    ACVP_TG_POOL *pool = ctx->tg_pool;
+    int i;
+
+    if (!pool) {
+        return;
+    }
+    acvp_mutex_lock(&ctx->tg_lock);
+    pool->stopping = 1;
+    pthread_cond_broadcast(&pool->work_cond);
+    acvp_mutex_unlock(&ctx->tg_lock);
+    for (i = 0; i < pool->thread_cnt; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    pthread_cond_destroy(&pool->work_cond);
+    pthread_cond_destroy(&pool->done_cond);
+    free(pool->threads);
+    free(pool);
+    ctx->tg_pool = NULL;
+}
+
+/*
+ * Process the test groups using ctx->group_workers threads, one of
+ * which is the calling thread.  The others come from the pool of the
+ * ctx, which has enough of them for each of the ctx->worker_count
+ * vector sets that may be processed at once.  The groups are handed
+ * out in order, so all the groups ahead of a failed one have been
+ * processed when the threads are done.
+ */
+static ACVP_RESULT acvp_process_test_groups_pool(ACVP_CTX *ctx,
+                                                 ACVP_CAPS_LIST *cap,
+                                                 JSON_Array *groups,
+                                                 JSON_Array *r_garr,
+                                                 ACVP_TG_HANDLER handler,
+                                                 int g_cnt) {
+    ACVP_TG_BATCH batch, **tail;
+    int i;
+    ACVP_RESULT rv = ACVP_SUCCESS;
+
+    memzero_s(&batch, sizeof(ACVP_TG_BATCH));
+    batch.ctx = ctx;
+    batch.cap = cap;
+    batch.groups = groups;
+    batch.handler = handler;
+    batch.g_cnt = g_cnt;
+    batch.max_active = ctx->group_workers;
+    batch.r_gvals = calloc(g_cnt, sizeof(JSON_Value *));
+    batch.rvs = calloc(g_cnt, sizeof(ACVP_RESULT));
+    if (!batch.r_gvals || !batch.rvs) {
+        free(batch.r_gvals);
+        free(batch.rvs);
+        return ACVP_MALLOC_FAIL;
+    }
+
+    acvp_mutex_lock(&ctx->tg_lock);
+    rv = acvp_tg_pool_grow(ctx, (ctx->group_workers - 1) * ctx->worker_count);
+    if (rv != ACVP_SUCCESS) {
+        acvp_mutex_unlock(&ctx->tg_lock);
+        free(batch.r_gvals);
+        free(batch.rvs);
+        return rv;
+    }
+    for (tail = &ctx->tg_pool->batches; *tail; tail = &(*tail)->next_batch);
+    *tail = &batch;
+    pthread_cond_broadcast(&ctx->tg_pool->work_cond);
+
+    /*
+     * Work on the groups along with the pool, and wait for the groups
+     * the pool threads are still processing.
+     */
+    while (acvp_tg_batch_open(&batch) || batch.active) {
+        if (acvp_tg_batch_open(&batch)) {
+            acvp_tg_batch_run(ctx, &batch);
+        } else {
+            pthread_cond_wait(&ctx->tg_pool->done_cond, &ctx->tg_lock);
+        }
+    }
+    for (tail = &ctx->tg_pool->batches; *tail != &batch; tail = &(*tail)->next_batch);
+    *tail = batch.next_batch;
+    acvp_mutex_unlock(&ctx->tg_lock);
+
+    /*
+     * Gather the responses in the order of the groups, the same order
+     * the serial loop would have appended them in.
+     */
+    for (i = 0; i < g_cnt; i++) {
+        if (rv == ACVP_SUCCESS && batch.rvs[i] != ACVP_SUCCESS) {
+            rv = batch.rvs[i];
+        }
+        if (rv == ACVP_SUCCESS) {
+            json_array_append_value(r_garr, batch.r_gvals[i]);
+        } else if (batch.r_gvals[i]) {
+            json_value_free(batch.r_gvals[i]);
+        }
+    }
+
+    free(batch.r_gvals);
+    free(batch.rvs);
+    return rv;
+}
+#endif
+
+/*
+ * Run each test group of a vector set through the handler and append
+ * the response groups to r_garr, in the order of the groups.  When
+ * ctx->group_workers is greater than one, the groups are processed
+ * concurrently.  The response is the same either way.
+ */
+ACVP_RESULT acvp_process_test_groups(ACVP_CTX *ctx,
+                                     ACVP_CAPS_LIST *cap,
+                                     JSON_Array *groups,
+                                     JSON_Array *r_garr,
+                                     ACVP_TG_HANDLER handler) {
+    JSON_Value *r_gval;
+    ACVP_RESULT rv;
+    int i, g_cnt;
+
+    g_cnt = json_array_get_count(groups);
+#ifndef WIN32
+    if (ctx->group_workers > 1 && g_cnt > 1) {
+        return acvp_process_test_groups_pool(ctx, cap, groups, r_garr, handler, g_cnt);
+    }
+#endif
+    for (i = 0; i < g_cnt; i++) {
+        r_gval = NULL;
+        rv = handler(ctx, cap, json_value_get_object(json_array_get_value(groups, i)), i, &r_gval);
+        if (rv != ACVP_SUCCESS) {
+            if (r_gval) json_value_free(r_gval);
+            return rv;
+        }
+        json_array_append_value(r_garr, r_gval);
+    }
+
+    return ACVP_SUCCESS;
+}
+
+
+/*
+ * Free the buffers held by a vector set work object.  The object
+ * itself belongs to the caller and is left zeroed so it can be
+ * reused for the next request.
+ */
+void acvp_vs_work_release(ACVP_VS_WORK *work) {
+    if (!work) return;
+
+    if (work->kat_buf) free(work->kat_buf);
+    if (work->kat_stream) acvp_json_stream_free(work->kat_stream);
+    if (work->kat_val) json_value_free(work->kat_val);
+    if (work->kat_resp) json_value_free(work->kat_resp);
+    if (work->resp_buf) {
+        if (work->resp_serialized) {
+            json_free_serialized_string(work->resp_buf);
+        } else {
+            free(work->resp_buf);
+        }
+    }
+    if (work->resp_writer) acvp_json_writer_free(work->resp_writer);
+    if (work->upld_buf) free(work->upld_buf);
+    if (work->test_sess_buf) free(work->test_sess_buf);
+    if (work->sample_buf) free(work->sample_buf);
+    memzero_s(work, sizeof(ACVP_VS_WORK));
+}
+
+/*
+ * Initialize a lock used to protect data on the ACVP_CTX.  The lock is
+ * recursive since a thread holding it while refreshing the JWT will
+ * take it again when sending the login request.
+ *
+ * Returns zero on success.
+ */
+int acvp_mutex_init(ACVP_MUTEX *mutex) {
+#ifndef WIN32
+    pthread_mutexattr_t attr;
+    int rv;
+
+    if (pthread_mutexattr_init(&attr)) {
+        return 1;
+    }
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    rv = pthread_mutex_init(mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+    return rv;
+#else
+    *mutex = 0;
+    return 0;
+#endif
+}